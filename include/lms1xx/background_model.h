@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BACKGROUND_MODEL_H
+#define BACKGROUND_MODEL_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "lms1xx/colaa_structs.h"
+
+struct BackgroundModelConfig
+{
+  /**
+   * @brief Number of scans averaged into the initial background, no changes are reported meanwhile
+   */
+  uint32_t learn_scans = 50;
+  /**
+   * @brief Weight of a new measurement in the running mean and variance of unchanged beams
+   */
+  float learning_rate = 0.01;
+  /**
+   * @brief Weight for changed beams, lets permanent changes fade into the background
+   */
+  float foreground_rate = 0.0005;
+  /**
+   * @brief A beam changed if it differs from the mean by more than sigma standard deviations plus min_delta
+   */
+  float sigma = 4.0;
+  /**
+   * @brief Minimum difference in m, covers quantisation and perfectly stable beams
+   */
+  float min_delta = 0.05;
+  /**
+   * @brief Changed beams separated by at most this many unchanged beams form one region
+   */
+  uint16_t merge_gap = 1;
+  /**
+   * @brief Regions with fewer beams are treated as noise
+   */
+  uint16_t min_region_beams = 2;
+};
+
+struct ChangedRegion
+{
+  uint8_t echo;
+  uint16_t first_beam;
+  uint16_t last_beam;
+};
+
+/**
+ * @brief Per beam background model for static mounted scanners
+ *
+ * Keeps a running mean and variance of the range of every beam and echo, beams without
+ * echo count as maximum range. The statistics are stored as separate float arrays and
+ * updated eight beams at a time with SSE2 where available. Changed beams are grouped
+ * into regions so that consumers only need to look at what differs from the background.
+ */
+class BackgroundModel
+{
+public:
+  explicit BackgroundModel(const BackgroundModelConfig &config = BackgroundModelConfig());
+
+  /**
+   * @brief Update the model with a scan and detect changes
+   * The model restarts learning when the number of echoes or beams changes.
+   * @return changed regions of all echoes, valid until the next call. Empty while learning.
+   */
+  const std::vector<ChangedRegion> &update(const ScanData &data);
+
+  bool learning() const;
+
+  /**
+   * @brief Running mean of each beam in raw range units
+   */
+  const std::vector<float> &mean(size_t echo) const;
+
+  void reset();
+
+  /**
+   * @brief Update mean and variance of count beams and flag the changed ones
+   * @param rate weight of a measurement for unchanged beams
+   * @param changed_rate weight of a measurement for changed beams
+   * @param min_delta minimum difference in raw range units
+   * @param changed set to 1 for changed beams, 0 otherwise
+   */
+  static void updateBeams(const uint16_t *ranges, float *mean, float *variance, uint8_t *changed, size_t count,
+                          float rate, float changed_rate, float sigma, float min_delta);
+
+private:
+  struct Echo
+  {
+    std::vector<float> mean;
+    std::vector<float> variance;
+    std::vector<uint8_t> changed;
+  };
+
+  void findRegions(uint8_t echo);
+
+  BackgroundModelConfig config_;
+  std::vector<Echo> echoes_;
+  std::vector<ChangedRegion> regions_;
+  uint32_t scans_;
+};
+
+#endif // BACKGROUND_MODEL_H
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CAPTURE_FILE_H
+#define CAPTURE_FILE_H
+
+#include <stdint.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Capture files store raw data received from a sensor for replay
+ *
+ * Layout (little endian):
+ *   8 byte magic "LMSCAP01"
+ *   records of
+ *     int64_t  receive time in ns (0 if unknown)
+ *     uint32_t payload length
+ *     payload  raw bytes as read from the socket
+ *
+ * A record usually holds exactly one STX/ETX framed telegram, but may hold any chunk of the byte stream
+ * (e.g. when dumped by the flight recorder).
+ */
+namespace CaptureFile
+{
+constexpr char MAGIC[8] = {'L', 'M', 'S', 'C', 'A', 'P', '0', '1'};
+/**
+ * @brief Largest record read or written, socket reads and telegrams are far smaller
+ *
+ * A longer length is taken as a corrupt or cut off file instead of being allocated.
+ */
+static const uint32_t MAX_RECORD_SIZE = 1 << 20;
+
+struct Record
+{
+  int64_t stamp_ns;
+  std::vector<char> data;
+};
+
+/**
+ * @brief Sequential reader for capture files
+ *
+ * Files without the magic header are read as a raw byte stream and every STX/ETX framed telegram
+ * becomes one record, so plain telegram dumps such as test/mrs1000.txt can be replayed as well.
+ */
+class Reader
+{
+public:
+  Reader();
+
+  /**
+   * @return false if the file can't be opened
+   */
+  bool open(const std::string &path);
+
+  /**
+   * @brief Read the next record
+   * @return false at the end of the file, on a truncated record or a length above MAX_RECORD_SIZE
+   */
+  bool next(Record &record);
+
+private:
+  std::ifstream stream_;
+  bool raw_;
+};
+
+/**
+ * @brief Appends records to a capture file
+ */
+class Writer
+{
+public:
+  /**
+   * @return false if the file can't be created
+   */
+  bool open(const std::string &path);
+
+  /**
+   * @return false on write errors or if length exceeds MAX_RECORD_SIZE
+   */
+  bool write(int64_t stamp_ns, const char *data, uint32_t length);
+
+  void close();
+
+private:
+  std::ofstream stream_;
+};
+
+/**
+ * @brief Read all STX/ETX framed telegrams of a capture file, each returned null terminated
+ * in place of the ETX as expected by CoLaA::parseTelegram()
+ * @return the telegrams, empty if the file can't be read
+ */
+std::vector<std::vector<char> > loadTelegrams(const std::string &path);
+}
+
+#endif // CAPTURE_FILE_H
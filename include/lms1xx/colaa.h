@@ -22,8 +22,10 @@
 #include <stdint.h>
 #include <vector>
 
+#include "lms1xx/colaa_statistics.h"
 #include "lms1xx/colaa_structs.h"
 
+class FlightRecorder;
 class LMSBuffer;
 class MRS1000ScanDataTest;
 
@@ -61,11 +63,72 @@ public:
   */
   bool isConnected() const;
 
+  /*!
+  * @brief Serial number of the scanner from the last parsed scan telegram, 0 before the first.
+  * Tracepoints are keyed on it, like the conversion and publish probes which take it from ScanData.
+  */
+  uint32_t getSerialNumber() const;
+
+  /*!
+  * @brief Record all received data and report timeouts, parse failures, telegram gaps and
+  * buffer resets to the recorder, which dumps the data leading up to the fault.
+  * @param recorder not owned, NULL to stop recording.
+  */
+  void setFlightRecorder(FlightRecorder *recorder);
+
+  /*!
+  * @brief Size the kernel receive buffer, so telegrams arriving while the reader is busy don't close the TCP window.
+  * Applied to the current connection and before every later connect. A fixed size turns off the kernel's receive
+  * autotuning, which follows the reader's throughput and does not grow while the reader stalls. The kernel caps
+  * the size at net.core.rmem_max (208 KiB by default), a warning is logged if the request was cut.
+  * @param bytes e.g. from estimateReceiveBuffer()
+  * @return size granted by the kernel (on Linux twice the usable size), 0 if not connected.
+  */
+  int setReceiveBufferSize(int bytes);
+
+  /*!
+  * @brief Receive buffer size holding the telegrams of the given time.
+  * @param beams per telegram
+  * @param echoes 16 bit channels per telegram
+  * @param telegram_rate telegrams per second, e.g. the scan frequency
+  */
+  static int estimateReceiveBuffer(size_t beams, size_t echoes, double telegram_rate, double seconds = 0.5);
+
+  /*!
+  * @brief Warn when more than scans_behind telegrams are waiting in the socket buffer for longer than duration
+  * seconds, which means processing does not keep up with the sensor. Defaults to 2 scans for 1 s.
+  */
+  void setBacklogWarning(double scans_behind, double duration);
+
+  /*!
+  * @brief Limits of valid beams, the parser marks every beam of every echo in ScanData::valid.
+  * By default only beams without echo (zero range) are invalid.
+  */
+  void setBeamLimits(const BeamLimits &limits);
+
+  /*!
+  * @brief Counters of this connection, safe to read from any thread.
+  */
+  const CoLaAStatistics &getStatistics() const;
+
   /*!
   * @brief Log into device
   * Increase privilege level, giving ability to change device configuration.
+  * @param attempts login commands to send, one per second, until the device replies; 0 retries forever
+  * @return false if the device did not reply
+  */
+  bool login(int attempts = 0);
+
+  /*!
+  * @brief Bound connecting and waiting for each command reply, 0 (the default) waits forever.
+  * Takes effect with the next connect. Scan data reads have their own timeout.
+  */
+  void setReplyTimeout(double seconds);
+
+  /*!
+  * @brief Whether a command reply timed out since the last connect, see setReplyTimeout()
   */
-  void login();
+  bool replyTimedOut() const;
 
   /*!
   * @brief The device is returned to the measurement mode after configuration.
@@ -125,6 +188,13 @@ public:
   */
   ScanConfig getScanConfig();
 
+  /*!
+  * @brief Read the scan data configuration back, as written by setScanDataConfig().
+  * @param cfg receives the configuration
+  * @returns false if the device did not reply with a complete configuration.
+  */
+  bool getScanDataConfig(ScanDataConfig &cfg);
+
   /*!
   * @brief Save data permanently.
   * Parameters are saved in the EEPROM of the LMS and will also be available after the device is switched off and on again.
@@ -170,6 +240,43 @@ public:
   */
   bool getScanData(void *scan_data);
 
+  /*!
+  * @brief Typed variant of getScanData() for sensors using the base ScanData format.
+  */
+  bool getScanData(ScanData &scan_data);
+
+  /**
+   * @brief Non-blocking variant of getScanData()
+   * Frames telegrams that are already buffered first and then reads whatever
+   * the socket has available without waiting. Call again until WouldBlock is
+   * returned to drain all buffered telegrams, e.g. after poll() reported the
+   * socket returned by getSocket() as readable.
+   * @param scan_data see getScanData()
+   * @return Scan if scan_data was filled
+   */
+  CoLaAReadResult::Result tryGetScanData(void *scan_data);
+
+  /**
+   * @brief Receive the next scan telegram without parsing it, e.g. to parse it on another host
+   * Blocks like getScanData(), command replies are skipped.
+   * @param telegram set to the telegram starting with the STX, without the ETX. Keeps its capacity.
+   * @return false on timeout
+   */
+  bool getTelegram(std::vector<uint8_t> &telegram);
+
+  /**
+   * @brief Socket of the connection for use with poll()/select(), -1 if not connected
+   */
+  int getSocket() const;
+
+  /**
+   * @brief Parse a telegram that was received by other means, e.g. read from a capture file
+   * @param telegram STX framed telegram, null terminated in place of the ETX. Modified while parsing.
+   * @param scan_data see getScanData()
+   * @return true if the telegram contained scan data
+   */
+  bool parseTelegram(char *telegram, void *scan_data) const;
+
   /**
    * @brief Query device state
    * @return the device state
@@ -188,6 +295,7 @@ protected:
 
   std::string READ_SCAN_CFG_COMMAND;
   std::string SET_SCAN_CFG_COMMAND;
+  std::string READ_SCAN_DATA_CFG_COMMAND;
   std::string SET_SCAN_DATA_CFG_COMMAND;
   std::string SET_ECHO_FILTER_COMMAND;
   std::string SET_MEAN_FILTER_COMMAND;
@@ -208,6 +316,10 @@ protected:
   std::string READ_DEVICE_STATE;
 
   std::string SCAN_DATA_REPLY;
+  /**
+   * @brief Start of streamed scan telegrams, after the STX
+   */
+  std::string SCAN_DATA_TELEGRAM;
 
   /**
    * @brief Sends login command
@@ -261,6 +373,7 @@ protected:
    * @brief Called by get_scan_data when the internal buffer is filled
    * @param buffer the message to be parsed
    * @param data Destination for the parsed data, pass a ScanData pointer for the base implementation
+   * @return false for anything but a complete scan data telegram, e.g. a truncated one or a command reply
    */
   virtual bool parseScanData(char *buffer, void *data) const;
 
@@ -275,8 +388,9 @@ protected:
    * @brief Parses the encoder part of the scan data message
    * The data is currently discarded.
    * @param buf the message data
+   * @return false if the message ends within the encoder part
    */
-  virtual void parseScanDataEncoderdata(char **buf) const;
+  virtual bool parseScanDataEncoderdata(char **buf) const;
 
   /**
    * @brief Surrounds command with start and end markers and sends them to the scanner
@@ -307,9 +421,63 @@ protected:
   bool readBack();
 
 private:
+  /**
+   * @brief Parse and pop the next complete telegram in the buffer
+   * @param found set to true if a telegram was framed
+   * @return true if the telegram was scan data
+   */
+  bool parseNextBuffered(void *scan_data, bool &found);
+
+  /**
+   * @brief Copy and pop the next complete telegram in the buffer, see parseNextBuffered()
+   */
+  bool popNextBuffered(std::vector<uint8_t> &telegram, bool &found);
+
+  /**
+   * @brief Frame the next telegram in the buffer, accounting for dropped data
+   * @return the STX framed telegram, NULL if there is no complete one
+   */
+  char *nextBuffered();
+
+  /**
+   * @brief Wait up to 100 ms for data and append it to the buffer
+   * @return false on timeout
+   */
+  bool waitForData();
+
+  /**
+   * @brief Account for bytes just appended to the buffer
+   */
+  void received(int bytes, bool idle);
+
+  /**
+   * @brief Sample the unread bytes in the socket and track sustained backlog
+   */
+  void sampleSocketQueue();
+
   bool connected_;
   LMSBuffer *buffer_;
+  FlightRecorder *recorder_;
   int socket_fd_;
+  mutable uint32_t serial_number_;
+  bool ever_connected_;
+  mutable int32_t last_telegram_counter_;
+  /**
+   * @brief Size of the last scan telegram including STX and ETX
+   */
+  size_t telegram_size_;
+  int receive_buffer_size_;
+  double reply_timeout_;
+  bool reply_timed_out_;
+  double backlog_scans_;
+  double backlog_duration_;
+  /**
+   * @brief Start of the current backlog, 0 if there is none
+   */
+  int64_t backlog_since_ns_;
+  bool backlog_reported_;
+  BeamLimits beam_limits_;
+  mutable CoLaAStatistics statistics_;
 };
 
 using LMS1xx = CoLaA; // CoLaA implements the protocol based on the LMS1xx sensor
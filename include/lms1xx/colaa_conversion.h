@@ -2,24 +2,59 @@
 #define COLAA_CONVERSION_H
 
 #include <lms1xx/colaa_structs.h>
+#include <lms1xx/background_model.h>
+#include <lms1xx/decoded_scan.h>
+#include <lms1xx/field_evaluator.h>
+#include <lms1xx/scan_matcher.h>
+#include <lms1xx/scan_tracker.h>
+#include <lms1xx/FieldStatus.h>
+#include <lms1xx/ScanChanges.h>
+#include <lms1xx/TrackArray.h>
+#include <lms1xx/tracing.h>
+#include <nav_msgs/Odometry.h>
 #include <sensor_msgs/MultiEchoLaserScan.h>
 #include <sensor_msgs/LaserScan.h>
 #include <sensor_msgs/point_cloud2_iterator.h>
 
 namespace CoLaAConversion
 {
-void fillMultiEchoLaserScan(sensor_msgs::MultiEchoLaserScan &scan, const ScanData &data);
-void fillLaserScan(sensor_msgs::LaserScan &scan, const ScanData &data, size_t channel = 0);
+/**
+ * @brief Scan conversions take the decoded scan, so outputs sharing an echo decode it only once
+ */
+void fillMultiEchoLaserScan(sensor_msgs::MultiEchoLaserScan &scan, DecodedScan &decoded);
+void fillLaserScan(sensor_msgs::LaserScan &scan, DecodedScan &decoded, size_t channel = 0);
+/**
+ * @brief Fill pose and twist (in the child frame) from two consecutive scan matcher poses dt seconds apart
+ */
+void fillOdometry(nav_msgs::Odometry &odom, const Pose2D &pose, const Pose2D &previous, double dt);
+/**
+ * @brief Copy the confirmed tracks, tracks.tracks keeps its capacity between calls
+ */
+void fillTrackArray(lms1xx::TrackArray &tracks, const ScanTracker &tracker);
+void fillFieldStatus(lms1xx::FieldStatus &status, const FieldEvaluator &evaluator,
+                     const std::vector<FieldResult> &results);
+void fillScanChanges(lms1xx::ScanChanges &changes, const ScanData &data, const std::vector<ChangedRegion> &regions);
 void fillPointCloud2(sensor_msgs::PointCloud2Iterator<float> &iter_x,
                      sensor_msgs::PointCloud2Iterator<float> &iter_y,
                      sensor_msgs::PointCloud2Iterator<float> &iter_z,
                      sensor_msgs::PointCloud2Iterator<float> &iter_int,
-                     const ScanData &data, size_t echo = 0);
+                     DecodedScan &decoded, size_t echo = 0);
 void fillPointCloud2MultiEcho(sensor_msgs::PointCloud2Iterator<float> &iter_x,
                      sensor_msgs::PointCloud2Iterator<float> &iter_y,
                      sensor_msgs::PointCloud2Iterator<float> &iter_z,
                      sensor_msgs::PointCloud2Iterator<float> &iter_int,
-                     const ScanData &data);
+                     DecodedScan &decoded);
+
+/**
+ * @brief Only the real returns of all echoes, see DecodedScan::sparseEchoes()
+ * The iterators must have room for decoded.sparseEchoes().returns points.
+ * @return number of points written
+ */
+size_t fillPointCloud2Returns(sensor_msgs::PointCloud2Iterator<float> &iter_x,
+                              sensor_msgs::PointCloud2Iterator<float> &iter_y,
+                              sensor_msgs::PointCloud2Iterator<float> &iter_z,
+                              sensor_msgs::PointCloud2Iterator<float> &iter_int,
+                              DecodedScan &decoded);
 
 template <size_t echo_count>
 size_t findStrongestEcho(const ScanData &data, size_t index)
@@ -45,25 +80,27 @@ void fillPointCloud2Strongest(sensor_msgs::PointCloud2Iterator<float> &iter_x,
                      sensor_msgs::PointCloud2Iterator<float> &iter_y,
                      sensor_msgs::PointCloud2Iterator<float> &iter_z,
                      sensor_msgs::PointCloud2Iterator<float> &iter_int,
-                     const ScanData &data)
+                     DecodedScan &decoded)
 {
-  float layer_angle = CoLaALayers::getLayerAngle(
-        static_cast<CoLaALayers::Layers>(data.header.status_info.layer_angle));
-  float cosLA = cos(layer_angle);
-  float sinLA = sin(layer_angle);
-  double start_angle = data.ch16bit[0].header.start_angle * M_PI / 180.0 / 10000.0 - M_PI / 2.0;
-  double angle_increment = data.ch16bit[0].header.step_size * M_PI / 180.0 / 10000.0;
+  const ScanData &data = decoded.data();
+  const BeamDirections &directions = decoded.directions(0);
+  const std::vector<float> *ranges[echo_count];
+  for (size_t e = 0; e < echo_count; ++e)
+    ranges[e] = &decoded.ranges(e);
+  LMS1XX_TRACE3(conversion_begin, data.header.device.serial_number, data.header.status_info.telegram_counter,
+                data.ch16bit[0].data.size());
 
   for (size_t i = 0; i < data.ch16bit[0].data.size(); ++i, ++iter_x, ++iter_y, ++iter_z, ++iter_int)
   {
     size_t echo = findStrongestEcho<echo_count>(data, i);
-    double dist = data.ch16bit[echo].data[i] * 0.001 * data.ch16bit[echo].header.scale_factor;
-    double angle = start_angle + i * angle_increment;
-    *iter_x = dist * cos(angle) * cosLA;
-    *iter_y = dist * sin(angle) * cosLA;
-    *iter_z = dist * sinLA;
+    float dist = (*ranges[echo])[i];
+    *iter_x = dist * directions.x[i];
+    *iter_y = dist * directions.y[i];
+    *iter_z = dist * directions.z;
     *iter_int = data.ch8bit[echo].data[i];
   }
+  LMS1XX_TRACE3(conversion_end, data.header.device.serial_number, data.header.status_info.telegram_counter,
+                data.ch16bit[0].data.size());
 }
 
 }
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COLAA_LOG_H
+#define COLAA_LOG_H
+
+#include <stddef.h>
+#include <atomic>
+
+/**
+ * @brief Logging of the ROS independent libraries
+ *
+ * Messages are passed to a handler the application can replace, e.g. to forward them to its own
+ * logging. Without a handler they go to console_bridge if the libraries are built with it (the
+ * catkin build defines LMS1XX_CONSOLE_BRIDGE), and to stderr otherwise. Messages below the level
+ * are dropped before they are formatted, so disabled debug messages in the receive path cost one
+ * comparison.
+ */
+namespace CoLaALog
+{
+enum Level
+{
+  Debug = 0,
+  Info = 1,
+  Warn = 2,
+  Error = 3,
+  None = 4
+};
+
+/**
+ * @param message formatted message without trailing newline
+ */
+typedef void (*Handler)(Level level, const char *file, int line, const char *message, void *context);
+
+/**
+ * @brief Replace the handler, NULL restores the default. Set it before starting any threads that log.
+ */
+void setHandler(Handler handler, void *context = NULL);
+
+/**
+ * @brief Lowest level passed to the handler, Warn by default and Debug with console_bridge, which
+ *        then applies its own level
+ */
+void setLevel(Level level);
+Level getLevel();
+
+/**
+ * @brief Current level, use setLevel()
+ */
+extern std::atomic<int> current_level;
+
+inline bool enabled(Level level)
+{
+  return level >= current_level.load(std::memory_order_relaxed);
+}
+
+void log(Level level, const char *file, int line, const char *format, ...) __attribute__((format(printf, 4, 5)));
+}
+
+#ifndef LMS1XX_LOG_NO_MACROS
+#define LMS1XX_LOG(level, ...)                                                                              \
+  do                                                                                                        \
+  {                                                                                                         \
+    if (CoLaALog::enabled(level))                                                                           \
+      CoLaALog::log(level, __FILE__, __LINE__, __VA_ARGS__);                                                \
+  } while (0)
+
+#define logDebug(...) LMS1XX_LOG(CoLaALog::Debug, __VA_ARGS__)
+#define logInform(...) LMS1XX_LOG(CoLaALog::Info, __VA_ARGS__)
+#define logWarn(...) LMS1XX_LOG(CoLaALog::Warn, __VA_ARGS__)
+#define logError(...) LMS1XX_LOG(CoLaALog::Error, __VA_ARGS__)
+#endif
+
+#endif // COLAA_LOG_H
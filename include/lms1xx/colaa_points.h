@@ -0,0 +1,35 @@
+#ifndef COLAA_POINTS_H
+#define COLAA_POINTS_H
+
+#include <lms1xx/colaa_structs.h>
+#include <lms1xx/decoded_scan.h>
+
+/**
+ * @brief ROS independent conversion of scan data to cartesian points
+ *
+ * Uses the same geometry as CoLaAConversion::fillPointCloud2.
+ */
+namespace CoLaAPoints
+{
+/**
+ * @brief Write x, y, z and intensity of every beam of one echo
+ * @param data parsed scan
+ * @param echo index into ch16bit / ch8bit
+ * @param out destination, must hold stride * beam count floats
+ * @param stride distance in floats between consecutive points, at least 4
+ * @return number of points written
+ */
+size_t fillPoints(const ScanData &data, size_t echo, float *out, size_t stride = 4);
+/**
+ * @brief Same as above, reusing the ranges and beam directions of an already decoded scan
+ */
+size_t fillPoints(DecodedScan &decoded, size_t echo, float *out, size_t stride = 4);
+/**
+ * @brief Write a point for every real return of all echoes, in beam order
+ * @param out destination, must hold stride * decoded.sparseEchoes().returns floats
+ * @return number of points written
+ */
+size_t fillReturns(DecodedScan &decoded, float *out, size_t stride = 4);
+}
+
+#endif // COLAA_POINTS_H
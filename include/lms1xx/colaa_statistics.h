@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COLAA_STATISTICS_H
+#define COLAA_STATISTICS_H
+
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * @brief Histogram with fixed bucket bounds that can be updated lock-free
+ *
+ * Buckets hold non-cumulative counts, the last bucket is +Inf.
+ */
+struct AtomicHistogram
+{
+  static constexpr size_t BUCKETS = 10;
+
+  /**
+   * @brief Upper bounds of the buckets in microseconds, excluding +Inf
+   */
+  static const uint32_t BOUNDS_US[BUCKETS - 1];
+
+  std::atomic<uint64_t> counts[BUCKETS];
+  std::atomic<uint64_t> sum_ns;
+
+  AtomicHistogram() : sum_ns(0)
+  {
+    for (size_t i = 0; i < BUCKETS; ++i)
+      counts[i] = 0;
+  }
+
+  void observe(uint64_t ns)
+  {
+    size_t bucket = 0;
+    while (bucket < BUCKETS - 1 && ns > BOUNDS_US[bucket] * 1000ull)
+      ++bucket;
+    counts[bucket].fetch_add(1, std::memory_order_relaxed);
+    sum_ns.fetch_add(ns, std::memory_order_relaxed);
+  }
+};
+
+/**
+ * @brief Counters of one sensor connection
+ *
+ * Written by the thread calling CoLaA::getScanData() with relaxed atomics,
+ * so they can be read from any other thread (e.g. MetricsExporter) without locking.
+ */
+struct CoLaAStatistics
+{
+  /**
+   * @brief Successfully parsed scan telegrams
+   */
+  std::atomic<uint64_t> telegrams;
+  /**
+   * @brief Bytes read from the socket
+   */
+  std::atomic<uint64_t> bytes_received;
+  /**
+   * @brief Number of times the receive buffer dropped data to resynchronise
+   */
+  std::atomic<uint64_t> buffer_resets;
+  /**
+   * @brief Successful connects after the first one
+   */
+  std::atomic<uint64_t> reconnects;
+  /**
+   * @brief Telegrams missing according to the telegram counter
+   */
+  std::atomic<uint64_t> telegram_gaps;
+  /**
+   * @brief Framed messages that were not scan data, e.g. command replies
+   */
+  std::atomic<uint64_t> non_scan_telegrams;
+  /**
+   * @brief Scan telegrams that were truncated or malformed
+   */
+  std::atomic<uint64_t> parse_failures;
+  /**
+   * @brief getScanData() calls that timed out
+   */
+  std::atomic<uint64_t> timeouts;
+  /**
+   * @brief Times the socket backlog stayed above the threshold of CoLaA::setBacklogWarning()
+   */
+  std::atomic<uint64_t> backlogs;
+  /**
+   * @brief Duration of parseScanData()
+   */
+  AtomicHistogram parse_time;
+  /**
+   * @brief Bytes left unread in the kernel socket buffer after the last read (gauge)
+   */
+  std::atomic<uint64_t> socket_queue_bytes;
+  /**
+   * @brief socket_queue_bytes in telegrams of the current size, i.e. how far the reader lags behind (gauge)
+   */
+  std::atomic<double> scans_behind;
+
+  CoLaAStatistics()
+    : telegrams(0), bytes_received(0), buffer_resets(0), reconnects(0), telegram_gaps(0),
+      non_scan_telegrams(0), parse_failures(0), timeouts(0), backlogs(0), socket_queue_bytes(0), scans_behind(0)
+  {
+  }
+};
+
+#endif // COLAA_STATISTICS_H
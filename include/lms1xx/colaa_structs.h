@@ -21,6 +21,7 @@
 #include "lms1xx/parse_helpers.h"
 #include <vector>
 #include <cmath>
+#include <limits>
 
 namespace CoLaAStatus
 {
@@ -121,6 +122,19 @@ static SopasError parseError(const char *buf, bool twodigits)
 }
 }
 
+namespace CoLaAReadResult
+{
+/**
+ * @brief Result of the non-blocking CoLaA::tryGetScanData()
+ */
+enum Result : uint8_t
+{
+  Scan = 0, // A scan was parsed
+  WouldBlock = 1, // No complete telegram available yet
+  Disconnected = 2 // The connection was closed or failed
+};
+}
+
 /**
  * @brief Echo return configuration
  */
@@ -430,46 +444,129 @@ public:
   /**
    * @brief Parse channel header from stream
    * @param buf the data stream
-   * @return the parsed header
+   * @param header the parsed header
+   * @return false if the stream ends early or holds a malformed field
    */
-  static ChannelDataHeader parseScanDataChannelHeader(char **buf)
+  static bool parseScanDataChannelHeader(char **buf, ChannelDataHeader &header)
   {
-    ChannelDataHeader header;
-    nextToken(buf, header.contents);
-    nextToken(buf, header.scale_factor);
-    nextToken(buf, header.scale_factor_offset);
-    nextToken(buf, header.start_angle);
-    nextToken(buf, header.step_size);
-    nextToken(buf, header.data_count);
-    return header;
+    return nextToken(buf, header.contents) &&
+           nextToken(buf, header.scale_factor) &&
+           nextToken(buf, header.scale_factor_offset) &&
+           nextToken(buf, header.start_angle) &&
+           nextToken(buf, header.step_size) &&
+           nextToken(buf, header.data_count);
   }
 
   /**
    * @brief Parse all channels of given type T
+   *
+   * The channel and value counts announced by the telegram are checked against the remaining
+   * length of the stream before anything is allocated, so a corrupt count cannot make the parser
+   * reserve memory for data that is not there.
    * @param buf data stream
-   * @return A vector containing all extracted data channels in this section
+   * @param end terminating NUL of the data stream
+   * @param channels receives all extracted data channels in this section, reusing its storage
+   * @return false if the section is truncated or malformed
    */
-  static std::vector<ChannelData<T> > parseScanDataChannels(char **buf)
+  static bool parseScanDataChannels(char **buf, const char *end, std::vector<ChannelData<T> > &channels)
   {
-    std::vector<ChannelData<T> > channels;
     uint16_t num_channels = 0;
-    nextToken(buf, num_channels);
-    for (uint16_t channel = 0; channel < num_channels; ++channel)
+    if (!nextToken(buf, num_channels))
+      return false;
+    // A channel header takes at least six tokens, each value at least one digit and a separator
+    if (num_channels > (end - *buf) / 12)
+      return false;
+    channels.resize(num_channels);
+    for (ChannelData<T> &chan : channels)
     {
-      ChannelData<T> chan;
-      chan.header = parseScanDataChannelHeader(buf);
+      if (!parseScanDataChannelHeader(buf, chan.header))
+        return false;
+      if (chan.header.data_count > (end - *buf + 1) / 2)
+        return false;
       chan.data.resize(chan.header.data_count);
-      T data_n;
-      for (uint16_t d = 0; d < chan.header.data_count; ++d)
+      for (T &value : chan.data)
       {
-        nextToken(buf, data_n);
-        chan.data[d] = data_n;
+        if (!nextToken(buf, value))
+          return false;
       }
-      channels.push_back(chan);
     }
-    //TODO does this produce unnecessary copies of the data vectors?
-    return channels;
+    return true;
+  }
+};
+
+/**
+ * @brief Limits for a beam to be valid, see CoLaA::setBeamLimits()
+ */
+struct BeamLimits
+{
+  /**
+   * @brief Range limits in metres, a zero range (no echo) is never valid
+   */
+  float min_range = 0;
+  float max_range = std::numeric_limits<float>::infinity();
+  /**
+   * @brief Minimum value of the echo's 8 bit channel, not applied to echoes without one
+   */
+  uint8_t min_rssi = 0;
+  /**
+   * @brief Minimum value of the echo's 16 bit remission channel, sent by the LMS1xx instead of an 8 bit one
+   */
+  uint16_t min_remission = 0;
+};
+
+/**
+ * @brief One bit per beam of an echo, set if the beam is valid
+ *
+ * Computed once by the parser so that conversions and filters skip invalid beams without testing
+ * every range again. An empty mask (scan data not from the parser) means all beams are valid.
+ */
+struct BeamMask
+{
+  std::vector<uint64_t> bits;
+
+  bool test(size_t beam) const
+  {
+    return bits.empty() || (bits[beam >> 6] >> (beam & 63)) & 1;
+  }
+
+  /**
+   * @brief Call f(beam) for every invalid beam, in order
+   */
+  template <typename F>
+  void forEachInvalid(size_t count, F f) const
+  {
+    for (size_t w = 0; w < bits.size(); ++w)
+    {
+      uint64_t invalid = ~bits[w];
+      if (w == bits.size() - 1 && (count & 63))
+        invalid &= (uint64_t(1) << (count & 63)) - 1;
+      for (; invalid; invalid &= invalid - 1)
+        f(w * 64 + __builtin_ctzll(invalid));
+    }
   }
+
+  /**
+   * @brief Number of valid beams
+   */
+  size_t count() const;
+
+  /**
+   * @brief Compute the mask of one echo
+   * @param rssi the echo's 8 bit channel, NULL if it has none
+   */
+  void compute(const ChannelData<uint16_t> &ranges, const ChannelData<uint8_t> *rssi, const BeamLimits &limits);
+
+  /**
+   * @brief Clear the bits of beams with a 16 bit remission below min_remission
+   */
+  void applyRemissionLimit(const ChannelData<uint16_t> &remission, uint16_t min_remission);
+
+  /**
+   * @brief Set the bits of beams with min_raw <= range <= max_raw and rssi >= min_rssi
+   * @param rssi may be NULL, bits must hold count bits and be zeroed
+   */
+  static void computeBits(const uint16_t *ranges, const uint8_t *rssi, size_t count, uint16_t min_raw,
+                          uint16_t max_raw, uint8_t min_rssi, uint64_t *bits);
 };
 
 /**
@@ -489,6 +586,32 @@ struct ScanData
    * @brief 8 bit measurement channels
    */
   std::vector<ChannelData<uint8_t>> ch8bit;
+  /**
+   * @brief Validity of the beams of each 16 bit channel, empty if not computed
+   */
+  std::vector<BeamMask> valid;
+
+  /**
+   * @brief Number of distance echoes, i.e. the 16 bit channels before any 16 bit remission channel
+   *
+   * The LMS1xx sends its remission as a second 16 bit channel (RSSI1) after DIST1, which is not an echo.
+   */
+  size_t echoCount() const
+  {
+    size_t echoes = 0;
+    while (echoes < ch16bit.size() && ch16bit[echoes].header.contents.compare(0, 4, "RSSI") != 0)
+      ++echoes;
+    return echoes;
+  }
+
+  /**
+   * @brief 16 bit remission channel of an echo, NULL if it has none
+   */
+  const ChannelData<uint16_t> *remission(size_t echo) const
+  {
+    size_t channel = echoCount() + echo;
+    return echo < echoCount() && channel < ch16bit.size() ? &ch16bit[channel] : NULL;
+  }
 };
 
 
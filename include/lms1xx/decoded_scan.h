@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DECODED_SCAN_H
+#define DECODED_SCAN_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "lms1xx/colaa_structs.h"
+
+/**
+ * @brief Direction of every beam of one scan geometry, x and y include the cosine of the layer angle
+ */
+struct BeamDirections
+{
+  int32_t start_angle;
+  uint16_t step_size;
+  uint16_t layer_angle;
+  std::vector<float> x;
+  std::vector<float> y;
+  float z;
+};
+
+/**
+ * @brief Real returns of all echoes of a scan, leaving out the empty echoes
+ *
+ * In multi-echo mode most beams have a single return, so instead of a full array per echo the
+ * first return of every beam is kept per beam and the further returns are packed in beam order.
+ */
+struct SparseEchoes
+{
+  /**
+   * @brief Returns of every beam, 0 if no echo hit anything
+   */
+  std::vector<uint8_t> counts;
+  /**
+   * @brief Range in metres and intensity of the first return of every beam, 0 if there is none
+   */
+  std::vector<float> first_ranges;
+  std::vector<uint8_t> first_intensities;
+  /**
+   * @brief Second and later returns, beam i owns counts[i] - 1 of them
+   */
+  std::vector<float> extra_ranges;
+  std::vector<uint8_t> extra_intensities;
+  /**
+   * @brief Total number of returns
+   */
+  size_t returns;
+};
+
+/**
+ * @brief Scan data decoded to metres, shared by all output conversions of one scan
+ *
+ * Ranges of an echo are decoded on first use only, so every beam is scaled once no matter how
+ * many outputs (LaserScan, MultiEchoLaserScan, point clouds) are enabled. Beam directions are
+ * kept across scans for each geometry (start angle, step size, layer), which removes the
+ * trigonometry from the point conversions. Reuse one instance for all scans of a scanner, it
+ * does not allocate once all echoes and layers have been seen.
+ */
+class DecodedScan
+{
+public:
+  DecodedScan();
+
+  /**
+   * @brief Start decoding a new scan, data must stay alive until the next reset
+   */
+  void reset(const ScanData &data);
+
+  const ScanData &data() const
+  {
+    return *data_;
+  }
+
+  /**
+   * @brief Number of distance echoes, a 16 bit remission channel is not one
+   */
+  size_t echoCount() const
+  {
+    return echoes_;
+  }
+
+  /**
+   * @brief Ranges of an echo in metres, 0 for beams invalid in ScanData::valid
+   */
+  const std::vector<float> &ranges(size_t echo);
+
+  /**
+   * @brief Beam directions of an echo, a point is (range * x, range * y, range * z)
+   */
+  const BeamDirections &directions(size_t echo);
+
+  /**
+   * @brief All echoes without the empty ones, built on first use
+   */
+  const SparseEchoes &sparseEchoes();
+
+  /**
+   * @brief Angle of the first beam in the ROS convention (0 straight ahead), radians
+   */
+  double angleMin(size_t echo) const;
+  double angleIncrement(size_t echo) const;
+
+private:
+  const ScanData *data_;
+  size_t echoes_;
+  std::vector<std::vector<float> > ranges_;
+  std::vector<uint8_t> decoded_;
+  SparseEchoes sparse_;
+  bool sparse_decoded_;
+  std::vector<BeamDirections> directions_;
+  /**
+   * @brief Next table to replace once the direction cache is full
+   */
+  size_t next_direction_;
+};
+
+#endif // DECODED_SCAN_H
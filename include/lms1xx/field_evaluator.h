@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FIELD_EVALUATOR_H
+#define FIELD_EVALUATOR_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "lms1xx/colaa_structs.h"
+
+/**
+ * @brief Polygonal field in the sensor frame
+ */
+struct FieldPolygon
+{
+  std::string name;
+  /**
+   * @brief Corners as x, y pairs in m
+   */
+  std::vector<float> points;
+};
+
+struct FieldResult
+{
+  bool violated;
+  /**
+   * @brief Number of beams ending inside the field
+   */
+  uint16_t beams;
+  /**
+   * @brief Index of the first beam inside the field, -1 if there is none
+   */
+  int32_t first_beam;
+};
+
+/**
+ * @brief Host side evaluation of protective and warning fields
+ *
+ * As the beam directions are fixed, every polygon is compiled into a table holding the
+ * raw range interval [lower, upper) each beam spends inside the polygon. Evaluating a
+ * field is then one unsigned 16 bit compare per beam on the raw channel data, done
+ * eight beams at a time with SSE2 where available. Tables for all field sets are
+ * compiled when the fields or the beam geometry change, so switching sets is free.
+ *
+ * If a beam enters a non convex polygon more than once, the table holds the interval
+ * from the first entry to the last exit, i.e. the field is evaluated conservatively.
+ */
+class FieldEvaluator
+{
+public:
+  /**
+   * @param min_beams A field is violated if at least this many beams end inside it
+   */
+  explicit FieldEvaluator(uint16_t min_beams = 1);
+
+  /**
+   * @brief Add a set of fields evaluated together, e.g. the fields for one speed range
+   * @return index of the set, the first set is active initially
+   */
+  size_t addFieldSet(const std::vector<FieldPolygon> &fields);
+
+  void clearFieldSets();
+
+  bool selectFieldSet(size_t index);
+
+  size_t activeFieldSet() const;
+
+  size_t fieldSetCount() const;
+
+  /**
+   * @brief Fields of the active set
+   */
+  const std::vector<FieldPolygon> &fields() const;
+
+  /**
+   * @brief Evaluate the active field set
+   * @return one result per field of the active set, valid until the next call
+   */
+  const std::vector<FieldResult> &evaluate(const ScanData &data, size_t echo = 0);
+
+  /**
+   * @brief Count the beams with lower <= range < upper
+   * @param first set to the index of the first such beam or -1
+   */
+  static uint16_t countInside(const uint16_t *ranges, const uint16_t *lower, const uint16_t *upper,
+                              size_t count, int32_t &first);
+
+private:
+  struct Table
+  {
+    std::vector<uint16_t> lower;
+    std::vector<uint16_t> upper;
+  };
+
+  void compile(const ChannelDataHeader &header, size_t count);
+
+  uint16_t min_beams_;
+  std::vector<std::vector<FieldPolygon> > field_sets_;
+  std::vector<std::vector<Table> > tables_;
+  std::vector<FieldResult> results_;
+  size_t active_;
+
+  // Geometry the tables were compiled for
+  bool compiled_;
+  int32_t start_angle_;
+  uint16_t step_size_;
+  float scale_factor_;
+  size_t count_;
+};
+
+#endif // FIELD_EVALUATOR_H
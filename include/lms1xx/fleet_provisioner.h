@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FLEET_PROVISIONER_H
+#define FLEET_PROVISIONER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "lms1xx/colaa_structs.h"
+
+namespace CoLaADeviceType
+{
+enum DeviceType : uint8_t
+{
+  LMS1xx = 0,
+  LMS5xx = 1,
+  MRS1000 = 2
+};
+}
+
+/**
+ * @brief Fields of ScanConfig given for a device
+ */
+namespace ScanConfigField
+{
+enum Field : uint8_t
+{
+  Frequency = 1,
+  Resolution = 2,
+  StartAngle = 4,
+  StopAngle = 8
+};
+}
+
+/**
+ * @brief Fields of ScanDataConfig given for a device
+ */
+namespace ScanDataField
+{
+enum Field : uint8_t
+{
+  OutputChannel = 1,
+  Remission = 2,
+  RemissionResolution = 4,
+  OutputInterval = 8
+};
+}
+
+/**
+ * @brief Desired configuration of one scanner, unset parts are left untouched
+ */
+struct DeviceConfig
+{
+  std::string name;
+  std::string host;
+  int port = 2111;
+  CoLaADeviceType::DeviceType type = CoLaADeviceType::LMS1xx;
+  /**
+   * @brief Seconds to wait for connecting and for each reply, the login is retried once per second as long
+   */
+  double reply_timeout = 5;
+
+  /**
+   * @brief ScanConfigField bits of the scan_config fields given, the others keep the device's values
+   */
+  uint8_t scan_config_fields = 0;
+  ScanConfig scan_config;
+  /**
+   * @brief ScanDataField bits of the scan_data_config fields given, the others keep the device's values
+   */
+  uint8_t scan_data_fields = 0;
+  ScanDataConfig scan_data_config;
+  /**
+   * @brief Filter settings, negative values leave the filter untouched
+   */
+  int echo_filter = -1;
+  int particle_filter = -1;
+  /**
+   * @brief Number of scans averaged by the mean filter, 0 disables it
+   */
+  int mean_filter = -1;
+};
+
+namespace ProvisionResult
+{
+enum Result : uint8_t
+{
+  Unchanged = 0,
+  Applied = 1,
+  ConnectFailed = 2,
+  VerifyFailed = 3,
+  DryRun = 4,
+  /**
+   * @brief Connected, but the device stopped replying
+   */
+  Timeout = 5
+};
+}
+
+struct ProvisionReport
+{
+  std::string name;
+  ProvisionResult::Result result;
+  /**
+   * @brief Human readable list of the settings that were (or in a dry run would be) written
+   */
+  std::vector<std::string> changes;
+  double seconds;
+};
+
+namespace FleetProvisioner
+{
+/**
+ * @brief Parse a fleet configuration file
+ *
+ * The file has one section per scanner, keys before the first section are defaults
+ * for all scanners. Angles are given in degrees and frequencies in Hz:
+ *
+ *   type = lms5xx
+ *   scan_frequency = 50
+ *
+ *   [front]
+ *   host = 192.168.0.10
+ *   angular_resolution = 0.25
+ *   start_angle = -45
+ *   stop_angle = 225
+ *   echo_filter = first
+ *
+ * @param error set to a description of the first problem found
+ * @return false if the file could not be read or is invalid
+ */
+bool loadConfig(const std::string &path, std::vector<DeviceConfig> &devices, std::string &error);
+
+/**
+ * @brief Bring one scanner to its desired configuration
+ *
+ * The scan and scan data configurations are read back and only written if they differ.
+ * Filter settings cannot be read back over CoLa A and are always written when given.
+ * The EEPROM is written once at the end if anything changed, after which the scan
+ * configuration is read back again to verify it. If the device stops replying for
+ * reply_timeout nothing more is sent, and the EEPROM is not written.
+ */
+ProvisionReport provisionDevice(const DeviceConfig &device, bool dry_run);
+
+/**
+ * @brief Provision all scanners, up to max_parallel at the same time
+ * @return one report per device, in the order of devices
+ */
+std::vector<ProvisionReport> provisionFleet(const std::vector<DeviceConfig> &devices, bool dry_run,
+                                            size_t max_parallel);
+}
+
+#endif // FLEET_PROVISIONER_H
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace FlightRecorderTrigger
+{
+enum Trigger : uint8_t
+{
+  Timeout = 0,
+  ParseFailure = 1,
+  TelegramGap = 2,
+  BufferReset = 3,
+  Manual = 4
+};
+}
+
+struct FlightRecorderConfig
+{
+  /**
+   * @brief Bytes of raw data kept, about 1 MB per second for an MRS1000 with all echoes
+   */
+  size_t capacity = 8 * 1024 * 1024;
+  /**
+   * @brief Number of socket reads kept
+   */
+  size_t max_chunks = 16384;
+  /**
+   * @brief Only data received within this many seconds before the fault is dumped
+   */
+  double window = 10.0;
+  /**
+   * @brief Faults within this many seconds after a dump do not cause another one
+   */
+  double min_dump_interval = 30.0;
+  /**
+   * @brief Directory and file name prefix of the dumps, the file name is completed with time and trigger
+   */
+  std::string directory = ".";
+  std::string prefix = "flight";
+};
+
+/**
+ * @brief Keeps the most recent raw bytes received from a sensor and writes them to a capture file on faults
+ *
+ * All memory is allocated on construction, recording copies into a byte ring that is
+ * overwritten in place. Each socket read is one chunk with its receive time and becomes one record
+ * (two if it wraps around the ring) of the dumped capture file, which can be replayed like any
+ * other capture.
+ *
+ * Not thread safe, record() and trigger() are called from the thread reading the socket.
+ */
+class FlightRecorder
+{
+public:
+  explicit FlightRecorder(const FlightRecorderConfig &config = FlightRecorderConfig());
+
+  /**
+   * @brief Append data just read from the socket
+   * @param stamp_ns receive time, ns since the epoch
+   */
+  void record(const char *data, size_t length, int64_t stamp_ns);
+
+  /**
+   * @brief Report a fault, dumps the recorded data unless a dump was written recently
+   * @return path of the dump, empty if none was written
+   */
+  std::string trigger(FlightRecorderTrigger::Trigger trigger);
+
+  /**
+   * @brief Write the data of the last window seconds to path
+   * @return false if the file could not be written
+   */
+  bool dump(const std::string &path) const;
+
+  /**
+   * @brief Bytes currently held
+   */
+  size_t size() const;
+
+  /**
+   * @brief Forget all recorded data, e.g. on reconnect
+   */
+  void clear();
+
+  static const char *triggerName(FlightRecorderTrigger::Trigger trigger);
+
+private:
+  struct Chunk
+  {
+    int64_t stamp_ns;
+    /**
+     * @brief Position of the first byte in the stream of all recorded bytes
+     */
+    uint64_t offset;
+    uint32_t length;
+  };
+
+  FlightRecorderConfig config_;
+  std::vector<char> bytes_;
+  std::vector<Chunk> chunks_;
+  /**
+   * @brief Total bytes and chunks recorded, the ring positions are these modulo the ring sizes
+   */
+  uint64_t written_;
+  uint64_t chunk_count_;
+  int64_t last_dump_ns_;
+};
+
+#endif // FLIGHT_RECORDER_H
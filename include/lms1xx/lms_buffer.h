@@ -23,9 +23,11 @@
 #ifndef LMS1XX_LMS_BUFFER_H_
 #define LMS1XX_LMS_BUFFER_H_
 
-#include <console_bridge/console.h>
+#include "lms1xx/colaa_log.h"
+#include <errno.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 #define LMS_BUFFER_SIZE 50000
@@ -35,11 +37,11 @@
 class LMSBuffer
 {
 public:
-  LMSBuffer() : total_length_(0), end_of_first_message_(0)
+  LMSBuffer() : total_length_(0), end_of_first_message_(0), drop_count_(0)
   {
   }
 
-  void readFrom(int fd)
+  int readFrom(int fd)
   {
     int ret = read(fd, buffer_ + total_length_, sizeof(buffer_) - total_length_);
 
@@ -53,6 +55,43 @@ public:
 
       logWarn("Buffer read() returned error.");
     }
+    return ret;
+  }
+
+  /**
+   * Non-blocking variant of readFrom() for sockets.
+   * Returns the number of bytes read, 0 if the peer closed the connection and -1 on errors.
+   * If no data is available -1 is returned with errno set to EAGAIN.
+   */
+  int receiveFrom(int fd)
+  {
+    int ret = recv(fd, buffer_ + total_length_, sizeof(buffer_) - total_length_, MSG_DONTWAIT);
+    if (ret > 0)
+    {
+      total_length_ += ret;
+      logDebug("Received %d bytes from fd, total length is %d.", ret, total_length_);
+    }
+    else if (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+    {
+      logWarn("Buffer recv() returned error.");
+    }
+    return ret;
+  }
+
+  /**
+   * Start of the buffered bytes, the most recently read ones are at the end.
+   */
+  const char *data() const
+  {
+    return buffer_;
+  }
+
+  /**
+   * Number of bytes currently held, including partial messages.
+   */
+  uint16_t size() const
+  {
+    return total_length_;
   }
 
   char* getNextBuffer()
@@ -73,6 +112,7 @@ public:
       // None found, buffer reset.
       logWarn("No STX found, dropping %d bytes from buffer.", total_length_);
       total_length_ = 0;
+      ++drop_count_;
     }
     else if (buffer_ != start_of_message)
     {
@@ -80,6 +120,7 @@ public:
       logWarn("Shifting buffer, dropping %d bytes, %d bytes remain.",
               (start_of_message - buffer_), total_length_ - (start_of_message - buffer_));
       shiftBuffer(start_of_message);
+      ++drop_count_;
     }
 
     // Now look for the end of message character.
@@ -96,6 +137,32 @@ public:
     return buffer_;
   }
 
+  /**
+   * Length of the message returned by the last getNextBuffer() call without the ETX,
+   * 0 if there is none.
+   */
+  size_t getLastBufferLength() const
+  {
+    return end_of_first_message_ ? end_of_first_message_ - buffer_ : 0;
+  }
+
+  /**
+   * Number of times data was dropped to find the start of a message.
+   */
+  uint32_t getDropCount() const
+  {
+    return drop_count_;
+  }
+
+  /**
+   * Discard all buffered data, e.g. after the connection was closed.
+   */
+  void reset()
+  {
+    total_length_ = 0;
+    end_of_first_message_ = NULL;
+  }
+
   void popLastBuffer()
   {
     if (end_of_first_message_)
@@ -122,6 +189,7 @@ private:
   uint16_t total_length_;
 
   char* end_of_first_message_;
+  uint32_t drop_count_;
 };
 
 #endif  // LMS1XX_LMS_BUFFER_H_
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MESSAGE_POOL_H
+#define MESSAGE_POOL_H
+
+#include <boost/shared_ptr.hpp>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Pool of preallocated messages for zero-copy publishing
+ *
+ * acquire() hands out a message as boost::shared_ptr whose deleter puts it back into the pool once the
+ * last subscriber released it, so publishing a new message per scan does not allocate. Every message is
+ * a copy of the prototype, which holds the sensor geometry (frame, array sizes). When the geometry
+ * changes (e.g. after a reconnect) setPrototype() is called again and pooled messages are reassigned
+ * from it the next time they are handed out.
+ *
+ * Messages still held by subscribers may outlive the pool, the shared state is kept until the last
+ * of them is returned.
+ */
+template <class M>
+class MessagePool
+{
+public:
+  /**
+   * @param capacity number of messages kept for reuse, should cover the publisher queue and the
+   *        number of messages a subscriber holds at the same time
+   */
+  explicit MessagePool(size_t capacity = 4) : state_(new State(capacity))
+  {
+  }
+
+  /**
+   * @brief Set the message every pooled message is shaped like, call after the geometry changed
+   */
+  void setPrototype(const M &prototype)
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->prototype = prototype;
+    ++state_->generation;
+  }
+
+  /**
+   * @brief Get a message shaped like the prototype, its contents are those of the previous use
+   */
+  boost::shared_ptr<M> acquire()
+  {
+    Slot *slot = NULL;
+    {
+      std::lock_guard<std::mutex> lock(state_->mutex);
+      if (!state_->free.empty())
+      {
+        slot = state_->free.back();
+        state_->free.pop_back();
+      }
+      else
+      {
+        slot = new Slot();
+        ++state_->allocations;
+      }
+      if (slot->generation != state_->generation)
+      {
+        slot->message = state_->prototype;
+        slot->generation = state_->generation;
+      }
+    }
+    return boost::shared_ptr<M>(&slot->message, Release(state_, slot));
+  }
+
+  /**
+   * @brief Number of messages ready for reuse
+   */
+  size_t available() const
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->free.size();
+  }
+
+  /**
+   * @brief Number of messages allocated since construction, stays constant once the pool is warm
+   */
+  size_t allocations() const
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->allocations;
+  }
+
+private:
+  struct Slot
+  {
+    Slot() : generation(0)
+    {
+    }
+
+    M message;
+    size_t generation;
+  };
+
+  struct State
+  {
+    explicit State(size_t capacity) : capacity(capacity), generation(1), allocations(0)
+    {
+      free.reserve(capacity);
+    }
+
+    ~State()
+    {
+      for (size_t i = 0; i < free.size(); ++i)
+        delete free[i];
+    }
+
+    mutable std::mutex mutex;
+    size_t capacity;
+    M prototype;
+    size_t generation;
+    size_t allocations;
+    std::vector<Slot *> free;
+  };
+
+  /**
+   * @brief Deleter returning the message to the pool, keeps the pool state alive until then
+   */
+  struct Release
+  {
+    Release(const boost::shared_ptr<State> &state, Slot *slot) : state(state), slot(slot)
+    {
+    }
+
+    void operator()(M *)
+    {
+      {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (state->free.size() < state->capacity)
+        {
+          state->free.push_back(slot);
+          slot = NULL;
+        }
+      }
+      delete slot;
+      state.reset();
+    }
+
+    boost::shared_ptr<State> state;
+    Slot *slot;
+  };
+
+  boost::shared_ptr<State> state_;
+};
+
+#endif // MESSAGE_POOL_H
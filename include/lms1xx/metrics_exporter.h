@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef METRICS_EXPORTER_H
+#define METRICS_EXPORTER_H
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "lms1xx/colaa_statistics.h"
+
+class CoLaA;
+
+/**
+ * @brief Minimal HTTP endpoint serving CoLaAStatistics in the OpenMetrics/Prometheus text format
+ *
+ * Intended for deployments of the CoLaA library without ROS diagnostics. The exporter
+ * runs its own thread and only reads the lock-free counters of the registered sensors,
+ * so the acquisition threads are never blocked by a scrape.
+ *
+ * Every request is answered with the metrics, regardless of the path.
+ */
+class MetricsExporter
+{
+public:
+  /**
+   * @param address IPv4 address to bind to, defaults to the loopback interface
+   * @param port TCP port, 0 picks a free port (see port())
+   */
+  explicit MetricsExporter(const std::string &address = "127.0.0.1", int port = 9108);
+  ~MetricsExporter();
+
+  /**
+   * @brief Export the statistics of a sensor under the given label
+   * The sensor must outlive the exporter.
+   */
+  void addSensor(const std::string &name, const CoLaA &sensor);
+
+  /**
+   * @brief Export statistics not owned by a CoLaA instance
+   */
+  void addStatistics(const std::string &name, const CoLaAStatistics &statistics);
+
+  /**
+   * @brief Bind the socket and start serving
+   * @return false if the socket could not be bound
+   */
+  bool start();
+
+  void stop();
+
+  /**
+   * @brief Port the exporter is listening on, valid after start()
+   */
+  int port() const;
+
+  /**
+   * @brief Render all registered statistics in the text exposition format
+   */
+  std::string render() const;
+
+private:
+  void run();
+
+  std::string address_;
+  int port_;
+  int listen_fd_;
+  int wake_fds_[2];
+  std::thread thread_;
+  mutable std::mutex sensors_mutex_;
+  std::vector<std::pair<std::string, const CoLaAStatistics *> > sensors_;
+};
+
+#endif // METRICS_EXPORTER_H
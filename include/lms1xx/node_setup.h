@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NODE_SETUP_H
+#define NODE_SETUP_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <lms1xx/colaa.h>
+#include <lms1xx/flight_recorder.h>
+#include <lms1xx/pipeline_publisher.h>
+#include <lms1xx/scan_multicast.h>
+#include <ros/ros.h>
+
+/**
+ * @brief Create the flight recorder of a sensor node and attach it to the laser
+ *
+ * Reads the parameters flight_recorder (default true) and flight_recorder_dir (default "."). Dumps are
+ * named after the node, with the slashes of its namespace replaced so they stay in that directory.
+ * @return NULL if the recorder is disabled, keep the recorder alive as long as the laser
+ */
+std::unique_ptr<FlightRecorder> setupFlightRecorder(ros::NodeHandle &n, CoLaA &laser);
+
+/**
+ * @brief Set the beam limits of the laser from the parameters min_range and min_rssi
+ *
+ * Beams closer than min_range or weaker than min_rssi are published like beams without echo. min_rssi is
+ * compared with the 8 bit channels or, in LMS1xx telegrams, the 16 bit remission.
+ */
+void setupBeamLimits(ros::NodeHandle &n, CoLaA &laser);
+
+/**
+ * @brief Create the sender of a sensor node multicasting scans or raw telegrams to all consumers
+ *
+ * Reads the parameters multicast_group (default "", disabled), multicast_interface (default ""),
+ * multicast_port (default 2113) and multicast_sensor_id (default -1, a random id per run).
+ * @return NULL if multicast is disabled or the group cannot be joined
+ */
+std::unique_ptr<MulticastSender> setupMulticast(ros::NodeHandle &n);
+
+/**
+ * @brief Configure the in-driver processing pipeline of a sensor node and the publisher of its outputs
+ *
+ * Reads the stages from the parameter pipeline, appends extra_stages and sets the deadline from
+ * pipeline_deadline (default 0.5 times the scan period), past which optional stages are skipped.
+ * @param pipeline_pub Set to a publisher on nh if the pipeline has stages, NULL otherwise
+ * @return false if the configuration is invalid
+ */
+bool setupPipeline(ros::NodeHandle &n, ros::NodeHandle &nh, const std::string &frame_id, ScanPipeline &pipeline,
+                   std::unique_ptr<PipelinePublisher> &pipeline_pub,
+                   const std::vector<StageConfig> &extra_stages = std::vector<StageConfig>());
+
+#endif // NODE_SETUP_H
@@ -24,17 +24,20 @@
 /**
  * @brief Parse token of provided type and advance the buffer accordingly
  *
- * This is is not necessarily safe and may step over the end of the buffer.
+ * Tokens are separated by single spaces, numbers are hexadecimal. The buffer is not advanced
+ * beyond its terminating NUL, so reading past the last token keeps failing instead of leaving the
+ * buffer. Unlike strtok() this is safe to use from several threads.
  * @param buf pointer to the input buffer
- * @param val value to extract into
+ * @param val value to extract into, unchanged on failure
+ * @return false if the buffer has no further token or it is not a number
  */
-void nextToken(char **buf, uint8_t &val);
-void nextToken(char **buf, uint16_t &val);
-void nextToken(char **buf, uint32_t &val);
-void nextToken(char **buf, int32_t &val);
-void nextToken(char **buf, int16_t &val);
-void nextToken(char **buf, float &val);
-void nextToken(char **buf, std::string &val);
-void nextToken(char **buf);
+bool nextToken(char **buf, uint8_t &val);
+bool nextToken(char **buf, uint16_t &val);
+bool nextToken(char **buf, uint32_t &val);
+bool nextToken(char **buf, int32_t &val);
+bool nextToken(char **buf, int16_t &val);
+bool nextToken(char **buf, float &val);
+bool nextToken(char **buf, std::string &val);
+bool nextToken(char **buf);
 
 #endif // PARSE_HELPERS_H
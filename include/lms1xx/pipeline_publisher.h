@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PIPELINE_PUBLISHER_H
+#define PIPELINE_PUBLISHER_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <lms1xx/background_model.h>
+#include <lms1xx/message_pool.h>
+#include <lms1xx/scan_pipeline.h>
+#include <lms1xx/ScanChanges.h>
+#include <ros/ros.h>
+#include <sensor_msgs/PointCloud2.h>
+
+/**
+ * @brief Read the stages of a pipeline from a parameter
+ *
+ * The parameter is a list of dictionaries, each with the stage "type", optionally a "name", a
+ * "budget" (share of the scan period), "optional" and the stage parameters as further keys, e.g.
+ *   pipeline: [{type: points, name: cloud, echo: 0}, {type: changes, learn_scans: 100, optional: true}]
+ * @return false if the parameter is malformed, true with no stages if it is not set
+ */
+bool loadPipelineConfig(ros::NodeHandle &n, const std::string &param, std::vector<StageConfig> &stages);
+
+/**
+ * @brief Publishes the outputs of a pipeline on topics named after them
+ *
+ * PointsOutput becomes sensor_msgs/PointCloud2 and change regions lms1xx/ScanChanges, other outputs
+ * are only used within the pipeline. Clouds are copied once into pooled messages. Outputs of stages
+ * skipped for a scan are not published, and missed deadlines are reported.
+ */
+class PipelinePublisher
+{
+public:
+  /**
+   * @param outputs of a configured pipeline, the publishers are advertised for the outputs present
+   */
+  PipelinePublisher(ros::NodeHandle &nh, const std::string &frame_id, const PipelineOutputs &outputs);
+
+  void publish(const ScanPipeline &pipeline, const ScanData &data, const ros::Time &stamp);
+
+private:
+  struct Cloud
+  {
+    ros::Publisher pub;
+    MessagePool<sensor_msgs::PointCloud2> pool;
+  };
+
+  struct Changes
+  {
+    ros::Publisher pub;
+    lms1xx::ScanChanges msg;
+    bool had_changes;
+  };
+
+  std::map<std::string, std::unique_ptr<Cloud> > clouds_;
+  std::map<std::string, Changes> changes_;
+  uint64_t deadline_misses_;
+  uint64_t degraded_;
+};
+
+#endif // PIPELINE_PUBLISHER_H
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RAW_TELEGRAM_H
+#define RAW_TELEGRAM_H
+
+#include <lms1xx/colaa.h>
+#include <lms1xx/decoded_scan.h>
+#include <lms1xx/message_pool.h>
+#include <lms1xx/scan_multicast.h>
+#include <lms1xx/RawTelegram.h>
+#include <ros/ros.h>
+#include <sensor_msgs/LaserScan.h>
+#include <sensor_msgs/MultiEchoLaserScan.h>
+
+/**
+ * @brief Publishes scan telegrams as received, without parsing them
+ *
+ * The telegram is copied from the receive buffer straight into a pooled message, so a node in raw
+ * passthrough mode does nothing but frame telegrams and subscribers in the same process get them
+ * without another copy.
+ */
+class TelegramPublisher
+{
+public:
+  /**
+   * @param topic published relative to nh
+   * @param pool_size telegrams that may be in flight
+   */
+  TelegramPublisher(ros::NodeHandle &nh, const std::string &topic, const std::string &frame_id,
+                    size_t pool_size = 4);
+
+  /**
+   * @brief Receive the next scan telegram from laser and publish it
+   * @return false if the laser timed out
+   */
+  bool publishNext(CoLaA &laser);
+
+  /**
+   * @brief Also send every telegram to a multicast group, NULL to stop
+   */
+  void setMulticast(MulticastSender *sender)
+  {
+    multicast_ = sender;
+  }
+
+private:
+  ros::Publisher pub_;
+  MulticastSender *multicast_;
+  MessagePool<lms1xx::RawTelegram> pool_;
+};
+
+/**
+ * @brief Parses raw telegrams and converts them like the sensor nodes do
+ *
+ * Geometry and timing of the scans are taken from the telegram, so no connection to the sensor is
+ * needed. data() and decoded() refer to the last decoded telegram.
+ */
+class TelegramDecoder
+{
+public:
+  /**
+   * @brief Parse a telegram
+   * @return false if it does not contain scan data
+   */
+  bool decode(const lms1xx::RawTelegram &telegram);
+
+  /**
+   * @brief Limits of valid beams applied when parsing, see CoLaA::setBeamLimits()
+   */
+  void setBeamLimits(const BeamLimits &limits)
+  {
+    parser_.setBeamLimits(limits);
+  }
+
+  const ScanData &data() const
+  {
+    return data_;
+  }
+
+  DecodedScan &decoded()
+  {
+    return decoded_;
+  }
+
+  /**
+   * @brief Counters of the parser, gaps in the telegram counter show telegrams lost on the way
+   */
+  const CoLaAStatistics &getStatistics() const;
+
+  /**
+   * @brief Size and fill scan from the last telegram, the range limits are left as they are
+   *
+   * Intensities come from the echo's 8 bit channel or, for the LMS1xx, its 16 bit remission channel.
+   * @param echo below decoded().echoCount()
+   */
+  void fillLaserScan(sensor_msgs::LaserScan &scan, size_t echo = 0);
+  void fillMultiEchoLaserScan(sensor_msgs::MultiEchoLaserScan &scan);
+
+private:
+  template <class Scan>
+  void fillHeaderAndTiming(Scan &scan) const;
+
+  CoLaA parser_;
+  std_msgs::Header header_;
+  /**
+   * @brief Null terminated copy of the telegram, parsing modifies it in place
+   */
+  std::vector<char> buffer_;
+  ScanData data_;
+  DecodedScan decoded_;
+};
+
+#endif // RAW_TELEGRAM_H
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCAN_BUNDLE_H
+#define SCAN_BUNDLE_H
+
+#include <vector>
+
+#include <boost/function.hpp>
+#include <lms1xx/message_pool.h>
+#include <lms1xx/ScanBundle.h>
+#include <ros/ros.h>
+#include <sensor_msgs/LaserScan.h>
+
+/**
+ * @brief Collects consecutive scans into one ScanBundle message
+ *
+ * Scans are converted directly into the bundle (next()), bundles come from a message pool, so
+ * bundling neither copies scans nor allocates once the pool is warm. The scans a partial bundle
+ * does not use are kept aside and restored when a short bundle comes back, so partial bundles
+ * (e.g. after a missed layer) do not allocate either.
+ */
+class ScanBundler
+{
+public:
+  /**
+   * @param size number of scans per bundle
+   */
+  explicit ScanBundler(size_t size);
+
+  /**
+   * @brief Set the shape (frame, array sizes) of every scan in the bundle
+   */
+  void setPrototype(const sensor_msgs::LaserScan &scan);
+
+  /**
+   * @brief Scan slot to fill, the first slot determines the header of the bundle
+   */
+  sensor_msgs::LaserScan &next();
+
+  bool full() const
+  {
+    return count_ >= size_;
+  }
+
+  bool empty() const
+  {
+    return count_ == 0;
+  }
+
+  /**
+   * @brief Hand out the bundle for publishing, may be called before it is full
+   *
+   * Only the scans filled are handed out, the others are kept for reuse.
+   */
+  lms1xx::ScanBundlePtr take();
+
+  /**
+   * @brief Drop the scans collected so far (e.g. after a layer was missed)
+   */
+  void clear();
+
+private:
+  size_t size_;
+  size_t count_;
+  sensor_msgs::LaserScan prototype_;
+  MessagePool<lms1xx::ScanBundle> pool_;
+  lms1xx::ScanBundlePtr current_;
+  /**
+   * @brief Scans taken out of partial bundles, with their arrays
+   */
+  std::vector<sensor_msgs::LaserScan> spare_;
+};
+
+/**
+ * @brief Helpers for consumers of bundled scans
+ */
+namespace ScanBundling
+{
+/**
+ * @brief Scan of a bundle sharing ownership with the bundle, can be published without a copy
+ */
+sensor_msgs::LaserScanConstPtr unbundle(const lms1xx::ScanBundleConstPtr &bundle, size_t index);
+
+/**
+ * @brief Subscribe to a bundle topic and call callback for every scan in order
+ */
+ros::Subscriber subscribe(ros::NodeHandle &nh, const std::string &topic, uint32_t queue_size,
+                          const boost::function<void(const sensor_msgs::LaserScanConstPtr &)> &callback);
+}
+
+#endif // SCAN_BUNDLE_H
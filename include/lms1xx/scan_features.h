@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCAN_FEATURES_H
+#define SCAN_FEATURES_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "lms1xx/decoded_scan.h"
+
+struct FeatureConfig
+{
+  /**
+   * @brief Neighbours on each side of a beam its curvature is computed from
+   */
+  uint16_t window = 5;
+  /**
+   * @brief Features are selected separately in this many equal parts of the scan, spreading them out
+   */
+  uint16_t sectors = 6;
+  uint16_t edges_per_sector = 2;
+  uint16_t planes_per_sector = 4;
+  /**
+   * @brief Beams with a higher curvature in m^2 may become edges, beams with a lower one planes
+   */
+  float edge_threshold = 0.1;
+  float plane_threshold = 0.1;
+  /**
+   * @brief Neighbouring ranges differing by more than this share of the closer one are an occlusion boundary
+   */
+  float occlusion_ratio = 0.1;
+  /**
+   * @brief A beam whose range differs from both neighbours by more than this share runs almost parallel
+   *        to the surface it hits
+   */
+  float parallel_ratio = 0.02;
+};
+
+namespace BeamFeature
+{
+enum Label : uint8_t
+{
+  None = 0,
+  Edge = 1,
+  Plane = 2
+};
+}
+
+/**
+ * @brief Edge and planar features of a scan line as used by LOAM style lidar odometry
+ *
+ * The curvature of a beam is the squared norm of the summed differences between its point and
+ * the points of the window beams on either side, in m^2 like LOAM. A line of a MRS1000 layer
+ * is in beam order already, so no sorting of a published cloud into rings is needed. The
+ * curvature is computed four beams at a time with SSE2 where available. Beams next to an
+ * occlusion boundary, beams almost parallel to the surface and beams with an invalid neighbour
+ * are never selected. Per sector the beams with the highest curvature become edges and the
+ * ones with the lowest planes, and the neighbours of a selected beam are not selected again.
+ *
+ * Reuse one instance across scans, it does not allocate once sized for the scanner.
+ */
+class FeatureExtractor
+{
+public:
+  explicit FeatureExtractor(const FeatureConfig &config = FeatureConfig());
+
+  /**
+   * @brief Compute the curvature of one echo and select its features
+   */
+  void extract(DecodedScan &decoded, size_t echo = 0);
+
+  /**
+   * @brief Curvature of every beam of the last scan, -1 if it has none (window incomplete or invalid)
+   */
+  const std::vector<float> &curvature() const
+  {
+    return curvature_;
+  }
+
+  /**
+   * @brief BeamFeature::Label of every beam of the last scan
+   */
+  const std::vector<uint8_t> &labels() const
+  {
+    return labels_;
+  }
+
+  /**
+   * @brief Beam indices of the selected features, in order of selection within each sector
+   */
+  const std::vector<uint32_t> &edges() const
+  {
+    return edges_;
+  }
+
+  const std::vector<uint32_t> &planes() const
+  {
+    return planes_;
+  }
+
+  /**
+   * @brief Curvature of count beams with points (x, y, z_factor * range)
+   * @param curvature set to -1 for beams within window of the ends or of an invalid (0) range
+   */
+  static void computeCurvature(const float *x, const float *y, const float *ranges, float z_factor, size_t count,
+                               size_t window, float *curvature);
+
+private:
+  void excludeUnreliable(const std::vector<float> &ranges);
+  /**
+   * @brief Keep the neighbours of a selected beam from being selected, up to an occlusion boundary
+   */
+  void suppressNeighbours(const std::vector<float> &ranges, size_t beam);
+  void selectSector(const std::vector<float> &ranges, size_t first, size_t last);
+
+  FeatureConfig config_;
+  std::vector<float> x_;
+  std::vector<float> y_;
+  std::vector<float> curvature_;
+  std::vector<uint8_t> labels_;
+  /**
+   * @brief Beams that may not be selected (anymore)
+   */
+  std::vector<uint8_t> blocked_;
+  std::vector<uint32_t> order_;
+  std::vector<uint32_t> edges_;
+  std::vector<uint32_t> planes_;
+};
+
+#endif // SCAN_FEATURES_H
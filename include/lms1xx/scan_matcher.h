@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCAN_MATCHER_H
+#define SCAN_MATCHER_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "lms1xx/colaa_structs.h"
+
+struct Pose2D
+{
+  double x;
+  double y;
+  double theta;
+};
+
+struct ScanMatcherConfig
+{
+  /**
+   * @brief Cell size of the finest lookup grid in m
+   */
+  double resolution = 0.05;
+  /**
+   * @brief Number of precomputed grids, the coarsest has cells of resolution * 2^(levels - 1)
+   */
+  int levels = 6;
+  /**
+   * @brief Search window around the predicted pose in m (each direction)
+   */
+  double linear_window = 0.3;
+  /**
+   * @brief Search window around the predicted heading in rad (each direction)
+   */
+  double angular_window = 0.2;
+  /**
+   * @brief Beams outside [min_range, max_range] in m are ignored
+   */
+  double min_range = 0.1;
+  double max_range = 20.0;
+  /**
+   * @brief Upper bound of beams used per scan, beams are decimated evenly
+   */
+  size_t max_points = 360;
+  /**
+   * @brief Minimum normalised score (0..1) to accept a match
+   */
+  double min_score = 0.45;
+  /**
+   * @brief A new keyframe is taken when the scan moved this far from the current one
+   */
+  double keyframe_distance = 0.5;
+  double keyframe_angle = 0.3;
+  /**
+   * @brief Upper bound on scored branch and bound nodes per scan, bounds compute time
+   */
+  size_t max_nodes = 20000;
+};
+
+/**
+ * @brief Scan to keyframe matcher using fast correlative scan matching
+ *
+ * The keyframe is rasterised into a blurred lookup grid, from which a stack of
+ * max-filtered grids with doubling window sizes is precomputed. Candidate poses in
+ * the search window are then evaluated with branch and bound, using the coarse
+ * grids as upper bounds of the score of all finer candidates they cover.
+ * All buffers are allocated up front, a scan never allocates.
+ */
+class ScanMatcher
+{
+public:
+  explicit ScanMatcher(const ScanMatcherConfig &config = ScanMatcherConfig());
+
+  /**
+   * @brief Match a scan against the current keyframe and update the pose
+   * The first scan becomes the first keyframe at the origin.
+   * @param data parsed scan, echo selects the 16 bit channel
+   * @return false if the match failed, the pose is not updated in that case
+   */
+  bool addScan(const ScanData &data, size_t echo = 0);
+
+  /**
+   * @brief Pose of the latest scan relative to the first one
+   */
+  const Pose2D &pose() const;
+
+  /**
+   * @brief Normalised score (0..1) of the latest match
+   */
+  double score() const;
+
+  /**
+   * @brief Number of scored nodes of the latest match
+   */
+  size_t nodes() const;
+
+  void reset();
+
+  /**
+   * @brief Match points against the keyframe
+   * @param points x, y pairs in the sensor frame
+   * @param guess predicted pose relative to the keyframe
+   * @param result best pose relative to the keyframe
+   * @return normalised score of the result
+   */
+  double match(const std::vector<float> &points, const Pose2D &guess, Pose2D &result);
+
+  /**
+   * @brief Rebuild the lookup grids from the given points
+   */
+  void setKeyframe(const std::vector<float> &points);
+
+private:
+  struct Grid
+  {
+    int size;
+    std::vector<uint8_t> cells;
+
+    uint8_t at(int x, int y) const
+    {
+      if (x < 0 || y < 0 || x >= size || y >= size)
+        return 0;
+      return cells[y * size + x];
+    }
+  };
+
+  struct Candidate
+  {
+    int rotation;
+    int x;
+    int y;
+    uint32_t score;
+
+    bool operator<(const Candidate &other) const
+    {
+      return score > other.score;
+    }
+  };
+
+  void extractPoints(const ScanData &data, size_t echo);
+  uint32_t scoreCandidate(const Candidate &c, int level) const;
+  Candidate branch(std::vector<Candidate> &candidates, int level, uint32_t min_score);
+
+  ScanMatcherConfig config_;
+  std::vector<Grid> grids_;
+  double origin_;
+  int cells_;
+
+  std::vector<float> points_;
+  std::vector<float> cos_table_;
+  std::vector<float> sin_table_;
+  int32_t table_start_angle_;
+  uint16_t table_step_;
+
+  // Discretised points per rotation of the current match
+  std::vector<std::vector<int32_t> > rotated_;
+  std::vector<double> rotations_;
+  std::vector<std::vector<Candidate> > candidate_pool_;
+  size_t point_count_;
+  size_t nodes_;
+
+  bool has_keyframe_;
+  Pose2D keyframe_pose_;
+  Pose2D relative_;
+  Pose2D pose_;
+  double score_;
+};
+
+#endif // SCAN_MATCHER_H
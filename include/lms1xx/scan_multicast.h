@@ -0,0 +1,339 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCAN_MULTICAST_H
+#define SCAN_MULTICAST_H
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "lms1xx/colaa_structs.h"
+
+/**
+ * @brief UDP multicast of scans, one datagram per fragment serves every receiver
+ *
+ * Every datagram starts with a 34 byte header (little endian like capture files):
+ *   4 byte magic "LMSM"
+ *   uint8_t  version, 1
+ *   uint8_t  payload type, see Type
+ *   uint16_t fragment index and uint16_t fragment count
+ *   uint32_t sensor id
+ *   uint32_t message sequence number, consecutive per sender
+ *   uint32_t message size and uint32_t offset of this fragment in the message
+ *   int64_t  receive time of the scan in ns
+ * followed by the fragment. Scans are sent either as the raw telegram or in the compact binary
+ * form of serializeScan(), which is smaller than the telegram and needs no parsing.
+ */
+namespace ScanMulticast
+{
+enum Type : uint8_t
+{
+  Telegram = 0,
+  Scan = 1
+};
+
+constexpr char MAGIC[4] = {'L', 'M', 'S', 'M'};
+static const uint8_t VERSION = 1;
+static const size_t HEADER_SIZE = 34;
+/**
+ * @brief Datagram size fitting an Ethernet frame without IP fragmentation
+ */
+static const size_t DEFAULT_DATAGRAM_SIZE = 1472;
+/**
+ * @brief Largest UDP payload over IPv4
+ */
+static const size_t MAX_DATAGRAM_SIZE = 65507;
+/**
+ * @brief Messages larger than this are rejected by the receiver unless configured otherwise
+ */
+static const size_t DEFAULT_MAX_MESSAGE_SIZE = 4 << 20;
+
+struct DatagramHeader
+{
+  Type type;
+  uint16_t fragment;
+  uint16_t fragment_count;
+  uint32_t sensor_id;
+  uint32_t sequence;
+  uint32_t size;
+  uint32_t offset;
+  int64_t stamp_ns;
+};
+
+void writeHeader(const DatagramHeader &header, uint8_t *out);
+
+/**
+ * @return false if the datagram is too short, not ours or claims a message its fragments cannot carry
+ */
+bool parseHeader(const uint8_t *datagram, size_t length, DatagramHeader &header);
+
+/**
+ * @brief Compact binary form of a scan: header, channels and validity masks
+ * @param out replaced, reuse it across scans to avoid allocation
+ */
+void serializeScan(const ScanData &data, std::vector<uint8_t> &out);
+
+/**
+ * @return false if the data is truncated
+ */
+bool deserializeScan(const uint8_t *data, size_t size, ScanData &out);
+
+/**
+ * @brief Random id for a sender, differs between processes and runs
+ */
+uint32_t sessionId();
+}
+
+struct MulticastMessage
+{
+  ScanMulticast::Type type;
+  uint32_t sensor_id;
+  uint32_t sequence;
+  int64_t stamp_ns;
+  std::vector<uint8_t> data;
+};
+
+struct MulticastStatistics
+{
+  uint64_t datagrams = 0;
+  uint64_t messages = 0;
+  /**
+   * @brief Messages not returned, from gaps in the sequence numbers of the returned ones
+   */
+  uint64_t lost = 0;
+  /**
+   * @brief Messages of which some but not all fragments arrived, included in lost
+   */
+  uint64_t incomplete = 0;
+  /**
+   * @brief Datagrams without a valid header, of oversized messages or not fitting the other fragments
+   */
+  uint64_t malformed = 0;
+  /**
+   * @brief Senders that started over with their sequence numbers
+   */
+  uint64_t restarts = 0;
+};
+
+/**
+ * @brief Sends scans or telegrams to a multicast group
+ *
+ * Not thread safe, call from the acquisition thread.
+ */
+class MulticastSender
+{
+public:
+  MulticastSender();
+  ~MulticastSender();
+
+  /**
+   * @param group multicast group, a unicast address (e.g. 127.0.0.1) sends to that host only
+   * @param interface address of the interface to send on, empty for the default route
+   * @param ttl hops the datagrams may take, 1 stays in the local network
+   * @return false if the socket could not be set up
+   */
+  bool open(const std::string &group, uint16_t port, const std::string &interface = "", int ttl = 1);
+  void close();
+
+  bool isOpen() const
+  {
+    return socket_fd_ >= 0;
+  }
+
+  /**
+   * @param size of the datagrams including the header, 1472 fits Ethernet without IP fragmentation
+   */
+  void setDatagramSize(size_t size);
+
+  /**
+   * @brief Id receivers tell senders apart by, a random session id by default
+   *
+   * Receivers see a restarted sender with the same id from its sequence numbers going back.
+   */
+  void setSensorId(uint32_t id)
+  {
+    sensor_id_ = id;
+  }
+
+  /**
+   * @brief Send a scan in compact form
+   * @return false if sending failed, the sequence number is used up anyway
+   */
+  bool sendScan(const ScanData &data, int64_t stamp_ns);
+
+  /**
+   * @brief Send a telegram as received, e.g. from CoLaA::getTelegram()
+   */
+  bool sendTelegram(const uint8_t *telegram, size_t size, int64_t stamp_ns);
+
+  /**
+   * @brief Send any payload as one message, fragmenting it as needed
+   */
+  bool send(ScanMulticast::Type type, const uint8_t *data, size_t size, int64_t stamp_ns);
+
+  uint32_t sequence() const
+  {
+    return sequence_;
+  }
+
+private:
+  int socket_fd_;
+  std::vector<uint8_t> destination_;
+  size_t datagram_size_;
+  uint32_t sensor_id_;
+  uint32_t sequence_;
+  std::vector<uint8_t> payload_;
+};
+
+/**
+ * @brief Reassembles messages from datagrams in any order
+ *
+ * A few messages are assembled at the same time, so fragments of consecutive messages and of
+ * several senders may interleave. A message still missing fragments when its slot is needed for
+ * another one is dropped. Per sender only messages newer than the last one completed are
+ * returned. A sender whose sequence goes back with a newer receive time, or by more than
+ * RESTART_GAP, has restarted and is followed from its new sequence on.
+ */
+class MulticastReassembler
+{
+public:
+  static const uint32_t RESTART_GAP = 1024;
+  /**
+   * @brief Senders followed at the same time, the one silent the longest is forgotten first
+   */
+  static const size_t MAX_SENDERS = 64;
+
+  explicit MulticastReassembler(size_t slots = 4);
+
+  /**
+   * @brief Messages announcing more bytes are dropped without allocating
+   */
+  void setMaxMessageSize(size_t size)
+  {
+    max_message_size_ = size;
+  }
+
+  /**
+   * @brief Add a datagram
+   * @return true if it completed a message, which is swapped into out
+   */
+  bool add(const uint8_t *datagram, size_t length, MulticastMessage &out);
+
+  const MulticastStatistics &statistics() const
+  {
+    return statistics_;
+  }
+
+private:
+  struct Slot
+  {
+    bool used;
+    /**
+     * @brief Datagram count when the slot was taken, the oldest is reused first
+     */
+    uint64_t created;
+    ScanMulticast::DatagramHeader header;
+    /**
+     * @brief Size of all fragments but the last, 0 until known
+     */
+    uint32_t fragment_size;
+    std::vector<uint8_t> received;
+    uint16_t missing;
+    MulticastMessage message;
+  };
+
+  struct Sender
+  {
+    uint32_t last_sequence;
+    int64_t last_stamp_ns;
+    /**
+     * @brief Message count when the sender last completed a message
+     */
+    uint64_t last_message;
+  };
+
+  /**
+   * @return true if sequence a is after b, allowing for wrap around
+   */
+  static bool newer(uint32_t a, uint32_t b)
+  {
+    return static_cast<int32_t>(a - b) > 0;
+  }
+
+  /**
+   * @return false if the fragment is not where the other fragments of the message put it
+   */
+  static bool placeFragment(Slot &slot, const ScanMulticast::DatagramHeader &header, size_t payload);
+
+  /**
+   * @brief Give up the messages of a sender older than sequence, all of them if restarted
+   */
+  void dropOlder(uint32_t sensor_id, uint32_t sequence, bool restarted = false);
+
+  std::vector<Slot> slots_;
+  std::map<uint32_t, Sender> senders_;
+  size_t max_message_size_;
+  MulticastStatistics statistics_;
+};
+
+/**
+ * @brief Joins a multicast group and returns complete messages
+ *
+ * Several receivers, also in the same process, can listen on the same group and port.
+ */
+class MulticastReceiver
+{
+public:
+  MulticastReceiver();
+  ~MulticastReceiver();
+
+  /**
+   * @param port 0 picks a free port, see port()
+   * @param interface address of the interface to join on, empty for the default
+   * @param receive_buffer kernel receive buffer in bytes, 0 keeps the system default
+   * @return false if the socket could not be set up
+   */
+  bool open(const std::string &group, uint16_t port, const std::string &interface = "", int receive_buffer = 0);
+  void close();
+
+  uint16_t port() const;
+
+  void setMaxMessageSize(size_t size)
+  {
+    reassembler_.setMaxMessageSize(size);
+  }
+
+  /**
+   * @brief Wait up to timeout_ms for the next complete message
+   * @return false on timeout or error
+   */
+  bool receive(MulticastMessage &message, int timeout_ms);
+
+  const MulticastStatistics &statistics() const
+  {
+    return reassembler_.statistics();
+  }
+
+private:
+  int socket_fd_;
+  std::vector<uint8_t> datagram_;
+  MulticastReassembler reassembler_;
+};
+
+#endif // SCAN_MULTICAST_H
@@ -0,0 +1,435 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCAN_PIPELINE_H
+#define SCAN_PIPELINE_H
+
+#include <stdint.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+#include "lms1xx/colaa_structs.h"
+#include "lms1xx/decoded_scan.h"
+
+/**
+ * @brief Parameters of a stage as strings, converted on access
+ */
+class StageParams
+{
+public:
+  void set(const std::string &key, const std::string &value)
+  {
+    values_[key] = value;
+  }
+
+  bool has(const std::string &key) const
+  {
+    return values_.count(key) > 0;
+  }
+
+  std::string getString(const std::string &key, const std::string &fallback) const;
+  /**
+   * @brief Value converted to a number, fallback if missing or not a number
+   */
+  double getDouble(const std::string &key, double fallback) const;
+  int getInt(const std::string &key, int fallback) const;
+  /**
+   * @brief true for "true" or "1", false for "false" or "0", fallback otherwise
+   */
+  bool getBool(const std::string &key, bool fallback) const;
+
+  const std::map<std::string, std::string> &values() const
+  {
+    return values_;
+  }
+
+private:
+  std::map<std::string, std::string> values_;
+};
+
+struct StageConfig
+{
+  /**
+   * @brief Registered stage type, see ScanStageRegistry
+   */
+  std::string type;
+  /**
+   * @brief Unique name of the stage, the type if empty. Outputs are named after it by default.
+   */
+  std::string name;
+  StageParams params;
+  /**
+   * @brief Time the stage may take per scan as share of the scan period, 0 for no budget
+   */
+  double budget = 0;
+  /**
+   * @brief Optional stages are skipped for a scan if they would end after the pipeline deadline
+   */
+  bool optional = false;
+};
+
+struct StageStatistics
+{
+  uint64_t runs = 0;
+  /**
+   * @brief Scans the stage was skipped for to keep the deadline
+   */
+  uint64_t skipped = 0;
+  /**
+   * @brief Runs that took longer than the budget
+   */
+  uint64_t budget_misses = 0;
+  int64_t last_ns = 0;
+  int64_t max_ns = 0;
+  /**
+   * @brief Moving average of the run time, the expected time of the next run
+   */
+  double average_ns = 0;
+};
+
+struct PipelineStatistics
+{
+  uint64_t scans = 0;
+  /**
+   * @brief Scans the pipeline finished after its deadline
+   */
+  uint64_t deadline_misses = 0;
+  /**
+   * @brief Scans some optional stage was skipped for
+   */
+  uint64_t degraded = 0;
+  int64_t last_ns = 0;
+  int64_t max_ns = 0;
+};
+
+/**
+ * @brief What every stage sees of one scan
+ *
+ * decoded caches ranges and beam directions for all stages (and the node's own conversions),
+ * so each echo is decoded at most once per scan.
+ */
+struct ScanFrame
+{
+  const ScanData &data;
+  DecodedScan &decoded;
+  /**
+   * @brief Receive time of the scan
+   */
+  int64_t stamp_ns;
+  /**
+   * @brief Scans processed by the pipeline before this one
+   */
+  uint64_t sequence;
+};
+
+/**
+ * @brief Points as x, y, z and intensity, the common output of point producing stages
+ */
+struct PointsOutput
+{
+  std::vector<float> xyzi;
+  size_t count = 0;
+};
+
+/**
+ * @brief Named outputs of the stages, owned by the pipeline
+ *
+ * An output is created on first use and kept with its capacity for the following scans, so
+ * stages write into the same buffers every scan. References stay valid until the pipeline is
+ * configured again. A stage reads the outputs of the stages before it by name. The outputs of a
+ * stage skipped for the current scan are not found, so stale data is neither used nor published.
+ */
+class PipelineOutputs
+{
+public:
+  PipelineOutputs() : stage_(NO_STAGE)
+  {
+  }
+
+  /**
+   * @brief Output of type T, created on first use
+   * An existing output of another type is replaced.
+   */
+  template <class T>
+  T &get(const std::string &name)
+  {
+    std::unique_ptr<Holder> &holder = outputs_[name];
+    if (!holder || holder->type() != typeid(T))
+    {
+      holder.reset(new TypedHolder<T>());
+      holder->stage = stage_;
+    }
+    return static_cast<TypedHolder<T> *>(holder.get())->value;
+  }
+
+  /**
+   * @return the output if it exists, has type T and its stage ran on the current scan, NULL otherwise
+   */
+  template <class T>
+  const T *find(const std::string &name) const
+  {
+    std::map<std::string, std::unique_ptr<Holder> >::const_iterator it = outputs_.find(name);
+    if (it == outputs_.end() || it->second->type() != typeid(T) || skipped(it->second->stage))
+      return NULL;
+    return &static_cast<const TypedHolder<T> *>(it->second.get())->value;
+  }
+
+  /**
+   * @brief Names of the outputs of type T
+   */
+  template <class T>
+  std::vector<std::string> names() const
+  {
+    std::vector<std::string> result;
+    for (std::map<std::string, std::unique_ptr<Holder> >::const_iterator it = outputs_.begin();
+         it != outputs_.end(); ++it)
+    {
+      if (it->second->type() == typeid(T))
+        result.push_back(it->first);
+    }
+    return result;
+  }
+
+  void clear()
+  {
+    outputs_.clear();
+    skipped_.clear();
+  }
+
+private:
+  friend class ScanPipeline;
+
+  static const size_t NO_STAGE = static_cast<size_t>(-1);
+
+  struct Holder
+  {
+    virtual ~Holder() {}
+    virtual const std::type_info &type() const = 0;
+    /**
+     * @brief Index of the stage that created the output
+     */
+    size_t stage;
+  };
+
+  template <class T>
+  struct TypedHolder : Holder
+  {
+    const std::type_info &type() const
+    {
+      return typeid(T);
+    }
+    T value;
+  };
+
+  bool skipped(size_t stage) const
+  {
+    return stage < skipped_.size() && skipped_[stage];
+  }
+
+  std::map<std::string, std::unique_ptr<Holder> > outputs_;
+  /**
+   * @brief Stage running or being configured, owner of the outputs it creates
+   */
+  size_t stage_;
+  std::vector<uint8_t> skipped_;
+};
+
+/**
+ * @brief One processing step run on every scan
+ */
+class ScanStage
+{
+public:
+  virtual ~ScanStage() {}
+
+  /**
+   * @brief Called once before the first scan, look up or create outputs here
+   * @param name of the stage, default name of its output
+   * @return false if the parameters are invalid
+   */
+  virtual bool configure(const std::string &/*name*/, const StageParams &/*params*/, PipelineOutputs &/*outputs*/)
+  {
+    return true;
+  }
+
+  /**
+   * @brief Process a scan, results go to outputs
+   */
+  virtual void process(const ScanFrame &frame, PipelineOutputs &outputs) = 0;
+};
+
+/**
+ * @brief Stage types by name
+ *
+ * The built-in stages are always available:
+ *   points          points of one echo (param echo), PointsOutput
+ *   returns         the real returns of all echoes, PointsOutput
+ *   sector_index    SectorIndex of one echo (param echo)
+ *   changes         changes against a learned background (params learn_scans, sigma, min_delta),
+ *                   std::vector<ChangedRegion>
+ *   features        LOAM style edge and planar features of one echo (param echo and those of
+ *                   FeatureConfig), PointsOutput <name>/edges and <name>/planes
+ * Further stages are added with LMS1XX_REGISTER_STAGE in the executable using them.
+ */
+class ScanStageRegistry
+{
+public:
+  typedef std::function<std::unique_ptr<ScanStage>()> Factory;
+
+  /**
+   * @return false if the type is already registered, the first registration is kept
+   */
+  static bool add(const std::string &type, const Factory &factory);
+
+  /**
+   * @return NULL for unknown types
+   */
+  static std::unique_ptr<ScanStage> create(const std::string &type);
+
+  static std::vector<std::string> types();
+
+private:
+  static std::map<std::string, Factory> &factories();
+};
+
+/**
+ * @brief Register a stage type at static initialisation, use at namespace scope in a source file
+ */
+#define LMS1XX_REGISTER_STAGE(Class, type)                                                                  \
+  static const bool lms1xx_stage_registered_##Class =                                                     \
+      ScanStageRegistry::add(type, [] { return std::unique_ptr<ScanStage>(new Class()); })
+
+/**
+ * @brief Runs a configured chain of stages on every scan
+ *
+ * Stages get the scan by reference and share one DecodedScan, nothing is copied into the
+ * pipeline. The outputs and the stages' own state are kept across scans, so a running
+ * pipeline does not allocate once every buffer has grown to the size of the scans.
+ *
+ * Processing a scan has a deadline, a share of the scan period after process() is called, so
+ * the next telegram is read in time. Before an optional stage runs its expected time (the
+ * moving average of its runs) is checked against the time left, and the stage is skipped for
+ * this scan if it would end late. Required stages always run. Stage times are measured and
+ * counted against the stage budgets and the deadline. The estimate of a skipped stage decays,
+ * so it is tried again once there is time.
+ */
+class ScanPipeline
+{
+public:
+  ScanPipeline();
+
+  /**
+   * @brief Replace the stages, run in the given order
+   * @return false if a type is unknown, a name is used twice or a stage rejects its
+   *         parameters, the pipeline is empty then
+   */
+  bool configure(const std::vector<StageConfig> &stages);
+
+  void clear();
+
+  bool empty() const
+  {
+    return stages_.empty();
+  }
+
+  size_t size() const
+  {
+    return stages_.size();
+  }
+
+  const std::string &stageName(size_t i) const
+  {
+    return stages_[i].name;
+  }
+
+  /**
+   * @brief Scan frequency in 1/100 Hz like ScanConfig::scan_frequency, the scan period the budgets
+   *        and the deadline refer to. 0 (the default) takes the frequency from each scan's header.
+   */
+  void setScanFrequency(uint32_t frequency)
+  {
+    scan_frequency_ = frequency;
+  }
+
+  /**
+   * @brief Share of the scan period all stages together may take, 0.5 by default
+   */
+  void setDeadline(double share)
+  {
+    deadline_ = share;
+  }
+
+  const PipelineStatistics &statistics() const
+  {
+    return statistics_;
+  }
+
+  const StageStatistics &stageStatistics(size_t i) const
+  {
+    return stages_[i].statistics;
+  }
+
+  /**
+   * @brief false if stage i was skipped on the last scan
+   */
+  bool ran(size_t i) const
+  {
+    return !outputs_.skipped(i);
+  }
+
+  /**
+   * @brief Run all stages on a scan already reset into decoded
+   */
+  void process(DecodedScan &decoded, int64_t stamp_ns);
+
+  /**
+   * @brief Run all stages on a scan, decoded with the pipeline's own DecodedScan
+   */
+  void process(const ScanData &data, int64_t stamp_ns);
+
+  /**
+   * @brief Outputs of the last scan, overwritten by the next
+   */
+  const PipelineOutputs &outputs() const
+  {
+    return outputs_;
+  }
+
+private:
+  struct Stage
+  {
+    std::string name;
+    std::unique_ptr<ScanStage> stage;
+    double budget;
+    bool optional;
+    StageStatistics statistics;
+  };
+
+  std::vector<Stage> stages_;
+  PipelineOutputs outputs_;
+  DecodedScan decoded_;
+  uint64_t sequence_;
+  uint32_t scan_frequency_;
+  double deadline_;
+  PipelineStatistics statistics_;
+};
+
+#endif // SCAN_PIPELINE_H
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCAN_REACTOR_H
+#define SCAN_REACTOR_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "lms1xx/colaa.h"
+
+/**
+ * @brief Event loop multiplexing any number of connected sensors on one thread
+ *
+ * Waits on the sockets of all registered sensors with poll(), frames and parses
+ * telegrams with the non-blocking CoLaA::tryGetScanData() and hands every scan to
+ * the sensor's callback. Processing can be moved off the I/O thread by passing an
+ * executor, in which case each scan is parsed into its own shared buffer.
+ *
+ * add(), remove(), runOnce() and run() must be called from the same thread,
+ * stop() may be called from any thread.
+ */
+class ScanReactor
+{
+public:
+  typedef std::function<void(const ScanData &)> ScanCallback;
+  /**
+   * @brief Called on the reactor thread when a sensor timed out or lost its connection
+   * The sensor may be reconnected from within the callback.
+   */
+  typedef std::function<void(CoLaA &)> ErrorCallback;
+  /**
+   * @brief Runs a task, e.g. by posting it to a thread pool
+   */
+  typedef std::function<void(std::function<void()>)> Executor;
+
+  /**
+   * @param executor Runs the scan callbacks. Defaults to calling them inline on the reactor thread.
+   */
+  explicit ScanReactor(Executor executor = Executor());
+  ~ScanReactor();
+
+  /**
+   * @brief Register a sensor
+   * @param sensor connected sensor with continuous output enabled, must outlive its registration
+   * @param on_scan called for every parsed scan
+   * @param on_error called if no scan was received for timeout_ms or the connection failed
+   * @param timeout_ms see on_error
+   */
+  void add(CoLaA &sensor, ScanCallback on_scan, ErrorCallback on_error = ErrorCallback(), int timeout_ms = 100);
+
+  void remove(CoLaA &sensor);
+
+  /**
+   * @brief Wait up to max_wait_ms for data and dispatch all scans that are available
+   * @return number of scans dispatched
+   */
+  size_t runOnce(int max_wait_ms);
+
+  /**
+   * @brief Dispatch scans until stop() is called
+   */
+  void run();
+
+  /**
+   * @brief Make run() return, safe to call from any thread and from callbacks
+   */
+  void stop();
+
+private:
+  struct Entry
+  {
+    CoLaA *sensor;
+    ScanCallback on_scan;
+    ErrorCallback on_error;
+    int64_t timeout_ns;
+    int64_t last_activity_ns;
+    ScanData scan;
+  };
+
+  /**
+   * @brief Drain all telegrams of a sensor, returns the number of scans
+   */
+  size_t drain(Entry &entry, int64_t now);
+
+  Executor executor_;
+  std::vector<std::shared_ptr<Entry> > entries_;
+  int wake_fds_[2];
+  std::atomic<bool> stopped_;
+};
+
+#endif // SCAN_REACTOR_H
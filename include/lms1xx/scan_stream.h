@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCAN_STREAM_H
+#define SCAN_STREAM_H
+
+/*
+ * C++20 coroutine interface on top of ScanReactor, enabled with the
+ * LMS1XX_COROUTINES CMake option:
+ *
+ *   ScanTask process(ScanStream &stream)
+ *   {
+ *     while (std::optional<ScanData> scan = co_await stream.nextScan())
+ *       ...
+ *   }
+ *
+ * Coroutines are resumed on the reactor thread, the reactor must not use an executor.
+ */
+
+#ifdef LMS1XX_ENABLE_COROUTINES
+
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <optional>
+
+#include "lms1xx/scan_reactor.h"
+
+/**
+ * @brief Fire and forget coroutine type, starts eagerly and cleans up after itself
+ */
+struct ScanTask
+{
+  struct promise_type
+  {
+    ScanTask get_return_object()
+    {
+      return ScanTask();
+    }
+    std::suspend_never initial_suspend() noexcept
+    {
+      return std::suspend_never();
+    }
+    std::suspend_never final_suspend() noexcept
+    {
+      return std::suspend_never();
+    }
+    void return_void()
+    {
+    }
+    void unhandled_exception()
+    {
+      std::terminate();
+    }
+  };
+};
+
+/**
+ * @brief Awaitable stream of the scans of one sensor
+ *
+ * Registers the sensor with the reactor for its lifetime. Scans arriving while no
+ * coroutine is waiting are queued up to max_queue, older scans are dropped.
+ * The stream must outlive any coroutine waiting on it.
+ */
+class ScanStream
+{
+public:
+  class NextScan
+  {
+  public:
+    explicit NextScan(ScanStream &stream) : stream_(stream)
+    {
+    }
+
+    bool await_ready() const
+    {
+      return !stream_.queue_.empty() || stream_.error_;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+      stream_.waiter_ = handle;
+    }
+
+    /**
+     * @return the next scan or nothing if the sensor timed out or disconnected
+     */
+    std::optional<ScanData> await_resume()
+    {
+      if (stream_.queue_.empty())
+      {
+        stream_.error_ = false;
+        return std::nullopt;
+      }
+      std::optional<ScanData> scan(std::move(stream_.queue_.front()));
+      stream_.queue_.pop_front();
+      return scan;
+    }
+
+  private:
+    ScanStream &stream_;
+  };
+
+  ScanStream(ScanReactor &reactor, CoLaA &sensor, size_t max_queue = 4, int timeout_ms = 100)
+    : reactor_(reactor), sensor_(sensor), max_queue_(max_queue), error_(false)
+  {
+    reactor_.add(sensor_, [this](const ScanData &scan) { onScan(scan); },
+                 [this](CoLaA &) { onError(); }, timeout_ms);
+  }
+
+  ~ScanStream()
+  {
+    reactor_.remove(sensor_);
+  }
+
+  ScanStream(const ScanStream &) = delete;
+  ScanStream &operator=(const ScanStream &) = delete;
+
+  NextScan nextScan()
+  {
+    return NextScan(*this);
+  }
+
+private:
+  void onScan(const ScanData &scan)
+  {
+    if (queue_.size() >= max_queue_)
+      queue_.pop_front();
+    queue_.push_back(scan);
+    resume();
+  }
+
+  void onError()
+  {
+    error_ = true;
+    resume();
+  }
+
+  void resume()
+  {
+    if (waiter_)
+    {
+      std::coroutine_handle<> waiter = waiter_;
+      waiter_ = nullptr;
+      waiter.resume();
+    }
+  }
+
+  ScanReactor &reactor_;
+  CoLaA &sensor_;
+  size_t max_queue_;
+  std::deque<ScanData> queue_;
+  std::coroutine_handle<> waiter_;
+  bool error_;
+};
+
+#endif // LMS1XX_ENABLE_COROUTINES
+
+#endif // SCAN_STREAM_H
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCAN_TRACKER_H
+#define SCAN_TRACKER_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "lms1xx/colaa_structs.h"
+
+struct ScanTrackerConfig
+{
+  /**
+   * @brief Consecutive beams farther apart than this in m start a new segment
+   */
+  double segment_distance = 0.3;
+  /**
+   * @brief Smallest incidence angle in rad of a surface that still forms one segment
+   * The segment distance grows with range accordingly (adaptive breakpoint detection).
+   */
+  double breakpoint_angle = 0.17;
+  /**
+   * @brief Segments with fewer beams are ignored
+   */
+  size_t min_points = 3;
+  /**
+   * @brief Segments wider than this in m (walls, shelves) are ignored
+   */
+  double max_width = 1.5;
+  double min_range = 0.1;
+  double max_range = 30.0;
+  /**
+   * @brief Maximum distance in m between a predicted track and a segment to associate them
+   */
+  double gate = 0.8;
+  /**
+   * @brief Alpha-beta filter gains for position and velocity
+   */
+  double alpha = 0.6;
+  double beta = 0.2;
+  /**
+   * @brief Tracks are dropped after this many scans without a segment
+   */
+  uint32_t max_missed = 5;
+  /**
+   * @brief Tracks are reported once they were seen in this many scans
+   */
+  uint32_t min_hits = 3;
+  /**
+   * @brief Capacity of the segment and track tables, further segments are ignored
+   */
+  size_t max_segments = 128;
+  size_t max_tracks = 64;
+};
+
+struct Track
+{
+  uint32_t id;
+  float x;
+  float y;
+  float vx;
+  float vy;
+  /**
+   * @brief Distance between the first and last beam of the latest segment in m
+   */
+  float width;
+  uint32_t hits;
+  uint32_t missed;
+  bool active;
+};
+
+/**
+ * @brief Segments scans into clusters and tracks them across scans
+ *
+ * Segmentation is a single pass over the beams. Segments are associated to tracks
+ * by gated nearest neighbour against the constant velocity prediction, and tracks
+ * are updated with an alpha-beta filter. Segment and track tables have a fixed
+ * capacity allocated in the constructor.
+ */
+class ScanTracker
+{
+public:
+  explicit ScanTracker(const ScanTrackerConfig &config = ScanTrackerConfig());
+
+  /**
+   * @brief Process a scan
+   * @param data parsed scan, echo selects the 16 bit channel
+   * @param stamp time of the scan in s, used for prediction and velocity
+   * @return number of confirmed tracks
+   */
+  size_t update(const ScanData &data, double stamp, size_t echo = 0);
+
+  /**
+   * @brief Track table, only entries that are active with at least min_hits are confirmed
+   */
+  const std::vector<Track> &tracks() const;
+
+  bool isConfirmed(const Track &track) const;
+
+  /**
+   * @brief Number of segments found in the latest scan
+   */
+  size_t segmentCount() const;
+
+  void reset();
+
+private:
+  struct Segment
+  {
+    float sum_x;
+    float sum_y;
+    float first_x;
+    float first_y;
+    float last_x;
+    float last_y;
+    uint32_t count;
+    bool taken;
+  };
+
+  void segment(const ScanData &data, size_t echo);
+  void closeSegment(Segment &current);
+  void associate(float dt);
+
+  ScanTrackerConfig config_;
+  std::vector<Segment> segments_;
+  size_t segment_count_;
+  std::vector<Track> tracks_;
+  std::vector<float> cos_table_;
+  std::vector<float> sin_table_;
+  int32_t table_start_angle_;
+  uint16_t table_step_;
+  float breakpoint_factor_;
+  uint32_t next_id_;
+  double last_stamp_;
+  bool has_stamp_;
+};
+
+#endif // SCAN_TRACKER_H
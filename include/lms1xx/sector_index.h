@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SECTOR_INDEX_H
+#define SECTOR_INDEX_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "lms1xx/colaa_structs.h"
+
+struct SectorMin
+{
+  /**
+   * @brief Closest valid range in m, infinity if the sector has no valid beam
+   */
+  float range;
+  /**
+   * @brief Angle of that beam in the ROS convention (0 straight ahead), radians
+   */
+  float angle;
+  /**
+   * @brief Index of that beam, the first one on ties, -1 if there is none
+   */
+  int32_t beam;
+};
+
+/**
+ * @brief Minimum range of any sector of one scan in constant time
+ *
+ * Every beam is keyed as range << 16 | beam, so the minimum key is the closest beam and the
+ * first one on ties. Beams are grouped in blocks of 16 with the minimum up to and from every
+ * beam within its block, and a sparse table holds the minimum of every power of two run of
+ * blocks. A sector spanning several blocks is then answered from at most four lookups, one
+ * within a block by scanning at most 16 beams. Building is linear in the number of beams as
+ * the sparse table only covers the blocks. Invalid beams (ScanData::valid) are never the
+ * minimum.
+ *
+ * Reuse one instance across scans, it does not allocate once sized for the scanner.
+ */
+class SectorIndex
+{
+public:
+  SectorIndex();
+
+  /**
+   * @brief Index one echo of a scan, the scan is not referenced afterwards
+   */
+  void build(const ScanData &data, size_t echo = 0);
+
+  /**
+   * @brief Closest beam in [first, last], clamped to the scan
+   */
+  SectorMin query(size_t first, size_t last) const;
+
+  /**
+   * @brief Closest beam with an angle in [angle_min, angle_max], radians (0 straight ahead)
+   */
+  SectorMin queryAngles(double angle_min, double angle_max) const;
+
+  /**
+   * @brief Number of beams indexed
+   */
+  size_t size() const
+  {
+    return keys_.size();
+  }
+
+  /**
+   * @brief Telegram counter of the indexed scan
+   */
+  uint16_t telegramCounter() const
+  {
+    return telegram_counter_;
+  }
+
+  static const size_t BLOCK = 16;
+
+private:
+  SectorMin decode(uint32_t key) const;
+
+  std::vector<uint32_t> keys_;
+  /**
+   * @brief Minimum from the start of the beam's block to the beam and from the beam to the block end
+   */
+  std::vector<uint32_t> prefix_;
+  std::vector<uint32_t> suffix_;
+  /**
+   * @brief Level k holds the minimum of the 2^k blocks starting at each block, levels stored back to back
+   */
+  std::vector<uint32_t> table_;
+  size_t blocks_;
+  float unit_;
+  double angle_min_;
+  double angle_increment_;
+  uint16_t telegram_counter_;
+};
+
+#endif // SECTOR_INDEX_H
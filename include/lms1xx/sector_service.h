@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SECTOR_SERVICE_H
+#define SECTOR_SERVICE_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <lms1xx/sector_index.h>
+#include <lms1xx/SectorQuery.h>
+#include <ros/callback_queue.h>
+#include <ros/ros.h>
+
+/**
+ * @brief Answers lms1xx/SectorQuery for the latest scan
+ *
+ * The service has its own callback queue and spinner thread, so queries are answered while the
+ * acquisition loop waits for the next telegram. Every scan is indexed into a spare buffer that is
+ * then swapped in. The service thread holds the lock only to mark the latest index as being queried
+ * and to release it again, so a buffer is never rebuilt while a query reads it.
+ */
+class SectorService
+{
+public:
+  /**
+   * @param name service name relative to nh
+   * @param echo 16 bit channel indexed
+   */
+  SectorService(ros::NodeHandle &nh, const std::string &name, size_t echo = 0);
+  ~SectorService();
+
+  /**
+   * @brief Index a scan and make it the one queries are answered from, called by the acquisition thread
+   */
+  void update(const ScanData &data, const ros::Time &stamp);
+
+private:
+  struct Indexed
+  {
+    SectorIndex index;
+    ros::Time stamp;
+    /**
+     * @brief Queries reading the index, guarded by mutex_
+     */
+    int readers = 0;
+  };
+
+  bool query(lms1xx::SectorQuery::Request &request, lms1xx::SectorQuery::Response &response);
+
+  size_t echo_;
+  ros::CallbackQueue queue_;
+  ros::ServiceServer server_;
+  ros::AsyncSpinner spinner_;
+  std::mutex mutex_;
+  /**
+   * @brief The latest index, one being queried and one to build the next scan into, only the
+   *        acquisition thread adds buffers
+   */
+  std::vector<std::unique_ptr<Indexed> > buffers_;
+  /**
+   * @brief Index queries are answered from, NULL before the first scan, guarded by mutex_
+   */
+  Indexed *latest_;
+};
+
+#endif // SECTOR_SERVICE_H
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LMS1XX_TRACING_H
+#define LMS1XX_TRACING_H
+
+/*
+ * USDT static tracepoints of the acquisition and conversion path.
+ *
+ * All probes live in the "lms1xx" provider. When LMS1XX_USDT is defined (set by
+ * CMake if sys/sdt.h is available) every probe compiles to a single nop, which
+ * tools like bpftrace or perf patch at runtime when attached:
+ *
+ *   bpftrace -e 'usdt:./LMS5xx_node:lms1xx:parse_end { @[arg0] = count(); }'
+ *
+ * Probes and arguments, all keyed on the scanner's serial number. The probes before
+ * parsing use the serial number of the previous telegram, 0 for the first one:
+ *   telegram_start    (serial number, bytes read)
+ *   telegram_framed   (serial number, telegram size)
+ *   parse_begin       (serial number, telegram size)
+ *   parse_end         (serial number, telegram counter, success)
+ *   conversion_begin  (serial number, telegram counter, beam count)
+ *   conversion_end    (serial number, telegram counter, beam count)
+ *   publish           (serial number, telegram counter, message size)
+ */
+
+#ifdef LMS1XX_USDT
+#include <sys/sdt.h>
+#define LMS1XX_TRACE2(probe, a, b) DTRACE_PROBE2(lms1xx, probe, a, b)
+#define LMS1XX_TRACE3(probe, a, b, c) DTRACE_PROBE3(lms1xx, probe, a, b, c)
+#else
+#define LMS1XX_TRACE2(probe, a, b) do {} while (0)
+#define LMS1XX_TRACE3(probe, a, b, c) do {} while (0)
+#endif
+
+#endif // LMS1XX_TRACING_H
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lms1xx/background_model.h"
+
+#include "lms1xx/colaa_log.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+BackgroundModel::BackgroundModel(const BackgroundModelConfig &config) : config_(config), scans_(0)
+{
+}
+
+void BackgroundModel::reset()
+{
+  echoes_.clear();
+  regions_.clear();
+  scans_ = 0;
+}
+
+bool BackgroundModel::learning() const
+{
+  return scans_ < config_.learn_scans;
+}
+
+const std::vector<float> &BackgroundModel::mean(size_t echo) const
+{
+  return echoes_[echo].mean;
+}
+
+const std::vector<ChangedRegion> &BackgroundModel::update(const ScanData &data)
+{
+  regions_.clear();
+  size_t echoes = data.echoCount();
+  if (echoes == 0)
+    return regions_;
+
+  bool geometry_changed = echoes_.size() != echoes;
+  for (size_t e = 0; !geometry_changed && e < echoes_.size(); ++e)
+    geometry_changed = echoes_[e].mean.size() != data.ch16bit[e].data.size();
+  if (geometry_changed)
+  {
+    if (!echoes_.empty())
+      logWarn("Scan layout changed, learning a new background");
+    echoes_.resize(echoes);
+    size_t max_regions = 0;
+    for (size_t e = 0; e < echoes_.size(); ++e)
+    {
+      size_t count = data.ch16bit[e].data.size();
+      echoes_[e].mean.assign(count, 0);
+      echoes_[e].variance.assign(count, 0);
+      echoes_[e].changed.assign(count, 0);
+      max_regions += count / 2 + 1;
+    }
+    regions_.reserve(max_regions);
+    scans_ = 0;
+  }
+
+  bool learn = learning();
+  // While learning all beams are averaged with equal weight
+  float rate = learn ? 1.0f / (scans_ + 1) : config_.learning_rate;
+  float changed_rate = learn ? rate : config_.foreground_rate;
+  for (size_t e = 0; e < echoes_.size(); ++e)
+  {
+    const ChannelData<uint16_t> &channel = data.ch16bit[e];
+    Echo &echo = echoes_[e];
+    float min_delta = config_.min_delta / (0.001f * channel.header.scale_factor);
+    updateBeams(channel.data.data(), echo.mean.data(), echo.variance.data(), echo.changed.data(),
+                channel.data.size(), rate, changed_rate, config_.sigma, min_delta);
+    if (!learn)
+      findRegions(e);
+  }
+  ++scans_;
+  return regions_;
+}
+
+void BackgroundModel::findRegions(uint8_t echo)
+{
+  const std::vector<uint8_t> &changed = echoes_[echo].changed;
+  size_t count = changed.size();
+  size_t i = 0;
+  while (i < count)
+  {
+    if (!changed[i])
+    {
+      ++i;
+      continue;
+    }
+    size_t first = i;
+    size_t last = i;
+    size_t beams = 0;
+    // Extend while the next changed beam is within merge_gap
+    while (i < count && i <= last + config_.merge_gap + 1)
+    {
+      if (changed[i])
+      {
+        last = i;
+        ++beams;
+      }
+      ++i;
+    }
+    if (beams >= config_.min_region_beams)
+    {
+      ChangedRegion region = { echo, static_cast<uint16_t>(first), static_cast<uint16_t>(last) };
+      regions_.push_back(region);
+    }
+  }
+}
+
+void BackgroundModel::updateBeams(const uint16_t *ranges, float *mean, float *variance, uint8_t *changed,
+                                  size_t count, float rate, float changed_rate, float sigma, float min_delta)
+{
+  float sigma2 = sigma * sigma;
+  float min_delta2 = min_delta * min_delta;
+  size_t i = 0;
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 v_sigma2 = _mm_set1_ps(sigma2);
+  const __m128 v_min_delta2 = _mm_set1_ps(min_delta2);
+  const __m128 v_rate = _mm_set1_ps(rate);
+  const __m128 v_changed_rate = _mm_set1_ps(changed_rate);
+  for (; i + 8 <= count; i += 8)
+  {
+    __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ranges + i));
+    // No echo counts as maximum range
+    r = _mm_or_si128(r, _mm_cmpeq_epi16(r, zero));
+    __m128 x[2] = { _mm_cvtepi32_ps(_mm_unpacklo_epi16(r, zero)), _mm_cvtepi32_ps(_mm_unpackhi_epi16(r, zero)) };
+    __m128 flags[2];
+    for (int h = 0; h < 2; ++h)
+    {
+      __m128 m = _mm_loadu_ps(mean + i + 4 * h);
+      __m128 v = _mm_loadu_ps(variance + i + 4 * h);
+      __m128 d = _mm_sub_ps(x[h], m);
+      __m128 d2 = _mm_mul_ps(d, d);
+      flags[h] = _mm_cmpgt_ps(d2, _mm_add_ps(_mm_mul_ps(v_sigma2, v), v_min_delta2));
+      __m128 a = _mm_or_ps(_mm_and_ps(flags[h], v_changed_rate), _mm_andnot_ps(flags[h], v_rate));
+      _mm_storeu_ps(mean + i + 4 * h, _mm_add_ps(m, _mm_mul_ps(a, d)));
+      _mm_storeu_ps(variance + i + 4 * h, _mm_mul_ps(_mm_sub_ps(one, a), _mm_add_ps(v, _mm_mul_ps(a, d2))));
+    }
+    __m128i packed = _mm_packs_epi32(_mm_castps_si128(flags[0]), _mm_castps_si128(flags[1]));
+    packed = _mm_and_si128(_mm_packs_epi16(packed, zero), _mm_set1_epi8(1));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(changed + i), packed);
+  }
+#endif
+  for (; i < count; ++i)
+  {
+    float x = ranges[i] ? ranges[i] : 65535.0f;
+    float d = x - mean[i];
+    float d2 = d * d;
+    bool is_changed = d2 > sigma2 * variance[i] + min_delta2;
+    float a = is_changed ? changed_rate : rate;
+    mean[i] += a * d;
+    variance[i] = (1.0f - a) * (variance[i] + a * d2);
+    changed[i] = is_changed;
+  }
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lms1xx/colaa_structs.h"
+
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+size_t BeamMask::count() const
+{
+  size_t valid = 0;
+  for (size_t w = 0; w < bits.size(); ++w)
+    valid += __builtin_popcountll(bits[w]);
+  return valid;
+}
+
+void BeamMask::compute(const ChannelData<uint16_t> &ranges, const ChannelData<uint8_t> *rssi,
+                       const BeamLimits &limits)
+{
+  size_t count = ranges.data.size();
+  bits.assign((count + 63) / 64, 0);
+  double unit = 0.001 * ranges.header.scale_factor;
+  double min_raw = unit > 0 ? std::ceil(limits.min_range / unit) : 1.0;
+  double max_raw = unit > 0 ? std::floor(limits.max_range / unit) : 65535.0;
+  bool with_rssi = rssi && rssi->data.size() == count && limits.min_rssi > 0;
+  computeBits(ranges.data.data(), with_rssi ? rssi->data.data() : NULL, count,
+              static_cast<uint16_t>(std::max(1.0, std::min(65535.0, min_raw))),
+              static_cast<uint16_t>(std::max(0.0, std::min(65535.0, max_raw))), limits.min_rssi, bits.data());
+}
+
+void BeamMask::applyRemissionLimit(const ChannelData<uint16_t> &remission, uint16_t min_remission)
+{
+  size_t count = std::min(remission.data.size(), bits.size() * 64);
+  for (size_t i = 0; i < count; ++i)
+  {
+    if (remission.data[i] < min_remission)
+      bits[i >> 6] &= ~(uint64_t(1) << (i & 63));
+  }
+}
+
+void BeamMask::computeBits(const uint16_t *ranges, const uint8_t *rssi, size_t count, uint16_t min_raw,
+                           uint16_t max_raw, uint8_t min_rssi, uint64_t *bits)
+{
+  size_t i = 0;
+#ifdef __SSE2__
+  // Unsigned compares via saturating subtraction: r >= min <=> min -| r == 0, r <= max <=> r -| max == 0
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i v_min = _mm_set1_epi16(static_cast<int16_t>(min_raw));
+  const __m128i v_max = _mm_set1_epi16(static_cast<int16_t>(max_raw));
+  const __m128i v_rssi = _mm_set1_epi8(static_cast<char>(min_rssi));
+  // Eight beams per step never straddle a word
+  for (; i + 8 <= count; i += 8)
+  {
+    __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ranges + i));
+    __m128i above = _mm_cmpeq_epi16(_mm_subs_epu16(v_min, r), zero);
+    __m128i below = _mm_cmpeq_epi16(_mm_subs_epu16(r, v_max), zero);
+    __m128i valid = _mm_packs_epi16(_mm_and_si128(above, below), zero);
+    if (rssi)
+    {
+      __m128i q = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(rssi + i));
+      valid = _mm_and_si128(valid, _mm_cmpeq_epi8(_mm_subs_epu8(v_rssi, q), zero));
+    }
+    bits[i >> 6] |= static_cast<uint64_t>(_mm_movemask_epi8(valid) & 0xff) << (i & 63);
+  }
+#endif
+  for (; i < count; ++i)
+  {
+    if (ranges[i] >= min_raw && ranges[i] <= max_raw && (!rssi || rssi[i] >= min_rssi))
+      bits[i >> 6] |= uint64_t(1) << (i & 63);
+  }
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lms1xx/capture_file.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+#include "lms1xx/lms_buffer.h"
+
+CaptureFile::Reader::Reader() : raw_(false)
+{
+}
+
+bool CaptureFile::Reader::open(const std::string &path)
+{
+  stream_.open(path.c_str(), std::ios::binary);
+  if (!stream_)
+    return false;
+  char magic[sizeof(MAGIC)];
+  stream_.read(magic, sizeof(magic));
+  raw_ = !stream_ || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0;
+  if (raw_)
+  {
+    stream_.clear();
+    stream_.seekg(0);
+  }
+  return true;
+}
+
+bool CaptureFile::Reader::next(Record &record)
+{
+  if (raw_)
+  {
+    record.stamp_ns = 0;
+    record.data.clear();
+    // Skip anything up to the next STX, then collect up to and including ETX
+    int c;
+    while ((c = stream_.get()) != EOF && c != LMS_STX)
+    {
+    }
+    if (c == EOF)
+      return false;
+    record.data.push_back(LMS_STX);
+    while ((c = stream_.get()) != EOF)
+    {
+      record.data.push_back(static_cast<char>(c));
+      if (c == LMS_ETX)
+        return true;
+    }
+    return false;
+  }
+
+  uint32_t length = 0;
+  stream_.read(reinterpret_cast<char *>(&record.stamp_ns), sizeof(record.stamp_ns));
+  stream_.read(reinterpret_cast<char *>(&length), sizeof(length));
+  if (!stream_ || length > MAX_RECORD_SIZE)
+    return false;
+  record.data.resize(length);
+  stream_.read(record.data.data(), length);
+  return static_cast<bool>(stream_);
+}
+
+bool CaptureFile::Writer::open(const std::string &path)
+{
+  stream_.open(path.c_str(), std::ios::binary | std::ios::trunc);
+  if (!stream_)
+    return false;
+  stream_.write(MAGIC, sizeof(MAGIC));
+  return static_cast<bool>(stream_);
+}
+
+bool CaptureFile::Writer::write(int64_t stamp_ns, const char *data, uint32_t length)
+{
+  if (length > MAX_RECORD_SIZE)
+    return false;
+  stream_.write(reinterpret_cast<const char *>(&stamp_ns), sizeof(stamp_ns));
+  stream_.write(reinterpret_cast<const char *>(&length), sizeof(length));
+  stream_.write(data, length);
+  return static_cast<bool>(stream_);
+}
+
+void CaptureFile::Writer::close()
+{
+  stream_.close();
+}
+
+std::vector<std::vector<char> > CaptureFile::loadTelegrams(const std::string &path)
+{
+  std::vector<std::vector<char> > telegrams;
+  Reader reader;
+  if (!reader.open(path))
+    return telegrams;
+
+  // Records may split or combine telegrams, so reframe the concatenated stream
+  std::vector<char> stream;
+  Record record;
+  while (reader.next(record))
+    stream.insert(stream.end(), record.data.begin(), record.data.end());
+
+  std::vector<char>::iterator pos = stream.begin();
+  while (true)
+  {
+    std::vector<char>::iterator stx = std::find(pos, stream.end(), LMS_STX);
+    std::vector<char>::iterator etx = std::find(stx, stream.end(), LMS_ETX);
+    if (etx == stream.end())
+      break;
+    std::vector<char> telegram(stx, etx);
+    telegram.push_back(0);
+    telegrams.push_back(telegram);
+    pos = etx + 1;
+  }
+  return telegrams;
+}
@@ -18,22 +18,59 @@
 #include "lms1xx/colaa.h"
 
 #include <iostream>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <netinet/in.h> // sockaddr
 #include <arpa/inet.h> // inet_pton
-#include <console_bridge/console.h>
+#include "lms1xx/colaa_log.h"
 #include <sstream>
 #include <iomanip>
 #include <inttypes.h>
-
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#ifdef __linux__
+#include <linux/sockios.h> // SIOCINQ
+#else
+#define SIOCINQ FIONREAD
+#endif
+
+#include "lms1xx/flight_recorder.h"
 #include "lms1xx/lms_buffer.h"
 #include "lms1xx/parse_helpers.h"
+#include "lms1xx/tracing.h"
 
 constexpr uint8_t STX = 0x02; //Start transmission marker
 constexpr uint8_t ETX = 0x03; //End transmission marker
 constexpr size_t DEF_BUF_LEN = 128; // Default buffer size
 
-CoLaA::CoLaA() : connected_(false)
+/**
+ * @brief Field of a sysctl file such as /proc/sys/net/ipv4/tcp_rmem, 0 if it cannot be read
+ */
+static int readSysctl(const char *path, int field = 0)
+{
+  std::ifstream file(path);
+  long value = 0;
+  for (int i = 0; i <= field; ++i)
+  {
+    if (!(file >> value))
+      return 0;
+  }
+  return static_cast<int>(std::min<long>(value, 0x7fffffff));
+}
+
+const uint32_t AtomicHistogram::BOUNDS_US[AtomicHistogram::BUCKETS - 1] =
+{
+  50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000
+};
+
+CoLaA::CoLaA() : connected_(false), recorder_(NULL), socket_fd_(-1), serial_number_(0), ever_connected_(false),
+  last_telegram_counter_(-1), telegram_size_(0), receive_buffer_size_(0), reply_timeout_(0), reply_timed_out_(false),
+  backlog_scans_(2.0), backlog_duration_(1.0),
+  backlog_since_ns_(0), backlog_reported_(false)
 {
   buffer_ = new LMSBuffer();
   LOGIN_COMMAND = "sMN SetAccessMode";
@@ -46,6 +83,7 @@ CoLaA::CoLaA() : connected_(false)
 
   READ_SCAN_CFG_COMMAND = "sRN LMPscancfg";
   SET_SCAN_CFG_COMMAND = "sMN mLMPsetscancfg";
+  READ_SCAN_DATA_CFG_COMMAND = "sRN LMDscandatacfg";
   SET_SCAN_DATA_CFG_COMMAND = "sWN LMDscandatacfg";
   SET_ECHO_FILTER_COMMAND = "sWN FREchoFilter";
   SET_PARTICLE_FILTER_COMMAND = "sWN LFPparticle";
@@ -66,6 +104,7 @@ CoLaA::CoLaA() : connected_(false)
   READ_DEVICE_STATE = "sRN SCdevicestate";
 
   SCAN_DATA_REPLY = "sEA LMDscandata";
+  SCAN_DATA_TELEGRAM = "sSN LMDscandata ";
 }
 
 CoLaA::~CoLaA()
@@ -79,8 +118,22 @@ void CoLaA::connect(std::string host, int port)
   {
     logDebug("Creating non-blocking socket.");
     socket_fd_ = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
-    if (socket_fd_)
+    if (socket_fd_ >= 0)
     {
+      // Before connecting, the window scale is negotiated for this size
+      if (receive_buffer_size_ > 0)
+        setsockopt(socket_fd_, SOL_SOCKET, SO_RCVBUF, &receive_buffer_size_, sizeof(receive_buffer_size_));
+      if (reply_timeout_ > 0)
+      {
+        // SO_SNDTIMEO also bounds connect()
+        struct timeval tv;
+        tv.tv_sec = static_cast<time_t>(reply_timeout_);
+        tv.tv_usec = static_cast<suseconds_t>((reply_timeout_ - tv.tv_sec) * 1e6);
+        setsockopt(socket_fd_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(socket_fd_, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+      }
+      reply_timed_out_ = false;
+
       struct sockaddr_in stSockAddr;
       stSockAddr.sin_family = PF_INET;
       stSockAddr.sin_port = htons(port);
@@ -92,8 +145,17 @@ void CoLaA::connect(std::string host, int port)
       if (ret == 0)
       {
         connected_ = true;
+        if (ever_connected_)
+          statistics_.reconnects.fetch_add(1, std::memory_order_relaxed);
+        ever_connected_ = true;
         logDebug("Connected succeeded.");
       }
+      else
+      {
+        // Don't leak the socket when retrying the connection in a loop
+        close(socket_fd_);
+        socket_fd_ = -1;
+      }
     }
   }
 }
@@ -103,7 +165,14 @@ void CoLaA::disconnect()
   if (connected_)
   {
     close(socket_fd_);
+    socket_fd_ = -1;
     connected_ = false;
+    // Partial telegrams of the old connection must not be framed with new data
+    buffer_->reset();
+    last_telegram_counter_ = -1;
+    backlog_since_ns_ = 0;
+    statistics_.socket_queue_bytes.store(0, std::memory_order_relaxed);
+    statistics_.scans_behind.store(0, std::memory_order_relaxed);
   }
 }
 
@@ -112,13 +181,83 @@ bool CoLaA::isConnected() const
   return connected_;
 }
 
-void CoLaA::login()
+void CoLaA::setFlightRecorder(FlightRecorder *recorder)
+{
+  recorder_ = recorder;
+}
+
+int CoLaA::setReceiveBufferSize(int bytes)
+{
+  // A fixed size turns off receive autotuning, which grows the buffer with the reader's throughput and not
+  // while the reader stalls. Only a fixed size absorbs stalls, at the cost of the net.core.rmem_max cap.
+  receive_buffer_size_ = bytes;
+  if (!connected_)
+    return 0;
+  setsockopt(socket_fd_, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes));
+  int granted = 0;
+  socklen_t len = sizeof(granted);
+  getsockopt(socket_fd_, SOL_SOCKET, SO_RCVBUF, &granted, &len);
+#ifdef __linux__
+  // Linux reports twice the requested size to account for its bookkeeping
+  long long expected = 2LL * bytes;
+#else
+  long long expected = bytes;
+#endif
+  if (granted < expected)
+    logWarn("Receive buffer limited to %d bytes instead of %lld and no longer autotuned (up to %d bytes), "
+            "consider raising net.core.rmem_max", granted, expected, readSysctl("/proc/sys/net/ipv4/tcp_rmem", 2));
+  else
+    logDebug("Receive buffer size is %d bytes.", granted);
+  return granted;
+}
+
+int CoLaA::estimateReceiveBuffer(size_t beams, size_t echoes, double telegram_rate, double seconds)
+{
+  // Hex encoded values with separator, up to 5 characters per distance and 3 per remission,
+  // plus header and channel descriptions
+  size_t telegram = beams * echoes * (5 + 3) + 1024;
+  double telegrams = std::max(telegram_rate * seconds, 2.0);
+  return static_cast<int>(telegram * telegrams);
+}
+
+void CoLaA::setBacklogWarning(double scans_behind, double duration)
+{
+  backlog_scans_ = scans_behind;
+  backlog_duration_ = duration;
+}
+
+void CoLaA::setBeamLimits(const BeamLimits &limits)
+{
+  beam_limits_ = limits;
+}
+
+void CoLaA::setReplyTimeout(double seconds)
+{
+  reply_timeout_ = std::max(seconds, 0.0);
+}
+
+bool CoLaA::replyTimedOut() const
+{
+  return reply_timed_out_;
+}
+
+uint32_t CoLaA::getSerialNumber() const
+{
+  return serial_number_;
+}
+
+const CoLaAStatistics &CoLaA::getStatistics() const
+{
+  return statistics_;
+}
+
+bool CoLaA::login(int attempts)
 {
   fd_set readset;
   struct timeval timeout;
   ssize_t result = -1;
 
-  do   //loop until data is available to read
+  for (int attempt = 0; result <= 0 && (attempts <= 0 || attempt < attempts); ++attempt)
   {
     timeout.tv_sec = 1;
     timeout.tv_usec = 0;
@@ -128,11 +267,16 @@ void CoLaA::login()
     FD_ZERO(&readset);
     FD_SET(socket_fd_, &readset);
     result = select(socket_fd_ + 1, &readset, NULL, NULL, &timeout);
-
   }
-  while (result <= 0);
+  if (result <= 0)
+  {
+    logWarn("No reply to login after %d attempts", attempts);
+    reply_timed_out_ = true;
+    return false;
+  }
 
   readBack();
+  return true;
 }
 
 void CoLaA::startDevice()
@@ -172,7 +316,7 @@ void CoLaA::setScanDataConfig(const ScanDataConfig &cfg)
 void CoLaA::setEchoFilter(CoLaAEchoFilter::EchoFilter filter)
 {
   std::stringstream cmd;
-  cmd << SET_ECHO_FILTER_COMMAND << " " << filter;
+  cmd << SET_ECHO_FILTER_COMMAND << " " << static_cast<int>(filter);
   sendCommand(cmd.str());
   readBack();
 }
@@ -203,6 +347,38 @@ ScanConfig CoLaA::getScanConfig()
   return parseScanCfg(buf, len);
 }
 
+bool CoLaA::getScanDataConfig(ScanDataConfig &cfg)
+{
+  sendCommand(READ_SCAN_DATA_CFG_COMMAND);
+  char buf[DEF_BUF_LEN];
+  size_t len = (sizeof buf);
+  if (!readBack(buf, len))
+    return false;
+
+  // Same layout as buildScanDataCfg(), the output interval is signed and therefore decimal
+  char *parsable = &buf[0];
+  uint8_t output_channel, remission, resolution, encoder, position, device_name, comment, timestamp;
+  std::string output_interval;
+  if (!nextToken(&parsable) || !nextToken(&parsable) ||
+      !nextToken(&parsable, output_channel) || !nextToken(&parsable) ||
+      !nextToken(&parsable, remission) || !nextToken(&parsable, resolution) || !nextToken(&parsable) ||
+      !nextToken(&parsable, encoder) || !nextToken(&parsable) ||
+      !nextToken(&parsable, position) || !nextToken(&parsable, device_name) ||
+      !nextToken(&parsable, comment) || !nextToken(&parsable, timestamp) ||
+      !nextToken(&parsable, output_interval))
+    return false;
+  cfg.output_channel = output_channel;
+  cfg.remission = remission != 0;
+  cfg.resolution = resolution;
+  cfg.encoder = encoder;
+  cfg.position = position != 0;
+  cfg.device_name = device_name != 0;
+  cfg.comment = comment != 0;
+  cfg.timestamp = timestamp != 0;
+  cfg.output_interval = atoi(output_interval.c_str());
+  return true;
+}
+
 void CoLaA::saveConfig()
 {
   sendCommand(SAVE_CONFIG_COMMAND);
@@ -248,6 +424,8 @@ void CoLaA::scanContinuous(bool start)
   std::string command = REQUEST_SCANS_CONTINUOUSLY + " " + std::to_string(static_cast<int>(start));
   sendCommand(command);
   readBack();
+  // The reply may have been read along with part of a scan telegram, resynchronising afterwards is expected
+  last_telegram_counter_ = -1;
 }
 
 void CoLaA::requestLastScan()
@@ -257,49 +435,244 @@ void CoLaA::requestLastScan()
 }
 
 bool CoLaA::getScanData(void *scan_data)
+{
+  // A previous read may have received more than one telegram
+  bool buffered = true;
+  while (buffered)
+  {
+    if (parseNextBuffered(scan_data, buffered))
+      return true;
+  }
+
+  while (waitForData())
+  {
+    bool found = true;
+    while (found)
+    {
+      if (parseNextBuffered(scan_data, found))
+        return true;
+    }
+  }
+  return false;
+}
+
+bool CoLaA::getTelegram(std::vector<uint8_t> &telegram)
+{
+  bool buffered = true;
+  while (buffered)
+  {
+    if (popNextBuffered(telegram, buffered))
+      return true;
+  }
+
+  while (waitForData())
+  {
+    bool found = true;
+    while (found)
+    {
+      if (popNextBuffered(telegram, found))
+        return true;
+    }
+  }
+  return false;
+}
+
+bool CoLaA::waitForData()
 {
   fd_set rfds;
   FD_ZERO(&rfds);
   FD_SET(socket_fd_, &rfds);
 
-  // Block a total of up to 100ms waiting for more data from the laser.
-  while (1)
+  // Block up to 100ms waiting for more data from the laser.
+  // Would be great to depend on linux's behaviour of updating the timeval, but unfortunately
+  // that's non-POSIX (doesn't work on OS X, for example).
+  struct timeval tv;
+  tv.tv_sec = 0;
+  tv.tv_usec = 100000;
+
+  logDebug("entering select()", tv.tv_usec);
+  int retval = select(socket_fd_ + 1, &rfds, NULL, NULL, &tv);
+  logDebug("returned %d from select()", retval);
+  if (!retval)
   {
-    // Would be great to depend on linux's behaviour of updating the timeval, but unfortunately
-    // that's non-POSIX (doesn't work on OS X, for example).
-    struct timeval tv;
-    tv.tv_sec = 0;
-    tv.tv_usec = 100000;
-
-    logDebug("entering select()", tv.tv_usec);
-    int retval = select(socket_fd_ + 1, &rfds, NULL, NULL, &tv);
-    logDebug("returned %d from select()", retval);
-    if (retval)
-    {
-      buffer_->readFrom(socket_fd_);
+    // Select timed out
+    statistics_.timeouts.fetch_add(1, std::memory_order_relaxed);
+    if (recorder_)
+      recorder_->trigger(FlightRecorderTrigger::Timeout);
+    return false;
+  }
 
-      // Will return pointer if a complete message exists in the buffer,
-      // otherwise will return null.
-      char* buffer_data = buffer_->getNextBuffer();
+  bool idle = buffer_->size() == 0;
+  received(buffer_->readFrom(socket_fd_), idle);
+  return true;
+}
 
-      if (buffer_data)
-      {
-        bool success = parseScanData(buffer_data, scan_data);
-        buffer_->popLastBuffer();
-        if (success)
-          return true;
-        else
-          continue;
-      }
+bool CoLaA::getScanData(ScanData &scan_data)
+{
+  return getScanData(static_cast<void *>(&scan_data));
+}
+
+CoLaAReadResult::Result CoLaA::tryGetScanData(void *scan_data)
+{
+  if (!connected_)
+    return CoLaAReadResult::Disconnected;
+  while (true)
+  {
+    bool found = false;
+    if (parseNextBuffered(scan_data, found))
+      return CoLaAReadResult::Scan;
+    if (found)
+      continue;
+
+    bool idle = buffer_->size() == 0;
+    int bytes = buffer_->receiveFrom(socket_fd_);
+    bool would_block = bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    received(bytes, idle);
+    if (would_block)
+    {
+      return CoLaAReadResult::WouldBlock;
     }
-    else
+    else if (bytes <= 0)
     {
-      // Select timed out or there was an fd error.
-      return false;
+      return CoLaAReadResult::Disconnected;
     }
   }
 }
 
+void CoLaA::received(int bytes, bool idle)
+{
+  if (bytes <= 0)
+    return;
+  statistics_.bytes_received.fetch_add(bytes, std::memory_order_relaxed);
+  if (idle)
+    LMS1XX_TRACE2(telegram_start, serial_number_, bytes);
+  sampleSocketQueue();
+  if (recorder_)
+  {
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::system_clock::now().time_since_epoch()).count();
+    recorder_->record(buffer_->data() + buffer_->size() - bytes, bytes, now);
+  }
+}
+
+void CoLaA::sampleSocketQueue()
+{
+  int queued = 0;
+  if (ioctl(socket_fd_, SIOCINQ, &queued) != 0)
+    return;
+  double behind = telegram_size_ > 0 ? static_cast<double>(queued) / telegram_size_ : 0;
+  statistics_.socket_queue_bytes.store(queued, std::memory_order_relaxed);
+  statistics_.scans_behind.store(behind, std::memory_order_relaxed);
+
+  if (behind < backlog_scans_ || telegram_size_ == 0)
+  {
+    backlog_since_ns_ = 0;
+    return;
+  }
+  int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  if (backlog_since_ns_ == 0)
+  {
+    backlog_since_ns_ = now;
+    backlog_reported_ = false;
+  }
+  else if (!backlog_reported_ && now - backlog_since_ns_ >= static_cast<int64_t>(backlog_duration_ * 1e9))
+  {
+    backlog_reported_ = true;
+    statistics_.backlogs.fetch_add(1, std::memory_order_relaxed);
+    logWarn("%.1f scans (%d bytes) have been waiting in the socket for more than %.1f s, "
+            "processing does not keep up with the sensor.", behind, queued, backlog_duration_);
+  }
+}
+
+int CoLaA::getSocket() const
+{
+  return connected_ ? socket_fd_ : -1;
+}
+
+char *CoLaA::nextBuffered()
+{
+  // Will return pointer if a complete message exists in the buffer,
+  // otherwise will return null.
+  uint32_t drops = buffer_->getDropCount();
+  char* buffer_data = buffer_->getNextBuffer();
+  if (buffer_->getDropCount() != drops)
+  {
+    statistics_.buffer_resets.fetch_add(buffer_->getDropCount() - drops, std::memory_order_relaxed);
+    // Resynchronising on the first telegram after connecting or starting the stream is expected
+    if (recorder_ && last_telegram_counter_ >= 0)
+      recorder_->trigger(FlightRecorderTrigger::BufferReset);
+  }
+  return buffer_data;
+}
+
+bool CoLaA::popNextBuffered(std::vector<uint8_t> &telegram, bool &found)
+{
+  char *buffer_data = nextBuffered();
+  found = buffer_data != NULL;
+  if (!found)
+    return false;
+
+  size_t telegram_size = buffer_->getLastBufferLength();
+  LMS1XX_TRACE2(telegram_framed, serial_number_, telegram_size);
+  // Command replies are framed here as well, only scan data is passed on
+  bool scan_telegram = strncmp(buffer_data + 1, SCAN_DATA_TELEGRAM.c_str(), SCAN_DATA_TELEGRAM.size()) == 0;
+  if (scan_telegram)
+  {
+    telegram_size_ = telegram_size + 1;
+    telegram.assign(buffer_data, buffer_data + telegram_size);
+    statistics_.telegrams.fetch_add(1, std::memory_order_relaxed);
+  }
+  buffer_->popLastBuffer();
+  return scan_telegram;
+}
+
+bool CoLaA::parseNextBuffered(void *scan_data, bool &found)
+{
+  char *buffer_data = nextBuffered();
+  found = buffer_data != NULL;
+  if (!found)
+    return false;
+
+  size_t telegram_size = buffer_->getLastBufferLength();
+  LMS1XX_TRACE2(telegram_framed, serial_number_, telegram_size);
+  LMS1XX_TRACE2(parse_begin, serial_number_, telegram_size);
+  std::chrono::steady_clock::time_point parse_start = std::chrono::steady_clock::now();
+  uint64_t gaps = statistics_.telegram_gaps.load(std::memory_order_relaxed);
+  // Command replies are framed here as well, only scan data that fails to parse is a fault
+  bool scan_telegram = strncmp(buffer_data + 1, SCAN_DATA_TELEGRAM.c_str(), SCAN_DATA_TELEGRAM.size()) == 0;
+  bool success = parseScanData(buffer_data, scan_data);
+  statistics_.parse_time.observe(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   std::chrono::steady_clock::now() - parse_start).count());
+  buffer_->popLastBuffer();
+  if (success)
+  {
+    telegram_size_ = telegram_size + 1;
+    statistics_.telegrams.fetch_add(1, std::memory_order_relaxed);
+  }
+  else if (scan_telegram)
+  {
+    statistics_.parse_failures.fetch_add(1, std::memory_order_relaxed);
+  }
+  else
+  {
+    statistics_.non_scan_telegrams.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (recorder_)
+  {
+    if (!success && scan_telegram)
+      recorder_->trigger(FlightRecorderTrigger::ParseFailure);
+    else if (statistics_.telegram_gaps.load(std::memory_order_relaxed) != gaps)
+      recorder_->trigger(FlightRecorderTrigger::TelegramGap);
+  }
+  return success;
+}
+
+bool CoLaA::parseTelegram(char *telegram, void *scan_data) const
+{
+  return parseScanData(telegram, scan_data);
+}
+
 CoLaADeviceState::State CoLaA::getDeviceState()
 {
   sendCommand(READ_DEVICE_STATE);
@@ -391,12 +764,41 @@ bool CoLaA::parseScanData(char *buffer, void *__data) const
   std::string currentCommand = prefix.append(" ").append(command);
   // Check if we captured a late reply for the start measurement command
   if (currentCommand == SCAN_DATA_REPLY)
+  {
+    LMS1XX_TRACE3(parse_end, serial_number_, 0, 0);
     return false;
+  }
 
+  // The header fields are not checked one by one, a truncated header leaves nothing for the encoders
+  const char *end = buffer + strlen(buffer);
   data->header = parseScanDataHeader(&buffer);
-  parseScanDataEncoderdata(&buffer);
-  data->ch16bit = ChannelData<uint16_t>::parseScanDataChannels(&buffer);
-  data->ch8bit = ChannelData<uint8_t>::parseScanDataChannels(&buffer);
+  if (!parseScanDataEncoderdata(&buffer) ||
+      !ChannelData<uint16_t>::parseScanDataChannels(&buffer, end, data->ch16bit) ||
+      !ChannelData<uint8_t>::parseScanDataChannels(&buffer, end, data->ch8bit) ||
+      data->ch16bit.empty() || buffer == end)
+  {
+    // Position, name, comment, time and event flags follow the channels, a complete telegram has them
+    logDebug("Discarding truncated or malformed scan data telegram");
+    LMS1XX_TRACE3(parse_end, serial_number_, 0, 0);
+    return false;
+  }
+  data->valid.resize(data->ch16bit.size());
+  for (size_t e = 0; e < data->ch16bit.size(); ++e)
+    data->valid[e].compute(data->ch16bit[e], e < data->ch8bit.size() ? &data->ch8bit[e] : NULL, beam_limits_);
+  for (size_t e = 0; beam_limits_.min_remission > 0 && data->remission(e); ++e)
+    data->valid[e].applyRemissionLimit(*data->remission(e), beam_limits_.min_remission);
+
+  uint16_t counter = data->header.status_info.telegram_counter;
+  if (last_telegram_counter_ >= 0)
+  {
+    uint16_t missing = counter - static_cast<uint16_t>(last_telegram_counter_) - 1;
+    // Large values are duplicates or the device restarting its counter
+    if (missing > 0 && missing < 0x8000)
+      statistics_.telegram_gaps.fetch_add(missing, std::memory_order_relaxed);
+  }
+  last_telegram_counter_ = counter;
+  serial_number_ = data->header.device.serial_number;
+  LMS1XX_TRACE3(parse_end, serial_number_, data->header.status_info.telegram_counter, 1);
   return true;
 }
 
@@ -426,18 +828,20 @@ ScanDataHeader CoLaA::parseScanDataHeader(char **buf) const
   return header;
 }
 
-void CoLaA::parseScanDataEncoderdata(char **buf) const
+bool CoLaA::parseScanDataEncoderdata(char **buf) const
 {
    uint16_t num_encoders = 0;
-   nextToken(buf, num_encoders);
+   if (!nextToken(buf, num_encoders))
+     return false;
    logDebug("Got %ud encoders", num_encoders);
    for (uint16_t i = 0; i < num_encoders; ++ i)
    {
      uint32_t encoder_position = 0;
      uint16_t encoder_speed = 0;
-     nextToken(buf, encoder_position);
-     nextToken(buf, encoder_speed);
+     if (!nextToken(buf, encoder_position) || !nextToken(buf, encoder_speed))
+       return false;
    }
+   return true;
 }
 
 void CoLaA::sendCommand(const std::string &command) const
@@ -464,8 +868,17 @@ bool CoLaA::readBack(char *buf, size_t &buflen)
     logDebug("No buffer supplied");
     return false;
   }
-  ssize_t len = read(socket_fd_, buf, buflen);
-  bool success = buf[0] == STX;
+  // Leave room for the null terminator
+  ssize_t len = read(socket_fd_, buf, buflen - 1);
+  if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+  {
+    logWarn("Timed out waiting for a reply");
+    reply_timed_out_ = true;
+    buflen = 0;
+    buf[0] = 0;
+    return false;
+  }
+  bool success = len > 0 && buf[0] == STX;
   if ((len == 7 || len == 8) && strncmp(&buf[1], "sFA ", 4) == 0)
   {
     // This is an error message
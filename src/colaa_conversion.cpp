@@ -1,41 +1,140 @@
 #include "lms1xx/colaa_conversion.h"
+#include "lms1xx/tracing.h"
+#include <algorithm>
 #include <ros/ros.h>
 
-void CoLaAConversion::fillMultiEchoLaserScan(sensor_msgs::MultiEchoLaserScan &scan, const ScanData &data)
+/**
+ * @brief Intensities of an echo from its 8 bit channel or, on the LMS1xx, its 16 bit remission channel
+ */
+static void copyIntensities(const ScanData &data, size_t echo, std::vector<float> &out)
 {
-  ROS_ASSERT(scan.ranges.size() ==  data.ch16bit.size());
-  double start_angle = data.ch16bit[0].header.start_angle * M_PI / 180.0 / 10000.0 - M_PI / 2.0;
-  double angle_increment = data.ch16bit[0].header.step_size * M_PI / 180.0 / 10000.0;
+  const ChannelData<uint16_t> *remission = data.remission(echo);
+  if (echo < data.ch8bit.size() && data.ch8bit[echo].data.size() == out.size())
+    std::copy(data.ch8bit[echo].data.begin(), data.ch8bit[echo].data.end(), out.begin());
+  else if (remission && remission->data.size() == out.size())
+    std::copy(remission->data.begin(), remission->data.end(), out.begin());
+  else
+    std::fill(out.begin(), out.end(), 0.0f);
+}
+
+void CoLaAConversion::fillMultiEchoLaserScan(sensor_msgs::MultiEchoLaserScan &scan, DecodedScan &decoded)
+{
+  const ScanData &data = decoded.data();
+  ROS_ASSERT(scan.ranges.size() == decoded.echoCount());
+  LMS1XX_TRACE3(conversion_begin, data.header.device.serial_number, data.header.status_info.telegram_counter,
+                data.ch16bit[0].data.size());
+  double start_angle = decoded.angleMin(0);
+  double angle_increment = decoded.angleIncrement(0);
 
   scan.angle_increment = angle_increment;
   scan.angle_min = start_angle;
   scan.angle_max = start_angle + (data.ch16bit[0].data.size() - 1) * angle_increment;
 
-  for (size_t i = 0; i < data.ch16bit.size(); ++i)
+  for (size_t i = 0; i < decoded.echoCount(); ++i)
   {
     ROS_ASSERT(scan.ranges[i].echoes.size() ==  data.ch16bit[i].data.size());
-    for (size_t k = 0; k < data.ch16bit[i].data.size(); ++k)
-    {
-      scan.ranges[i].echoes[k] = data.ch16bit[i].data[k] * 0.001 * data.ch16bit[i].header.scale_factor;
-      scan.intensities[i].echoes[k] = data.ch8bit[i].data[k];
-    }
+    const std::vector<float> &ranges = decoded.ranges(i);
+    std::copy(ranges.begin(), ranges.end(), scan.ranges[i].echoes.begin());
+    copyIntensities(data, i, scan.intensities[i].echoes);
   }
+  LMS1XX_TRACE3(conversion_end, data.header.device.serial_number, data.header.status_info.telegram_counter,
+                data.ch16bit[0].data.size());
 }
 
-void CoLaAConversion::fillLaserScan(sensor_msgs::LaserScan &scan, const ScanData &data, size_t channel)
+void CoLaAConversion::fillLaserScan(sensor_msgs::LaserScan &scan, DecodedScan &decoded, size_t channel)
 {
+  const ScanData &data = decoded.data();
   ROS_ASSERT(data.ch16bit[channel].data.size() == scan.ranges.size());
+  LMS1XX_TRACE3(conversion_begin, data.header.device.serial_number, data.header.status_info.telegram_counter,
+                scan.ranges.size());
 
-  double start_angle = data.ch16bit[channel].header.start_angle * M_PI / 180.0 / 10000.0 - M_PI / 2.0;
-  double angle_increment = data.ch16bit[channel].header.step_size * M_PI / 180.0 / 10000.0;
+  double start_angle = decoded.angleMin(channel);
+  double angle_increment = decoded.angleIncrement(channel);
 
   scan.angle_increment = angle_increment;
   scan.angle_min = start_angle;
   scan.angle_max = start_angle + (data.ch16bit[0].data.size() - 1) * angle_increment;
-  for (size_t k = 0; k < data.ch16bit[channel].data.size(); ++k)
+  const std::vector<float> &ranges = decoded.ranges(channel);
+  std::copy(ranges.begin(), ranges.end(), scan.ranges.begin());
+  copyIntensities(data, channel, scan.intensities);
+  LMS1XX_TRACE3(conversion_end, data.header.device.serial_number, data.header.status_info.telegram_counter,
+                scan.ranges.size());
+}
+
+void CoLaAConversion::fillOdometry(nav_msgs::Odometry &odom, const Pose2D &pose, const Pose2D &previous, double dt)
+{
+  odom.pose.pose.position.x = pose.x;
+  odom.pose.pose.position.y = pose.y;
+  odom.pose.pose.position.z = 0;
+  odom.pose.pose.orientation.x = 0;
+  odom.pose.pose.orientation.y = 0;
+  odom.pose.pose.orientation.z = sin(pose.theta / 2.0);
+  odom.pose.pose.orientation.w = cos(pose.theta / 2.0);
+
+  if (dt <= 0)
+    return;
+  double dx = pose.x - previous.x;
+  double dy = pose.y - previous.y;
+  double dtheta = atan2(sin(pose.theta - previous.theta), cos(pose.theta - previous.theta));
+  odom.twist.twist.linear.x = (cos(previous.theta) * dx + sin(previous.theta) * dy) / dt;
+  odom.twist.twist.linear.y = (-sin(previous.theta) * dx + cos(previous.theta) * dy) / dt;
+  odom.twist.twist.angular.z = dtheta / dt;
+}
+
+void CoLaAConversion::fillTrackArray(lms1xx::TrackArray &tracks, const ScanTracker &tracker)
+{
+  tracks.tracks.clear();
+  for (size_t i = 0; i < tracker.tracks().size(); ++i)
   {
-    scan.ranges[k] = data.ch16bit[channel].data[k] * 0.001 * data.ch16bit[channel].header.scale_factor;
-    scan.intensities[k] = data.ch8bit[channel].data[k];
+    const Track &track = tracker.tracks()[i];
+    if (!tracker.isConfirmed(track))
+      continue;
+    tracks.tracks.resize(tracks.tracks.size() + 1);
+    lms1xx::Track &msg = tracks.tracks.back();
+    msg.id = track.id;
+    msg.position.x = track.x;
+    msg.position.y = track.y;
+    msg.position.z = 0;
+    msg.velocity.x = track.vx;
+    msg.velocity.y = track.vy;
+    msg.velocity.z = 0;
+    msg.width = track.width;
+    msg.hits = track.hits;
+  }
+}
+
+void CoLaAConversion::fillFieldStatus(lms1xx::FieldStatus &status, const FieldEvaluator &evaluator,
+                                      const std::vector<FieldResult> &results)
+{
+  status.field_set = evaluator.activeFieldSet();
+  status.names.resize(results.size());
+  status.violated.resize(results.size());
+  status.beams.resize(results.size());
+  for (size_t i = 0; i < results.size(); ++i)
+  {
+    // Names only change with the field set
+    if (status.names[i] != evaluator.fields()[i].name)
+      status.names[i] = evaluator.fields()[i].name;
+    status.violated[i] = results[i].violated;
+    status.beams[i] = results[i].beams;
+  }
+}
+
+void CoLaAConversion::fillScanChanges(lms1xx::ScanChanges &changes, const ScanData &data,
+                                      const std::vector<ChangedRegion> &regions)
+{
+  changes.angle_min = data.ch16bit[0].header.start_angle * M_PI / 180.0 / 10000.0 - M_PI / 2.0;
+  changes.angle_increment = data.ch16bit[0].header.step_size * M_PI / 180.0 / 10000.0;
+  changes.regions.resize(regions.size());
+  for (size_t i = 0; i < regions.size(); ++i)
+  {
+    const ChannelData<uint16_t> &channel = data.ch16bit[regions[i].echo];
+    lms1xx::ChangedRegion &region = changes.regions[i];
+    region.echo = regions[i].echo;
+    region.first_beam = regions[i].first_beam;
+    region.ranges.resize(regions[i].last_beam - regions[i].first_beam + 1);
+    for (size_t k = 0; k < region.ranges.size(); ++k)
+      region.ranges[k] = channel.data[region.first_beam + k] * 0.001 * channel.header.scale_factor;
   }
 }
 
@@ -43,31 +142,69 @@ void CoLaAConversion::fillPointCloud2(sensor_msgs::PointCloud2Iterator<float> &i
                                       sensor_msgs::PointCloud2Iterator<float> &iter_y,
                                       sensor_msgs::PointCloud2Iterator<float> &iter_z,
                                       sensor_msgs::PointCloud2Iterator<float> &iter_int,
-                                      const ScanData &data, size_t echo)
+                                      DecodedScan &decoded, size_t echo)
 {
-  float layer_angle = CoLaALayers::getLayerAngle(
-        static_cast<CoLaALayers::Layers>(data.header.status_info.layer_angle));
-  float cosLA = cos(layer_angle);
-  float sinLA = sin(layer_angle);
-  double start_angle = data.ch16bit[echo].header.start_angle * M_PI / 180.0 / 10000.0 - M_PI / 2.0;
-  double angle_increment = data.ch16bit[echo].header.step_size * M_PI / 180.0 / 10000.0;
-
-  for (size_t i = 0; i < data.ch16bit[echo].data.size(); ++i, ++iter_x, ++iter_y, ++iter_z, ++iter_int)
+  const ScanData &data = decoded.data();
+  LMS1XX_TRACE3(conversion_begin, data.header.device.serial_number, data.header.status_info.telegram_counter,
+                data.ch16bit[echo].data.size());
+  const std::vector<float> &ranges = decoded.ranges(echo);
+  const BeamDirections &directions = decoded.directions(echo);
+  const std::vector<uint8_t> &intensities = data.ch8bit[echo].data;
+
+  for (size_t i = 0; i < ranges.size(); ++i, ++iter_x, ++iter_y, ++iter_z, ++iter_int)
   {
-    double dist = data.ch16bit[echo].data[i] * 0.001 * data.ch16bit[echo].header.scale_factor;
-    double angle = start_angle + i * angle_increment;
-    *iter_x = dist * cos(angle) * cosLA;
-    *iter_y = dist * sin(angle) * cosLA;
-    *iter_z = dist * sinLA;
-    *iter_int = data.ch8bit[echo].data[i];
+    float dist = ranges[i];
+    *iter_x = dist * directions.x[i];
+    *iter_y = dist * directions.y[i];
+    *iter_z = dist * directions.z;
+    *iter_int = intensities[i];
   }
+  LMS1XX_TRACE3(conversion_end, data.header.device.serial_number, data.header.status_info.telegram_counter,
+                data.ch16bit[echo].data.size());
 }
 
-void CoLaAConversion::fillPointCloud2MultiEcho(sensor_msgs::PointCloud2Iterator<float> &iter_x, sensor_msgs::PointCloud2Iterator<float> &iter_y, sensor_msgs::PointCloud2Iterator<float> &iter_z, sensor_msgs::PointCloud2Iterator<float> &iter_int, const ScanData &data)
+void CoLaAConversion::fillPointCloud2MultiEcho(sensor_msgs::PointCloud2Iterator<float> &iter_x, sensor_msgs::PointCloud2Iterator<float> &iter_y, sensor_msgs::PointCloud2Iterator<float> &iter_z, sensor_msgs::PointCloud2Iterator<float> &iter_int, DecodedScan &decoded)
 {
-  for (size_t i = 0; i < data.ch16bit.size(); ++i) {
-    fillPointCloud2(iter_x, iter_y, iter_z, iter_int, data, i);
+  for (size_t i = 0; i < decoded.echoCount(); ++i) {
+    fillPointCloud2(iter_x, iter_y, iter_z, iter_int, decoded, i);
+  }
+}
+
+size_t CoLaAConversion::fillPointCloud2Returns(sensor_msgs::PointCloud2Iterator<float> &iter_x,
+                                               sensor_msgs::PointCloud2Iterator<float> &iter_y,
+                                               sensor_msgs::PointCloud2Iterator<float> &iter_z,
+                                               sensor_msgs::PointCloud2Iterator<float> &iter_int,
+                                               DecodedScan &decoded)
+{
+  const ScanData &data = decoded.data();
+  const SparseEchoes &sparse = decoded.sparseEchoes();
+  const BeamDirections &directions = decoded.directions(0);
+  LMS1XX_TRACE3(conversion_begin, data.header.device.serial_number, data.header.status_info.telegram_counter,
+                sparse.returns);
+
+  size_t extra = 0;
+  for (size_t i = 0; i < sparse.counts.size(); ++i)
+  {
+    if (sparse.counts[i] == 0)
+      continue;
+    float dist = sparse.first_ranges[i];
+    *iter_x = dist * directions.x[i];
+    *iter_y = dist * directions.y[i];
+    *iter_z = dist * directions.z;
+    *iter_int = sparse.first_intensities[i];
+    ++iter_x, ++iter_y, ++iter_z, ++iter_int;
+    for (uint8_t r = 1; r < sparse.counts[i]; ++r, ++extra, ++iter_x, ++iter_y, ++iter_z, ++iter_int)
+    {
+      dist = sparse.extra_ranges[extra];
+      *iter_x = dist * directions.x[i];
+      *iter_y = dist * directions.y[i];
+      *iter_z = dist * directions.z;
+      *iter_int = sparse.extra_intensities[extra];
+    }
   }
+  LMS1XX_TRACE3(conversion_end, data.header.device.serial_number, data.header.status_info.telegram_counter,
+                sparse.returns);
+  return sparse.returns;
 }
 
 template<>
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// The console_bridge macros have the same names as ours
+#define LMS1XX_LOG_NO_MACROS
+#include "lms1xx/colaa_log.h"
+
+#include <cstdarg>
+#include <cstdio>
+
+#ifdef LMS1XX_CONSOLE_BRIDGE
+#include <console_bridge/console.h>
+#endif
+
+namespace CoLaALog
+{
+#ifdef LMS1XX_CONSOLE_BRIDGE
+std::atomic<int> current_level(Debug);
+#else
+std::atomic<int> current_level(Warn);
+#endif
+
+static Handler handler = NULL;
+static void *handler_context = NULL;
+
+static void defaultHandler(Level level, const char *file, int line, const char *message)
+{
+#ifdef LMS1XX_CONSOLE_BRIDGE
+  static const console_bridge::LogLevel levels[] = { console_bridge::CONSOLE_BRIDGE_LOG_DEBUG,
+                                                     console_bridge::CONSOLE_BRIDGE_LOG_INFO,
+                                                     console_bridge::CONSOLE_BRIDGE_LOG_WARN,
+                                                     console_bridge::CONSOLE_BRIDGE_LOG_ERROR };
+  console_bridge::log(file, line, levels[level], "%s", message);
+#else
+  static const char *names[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+  fprintf(stderr, "%s: %s (%s:%d)\n", names[level], message, file, line);
+#endif
+}
+
+void setHandler(Handler h, void *context)
+{
+  handler = h;
+  handler_context = context;
+}
+
+void setLevel(Level level)
+{
+  current_level.store(level, std::memory_order_relaxed);
+}
+
+Level getLevel()
+{
+  return static_cast<Level>(current_level.load(std::memory_order_relaxed));
+}
+
+void log(Level level, const char *file, int line, const char *format, ...)
+{
+  if (level >= None || !enabled(level))
+    return;
+#ifdef LMS1XX_CONSOLE_BRIDGE
+  // console_bridge drops messages below its own level, skip formatting them
+  if (!handler && static_cast<int>(level) < static_cast<int>(console_bridge::getLogLevel()))
+    return;
+#endif
+  char message[1024];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(message, sizeof(message), format, args);
+  va_end(args);
+  if (handler)
+    handler(level, file, line, message, handler_context);
+  else
+    defaultHandler(level, file, line, message);
+}
+}
@@ -0,0 +1,57 @@
+#include "lms1xx/colaa_points.h"
+
+size_t CoLaAPoints::fillPoints(const ScanData &data, size_t echo, float *out, size_t stride)
+{
+  DecodedScan decoded;
+  decoded.reset(data);
+  return fillPoints(decoded, echo, out, stride);
+}
+
+size_t CoLaAPoints::fillPoints(DecodedScan &decoded, size_t echo, float *out, size_t stride)
+{
+  const ScanData &data = decoded.data();
+  if (echo >= decoded.echoCount())
+    return 0;
+  const std::vector<uint8_t> *intensities = echo < data.ch8bit.size() ? &data.ch8bit[echo].data : NULL;
+  const std::vector<float> &ranges = decoded.ranges(echo);
+  const BeamDirections &directions = decoded.directions(echo);
+
+  for (size_t i = 0; i < ranges.size(); ++i, out += stride)
+  {
+    float dist = ranges[i];
+    out[0] = dist * directions.x[i];
+    out[1] = dist * directions.y[i];
+    out[2] = dist * directions.z;
+    out[3] = intensities && i < intensities->size() ? (*intensities)[i] : 0;
+  }
+  return ranges.size();
+}
+
+size_t CoLaAPoints::fillReturns(DecodedScan &decoded, float *out, size_t stride)
+{
+  if (decoded.echoCount() == 0)
+    return 0;
+  const SparseEchoes &sparse = decoded.sparseEchoes();
+  const BeamDirections &directions = decoded.directions(0);
+  size_t extra = 0;
+  for (size_t i = 0; i < sparse.counts.size(); ++i)
+  {
+    if (sparse.counts[i] == 0)
+      continue;
+    float dist = sparse.first_ranges[i];
+    out[0] = dist * directions.x[i];
+    out[1] = dist * directions.y[i];
+    out[2] = dist * directions.z;
+    out[3] = sparse.first_intensities[i];
+    out += stride;
+    for (uint8_t r = 1; r < sparse.counts[i]; ++r, ++extra, out += stride)
+    {
+      dist = sparse.extra_ranges[extra];
+      out[0] = dist * directions.x[i];
+      out[1] = dist * directions.y[i];
+      out[2] = dist * directions.z;
+      out[3] = sparse.extra_intensities[extra];
+    }
+  }
+  return sparse.returns;
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lms1xx/decoded_scan.h"
+
+#include <algorithm>
+#include <cmath>
+
+/**
+ * @brief Enough direction tables for all layers of an MRS1000 with some room for sector changes
+ */
+static const size_t MAX_DIRECTION_TABLES = 8;
+
+static const ScanData EMPTY_SCAN = ScanData();
+
+DecodedScan::DecodedScan() : data_(&EMPTY_SCAN), echoes_(0), sparse_decoded_(false), next_direction_(0)
+{
+  sparse_.returns = 0;
+  directions_.reserve(MAX_DIRECTION_TABLES);
+}
+
+void DecodedScan::reset(const ScanData &data)
+{
+  data_ = &data;
+  echoes_ = data.echoCount();
+  if (ranges_.size() < data.ch16bit.size())
+    ranges_.resize(data.ch16bit.size());
+  decoded_.assign(data.ch16bit.size(), 0);
+  sparse_decoded_ = false;
+}
+
+const std::vector<float> &DecodedScan::ranges(size_t echo)
+{
+  std::vector<float> &out = ranges_[echo];
+  if (decoded_[echo])
+    return out;
+
+  const ChannelData<uint16_t> &channel = data_->ch16bit[echo];
+  out.resize(channel.data.size());
+  const uint16_t *in = channel.data.data();
+  float *dst = out.data();
+  float scale = 0.001f * channel.header.scale_factor;
+  // Simple enough for the compiler to vectorise
+  for (size_t i = 0; i < out.size(); ++i)
+    dst[i] = in[i] * scale;
+  // Few beams are invalid, clearing them afterwards keeps the loop above branch free
+  if (echo < data_->valid.size())
+    data_->valid[echo].forEachInvalid(out.size(), [dst](size_t i) { dst[i] = 0; });
+  decoded_[echo] = 1;
+  return out;
+}
+
+const BeamDirections &DecodedScan::directions(size_t echo)
+{
+  const ChannelData<uint16_t> &channel = data_->ch16bit[echo];
+  uint16_t layer = data_->header.status_info.layer_angle;
+  for (size_t i = 0; i < directions_.size(); ++i)
+  {
+    const BeamDirections &d = directions_[i];
+    if (d.start_angle == channel.header.start_angle && d.step_size == channel.header.step_size &&
+        d.layer_angle == layer && d.x.size() == channel.data.size())
+      return d;
+  }
+
+  if (directions_.size() < MAX_DIRECTION_TABLES)
+  {
+    directions_.resize(directions_.size() + 1);
+    next_direction_ = directions_.size() - 1;
+  }
+  BeamDirections &d = directions_[next_direction_];
+  next_direction_ = (next_direction_ + 1) % MAX_DIRECTION_TABLES;
+
+  d.start_angle = channel.header.start_angle;
+  d.step_size = channel.header.step_size;
+  d.layer_angle = layer;
+  float layer_angle = CoLaALayers::getLayerAngle(static_cast<CoLaALayers::Layers>(layer));
+  double cos_layer = cos(layer_angle);
+  d.z = sin(layer_angle);
+  double start_angle = angleMin(echo);
+  double angle_increment = angleIncrement(echo);
+  d.x.resize(channel.data.size());
+  d.y.resize(channel.data.size());
+  for (size_t i = 0; i < channel.data.size(); ++i)
+  {
+    double angle = start_angle + i * angle_increment;
+    d.x[i] = cos(angle) * cos_layer;
+    d.y[i] = sin(angle) * cos_layer;
+  }
+  return d;
+}
+
+const SparseEchoes &DecodedScan::sparseEchoes()
+{
+  if (sparse_decoded_)
+    return sparse_;
+
+  // The LMS5xx has the most echoes with five
+  const size_t MAX_ECHOES = 8;
+  const float *echo_ranges[MAX_ECHOES];
+  const uint8_t *echo_intensities[MAX_ECHOES];
+  size_t echoes = std::min(echoes_, MAX_ECHOES);
+  size_t beams = echoes > 0 ? data_->ch16bit[0].data.size() : 0;
+  for (size_t e = 0; e < echoes; ++e)
+  {
+    echo_ranges[e] = ranges(e).data();
+    bool intensities = e < data_->ch8bit.size() && data_->ch8bit[e].data.size() == beams;
+    echo_intensities[e] = intensities ? data_->ch8bit[e].data.data() : NULL;
+    // Echoes of a different length can't be matched to the beams
+    if (data_->ch16bit[e].data.size() != beams)
+      echoes = e;
+  }
+
+  sparse_.counts.assign(beams, 0);
+  sparse_.first_ranges.assign(beams, 0);
+  sparse_.first_intensities.assign(beams, 0);
+  sparse_.extra_ranges.clear();
+  sparse_.extra_intensities.clear();
+  sparse_.returns = 0;
+  for (size_t i = 0; i < beams; ++i)
+  {
+    uint8_t count = 0;
+    for (size_t e = 0; e < echoes; ++e)
+    {
+      float range = echo_ranges[e][i];
+      if (range == 0)
+        continue;
+      uint8_t intensity = echo_intensities[e] ? echo_intensities[e][i] : 0;
+      if (count == 0)
+      {
+        sparse_.first_ranges[i] = range;
+        sparse_.first_intensities[i] = intensity;
+      }
+      else
+      {
+        sparse_.extra_ranges.push_back(range);
+        sparse_.extra_intensities.push_back(intensity);
+      }
+      ++count;
+    }
+    sparse_.counts[i] = count;
+    sparse_.returns += count;
+  }
+  sparse_decoded_ = true;
+  return sparse_;
+}
+
+double DecodedScan::angleMin(size_t echo) const
+{
+  return data_->ch16bit[echo].header.start_angle * M_PI / 180.0 / 10000.0 - M_PI / 2.0;
+}
+
+double DecodedScan::angleIncrement(size_t echo) const
+{
+  return data_->ch16bit[echo].header.step_size * M_PI / 180.0 / 10000.0;
+}
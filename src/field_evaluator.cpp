@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lms1xx/field_evaluator.h"
+
+#include "lms1xx/colaa_log.h"
+#include <algorithm>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+FieldEvaluator::FieldEvaluator(uint16_t min_beams)
+  : min_beams_(std::max<uint16_t>(min_beams, 1)), active_(0), compiled_(false), start_angle_(0), step_size_(0),
+    scale_factor_(0), count_(0)
+{
+}
+
+size_t FieldEvaluator::addFieldSet(const std::vector<FieldPolygon> &fields)
+{
+  field_sets_.push_back(fields);
+  compiled_ = false;
+  return field_sets_.size() - 1;
+}
+
+void FieldEvaluator::clearFieldSets()
+{
+  field_sets_.clear();
+  tables_.clear();
+  results_.clear();
+  active_ = 0;
+  compiled_ = false;
+}
+
+bool FieldEvaluator::selectFieldSet(size_t index)
+{
+  if (index >= field_sets_.size())
+    return false;
+  active_ = index;
+  return true;
+}
+
+size_t FieldEvaluator::activeFieldSet() const
+{
+  return active_;
+}
+
+size_t FieldEvaluator::fieldSetCount() const
+{
+  return field_sets_.size();
+}
+
+const std::vector<FieldPolygon> &FieldEvaluator::fields() const
+{
+  static const std::vector<FieldPolygon> empty;
+  return field_sets_.empty() ? empty : field_sets_[active_];
+}
+
+/**
+ * @brief Range interval in m the ray from the origin in direction (dx, dy) spends inside the polygon
+ * @return false if the ray does not touch the polygon
+ */
+static bool rayInterval(const std::vector<float> &polygon, double dx, double dy, double &enter, double &leave)
+{
+  size_t n = polygon.size() / 2;
+  bool inside = false;
+  bool hit = false;
+  enter = 0;
+  leave = 0;
+  for (size_t i = 0, j = n - 1; i < n; j = i++)
+  {
+    double ax = polygon[2 * j];
+    double ay = polygon[2 * j + 1];
+    double ex = polygon[2 * i] - ax;
+    double ey = polygon[2 * i + 1] - ay;
+
+    // Crossing number test for the origin
+    if ((ay > 0) != (polygon[2 * i + 1] > 0) && 0 < ax - ay * ex / ey)
+      inside = !inside;
+
+    double denom = dx * ey - dy * ex;
+    if (std::fabs(denom) < 1e-12)
+      continue;
+    double t = (ax * ey - ay * ex) / denom;
+    double u = (ax * dy - ay * dx) / denom;
+    if (t < 0 || u < 0 || u > 1)
+      continue;
+    if (!hit)
+    {
+      enter = leave = t;
+      hit = true;
+    }
+    enter = std::min(enter, t);
+    leave = std::max(leave, t);
+  }
+  if (inside)
+    enter = 0;
+  return hit;
+}
+
+void FieldEvaluator::compile(const ChannelDataHeader &header, size_t count)
+{
+  double start_angle = header.start_angle * M_PI / 180.0 / 10000.0 - M_PI / 2.0;
+  double angle_increment = header.step_size * M_PI / 180.0 / 10000.0;
+  double unit = 0.001 * header.scale_factor;
+
+  tables_.resize(field_sets_.size());
+  for (size_t s = 0; s < field_sets_.size(); ++s)
+  {
+    tables_[s].resize(field_sets_[s].size());
+    for (size_t f = 0; f < field_sets_[s].size(); ++f)
+    {
+      const std::vector<float> &polygon = field_sets_[s][f].points;
+      Table &table = tables_[s][f];
+      table.lower.assign(count, 0);
+      table.upper.assign(count, 0);
+      if (polygon.size() < 6)
+      {
+        logWarn("Field %s has less than three corners", field_sets_[s][f].name.c_str());
+        continue;
+      }
+      for (size_t i = 0; i < count; ++i)
+      {
+        double angle = start_angle + i * angle_increment;
+        double enter, leave;
+        if (!rayInterval(polygon, cos(angle), sin(angle), enter, leave))
+          continue;
+        // Zero means no echo and never violates a field
+        table.lower[i] = static_cast<uint16_t>(std::max(1.0, std::min(65535.0, std::floor(enter / unit))));
+        table.upper[i] = static_cast<uint16_t>(std::min(65535.0, std::floor(leave / unit) + 1));
+      }
+    }
+  }
+
+  start_angle_ = header.start_angle;
+  step_size_ = header.step_size;
+  scale_factor_ = header.scale_factor;
+  count_ = count;
+  compiled_ = true;
+}
+
+const std::vector<FieldResult> &FieldEvaluator::evaluate(const ScanData &data, size_t echo)
+{
+  results_.clear();
+  if (field_sets_.empty() || echo >= data.echoCount())
+    return results_;
+
+  const ChannelData<uint16_t> &ranges = data.ch16bit[echo];
+  if (!compiled_ || start_angle_ != ranges.header.start_angle || step_size_ != ranges.header.step_size ||
+      scale_factor_ != ranges.header.scale_factor || count_ != ranges.data.size())
+  {
+    compile(ranges.header, ranges.data.size());
+  }
+
+  const std::vector<Table> &tables = tables_[active_];
+  results_.resize(tables.size());
+  for (size_t f = 0; f < tables.size(); ++f)
+  {
+    FieldResult &result = results_[f];
+    result.beams = countInside(ranges.data.data(), tables[f].lower.data(), tables[f].upper.data(), count_,
+                               result.first_beam);
+    result.violated = result.beams >= min_beams_;
+  }
+  return results_;
+}
+
+uint16_t FieldEvaluator::countInside(const uint16_t *ranges, const uint16_t *lower, const uint16_t *upper,
+                                     size_t count, int32_t &first)
+{
+  first = -1;
+  uint32_t beams = 0;
+  size_t i = 0;
+#ifdef __SSE2__
+  // Unsigned compares via saturating subtraction: r >= lower <=> lower -| r == 0, r < upper <=> upper -| r != 0
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 8 <= count; i += 8)
+  {
+    __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ranges + i));
+    __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lower + i));
+    __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(upper + i));
+    __m128i above = _mm_cmpeq_epi16(_mm_subs_epu16(lo, r), zero);
+    __m128i beyond = _mm_cmpeq_epi16(_mm_subs_epu16(hi, r), zero);
+    int mask = _mm_movemask_epi8(_mm_andnot_si128(beyond, above));
+    if (mask)
+    {
+      if (first < 0)
+        first = static_cast<int32_t>(i) + __builtin_ctz(mask) / 2;
+      beams += __builtin_popcount(mask) / 2;
+    }
+  }
+#endif
+  for (; i < count; ++i)
+  {
+    if (ranges[i] >= lower[i] && ranges[i] < upper[i])
+    {
+      if (first < 0)
+        first = static_cast<int32_t>(i);
+      ++beams;
+    }
+  }
+  return static_cast<uint16_t>(std::min<uint32_t>(beams, 65535));
+}
@@ -0,0 +1,386 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lms1xx/fleet_provisioner.h"
+
+#include "lms1xx/colaa_log.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+#include "lms1xx/colaa.h"
+#include "lms1xx/lms5xx.h"
+#include "lms1xx/mrs1000.h"
+
+static std::string trim(const std::string &s)
+{
+  size_t begin = s.find_first_not_of(" \t\r");
+  if (begin == std::string::npos)
+    return "";
+  return s.substr(begin, s.find_last_not_of(" \t\r") - begin + 1);
+}
+
+static bool parseBool(const std::string &value, bool &out)
+{
+  if (value == "true" || value == "1" || value == "on")
+    out = true;
+  else if (value == "false" || value == "0" || value == "off")
+    out = false;
+  else
+    return false;
+  return true;
+}
+
+/**
+ * @brief Apply one key of the configuration file
+ * @return false if the key is unknown or the value invalid
+ */
+static bool applyKey(DeviceConfig &device, const std::string &key, const std::string &value)
+{
+  std::istringstream ss(value);
+  double number = 0;
+  bool flag = false;
+  bool numeric = static_cast<bool>(ss >> number) && ss.eof();
+
+  if (key == "host")
+    device.host = value;
+  else if (key == "port" && numeric)
+    device.port = static_cast<int>(number);
+  else if (key == "reply_timeout" && numeric && number > 0)
+    device.reply_timeout = number;
+  else if (key == "type")
+  {
+    if (value == "lms1xx")
+      device.type = CoLaADeviceType::LMS1xx;
+    else if (value == "lms5xx")
+      device.type = CoLaADeviceType::LMS5xx;
+    else if (value == "mrs1000")
+      device.type = CoLaADeviceType::MRS1000;
+    else
+      return false;
+  }
+  else if (key == "scan_frequency" && numeric)
+  {
+    device.scan_config_fields |= ScanConfigField::Frequency;
+    device.scan_config.scan_frequency = static_cast<uint32_t>(std::lround(number * 100));
+  }
+  else if (key == "angular_resolution" && numeric)
+  {
+    device.scan_config_fields |= ScanConfigField::Resolution;
+    device.scan_config.angualar_resolution = static_cast<uint32_t>(std::lround(number * 10000));
+  }
+  else if (key == "start_angle" && numeric)
+  {
+    device.scan_config_fields |= ScanConfigField::StartAngle;
+    device.scan_config.start_angle = static_cast<int32_t>(std::lround(number * 10000));
+  }
+  else if (key == "stop_angle" && numeric)
+  {
+    device.scan_config_fields |= ScanConfigField::StopAngle;
+    device.scan_config.stop_angle = static_cast<int32_t>(std::lround(number * 10000));
+  }
+  else if (key == "output_channel" && numeric)
+  {
+    device.scan_data_fields |= ScanDataField::OutputChannel;
+    device.scan_data_config.output_channel = static_cast<int>(number);
+  }
+  else if (key == "remission" && parseBool(value, flag))
+  {
+    device.scan_data_fields |= ScanDataField::Remission;
+    device.scan_data_config.remission = flag;
+  }
+  else if (key == "remission_16bit" && parseBool(value, flag))
+  {
+    device.scan_data_fields |= ScanDataField::RemissionResolution;
+    device.scan_data_config.resolution = flag;
+  }
+  else if (key == "output_interval" && numeric)
+  {
+    device.scan_data_fields |= ScanDataField::OutputInterval;
+    device.scan_data_config.output_interval = static_cast<int>(number);
+  }
+  else if (key == "echo_filter")
+  {
+    if (value == "first")
+      device.echo_filter = CoLaAEchoFilter::FirstEcho;
+    else if (value == "all")
+      device.echo_filter = CoLaAEchoFilter::AllEchoes;
+    else if (value == "last")
+      device.echo_filter = CoLaAEchoFilter::LastEcho;
+    else
+      return false;
+  }
+  else if (key == "particle_filter" && parseBool(value, flag))
+    device.particle_filter = flag;
+  else if (key == "mean_filter" && numeric && number >= 0)
+    device.mean_filter = static_cast<int>(number);
+  else
+    return false;
+  return true;
+}
+
+bool FleetProvisioner::loadConfig(const std::string &path, std::vector<DeviceConfig> &devices, std::string &error)
+{
+  std::ifstream file(path.c_str());
+  if (!file)
+  {
+    error = "Unable to open " + path;
+    return false;
+  }
+
+  DeviceConfig defaults;
+
+  devices.clear();
+  DeviceConfig *current = &defaults;
+  std::string line;
+  for (int line_number = 1; std::getline(file, line); ++line_number)
+  {
+    line = trim(line.substr(0, line.find('#')));
+    if (line.empty())
+      continue;
+
+    std::ostringstream where;
+    where << path << ":" << line_number << ": ";
+    if (line[0] == '[')
+    {
+      if (line[line.size() - 1] != ']')
+      {
+        error = where.str() + "unterminated section";
+        return false;
+      }
+      devices.push_back(defaults);
+      current = &devices.back();
+      current->name = trim(line.substr(1, line.size() - 2));
+      continue;
+    }
+
+    size_t eq = line.find('=');
+    if (eq == std::string::npos)
+    {
+      error = where.str() + "expected key = value";
+      return false;
+    }
+    std::string key = trim(line.substr(0, eq));
+    if (!applyKey(*current, key, trim(line.substr(eq + 1))))
+    {
+      error = where.str() + "invalid setting " + key;
+      return false;
+    }
+  }
+
+  for (size_t i = 0; i < devices.size(); ++i)
+  {
+    if (devices[i].host.empty())
+    {
+      error = "No host given for " + devices[i].name;
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool sameScanConfig(const ScanConfig &a, const ScanConfig &b)
+{
+  return a.scan_frequency == b.scan_frequency && a.angualar_resolution == b.angualar_resolution &&
+         a.start_angle == b.start_angle && a.stop_angle == b.stop_angle;
+}
+
+/**
+ * @brief The device's scan configuration with the fields given for it replaced
+ */
+static ScanConfig desiredScanConfig(const DeviceConfig &device, const ScanConfig &current)
+{
+  ScanConfig cfg = current;
+  cfg.num_sectors = 1;
+  if (device.scan_config_fields & ScanConfigField::Frequency)
+    cfg.scan_frequency = device.scan_config.scan_frequency;
+  if (device.scan_config_fields & ScanConfigField::Resolution)
+    cfg.angualar_resolution = device.scan_config.angualar_resolution;
+  if (device.scan_config_fields & ScanConfigField::StartAngle)
+    cfg.start_angle = device.scan_config.start_angle;
+  if (device.scan_config_fields & ScanConfigField::StopAngle)
+    cfg.stop_angle = device.scan_config.stop_angle;
+  return cfg;
+}
+
+static bool sameScanDataConfig(const ScanDataConfig &a, const ScanDataConfig &b)
+{
+  return a.output_channel == b.output_channel && a.remission == b.remission && a.resolution == b.resolution &&
+         a.encoder == b.encoder && a.position == b.position && a.device_name == b.device_name &&
+         a.comment == b.comment && a.timestamp == b.timestamp && a.output_interval == b.output_interval;
+}
+
+/**
+ * @brief The device's scan data configuration with the fields given for it replaced
+ */
+static ScanDataConfig desiredScanDataConfig(const DeviceConfig &device, const ScanDataConfig &current)
+{
+  ScanDataConfig cfg = current;
+  if (device.scan_data_fields & ScanDataField::OutputChannel)
+    cfg.output_channel = device.scan_data_config.output_channel;
+  if (device.scan_data_fields & ScanDataField::Remission)
+    cfg.remission = device.scan_data_config.remission;
+  if (device.scan_data_fields & ScanDataField::RemissionResolution)
+    cfg.resolution = device.scan_data_config.resolution;
+  if (device.scan_data_fields & ScanDataField::OutputInterval)
+    cfg.output_interval = device.scan_data_config.output_interval;
+  return cfg;
+}
+
+static std::string describe(const ScanConfig &cfg)
+{
+  std::ostringstream ss;
+  ss << cfg.scan_frequency / 100.0 << " Hz, " << cfg.angualar_resolution / 10000.0 << " deg, "
+     << cfg.start_angle / 10000.0 << " to " << cfg.stop_angle / 10000.0 << " deg";
+  return ss.str();
+}
+
+ProvisionReport FleetProvisioner::provisionDevice(const DeviceConfig &device, bool dry_run)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  ProvisionReport report;
+  report.name = device.name;
+  report.result = ProvisionResult::Unchanged;
+
+  std::unique_ptr<CoLaA> laser;
+  if (device.type == CoLaADeviceType::LMS5xx)
+    laser.reset(new LMS5xx());
+  else if (device.type == CoLaADeviceType::MRS1000)
+    laser.reset(new MRS1000());
+  else
+    laser.reset(new CoLaA());
+
+  laser->setReplyTimeout(device.reply_timeout);
+  laser->connect(device.host, device.port);
+  if (!laser->isConnected())
+  {
+    report.result = ProvisionResult::ConnectFailed;
+  }
+  else if (!laser->login(static_cast<int>(std::ceil(device.reply_timeout))))
+  {
+    report.result = ProvisionResult::Timeout;
+    laser->disconnect();
+  }
+  else
+  {
+    bool scan_config_differs = false;
+    ScanConfig scan_config;
+    if (device.scan_config_fields)
+    {
+      ScanConfig current = laser->getScanConfig();
+      scan_config = desiredScanConfig(device, current);
+      scan_config_differs = !sameScanConfig(current, scan_config);
+      if (scan_config_differs)
+        report.changes.push_back("scan config " + describe(current) + " -> " + describe(scan_config));
+    }
+    bool scan_data_config_differs = false;
+    ScanDataConfig scan_data_config;
+    if (device.scan_data_fields && !laser->replyTimedOut())
+    {
+      ScanDataConfig current;
+      if (!laser->getScanDataConfig(current))
+      {
+        logWarn("%s: unable to read the scan data configuration", device.name.c_str());
+        report.result = ProvisionResult::VerifyFailed;
+      }
+      else
+      {
+        scan_data_config = desiredScanDataConfig(device, current);
+        scan_data_config_differs = !sameScanDataConfig(current, scan_data_config);
+        if (scan_data_config_differs)
+          report.changes.push_back("scan data config");
+      }
+    }
+    if (device.echo_filter >= 0)
+      report.changes.push_back("echo filter");
+    if (device.particle_filter >= 0)
+      report.changes.push_back("particle filter");
+    if (device.mean_filter >= 0)
+      report.changes.push_back("mean filter");
+
+    if (laser->replyTimedOut())
+    {
+      report.result = ProvisionResult::Timeout;
+    }
+    else if (report.result == ProvisionResult::VerifyFailed)
+    {
+      // Nothing is written without knowing the complete scan data configuration
+    }
+    else if (dry_run)
+    {
+      report.result = report.changes.empty() ? ProvisionResult::Unchanged : ProvisionResult::DryRun;
+    }
+    else if (!report.changes.empty())
+    {
+      // Nothing more is sent to a device that stopped replying, its EEPROM keeps the old settings
+      if (scan_config_differs)
+        laser->setScanConfig(scan_config);
+      if (scan_data_config_differs && !laser->replyTimedOut())
+        laser->setScanDataConfig(scan_data_config);
+      if (device.echo_filter >= 0 && !laser->replyTimedOut())
+        laser->setEchoFilter(static_cast<CoLaAEchoFilter::EchoFilter>(device.echo_filter));
+      if (device.particle_filter >= 0 && !laser->replyTimedOut())
+        laser->setParticleFilter(device.particle_filter != 0);
+      if (device.mean_filter >= 0 && !laser->replyTimedOut())
+        laser->setMeanFilter(device.mean_filter > 0, std::max(device.mean_filter, 2));
+      if (!laser->replyTimedOut())
+        laser->saveConfig();
+      if (!laser->replyTimedOut())
+        laser->startDevice();
+
+      report.result = ProvisionResult::Applied;
+      if (device.scan_config_fields && !laser->replyTimedOut() &&
+          !sameScanConfig(laser->getScanConfig(), scan_config))
+        report.result = ProvisionResult::VerifyFailed;
+      ScanDataConfig written;
+      if (scan_data_config_differs && !laser->replyTimedOut() &&
+          !(laser->getScanDataConfig(written) && sameScanDataConfig(written, scan_data_config)))
+        report.result = ProvisionResult::VerifyFailed;
+      if (laser->replyTimedOut())
+        report.result = ProvisionResult::Timeout;
+    }
+    laser->disconnect();
+  }
+
+  report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return report;
+}
+
+std::vector<ProvisionReport> FleetProvisioner::provisionFleet(const std::vector<DeviceConfig> &devices,
+                                                              bool dry_run, size_t max_parallel)
+{
+  std::vector<ProvisionReport> reports(devices.size());
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> workers;
+  size_t worker_count = std::max<size_t>(1, std::min(max_parallel, devices.size()));
+  for (size_t w = 0; w < worker_count; ++w)
+  {
+    workers.push_back(std::thread([&]()
+    {
+      for (size_t i = next++; i < devices.size(); i = next++)
+        reports[i] = provisionDevice(devices[i], dry_run);
+    }));
+  }
+  for (size_t w = 0; w < workers.size(); ++w)
+    workers[w].join();
+  return reports;
+}
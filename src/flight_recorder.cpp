@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lms1xx/flight_recorder.h"
+
+#include "lms1xx/colaa_log.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+
+#include "lms1xx/capture_file.h"
+
+FlightRecorder::FlightRecorder(const FlightRecorderConfig &config)
+  : config_(config), bytes_(std::max<size_t>(config.capacity, 1)), chunks_(std::max<size_t>(config.max_chunks, 1)),
+    written_(0), chunk_count_(0), last_dump_ns_(0)
+{
+}
+
+void FlightRecorder::record(const char *data, size_t length, int64_t stamp_ns)
+{
+  if (length == 0)
+    return;
+  // Only the tail of oversized reads fits
+  if (length > bytes_.size())
+  {
+    data += length - bytes_.size();
+    length = bytes_.size();
+  }
+
+  size_t position = written_ % bytes_.size();
+  size_t first = std::min(length, bytes_.size() - position);
+  memcpy(&bytes_[position], data, first);
+  memcpy(&bytes_[0], data + first, length - first);
+
+  Chunk &chunk = chunks_[chunk_count_ % chunks_.size()];
+  chunk.stamp_ns = stamp_ns;
+  chunk.offset = written_;
+  chunk.length = static_cast<uint32_t>(length);
+  written_ += length;
+  ++chunk_count_;
+}
+
+std::string FlightRecorder::trigger(FlightRecorderTrigger::Trigger trigger)
+{
+  if (chunk_count_ == 0)
+    return "";
+  int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+  if (last_dump_ns_ != 0 && now - last_dump_ns_ < static_cast<int64_t>(config_.min_dump_interval * 1e9))
+  {
+    logDebug("Flight recorder: %s within the minimum dump interval, not dumping", triggerName(trigger));
+    return "";
+  }
+  last_dump_ns_ = now;
+
+  time_t seconds = static_cast<time_t>(now / 1000000000);
+  struct tm local;
+  localtime_r(&seconds, &local);
+  char stamp[32];
+  strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+  std::string path = config_.directory + "/" + config_.prefix + "_" + stamp + "_" + triggerName(trigger) + ".cap";
+  if (!dump(path))
+  {
+    logError("Flight recorder: unable to write %s", path.c_str());
+    return "";
+  }
+  logWarn("Flight recorder: %s, wrote the last %.0f s of received data to %s", triggerName(trigger),
+          config_.window, path.c_str());
+  return path;
+}
+
+bool FlightRecorder::dump(const std::string &path) const
+{
+  CaptureFile::Writer writer;
+  if (!writer.open(path))
+    return false;
+
+  uint64_t first_chunk = chunk_count_ > chunks_.size() ? chunk_count_ - chunks_.size() : 0;
+  uint64_t first_byte = written_ > bytes_.size() ? written_ - bytes_.size() : 0;
+  int64_t newest = chunk_count_ > 0 ? chunks_[(chunk_count_ - 1) % chunks_.size()].stamp_ns : 0;
+  int64_t oldest = newest - static_cast<int64_t>(config_.window * 1e9);
+  for (uint64_t c = first_chunk; c < chunk_count_; ++c)
+  {
+    const Chunk &chunk = chunks_[c % chunks_.size()];
+    uint64_t begin = std::max(chunk.offset, first_byte);
+    uint64_t end = chunk.offset + chunk.length;
+    if (chunk.stamp_ns < oldest || begin >= end)
+      continue;
+    size_t position = begin % bytes_.size();
+    size_t length = end - begin;
+    size_t first = std::min(length, bytes_.size() - position);
+    if (!writer.write(chunk.stamp_ns, &bytes_[position], first))
+      return false;
+    if (first < length && !writer.write(chunk.stamp_ns, &bytes_[0], length - first))
+      return false;
+  }
+  writer.close();
+  return true;
+}
+
+size_t FlightRecorder::size() const
+{
+  return std::min<uint64_t>(written_, bytes_.size());
+}
+
+void FlightRecorder::clear()
+{
+  written_ = 0;
+  chunk_count_ = 0;
+}
+
+const char *FlightRecorder::triggerName(FlightRecorderTrigger::Trigger trigger)
+{
+  switch (trigger)
+  {
+  case FlightRecorderTrigger::Timeout:
+    return "timeout";
+  case FlightRecorderTrigger::ParseFailure:
+    return "parse_failure";
+  case FlightRecorderTrigger::TelegramGap:
+    return "telegram_gap";
+  case FlightRecorderTrigger::BufferReset:
+    return "buffer_reset";
+  case FlightRecorderTrigger::Manual:
+    return "manual";
+  }
+  return "unknown";
+}
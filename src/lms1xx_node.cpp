@@ -21,9 +21,24 @@
  *                                                                         *
  ***************************************************************************/
 
+#include <algorithm>
 #include <csignal>
 #include <cstdio>
+#include <memory>
+#include <lms1xx/background_model.h>
 #include <lms1xx/colaa.h>
+#include <lms1xx/colaa_conversion.h>
+#include <lms1xx/decoded_scan.h>
+#include <lms1xx/message_pool.h>
+#include <lms1xx/node_setup.h>
+#include <lms1xx/pipeline_publisher.h>
+#include <lms1xx/raw_telegram.h>
+#include <lms1xx/scan_multicast.h>
+#include <lms1xx/scan_matcher.h>
+#include <lms1xx/sector_service.h>
+#include <lms1xx/tracing.h>
+#include <lms1xx/ScanChanges.h>
+#include <nav_msgs/Odometry.h>
 #include <sensor_msgs/LaserScan.h>
 #include <ros/ros.h>
 
@@ -37,11 +52,16 @@ int main(int argc, char **argv)
   ScanOutputRange output_range;
   ScanDataConfig dataCfg;
   sensor_msgs::LaserScan scan_msg;
+  MessagePool<sensor_msgs::LaserScan> scan_pool;
 
   // parameters
   std::string host;
   std::string frame_id;
   int port;
+  bool odometry;
+  std::string odom_frame_id;
+  bool change_detection;
+  int learn_scans;
 
   ros::init(argc, argv, "lms1xx");
   ros::NodeHandle nh;
@@ -51,6 +71,71 @@ int main(int argc, char **argv)
   n.param<std::string>("host", host, "192.168.1.2");
   n.param<std::string>("frame_id", frame_id, "laser");
   n.param<int>("port", port, 2111);
+  n.param<bool>("odometry", odometry, false);
+  n.param<std::string>("odom_frame_id", odom_frame_id, "laser_odom");
+
+  // Scan matching odometry, allocated once and kept across reconnects
+  std::unique_ptr<ScanMatcher> matcher;
+  nav_msgs::Odometry odom_msg;
+  ros::Publisher odom_pub;
+  if (odometry)
+  {
+    matcher.reset(new ScanMatcher());
+    odom_pub = nh.advertise<nav_msgs::Odometry>("laser_odom", 1);
+    odom_msg.header.frame_id = odom_frame_id;
+    odom_msg.child_frame_id = frame_id;
+  }
+
+  // Change detection against a learned background for static mounted scanners
+  n.param<bool>("change_detection", change_detection, false);
+  n.param<int>("learn_scans", learn_scans, 50);
+  std::unique_ptr<BackgroundModel> background;
+  lms1xx::ScanChanges changes_msg;
+  ros::Publisher changes_pub;
+  bool had_changes = false;
+  if (change_detection)
+  {
+    BackgroundModelConfig background_config;
+    background_config.learn_scans = std::max(learn_scans, 1);
+    background.reset(new BackgroundModel(background_config));
+    changes_msg.header.frame_id = frame_id;
+    changes_pub = nh.advertise<lms1xx::ScanChanges>("changes", 1);
+  }
+
+  // Raw data of the last seconds is dumped as capture file on timeouts and stream errors
+  std::unique_ptr<FlightRecorder> recorder = setupFlightRecorder(n, laser);
+
+  // Beams closer than min_range or weaker than min_rssi are published like beams without echo
+  setupBeamLimits(n, laser);
+  DecodedScan decoded;
+
+  // Scans, or the raw telegrams with raw_passthrough, are sent once to a UDP multicast group for all consumers
+  std::unique_ptr<MulticastSender> multicast = setupMulticast(n);
+
+  // Raw passthrough only frames the telegrams and publishes them on "telegrams" for telegram_decoder
+  bool raw_passthrough;
+  n.param<bool>("raw_passthrough", raw_passthrough, false);
+  std::unique_ptr<TelegramPublisher> passthrough;
+  if (raw_passthrough)
+  {
+    passthrough.reset(new TelegramPublisher(nh, "telegrams", frame_id));
+    passthrough->setMulticast(multicast.get());
+  }
+
+  // Closest range in a sector of the latest scan, answered from its own thread on "sector_min"
+  bool sector_service;
+  n.param<bool>("sector_service", sector_service, false);
+  std::unique_ptr<SectorService> sectors;
+  if (sector_service)
+    sectors.reset(new SectorService(nh, "sector_min"));
+
+  // In-driver processing stages run on every scan, their outputs are published on topics named after them.
+  // Optional stages are skipped for a scan when the pipeline would take longer than pipeline_deadline
+  // times the scan period.
+  ScanPipeline pipeline;
+  std::unique_ptr<PipelinePublisher> pipeline_pub;
+  if (!setupPipeline(n, nh, frame_id, pipeline, pipeline_pub))
+    return 1;
 
   while (ros::ok())
   {
@@ -82,6 +167,7 @@ int main(int argc, char **argv)
               cfg.scan_frequency, cfg.num_sectors, cfg.angualar_resolution, cfg.start_angle, cfg.stop_angle);
     ROS_DEBUG("Laser output range:angleResolution %d, startAngle %d, stopAngle %d",
               output_range.angular_resolution, output_range.start_angle, output_range.stop_angle);
+    pipeline.setScanFrequency(cfg.scan_frequency);
 
     scan_msg.header.frame_id = frame_id;
     scan_msg.range_min = 0.01;
@@ -103,6 +189,7 @@ int main(int argc, char **argv)
     }
     scan_msg.ranges.resize(num_values);
     scan_msg.intensities.resize(num_values);
+    laser.setReceiveBufferSize(CoLaA::estimateReceiveBuffer(num_values, 1, cfg.scan_frequency / 100.0));
 
     scan_msg.time_increment =
       (output_range.angular_resolution / 10000.0)
@@ -110,6 +197,7 @@ int main(int argc, char **argv)
       / (cfg.scan_frequency / 100.0);
 
     ROS_DEBUG_STREAM("Time increment is " << static_cast<int>(scan_msg.time_increment * 1000000) << " microseconds");
+    scan_pool.setPrototype(scan_msg);
 
     dataCfg.output_channel = 1;
     dataCfg.remission = true;
@@ -150,6 +238,17 @@ int main(int argc, char **argv)
 
     while (ros::ok())
     {
+      if (passthrough)
+      {
+        if (!passthrough->publishNext(laser))
+        {
+          ROS_ERROR("Laser timed out on delivering scan, attempting to reinitialize.");
+          break;
+        }
+        ros::spinOnce();
+        continue;
+      }
+
       ros::Time start = ros::Time::now();
 
       scan_msg.header.stamp = start;
@@ -159,13 +258,58 @@ int main(int argc, char **argv)
       ROS_DEBUG("Reading scan data.");
       if (laser.getScanData(&data))
       {
-        for (size_t k = 0; k < data.ch16bit[0].data.size(); ++k)
+        decoded.reset(data);
+        if (multicast)
+          multicast->sendScan(data, start.toNSec());
+        if (sectors)
+          sectors->update(data, start);
+        sensor_msgs::LaserScanPtr scan = scan_pool.acquire();
+        scan->header.stamp = scan_msg.header.stamp;
+        scan->header.seq = scan_msg.header.seq;
+        const std::vector<float> &ranges = decoded.ranges(0);
+        for (size_t k = 0; k < ranges.size(); ++k)
         {
-          scan_msg.ranges[k] = data.ch16bit[0].data[k] * 0.001;
-          scan_msg.intensities[k] = data.ch16bit[1].data[k];
+          scan->ranges[k] = ranges[k];
+          scan->intensities[k] = data.ch16bit[1].data[k];
         }
         ROS_DEBUG("Publishing scan data.");
-        scan_pub.publish(scan_msg);
+        scan_pub.publish(scan);
+        LMS1XX_TRACE3(publish, data.header.device.serial_number, data.header.status_info.telegram_counter,
+                      scan->ranges.size());
+
+        if (matcher)
+        {
+          Pose2D previous = matcher->pose();
+          if (matcher->addScan(data))
+          {
+            double dt = odom_msg.header.stamp.isZero() ? 0 : (start - odom_msg.header.stamp).toSec();
+            odom_msg.header.stamp = start;
+            CoLaAConversion::fillOdometry(odom_msg, matcher->pose(), previous, dt);
+            odom_pub.publish(odom_msg);
+          }
+          else
+          {
+            ROS_DEBUG("Scan matching failed (score %f).", matcher->score());
+          }
+        }
+
+        if (background)
+        {
+          const std::vector<ChangedRegion> &regions = background->update(data);
+          if (!regions.empty() || had_changes)
+          {
+            changes_msg.header.stamp = start;
+            CoLaAConversion::fillScanChanges(changes_msg, data, regions);
+            changes_pub.publish(changes_msg);
+          }
+          had_changes = !regions.empty();
+        }
+
+        if (pipeline_pub)
+        {
+          pipeline.process(decoded, start.toNSec());
+          pipeline_pub->publish(pipeline, data, start);
+        }
       }
       else
       {
@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Python bindings of the CoLaA library.
+ *
+ * Channel data is exposed through the buffer protocol and as NumPy arrays that
+ * reference the C++ vectors directly, keeping the owning ScanData alive.
+ *
+ *   import lms1xx, numpy as np
+ *   scans = lms1xx.parse_capture("recording.cap")
+ *   scans["ranges"].shape  # (telegrams, echoes, beams)
+ */
+
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <pybind11/stl.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "lms1xx/capture_file.h"
+#include "lms1xx/colaa.h"
+#include "lms1xx/colaa_points.h"
+
+namespace py = pybind11;
+
+namespace
+{
+typedef std::vector<std::vector<char> > Telegrams;
+
+template <typename T>
+void bindChannel(py::module &m, const char *name)
+{
+  py::class_<ChannelData<T> >(m, name, py::buffer_protocol())
+    .def_property_readonly("contents", [](const ChannelData<T> &c) { return c.header.contents; })
+    .def_property_readonly("scale_factor", [](const ChannelData<T> &c) { return c.header.scale_factor; })
+    .def_property_readonly("scale_factor_offset", [](const ChannelData<T> &c) { return c.header.scale_factor_offset; })
+    .def_property_readonly("start_angle", [](const ChannelData<T> &c) { return c.header.start_angle; })
+    .def_property_readonly("step_size", [](const ChannelData<T> &c) { return c.header.step_size; })
+    .def_property_readonly("data", [](py::object self)
+    {
+      ChannelData<T> &c = self.cast<ChannelData<T> &>();
+      // No copy, the array keeps the channel (and thereby its ScanData) alive
+      return py::array_t<T>(c.data.size(), c.data.data(), self);
+    })
+    .def_buffer([](ChannelData<T> &c)
+    {
+      return py::buffer_info(c.data.data(), sizeof(T), py::format_descriptor<T>::format(), 1,
+                             { c.data.size() }, { sizeof(T) });
+    })
+    .def("__len__", [](const ChannelData<T> &c) { return c.data.size(); });
+}
+
+template <typename T>
+py::list channelList(py::object self, std::vector<ChannelData<T> > &channels)
+{
+  py::list list;
+  for (size_t i = 0; i < channels.size(); ++i)
+    list.append(py::cast(&channels[i], py::return_value_policy::reference_internal, self));
+  return list;
+}
+
+py::array_t<float> points(const ScanData &data, size_t echo)
+{
+  size_t count = echo < data.ch16bit.size() ? data.ch16bit[echo].data.size() : 0;
+  py::array_t<float> out({ count, static_cast<size_t>(4) });
+  CoLaAPoints::fillPoints(data, echo, out.mutable_data());
+  return out;
+}
+
+/**
+ * @brief Parse all telegrams in C++ and stack them into (telegrams, channels, beams) arrays
+ * Shorter scans and missing channels are zero padded.
+ */
+py::dict parseBatch(Telegrams &telegrams)
+{
+  std::vector<ScanData> scans(telegrams.size());
+  std::vector<uint8_t> valid(telegrams.size(), 0);
+  size_t ch16 = 0, ch8 = 0, beams = 0;
+  {
+    py::gil_scoped_release release;
+    CoLaA parser;
+    for (size_t t = 0; t < telegrams.size(); ++t)
+    {
+      if (telegrams[t].empty() || telegrams[t].back() != 0)
+        telegrams[t].push_back(0);
+      valid[t] = parser.parseTelegram(telegrams[t].data(), &scans[t]);
+      ch16 = std::max(ch16, scans[t].ch16bit.size());
+      ch8 = std::max(ch8, scans[t].ch8bit.size());
+      for (size_t c = 0; c < scans[t].ch16bit.size(); ++c)
+        beams = std::max(beams, scans[t].ch16bit[c].data.size());
+    }
+  }
+
+  const size_t count = scans.size();
+  py::array_t<uint16_t> ranges({ count, ch16, beams });
+  py::array_t<uint8_t> rssi({ count, ch8, beams });
+  py::array_t<float> scale({ count, ch16 });
+  py::array_t<uint16_t> telegram_counter(count);
+  py::array_t<uint16_t> layer_angle(count);
+  py::array_t<uint32_t> time_of_transmission(count);
+  py::array_t<bool> ok(count);
+  uint16_t *r = ranges.mutable_data();
+  uint8_t *i8 = rssi.mutable_data();
+  float *s = scale.mutable_data();
+  std::fill(r, r + count * ch16 * beams, 0);
+  std::fill(i8, i8 + count * ch8 * beams, 0);
+  std::fill(s, s + count * ch16, 0.f);
+
+  for (size_t t = 0; t < count; ++t)
+  {
+    const ScanData &data = scans[t];
+    for (size_t c = 0; c < data.ch16bit.size(); ++c)
+    {
+      std::copy(data.ch16bit[c].data.begin(), data.ch16bit[c].data.end(), r + (t * ch16 + c) * beams);
+      s[t * ch16 + c] = data.ch16bit[c].header.scale_factor;
+    }
+    for (size_t c = 0; c < data.ch8bit.size(); ++c)
+      std::copy(data.ch8bit[c].data.begin(), data.ch8bit[c].data.end(), i8 + (t * ch8 + c) * beams);
+    telegram_counter.mutable_at(t) = valid[t] ? data.header.status_info.telegram_counter : 0;
+    layer_angle.mutable_at(t) = valid[t] ? data.header.status_info.layer_angle : 0;
+    time_of_transmission.mutable_at(t) = valid[t] ? data.header.status_info.time_of_transmission : 0;
+    ok.mutable_at(t) = valid[t] != 0;
+  }
+
+  py::dict result;
+  result["ranges"] = ranges;
+  result["rssi"] = rssi;
+  result["scale_factor"] = scale;
+  result["telegram_counter"] = telegram_counter;
+  result["layer_angle"] = layer_angle;
+  result["time_of_transmission"] = time_of_transmission;
+  result["valid"] = ok;
+  return result;
+}
+
+std::vector<char> toTelegram(const py::bytes &bytes)
+{
+  std::string str = bytes;
+  std::vector<char> telegram(str.begin(), str.end());
+  // Accept telegrams with or without the ETX
+  if (!telegram.empty() && telegram.back() == 0x03)
+    telegram.back() = 0;
+  else
+    telegram.push_back(0);
+  return telegram;
+}
+}
+
+PYBIND11_MODULE(lms1xx, m)
+{
+  m.doc() = "SICK LMS1xx / LMS5xx / MRS1000 CoLa A scan data parsing";
+
+  bindChannel<uint16_t>(m, "ChannelData16");
+  bindChannel<uint8_t>(m, "ChannelData8");
+
+  py::class_<ScanData>(m, "ScanData")
+    .def_property_readonly("version_number", [](const ScanData &d) { return d.header.version_number; })
+    .def_property_readonly("device_number", [](const ScanData &d) { return d.header.device.device_number; })
+    .def_property_readonly("serial_number", [](const ScanData &d) { return d.header.device.serial_number; })
+    .def_property_readonly("telegram_counter", [](const ScanData &d) { return d.header.status_info.telegram_counter; })
+    .def_property_readonly("scan_counter", [](const ScanData &d) { return d.header.status_info.scan_counter; })
+    .def_property_readonly("time_since_startup", [](const ScanData &d) { return d.header.status_info.time_since_startup; })
+    .def_property_readonly("time_of_transmission",
+                           [](const ScanData &d) { return d.header.status_info.time_of_transmission; })
+    .def_property_readonly("layer_angle", [](const ScanData &d) { return d.header.status_info.layer_angle; })
+    .def_property_readonly("scan_frequency", [](const ScanData &d) { return d.header.frequencies.scan_frequency; })
+    .def_property_readonly("measurement_frequency",
+                           [](const ScanData &d) { return d.header.frequencies.measurement_frequency; })
+    .def_property_readonly("ch16bit", [](py::object self) { return channelList(self, self.cast<ScanData &>().ch16bit); })
+    .def_property_readonly("ch8bit", [](py::object self) { return channelList(self, self.cast<ScanData &>().ch8bit); })
+    .def("points", &points, py::arg("echo") = 0,
+         "Cartesian points of one echo as (beams, 4) float32 array of x, y, z, intensity");
+
+  py::class_<CoLaA>(m, "CoLaA")
+    .def(py::init<>())
+    .def("connect", &CoLaA::connect, py::arg("host"), py::arg("port") = 2111)
+    .def("disconnect", &CoLaA::disconnect)
+    .def("is_connected", &CoLaA::isConnected)
+    .def("login", &CoLaA::login)
+    .def("start_device", &CoLaA::startDevice)
+    .def("start_measurement", &CoLaA::startMeasurement)
+    .def("stop_measurement", &CoLaA::stopMeasurement)
+    .def("scan_continuous", &CoLaA::scanContinuous)
+    .def("get_scan_data", [](CoLaA &laser) -> py::object
+    {
+      ScanData data;
+      bool ok;
+      {
+        py::gil_scoped_release release;
+        ok = laser.getScanData(&data);
+      }
+      if (!ok)
+        return py::none();
+      return py::cast(std::move(data));
+    }, "Blocks for the next scan, returns None on timeout")
+    .def("parse", [](const CoLaA &parser, const py::bytes &bytes) -> py::object
+    {
+      std::vector<char> telegram = toTelegram(bytes);
+      ScanData data;
+      if (!parser.parseTelegram(telegram.data(), &data))
+        return py::none();
+      return py::cast(std::move(data));
+    });
+
+  m.def("parse", [](const py::bytes &bytes) -> py::object
+  {
+    std::vector<char> telegram = toTelegram(bytes);
+    ScanData data;
+    if (!CoLaA().parseTelegram(telegram.data(), &data))
+      return py::none();
+    return py::cast(std::move(data));
+  }, py::arg("telegram"), "Parse one STX framed telegram, returns None if it is not scan data");
+
+  m.def("load_telegrams", [](const std::string &path)
+  {
+    Telegrams telegrams = CaptureFile::loadTelegrams(path);
+    py::list list;
+    for (size_t t = 0; t < telegrams.size(); ++t)
+      list.append(py::bytes(telegrams[t].data(), telegrams[t].size() - 1));
+    return list;
+  }, py::arg("path"), "All framed telegrams of a capture file (without ETX)");
+
+  m.def("parse_batch", [](const std::vector<py::bytes> &list)
+  {
+    Telegrams telegrams;
+    telegrams.reserve(list.size());
+    for (size_t t = 0; t < list.size(); ++t)
+      telegrams.push_back(toTelegram(list[t]));
+    return parseBatch(telegrams);
+  }, py::arg("telegrams"), "Parse many telegrams and return stacked arrays");
+
+  m.def("parse_capture", [](const std::string &path)
+  {
+    Telegrams telegrams = CaptureFile::loadTelegrams(path);
+    return parseBatch(telegrams);
+  }, py::arg("path"), "Parse a whole capture file and return stacked arrays");
+}
@@ -17,11 +17,27 @@
 
 #include <csignal>
 #include <cstdio>
+#include <memory>
 #include <lms1xx/lms5xx.h>
+#include <lms1xx/field_evaluator.h>
+#include <lms1xx/message_pool.h>
+#include <lms1xx/node_setup.h>
+#include <lms1xx/pipeline_publisher.h>
+#include <lms1xx/raw_telegram.h>
+#include <lms1xx/scan_multicast.h>
+#include <lms1xx/scan_bundle.h>
+#include <lms1xx/scan_matcher.h>
+#include <lms1xx/sector_service.h>
+#include <lms1xx/scan_tracker.h>
+#include <lms1xx/FieldStatus.h>
+#include <lms1xx/TrackArray.h>
+#include <nav_msgs/Odometry.h>
 #include <ros/ros.h>
 #include <sensor_msgs/LaserScan.h>
 #include <sensor_msgs/MultiEchoLaserScan.h>
+#include <std_msgs/UInt8.h>
 #include "lms1xx/colaa_conversion.h"
+#include "lms1xx/tracing.h"
 
 constexpr double DEG2RAD = M_PI/180.0;
 constexpr size_t ALL_ECHOES_COUNT = 5;
@@ -38,10 +54,38 @@ void usage()
   std::cout << "    frame_id  Frame id of the laser, defaults to \"laser\"." << std::endl;
   std::cout << "    echoes    One of \"first\", \"last\" or \"all\"." << std::endl;
   std::cout << "    range     Maximum sensor range in m (default 80)" << std::endl;
+  std::cout << "    odometry  Publish scan matching odometry on \"laser_odom\" (default false)" << std::endl;
+  std::cout << "    odom_frame_id  Frame id of the odometry origin, defaults to \"laser_odom\"." << std::endl;
+  std::cout << "    tracking  Publish moving objects on \"tracks\" (default false)" << std::endl;
+  std::cout << "    bundle_size  Publish the scans in groups of this size on \"scan_bundle\" instead of \"scan\""
+               " (default 1, no bundling)" << std::endl;
+  std::cout << "    flight_recorder  Dump the raw data of the last 10 s on timeouts and stream errors"
+               " (default true)" << std::endl;
+  std::cout << "    flight_recorder_dir  Directory of the dumps (default \".\")" << std::endl;
+  std::cout << "    min_range  Beams closer than this are published as no echo (default 0)" << std::endl;
+  std::cout << "    min_rssi  Beams with lower remission are published as no echo (default 0)" << std::endl;
+  std::cout << "    sector_service  Answer lms1xx/SectorQuery for the latest scan on \"sector_min\" (default false)"
+            << std::endl;
+  std::cout << "    multicast_group  Also send every scan (raw telegram with raw_passthrough) to this UDP multicast"
+            << " group, see lms1xx/scan_multicast.h (default \"\", off)" << std::endl;
+  std::cout << "    multicast_port  Port of the multicast group (default 2113)" << std::endl;
+  std::cout << "    multicast_interface  Address of the interface to send on (default \"\", the default route)"
+            << std::endl;
+  std::cout << "    multicast_sensor_id  Sensor id of the multicast messages (default -1, random per run)"
+            << std::endl;
+  std::cout << "    raw_passthrough  Only publish the received telegrams on \"telegrams\", to be converted by"
+               " telegram_decoder on another host (default false)" << std::endl;
+  std::cout << "    field_sets  List of field sets, each a list of {name, polygon: [[x, y], ...]}."
+            " Evaluated fields are published on \"fields\", the active set is selected on \"field_set\"." << std::endl;
+  std::cout << "    pipeline  List of processing stages, each {type, name, stage parameters}, run on every scan."
+            " Point and change outputs are published on topics named after them, see lms1xx/scan_pipeline.h"
+            << std::endl;
+  std::cout << "    pipeline_deadline  Share of the scan period the pipeline may take, optional stages are skipped"
+               " to keep it (default 0.5)" << std::endl;
 }
 
 bool setup(LMS5xx &laser, sensor_msgs::LaserScan &scan_msg, sensor_msgs::MultiEchoLaserScan &multi_scan_msg,
-           const CoLaAEchoFilter::EchoFilter echo_mode, double max_range)
+           const CoLaAEchoFilter::EchoFilter echo_mode, double max_range, ScanPipeline &pipeline)
 {
   ScanConfig cfg;
   ScanOutputRange output_range;
@@ -74,6 +118,7 @@ bool setup(LMS5xx &laser, sensor_msgs::LaserScan &scan_msg, sensor_msgs::MultiEc
   multi_scan_msg.range_min = 0.01;
   multi_scan_msg.range_max = max_range;
   multi_scan_msg.scan_time = 100.0 / cfg.scan_frequency;
+  pipeline.setScanFrequency(cfg.scan_frequency);
 
   ROS_DEBUG_STREAM("Device resolution is " << (double)output_range.angular_resolution / 10000.0 << " degrees.");
   ROS_DEBUG_STREAM("Device frequency is " << (double)cfg.scan_frequency / 100.0 << " Hz");
@@ -87,6 +132,8 @@ bool setup(LMS5xx &laser, sensor_msgs::LaserScan &scan_msg, sensor_msgs::MultiEc
   }
   scan_msg.ranges.resize(num_values);
   scan_msg.intensities.resize(num_values);
+  size_t echo_count = echo_mode == CoLaAEchoFilter::AllEchoes ? ALL_ECHOES_COUNT : 1;
+  laser.setReceiveBufferSize(CoLaA::estimateReceiveBuffer(num_values, echo_count, cfg.scan_frequency / 100.0));
 
   multi_scan_msg.ranges.resize(ALL_ECHOES_COUNT);
   multi_scan_msg.intensities.resize(ALL_ECHOES_COUNT);
@@ -130,6 +177,41 @@ bool setup(LMS5xx &laser, sensor_msgs::LaserScan &scan_msg, sensor_msgs::MultiEc
   return true;
 }
 
+/**
+ * @brief Read the field_sets parameter
+ * @return false if the parameter is malformed
+ */
+bool loadFieldSets(ros::NodeHandle &n, FieldEvaluator &evaluator)
+{
+  XmlRpc::XmlRpcValue sets;
+  if (!n.getParam("field_sets", sets))
+    return true;
+  try
+  {
+    for (int s = 0; s < sets.size(); ++s)
+    {
+      std::vector<FieldPolygon> fields(sets[s].size());
+      for (int f = 0; f < sets[s].size(); ++f)
+      {
+        fields[f].name = static_cast<std::string>(sets[s][f]["name"]);
+        XmlRpc::XmlRpcValue &polygon = sets[s][f]["polygon"];
+        for (int p = 0; p < polygon.size(); ++p)
+        {
+          fields[f].points.push_back(static_cast<double>(polygon[p][0]));
+          fields[f].points.push_back(static_cast<double>(polygon[p][1]));
+        }
+      }
+      evaluator.addFieldSet(fields);
+    }
+  }
+  catch (XmlRpc::XmlRpcException &e)
+  {
+    ROS_ERROR_STREAM("Invalid field_sets parameter: " << e.getMessage());
+    return false;
+  }
+  return true;
+}
+
 int main(int argc, char **argv)
 {
   if (argc == 2)
@@ -146,6 +228,9 @@ int main(int argc, char **argv)
   LMS5xx laser;
   sensor_msgs::LaserScan scan_msg;
   sensor_msgs::MultiEchoLaserScan multi_scan_msg;
+  MessagePool<sensor_msgs::LaserScan> scan_pool;
+  MessagePool<sensor_msgs::MultiEchoLaserScan> multi_scan_pool;
+  DecodedScan decoded;
 
   // parameters
   std::string host;
@@ -154,11 +239,15 @@ int main(int argc, char **argv)
   std::string echoes;
   CoLaAEchoFilter::EchoFilter echo_mode = CoLaAEchoFilter::AllEchoes;
   double max_range = 80;
+  bool odometry;
+  std::string odom_frame_id;
+  bool tracking;
+  int bundle_size;
 
   ros::init(argc, argv, "lms5xx");
   ros::NodeHandle nh;
   ros::NodeHandle n("~");
-  ros::Publisher scan_pub = nh.advertise<sensor_msgs::LaserScan>("scan", 1);
+  ros::Publisher scan_pub;
   ros::Publisher multi_pub;
 
   n.param<std::string>("host", host, "192.168.0.1");
@@ -166,6 +255,57 @@ int main(int argc, char **argv)
   n.param<int>("port", port, 2111);
   n.param<std::string>("echoes", echoes, "all");
   n.param<double>("range", max_range, 80);
+  n.param<bool>("odometry", odometry, false);
+  n.param<std::string>("odom_frame_id", odom_frame_id, "laser_odom");
+  n.param<bool>("tracking", tracking, false);
+  n.param<int>("bundle_size", bundle_size, 1);
+
+  // With bundling the scans are published in groups of bundle_size instead of one message each
+  std::unique_ptr<ScanBundler> bundler;
+  ros::Publisher bundle_pub;
+  if (bundle_size > 1)
+  {
+    bundler.reset(new ScanBundler(bundle_size));
+    bundle_pub = nh.advertise<lms1xx::ScanBundle>("scan_bundle", 1);
+  }
+  else
+  {
+    scan_pub = nh.advertise<sensor_msgs::LaserScan>("scan", 1);
+  }
+
+  // Raw data of the last seconds is dumped as capture file on timeouts and stream errors
+  std::unique_ptr<FlightRecorder> recorder = setupFlightRecorder(n, laser);
+
+  // Beams closer than min_range or weaker than min_rssi are published like beams without echo
+  setupBeamLimits(n, laser);
+
+  // Scans, or the raw telegrams with raw_passthrough, are sent once to a UDP multicast group for all consumers
+  std::unique_ptr<MulticastSender> multicast = setupMulticast(n);
+
+  // Raw passthrough only frames the telegrams and publishes them on "telegrams" for telegram_decoder
+  bool raw_passthrough;
+  n.param<bool>("raw_passthrough", raw_passthrough, false);
+  std::unique_ptr<TelegramPublisher> passthrough;
+  if (raw_passthrough)
+  {
+    passthrough.reset(new TelegramPublisher(nh, "telegrams", frame_id));
+    passthrough->setMulticast(multicast.get());
+  }
+
+  // Closest range in a sector of the latest scan, answered from its own thread on "sector_min"
+  bool sector_service;
+  n.param<bool>("sector_service", sector_service, false);
+  std::unique_ptr<SectorService> sectors;
+  if (sector_service)
+    sectors.reset(new SectorService(nh, "sector_min"));
+
+  // In-driver processing stages run on every scan, their outputs are published on topics named after them.
+  // Optional stages are skipped for a scan when the pipeline would take longer than pipeline_deadline
+  // times the scan period.
+  ScanPipeline pipeline;
+  std::unique_ptr<PipelinePublisher> pipeline_pub;
+  if (!setupPipeline(n, nh, frame_id, pipeline, pipeline_pub))
+    return 1;
 
   if (echoes == std::string("first"))
   {
@@ -201,6 +341,53 @@ int main(int argc, char **argv)
   scan_msg.header.frame_id = frame_id;
   multi_scan_msg.header.frame_id = frame_id;
 
+  // Scan matching odometry, allocated once and kept across reconnects
+  std::unique_ptr<ScanMatcher> matcher;
+  nav_msgs::Odometry odom_msg;
+  ros::Publisher odom_pub;
+  if (odometry)
+  {
+    ScanMatcherConfig matcher_config;
+    matcher_config.max_range = std::min(max_range, matcher_config.max_range);
+    matcher.reset(new ScanMatcher(matcher_config));
+    odom_pub = nh.advertise<nav_msgs::Odometry>("laser_odom", 1);
+    odom_msg.header.frame_id = odom_frame_id;
+    odom_msg.child_frame_id = frame_id;
+  }
+
+  std::unique_ptr<ScanTracker> tracker;
+  lms1xx::TrackArray tracks_msg;
+  ros::Publisher tracks_pub;
+  if (tracking)
+  {
+    ScanTrackerConfig tracker_config;
+    tracker_config.max_range = max_range;
+    tracker.reset(new ScanTracker(tracker_config));
+    tracks_msg.header.frame_id = frame_id;
+    tracks_msg.tracks.reserve(tracker_config.max_tracks);
+    tracks_pub = nh.advertise<lms1xx::TrackArray>("tracks", 1);
+  }
+
+  FieldEvaluator evaluator;
+  lms1xx::FieldStatus field_msg;
+  ros::Publisher field_pub;
+  ros::Subscriber field_set_sub;
+  if (!loadFieldSets(n, evaluator))
+  {
+    return 1;
+  }
+  if (evaluator.fieldSetCount() > 0)
+  {
+    field_msg.header.frame_id = frame_id;
+    field_pub = nh.advertise<lms1xx::FieldStatus>("fields", 1);
+    field_set_sub = nh.subscribe<std_msgs::UInt8>("field_set", 1,
+                                                  [&evaluator](const std_msgs::UInt8::ConstPtr &msg)
+    {
+      if (!evaluator.selectFieldSet(msg->data))
+        ROS_WARN("Field set %d does not exist", msg->data);
+    });
+  }
+
   while (ros::ok())
   {
     ROS_INFO_STREAM("Connecting to laser at " << host);
@@ -212,10 +399,14 @@ int main(int argc, char **argv)
       continue;
     }
 
-    if (!setup(laser, scan_msg, multi_scan_msg, echo_mode, max_range))
+    if (!setup(laser, scan_msg, multi_scan_msg, echo_mode, max_range, pipeline))
     {
       continue;
     }
+    scan_pool.setPrototype(scan_msg);
+    if (bundler)
+      bundler->setPrototype(scan_msg);
+    multi_scan_pool.setPrototype(multi_scan_msg);
 
     ROS_DEBUG("Starting measurements.");
     laser.startMeasurement();
@@ -238,6 +429,17 @@ int main(int argc, char **argv)
 
     while (ros::ok())
     {
+      if (passthrough)
+      {
+        if (!passthrough->publishNext(laser))
+        {
+          ROS_ERROR("Laser timed out on delivering scan, attempting to reinitialize.");
+          break;
+        }
+        ros::spinOnce();
+        continue;
+      }
+
       ros::Time start = ros::Time::now();
 
       scan_msg.header.stamp = start;
@@ -250,18 +452,87 @@ int main(int argc, char **argv)
       ROS_DEBUG("Reading scan data.");
       if (laser.getScanData(&data))
       {
+        if (multicast)
+          multicast->sendScan(data, start.toNSec());
+        if (sectors)
+          sectors->update(data, start);
+        decoded.reset(data);
         // Configured echo or first echo if "all" is selected
-        CoLaAConversion::fillLaserScan(scan_msg, data);
-        ROS_DEBUG("Publishing single scan data.");
-        scan_pub.publish(scan_msg);
+        if (bundler)
+        {
+          sensor_msgs::LaserScan &scan = bundler->next();
+          scan.header.stamp = scan_msg.header.stamp;
+          scan.header.seq = scan_msg.header.seq;
+          CoLaAConversion::fillLaserScan(scan, decoded);
+          if (bundler->full())
+          {
+            ROS_DEBUG("Publishing scan bundle.");
+            bundle_pub.publish(bundler->take());
+            LMS1XX_TRACE3(publish, data.header.device.serial_number, data.header.status_info.telegram_counter,
+                          scan_msg.ranges.size() * bundle_size);
+          }
+        }
+        else
+        {
+          sensor_msgs::LaserScanPtr scan = scan_pool.acquire();
+          scan->header.stamp = scan_msg.header.stamp;
+          scan->header.seq = scan_msg.header.seq;
+          CoLaAConversion::fillLaserScan(*scan, decoded);
+          ROS_DEBUG("Publishing single scan data.");
+          scan_pub.publish(scan);
+          LMS1XX_TRACE3(publish, data.header.device.serial_number, data.header.status_info.telegram_counter,
+                        scan->ranges.size());
+        }
+
+        if (matcher)
+        {
+          Pose2D previous = matcher->pose();
+          if (matcher->addScan(data))
+          {
+            double dt = odom_msg.header.stamp.isZero() ? 0 : (start - odom_msg.header.stamp).toSec();
+            odom_msg.header.stamp = start;
+            CoLaAConversion::fillOdometry(odom_msg, matcher->pose(), previous, dt);
+            odom_pub.publish(odom_msg);
+          }
+          else
+          {
+            ROS_DEBUG("Scan matching failed (score %f).", matcher->score());
+          }
+        }
+
+        if (evaluator.fieldSetCount() > 0)
+        {
+          const std::vector<FieldResult> &results = evaluator.evaluate(data);
+          field_msg.header.stamp = start;
+          CoLaAConversion::fillFieldStatus(field_msg, evaluator, results);
+          field_pub.publish(field_msg);
+        }
+
+        if (tracker)
+        {
+          tracker->update(data, start.toSec());
+          tracks_msg.header.stamp = start;
+          CoLaAConversion::fillTrackArray(tracks_msg, *tracker);
+          tracks_pub.publish(tracks_msg);
+        }
 
         // The multi-echo message if all echoes are selected
         if (echo_mode == CoLaAEchoFilter::AllEchoes)
         {
-
-          CoLaAConversion::fillMultiEchoLaserScan(multi_scan_msg, data);
+          sensor_msgs::MultiEchoLaserScanPtr multi_scan = multi_scan_pool.acquire();
+          multi_scan->header.stamp = multi_scan_msg.header.stamp;
+          multi_scan->header.seq = multi_scan_msg.header.seq;
+          CoLaAConversion::fillMultiEchoLaserScan(*multi_scan, decoded);
           ROS_DEBUG("Publishing multi scan data.");
-          multi_pub.publish(multi_scan_msg);
+          multi_pub.publish(multi_scan);
+          LMS1XX_TRACE3(publish, data.header.device.serial_number, data.header.status_info.telegram_counter,
+                        multi_scan->ranges.size() * scan_msg.ranges.size());
+        }
+
+        if (pipeline_pub)
+        {
+          pipeline.process(decoded, start.toNSec());
+          pipeline_pub->publish(pipeline, data, start);
         }
       }
       else
@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lms1xx/metrics_exporter.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "lms1xx/colaa_log.h"
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+#include "lms1xx/colaa.h"
+
+namespace
+{
+struct Counter
+{
+  const char *name;
+  const char *help;
+  std::atomic<uint64_t> CoLaAStatistics::*member;
+};
+
+const Counter COUNTERS[] =
+{
+  {"lms1xx_telegrams", "Parsed scan telegrams", &CoLaAStatistics::telegrams},
+  {"lms1xx_received_bytes", "Bytes read from the sensor socket", &CoLaAStatistics::bytes_received},
+  {"lms1xx_buffer_resets", "Times the receive buffer dropped data to resynchronise", &CoLaAStatistics::buffer_resets},
+  {"lms1xx_reconnects", "Successful connects after the first one", &CoLaAStatistics::reconnects},
+  {"lms1xx_telegram_gaps", "Telegrams missing according to the telegram counter", &CoLaAStatistics::telegram_gaps},
+  {"lms1xx_non_scan_telegrams", "Framed messages that were not scan data", &CoLaAStatistics::non_scan_telegrams},
+  {"lms1xx_parse_failures", "Scan telegrams that were truncated or malformed", &CoLaAStatistics::parse_failures},
+  {"lms1xx_timeouts", "Scan reads that timed out", &CoLaAStatistics::timeouts},
+  {"lms1xx_backlogs", "Times telegrams piled up in the socket buffer", &CoLaAStatistics::backlogs},
+};
+}
+
+MetricsExporter::MetricsExporter(const std::string &address, int port)
+  : address_(address), port_(port), listen_fd_(-1)
+{
+  wake_fds_[0] = -1;
+  wake_fds_[1] = -1;
+}
+
+MetricsExporter::~MetricsExporter()
+{
+  stop();
+}
+
+void MetricsExporter::addSensor(const std::string &name, const CoLaA &sensor)
+{
+  addStatistics(name, sensor.getStatistics());
+}
+
+void MetricsExporter::addStatistics(const std::string &name, const CoLaAStatistics &statistics)
+{
+  std::lock_guard<std::mutex> lock(sensors_mutex_);
+  sensors_.push_back(std::make_pair(name, &statistics));
+}
+
+bool MetricsExporter::start()
+{
+  listen_fd_ = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (listen_fd_ < 0)
+    return false;
+  int one = 1;
+  setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port_);
+  inet_pton(AF_INET, address_.c_str(), &addr.sin_addr);
+  if (bind(listen_fd_, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(listen_fd_, 4) != 0
+      || pipe(wake_fds_) != 0)
+  {
+    logError("Unable to bind metrics endpoint to %s:%d", address_.c_str(), port_);
+    close(listen_fd_);
+    listen_fd_ = -1;
+    return false;
+  }
+  socklen_t len = sizeof(addr);
+  getsockname(listen_fd_, (struct sockaddr *) &addr, &len);
+  port_ = ntohs(addr.sin_port);
+
+  thread_ = std::thread(&MetricsExporter::run, this);
+  return true;
+}
+
+void MetricsExporter::stop()
+{
+  if (thread_.joinable())
+  {
+    char c = 0;
+    if (write(wake_fds_[1], &c, 1) != 1)
+      logWarn("Unable to wake metrics thread");
+    thread_.join();
+  }
+  for (int fd : {listen_fd_, wake_fds_[0], wake_fds_[1]})
+  {
+    if (fd >= 0)
+      close(fd);
+  }
+  listen_fd_ = -1;
+  wake_fds_[0] = -1;
+  wake_fds_[1] = -1;
+}
+
+int MetricsExporter::port() const
+{
+  return port_;
+}
+
+std::string MetricsExporter::render() const
+{
+  std::lock_guard<std::mutex> lock(sensors_mutex_);
+  std::ostringstream ss;
+  for (const Counter &counter : COUNTERS)
+  {
+    ss << "# HELP " << counter.name << " " << counter.help << "\n";
+    ss << "# TYPE " << counter.name << " counter\n";
+    for (size_t i = 0; i < sensors_.size(); ++i)
+    {
+      ss << counter.name << "_total{sensor=\"" << sensors_[i].first << "\"} "
+         << (sensors_[i].second->*counter.member).load(std::memory_order_relaxed) << "\n";
+    }
+  }
+
+  ss << "# HELP lms1xx_socket_queue_bytes Bytes waiting in the kernel socket buffer after the last read\n";
+  ss << "# TYPE lms1xx_socket_queue_bytes gauge\n";
+  for (size_t i = 0; i < sensors_.size(); ++i)
+  {
+    ss << "lms1xx_socket_queue_bytes{sensor=\"" << sensors_[i].first << "\"} "
+       << sensors_[i].second->socket_queue_bytes.load(std::memory_order_relaxed) << "\n";
+  }
+  ss << "# HELP lms1xx_scans_behind Telegrams waiting in the kernel socket buffer\n";
+  ss << "# TYPE lms1xx_scans_behind gauge\n";
+  for (size_t i = 0; i < sensors_.size(); ++i)
+  {
+    ss << "lms1xx_scans_behind{sensor=\"" << sensors_[i].first << "\"} "
+       << sensors_[i].second->scans_behind.load(std::memory_order_relaxed) << "\n";
+  }
+
+  ss << "# HELP lms1xx_parse_seconds Time spent parsing a scan telegram\n";
+  ss << "# TYPE lms1xx_parse_seconds histogram\n";
+  for (size_t i = 0; i < sensors_.size(); ++i)
+  {
+    const AtomicHistogram &hist = sensors_[i].second->parse_time;
+    uint64_t cumulative = 0;
+    for (size_t b = 0; b < AtomicHistogram::BUCKETS; ++b)
+    {
+      cumulative += hist.counts[b].load(std::memory_order_relaxed);
+      ss << "lms1xx_parse_seconds_bucket{sensor=\"" << sensors_[i].first << "\",le=\"";
+      if (b < AtomicHistogram::BUCKETS - 1)
+        ss << AtomicHistogram::BOUNDS_US[b] * 1e-6;
+      else
+        ss << "+Inf";
+      ss << "\"} " << cumulative << "\n";
+    }
+    ss << "lms1xx_parse_seconds_sum{sensor=\"" << sensors_[i].first << "\"} "
+       << hist.sum_ns.load(std::memory_order_relaxed) * 1e-9 << "\n";
+    ss << "lms1xx_parse_seconds_count{sensor=\"" << sensors_[i].first << "\"} " << cumulative << "\n";
+  }
+  ss << "# EOF\n";
+  return ss.str();
+}
+
+void MetricsExporter::run()
+{
+  while (true)
+  {
+    struct pollfd fds[2];
+    fds[0].fd = listen_fd_;
+    fds[0].events = POLLIN;
+    fds[1].fd = wake_fds_[0];
+    fds[1].events = POLLIN;
+    if (poll(fds, 2, -1) < 0)
+    {
+      // Signals delivered to this thread must not end the exporter
+      if (errno == EINTR)
+        continue;
+      logError("Metrics endpoint stopped, poll failed: %s", strerror(errno));
+      return;
+    }
+    if (fds[1].revents & POLLIN)
+      return;
+    if (!(fds[0].revents & POLLIN))
+      continue;
+
+    int client = accept(listen_fd_, NULL, NULL);
+    if (client < 0)
+      continue;
+
+    // Wait briefly for the request, its content does not matter
+    struct pollfd request;
+    request.fd = client;
+    request.events = POLLIN;
+    char buf[1024];
+    if (poll(&request, 1, 1000) > 0 && read(client, buf, sizeof(buf)) >= 0)
+    {
+      std::string body = render();
+      std::ostringstream response;
+      response << "HTTP/1.0 200 OK\r\n"
+               << "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+               << "Content-Length: " << body.size() << "\r\n"
+               << "Connection: close\r\n\r\n" << body;
+      std::string out = response.str();
+      size_t written = 0;
+      while (written < out.size())
+      {
+        ssize_t ret = send(client, out.data() + written, out.size() - written, MSG_NOSIGNAL);
+        if (ret <= 0)
+          break;
+        written += ret;
+      }
+    }
+    close(client);
+  }
+}
@@ -18,7 +18,7 @@
 #include "lms1xx/mrs1000.h"
 #include <cstring>
 #include <sstream>
-#include <console_bridge/console.h>
+#include "lms1xx/colaa_log.h"
 
 MRS1000::MRS1000()
 {
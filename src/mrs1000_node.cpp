@@ -15,14 +15,22 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <memory>
 #include <sstream>
+#include <lms1xx/message_pool.h>
 #include <lms1xx/mrs1000.h>
+#include <lms1xx/node_setup.h>
+#include <lms1xx/pipeline_publisher.h>
+#include <lms1xx/raw_telegram.h>
+#include <lms1xx/scan_multicast.h>
+#include <lms1xx/scan_bundle.h>
 #include <ros/ros.h>
 #include <sensor_msgs/PointCloud2.h>
 #include <sensor_msgs/point_cloud2_iterator.h>
 #include <sensor_msgs/MultiEchoLaserScan.h>
 #include <sensor_msgs/LaserScan.h>
 #include "lms1xx/colaa_conversion.h"
+#include "lms1xx/tracing.h"
 
 static size_t getLayerIndex(uint16_t layer)
 {
@@ -45,7 +53,11 @@ enum CloudEchoes
 {
   First,
   Strongest,
-  All
+  All,
+  /**
+   * @brief Only real returns of all echoes, unorganized cloud
+   */
+  Returns
 };
 }
 
@@ -59,6 +71,11 @@ int main(int argc, char **argv)
   sensor_msgs::PointCloud2 cloud;
   sensor_msgs::MultiEchoLaserScan multi_scan;
   sensor_msgs::LaserScan scan;
+  // One layer of each is in flight per layer publisher, the cloud collects all layers
+  MessagePool<sensor_msgs::PointCloud2> cloud_pool(2);
+  MessagePool<sensor_msgs::MultiEchoLaserScan> multi_scan_pool(8);
+  MessagePool<sensor_msgs::LaserScan> scan_pool(8);
+  DecodedScan decoded;
   double max_range;
   CoLaAEchoFilter::EchoFilter echo_mode =  CoLaAEchoFilter::FirstEcho;
   bool particle_filter;
@@ -95,6 +112,53 @@ int main(int argc, char **argv)
   n.param<bool>("mean_filter", mean_filter, false);
   n.param<int>("number_scans", number_scans, 2);
 
+  // Raw data of the last seconds is dumped as capture file on timeouts and stream errors
+  std::unique_ptr<FlightRecorder> recorder = setupFlightRecorder(n, laser);
+
+  // Beams closer than min_range or weaker than min_rssi are published like beams without echo
+  setupBeamLimits(n, laser);
+
+  // Scans, or the raw telegrams with raw_passthrough, are sent once to a UDP multicast group for all consumers
+  std::unique_ptr<MulticastSender> multicast = setupMulticast(n);
+
+  // Raw passthrough only frames the telegrams and publishes them on "telegrams" for telegram_decoder
+  bool raw_passthrough;
+  n.param<bool>("raw_passthrough", raw_passthrough, false);
+  std::unique_ptr<TelegramPublisher> passthrough;
+  if (raw_passthrough)
+  {
+    passthrough.reset(new TelegramPublisher(nh, "telegrams", frame_id));
+    passthrough->setMulticast(multicast.get());
+  }
+
+  // In-driver processing stages run on every scan, their outputs are published on topics named after them.
+  // Optional stages are skipped for a scan when the pipeline would take longer than pipeline_deadline
+  // times the scan period.
+  // LOAM style edge and planar features of every layer on "features/edges" and "features/planes", computed in
+  // beam order of the layer telegrams, skipped rather than delaying the next layer
+  bool features;
+  n.param<bool>("features", features, false);
+  std::vector<StageConfig> extra_stages;
+  if (features)
+  {
+    StageConfig feature_stage;
+    feature_stage.type = "features";
+    feature_stage.optional = true;
+    extra_stages.push_back(feature_stage);
+  }
+  ScanPipeline pipeline;
+  std::unique_ptr<PipelinePublisher> pipeline_pub;
+  if (!setupPipeline(n, nh, frame_id, pipeline, pipeline_pub, extra_stages))
+    return 1;
+
+  // All four layers of a scan in one message instead of one message per layer topic
+  bool bundle_layers;
+  n.param<bool>("bundle_layers", bundle_layers, false);
+  ScanBundler bundler(4);
+  ros::Publisher bundle_pub;
+  if (bundle_layers)
+    bundle_pub = nh.advertise<lms1xx::ScanBundle>("scan_bundle", 1);
+
 
   std::string echoes;
   n.param<std::string>("echoes", echoes, "first");
@@ -121,9 +185,11 @@ int main(int argc, char **argv)
     cloud_echoes = CloudEchoes::Strongest;
   else if (cloud_echo_str == "all")
     cloud_echoes = CloudEchoes::All;
+  else if (cloud_echo_str == "returns")
+    cloud_echoes = CloudEchoes::Returns;
   else
   {
-    ROS_ERROR("cloud_echo must be one of \"first\", \"strongest\", \"all\".");
+    ROS_ERROR("cloud_echo must be one of \"first\", \"strongest\", \"all\", \"returns\".");
     return 1;
   }
 
@@ -141,6 +207,12 @@ int main(int argc, char **argv)
   cloud.header.stamp = ros::Time::now();
   cloud.height = 4; // 4 layers
   cloud.width = scan_count *  cloud_echo_count;
+  if (cloud_echoes == CloudEchoes::Returns)
+  {
+    // Sized for every echo of every layer, shrunk to the real returns before publishing
+    cloud.height = 1;
+    cloud.width = 4 * scan_count * echo_count;
+  }
 
   // TODO individual frames for layers?
   multi_scan.range_min = .2f;
@@ -170,7 +242,7 @@ int main(int argc, char **argv)
     "intensity", 1, sensor_msgs::PointField::FLOAT32);
   //modifier.setPointCloud2FieldsByString(2, "xyz", "intensity");
   cloud.is_bigendian = false;
-  cloud.is_dense = false;
+  cloud.is_dense = cloud_echoes == CloudEchoes::Returns;
 
   while (ros::ok())
   {
@@ -193,6 +265,7 @@ int main(int argc, char **argv)
 
     ROS_DEBUG("Laser configuration: scaningFrequency %d, activeSensors %d, angleResolution %d, startAngle %d, stopAngle %d",
               cfg.scan_frequency, cfg.num_sectors, cfg.angualar_resolution, cfg.start_angle, cfg.stop_angle);
+    pipeline.setScanFrequency(cfg.scan_frequency);
     ROS_DEBUG("Laser output range: angleResolution %d, startAngle %d, stopAngle %d",
               output_range.angular_resolution, output_range.start_angle, output_range.stop_angle);
 
@@ -200,6 +273,11 @@ int main(int argc, char **argv)
     multi_scan.time_increment = (output_range.angular_resolution / 10000.0) / 360.0 / (cfg.scan_frequency / 100.0);
     scan.scan_time = multi_scan.scan_time;
     scan.time_increment = multi_scan.time_increment;
+    laser.setReceiveBufferSize(CoLaA::estimateReceiveBuffer(scan_count, echo_count, cfg.scan_frequency / 100.0));
+    cloud_pool.setPrototype(cloud);
+    multi_scan_pool.setPrototype(multi_scan);
+    scan_pool.setPrototype(scan);
+    bundler.setPrototype(scan);
 
     ROS_INFO("Connected to laser.");
 
@@ -248,24 +326,30 @@ int main(int argc, char **argv)
     laser.scanContinuous(true);
     //laser.requestLastScan();
 
+    // The cloud is taken from the pool when its first layer arrives
+    sensor_msgs::PointCloud2Ptr cloud_msg;
     sensor_msgs::PointCloud2Iterator<float>iter_x(cloud, "x");
     sensor_msgs::PointCloud2Iterator<float>iter_y(cloud, "y");
     sensor_msgs::PointCloud2Iterator<float>iter_z(cloud, "z");
     sensor_msgs::PointCloud2Iterator<float>iter_int(cloud, "intensity");
-    sensor_msgs::PointCloud2Iterator<float>start_iter_x(cloud, "x");
-    sensor_msgs::PointCloud2Iterator<float>start_iter_y(cloud, "y");
-    sensor_msgs::PointCloud2Iterator<float>start_iter_z(cloud, "z");
-    sensor_msgs::PointCloud2Iterator<float>start_iter_int(cloud, "intensity");
     bool synced = false;
     int layers_received = 0;
+    size_t cloud_points = 0;
 
     while (ros::ok())
     {
-      ros::Time start = ros::Time::now();
+      if (passthrough)
+      {
+        if (!passthrough->publishNext(laser))
+        {
+          ROS_ERROR("Laser timed out on delivering scan, attempting to reinitialize.");
+          break;
+        }
+        ros::spinOnce();
+        continue;
+      }
 
-      cloud.header.stamp = start;
-      scan.header.stamp = start;
-      multi_scan.header.stamp = start;
+      ros::Time start = ros::Time::now();
 
       //scanDataLayerMRS data;
       ScanData data;
@@ -273,23 +357,70 @@ int main(int argc, char **argv)
 
       if (laser.getScanData(&data))
       {
+        if (multicast)
+          multicast->sendScan(data, start.toNSec());
         ++layers_received;
-        CoLaAConversion::fillLaserScan(scan, data);
-        ROS_DEBUG("Publishing scan data");
-        layer_pubs.at(getLayerIndex(data.header.status_info.layer_angle)).publish(scan);
+        decoded.reset(data);
+        if (bundle_layers)
+        {
+          // A bundle always starts with the first layer, incomplete bundles are dropped
+          if (data.header.status_info.layer_angle == CoLaALayers::Layer2)
+            bundler.clear();
+          if (data.header.status_info.layer_angle == CoLaALayers::Layer2 || !bundler.empty())
+          {
+            sensor_msgs::LaserScan &layer_scan = bundler.next();
+            layer_scan.header.stamp = start;
+            CoLaAConversion::fillLaserScan(layer_scan, decoded);
+          }
+          if (data.header.status_info.layer_angle == CoLaALayers::Layer4 && bundler.full())
+          {
+            ROS_DEBUG("Publishing layer bundle");
+            bundle_pub.publish(bundler.take());
+            LMS1XX_TRACE3(publish, data.header.device.serial_number, data.header.status_info.telegram_counter,
+                          data.ch16bit[0].data.size() * 4);
+          }
+        }
+        else
+        {
+          sensor_msgs::LaserScanPtr layer_scan = scan_pool.acquire();
+          layer_scan->header.stamp = start;
+          CoLaAConversion::fillLaserScan(*layer_scan, decoded);
+          ROS_DEBUG("Publishing scan data");
+          layer_pubs.at(getLayerIndex(data.header.status_info.layer_angle)).publish(layer_scan);
+          LMS1XX_TRACE3(publish, data.header.device.serial_number, data.header.status_info.telegram_counter,
+                        layer_scan->ranges.size());
+        }
 
         // Publish Multiecho scan for this layer
-        CoLaAConversion::fillMultiEchoLaserScan(multi_scan, data);
+        sensor_msgs::MultiEchoLaserScanPtr layer_multi_scan = multi_scan_pool.acquire();
+        layer_multi_scan->header.stamp = start;
+        CoLaAConversion::fillMultiEchoLaserScan(*layer_multi_scan, decoded);
         ROS_DEBUG("Publishing multi scan data.");
-        layer_multi_pubs.at(getLayerIndex(data.header.status_info.layer_angle)).publish(multi_scan);
+        layer_multi_pubs.at(getLayerIndex(data.header.status_info.layer_angle)).publish(layer_multi_scan);
 
-        // reset iterators when receiving the first one, so we collect all layers in one cloud
+        if (pipeline_pub)
+        {
+          pipeline.process(decoded, start.toNSec());
+          pipeline_pub->publish(pipeline, data, start);
+        }
+
+        // start a new cloud when receiving the first layer, so we collect all layers in one cloud
         if (data.header.status_info.layer_angle == CoLaALayers::Layer2)
         {
-          iter_x = start_iter_x;
-          iter_y = start_iter_y;
-          iter_z = start_iter_z;
-          iter_int = start_iter_int;
+          cloud_msg = cloud_pool.acquire();
+          cloud_msg->header.stamp = start;
+          if (cloud_echoes == CloudEchoes::Returns)
+          {
+            // A reused cloud was shrunk to the returns of an earlier scan
+            cloud_msg->width = cloud.width;
+            cloud_msg->row_step = cloud.row_step;
+            cloud_msg->data.resize(cloud.data.size());
+            cloud_points = 0;
+          }
+          iter_x = sensor_msgs::PointCloud2Iterator<float>(*cloud_msg, "x");
+          iter_y = sensor_msgs::PointCloud2Iterator<float>(*cloud_msg, "y");
+          iter_z = sensor_msgs::PointCloud2Iterator<float>(*cloud_msg, "z");
+          iter_int = sensor_msgs::PointCloud2Iterator<float>(*cloud_msg, "intensity");
           synced = true;
           layers_received = 1;
         }
@@ -303,17 +434,29 @@ int main(int argc, char **argv)
           continue;
         }
         if (cloud_echoes == CloudEchoes::First)
-          CoLaAConversion::fillPointCloud2(iter_x, iter_y, iter_z, iter_int, data);
+          CoLaAConversion::fillPointCloud2(iter_x, iter_y, iter_z, iter_int, decoded);
         else if (cloud_echoes == CloudEchoes::All)
-          CoLaAConversion::fillPointCloud2MultiEcho(iter_x, iter_y, iter_z, iter_int, data);
+          CoLaAConversion::fillPointCloud2MultiEcho(iter_x, iter_y, iter_z, iter_int, decoded);
+        else if (cloud_echoes == CloudEchoes::Returns)
+          cloud_points += CoLaAConversion::fillPointCloud2Returns(iter_x, iter_y, iter_z, iter_int, decoded);
         else
-          CoLaAConversion::fillPointCloud2Strongest<3>(iter_x, iter_y, iter_z, iter_int, data);
+          CoLaAConversion::fillPointCloud2Strongest<3>(iter_x, iter_y, iter_z, iter_int, decoded);
 
         // Check if this is the last layer of the msg
         if (data.header.status_info.layer_angle == CoLaALayers::Layer4)
         {
+          if (cloud_echoes == CloudEchoes::Returns)
+          {
+            cloud_msg->width = cloud_points;
+            cloud_msg->row_step = cloud_points * cloud_msg->point_step;
+            cloud_msg->data.resize(cloud_msg->row_step);
+          }
           ROS_DEBUG("Publishing scan data.");
-          cloud_pub.publish(cloud);
+          cloud_pub.publish(cloud_msg);
+          LMS1XX_TRACE3(publish, data.header.device.serial_number, data.header.status_info.telegram_counter,
+                        cloud_msg->data.size());
+          cloud_msg.reset();
+          synced = false;
         }
       }
       else
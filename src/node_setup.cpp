@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lms1xx/node_setup.h"
+
+#include <algorithm>
+
+std::unique_ptr<FlightRecorder> setupFlightRecorder(ros::NodeHandle &n, CoLaA &laser)
+{
+  bool flight_recorder;
+  std::string flight_recorder_dir;
+  n.param<bool>("flight_recorder", flight_recorder, true);
+  n.param<std::string>("flight_recorder_dir", flight_recorder_dir, ".");
+  std::unique_ptr<FlightRecorder> recorder;
+  if (!flight_recorder)
+    return recorder;
+
+  FlightRecorderConfig recorder_config;
+  recorder_config.directory = flight_recorder_dir;
+  // "/ns/lms1xx" becomes "ns_lms1xx", a prefix with slashes would point into missing subdirectories
+  recorder_config.prefix = ros::this_node::getName().substr(1);
+  std::replace(recorder_config.prefix.begin(), recorder_config.prefix.end(), '/', '_');
+  recorder.reset(new FlightRecorder(recorder_config));
+  laser.setFlightRecorder(recorder.get());
+  return recorder;
+}
+
+void setupBeamLimits(ros::NodeHandle &n, CoLaA &laser)
+{
+  double min_range;
+  int min_rssi;
+  n.param<double>("min_range", min_range, 0.0);
+  n.param<int>("min_rssi", min_rssi, 0);
+  BeamLimits beam_limits;
+  beam_limits.min_range = min_range;
+  // Each limit only applies to the telegrams carrying its channel, so both are set from the same parameter
+  beam_limits.min_rssi = static_cast<uint8_t>(min_rssi < 0 ? 0 : min_rssi > 255 ? 255 : min_rssi);
+  beam_limits.min_remission = static_cast<uint16_t>(min_rssi < 0 ? 0 : min_rssi > 65535 ? 65535 : min_rssi);
+  laser.setBeamLimits(beam_limits);
+}
+
+std::unique_ptr<MulticastSender> setupMulticast(ros::NodeHandle &n)
+{
+  std::string multicast_group;
+  std::string multicast_interface;
+  int multicast_port;
+  int multicast_sensor_id;
+  n.param<std::string>("multicast_group", multicast_group, "");
+  n.param<std::string>("multicast_interface", multicast_interface, "");
+  n.param<int>("multicast_port", multicast_port, 2113);
+  n.param<int>("multicast_sensor_id", multicast_sensor_id, -1);
+  std::unique_ptr<MulticastSender> multicast;
+  if (multicast_group.empty())
+    return multicast;
+
+  multicast.reset(new MulticastSender());
+  // Without a fixed id every run gets a new random one, so receivers tell the sensors and runs apart
+  if (multicast_sensor_id >= 0)
+    multicast->setSensorId(static_cast<uint32_t>(multicast_sensor_id));
+  if (!multicast->open(multicast_group, multicast_port, multicast_interface))
+  {
+    ROS_ERROR_STREAM("Unable to multicast to " << multicast_group << ":" << multicast_port);
+    multicast.reset();
+  }
+  return multicast;
+}
+
+bool setupPipeline(ros::NodeHandle &n, ros::NodeHandle &nh, const std::string &frame_id, ScanPipeline &pipeline,
+                   std::unique_ptr<PipelinePublisher> &pipeline_pub, const std::vector<StageConfig> &extra_stages)
+{
+  std::vector<StageConfig> stage_configs;
+  if (!loadPipelineConfig(n, "pipeline", stage_configs))
+    return false;
+  stage_configs.insert(stage_configs.end(), extra_stages.begin(), extra_stages.end());
+  double pipeline_deadline;
+  n.param<double>("pipeline_deadline", pipeline_deadline, 0.5);
+  pipeline.setDeadline(pipeline_deadline);
+  if (!pipeline.configure(stage_configs))
+  {
+    ROS_ERROR("Invalid pipeline configuration.");
+    return false;
+  }
+  pipeline_pub.reset();
+  if (!pipeline.empty())
+    pipeline_pub.reset(new PipelinePublisher(nh, frame_id, pipeline.outputs()));
+  return true;
+}
@@ -20,61 +20,89 @@
 #include <cstring>
 #include <sstream>
 
-void nextToken(char **buf, uint8_t &val)
+/**
+ * @brief Cut the next token out of the buffer like strtok(), but stop at the terminating NUL
+ * @return the token, NULL if there is none
+ */
+static char *token(char **buf)
+{
+  char *p = *buf;
+  while (*p == ' ')
+    ++p;
+  if (*p == 0)
+  {
+    *buf = p;
+    return NULL;
+  }
+  char *start = p;
+  while (*p != 0 && *p != ' ')
+    ++p;
+  if (*p == ' ')
+    *p++ = 0;
+  *buf = p;
+  return start;
+}
+
+bool nextToken(char **buf, uint8_t &val)
 {
-  char *str = strtok(*buf, " ");
-  sscanf(str, "%hhx", &val);
-  *buf += strlen(str) + 1;
+  char *str = token(buf);
+  return str && sscanf(str, "%hhx", &val) == 1;
 }
 
-void nextToken(char **buf, uint16_t &val)
+bool nextToken(char **buf, uint16_t &val)
 {
-  char *str = strtok(*buf, " ");
-  sscanf(str, "%hx", &val);
-  *buf += strlen(str) + 1;
+  char *str = token(buf);
+  return str && sscanf(str, "%hx", &val) == 1;
 }
 
-void nextToken(char **buf, uint32_t &val)
+bool nextToken(char **buf, uint32_t &val)
 {
-  char *str = strtok(*buf, " ");
-  sscanf(str, "%x", &val);
-  *buf += strlen(str) + 1;
+  char *str = token(buf);
+  return str && sscanf(str, "%x", &val) == 1;
 }
 
-void nextToken(char **buf, int32_t &val)
+bool nextToken(char **buf, int32_t &val)
 {
   uint32_t temp;
-  nextToken(buf, temp);
+  if (!nextToken(buf, temp))
+    return false;
   val = temp;
+  return true;
 }
 
-void nextToken(char **buf, int16_t &val)
+bool nextToken(char **buf, int16_t &val)
 {
   uint16_t temp;
-  nextToken(buf, temp);
+  if (!nextToken(buf, temp))
+    return false;
   val = temp;
+  return true;
 }
 
-void nextToken(char **buf, float &val)
+bool nextToken(char **buf, float &val)
 {
-  char *str = strtok(*buf, " ");
+  char *str = token(buf);
+  if (!str)
+    return false;
   uint32_t mem;
   std::stringstream ss;
   ss << std::hex << str;
-  ss >> mem;
+  if (!(ss >> mem))
+    return false;
   val = *reinterpret_cast<float *>(&mem);
-  *buf += strlen(str) + 1;
+  return true;
 }
 
-void nextToken(char **buf, std::string &val)
+bool nextToken(char **buf, std::string &val)
 {
-  char *str = strtok(*buf, " ");
+  char *str = token(buf);
+  if (!str)
+    return false;
   val = std::string(str);
-  *buf += strlen(str) + 1;
+  return true;
 }
 
-void nextToken(char **buf)
+bool nextToken(char **buf)
 {
-  strtok(*buf, " ");
-  *buf += strlen(*buf) + 1;
+  return token(buf) != NULL;
 }
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lms1xx/pipeline_publisher.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+#include "lms1xx/colaa_conversion.h"
+#include <sensor_msgs/point_cloud2_iterator.h>
+
+/**
+ * @brief Scalar parameter value as string, false for lists and dictionaries
+ */
+static bool paramString(XmlRpc::XmlRpcValue &value, std::string &out)
+{
+  std::ostringstream s;
+  switch (value.getType())
+  {
+  case XmlRpc::XmlRpcValue::TypeString:
+    out = static_cast<std::string>(value);
+    return true;
+  case XmlRpc::XmlRpcValue::TypeInt:
+    s << static_cast<int>(value);
+    break;
+  case XmlRpc::XmlRpcValue::TypeDouble:
+    s << std::setprecision(15) << static_cast<double>(value);
+    break;
+  case XmlRpc::XmlRpcValue::TypeBoolean:
+    s << (static_cast<bool>(value) ? "true" : "false");
+    break;
+  default:
+    return false;
+  }
+  out = s.str();
+  return true;
+}
+
+bool loadPipelineConfig(ros::NodeHandle &n, const std::string &param, std::vector<StageConfig> &stages)
+{
+  stages.clear();
+  XmlRpc::XmlRpcValue list;
+  if (!n.getParam(param, list))
+    return true;
+  try
+  {
+    for (int i = 0; i < list.size(); ++i)
+    {
+      StageConfig stage;
+      for (XmlRpc::XmlRpcValue::iterator it = list[i].begin(); it != list[i].end(); ++it)
+      {
+        std::string value;
+        if (!paramString(it->second, value))
+        {
+          ROS_ERROR_STREAM("Invalid " << param << " parameter: " << it->first << " of stage " << i
+                           << " is not a scalar");
+          return false;
+        }
+        if (it->first == "type")
+          stage.type = value;
+        else if (it->first == "name")
+          stage.name = value;
+        else if (it->first == "budget")
+          stage.budget = atof(value.c_str());
+        else if (it->first == "optional")
+          stage.optional = value == "true" || value == "1";
+        else
+          stage.params.set(it->first, value);
+      }
+      if (stage.type.empty())
+      {
+        ROS_ERROR_STREAM("Invalid " << param << " parameter: stage " << i << " has no type");
+        return false;
+      }
+      stages.push_back(stage);
+    }
+  }
+  catch (XmlRpc::XmlRpcException &e)
+  {
+    ROS_ERROR_STREAM("Invalid " << param << " parameter: " << e.getMessage());
+    return false;
+  }
+  return true;
+}
+
+PipelinePublisher::PipelinePublisher(ros::NodeHandle &nh, const std::string &frame_id,
+                                     const PipelineOutputs &outputs)
+  : deadline_misses_(0), degraded_(0)
+{
+  sensor_msgs::PointCloud2 prototype;
+  prototype.header.frame_id = frame_id;
+  prototype.height = 1;
+  prototype.width = 0;
+  sensor_msgs::PointCloud2Modifier modifier(prototype);
+  modifier.setPointCloud2Fields(4,
+    "x", 1, sensor_msgs::PointField::FLOAT32,
+    "y", 1, sensor_msgs::PointField::FLOAT32,
+    "z", 1, sensor_msgs::PointField::FLOAT32,
+    "intensity", 1, sensor_msgs::PointField::FLOAT32);
+  prototype.is_bigendian = false;
+  prototype.is_dense = false;
+
+  std::vector<std::string> names = outputs.names<PointsOutput>();
+  for (size_t i = 0; i < names.size(); ++i)
+  {
+    std::unique_ptr<Cloud> &cloud = clouds_[names[i]];
+    cloud.reset(new Cloud());
+    cloud->pub = nh.advertise<sensor_msgs::PointCloud2>(names[i], 1);
+    cloud->pool.setPrototype(prototype);
+  }
+
+  names = outputs.names<std::vector<ChangedRegion> >();
+  for (size_t i = 0; i < names.size(); ++i)
+  {
+    Changes &changes = changes_[names[i]];
+    changes.pub = nh.advertise<lms1xx::ScanChanges>(names[i], 1);
+    changes.msg.header.frame_id = frame_id;
+    changes.had_changes = false;
+  }
+}
+
+void PipelinePublisher::publish(const ScanPipeline &pipeline, const ScanData &data, const ros::Time &stamp)
+{
+  const PipelineStatistics &statistics = pipeline.statistics();
+  if (statistics.deadline_misses != deadline_misses_ || statistics.degraded != degraded_)
+  {
+    ROS_WARN_THROTTLE(10, "Pipeline late on %lu of %lu scans, optional stages skipped on %lu (last %.2f ms).",
+                      statistics.deadline_misses, statistics.scans, statistics.degraded, statistics.last_ns * 1e-6);
+    deadline_misses_ = statistics.deadline_misses;
+    degraded_ = statistics.degraded;
+  }
+
+  const PipelineOutputs &outputs = pipeline.outputs();
+  for (std::map<std::string, std::unique_ptr<Cloud> >::iterator it = clouds_.begin(); it != clouds_.end(); ++it)
+  {
+    const PointsOutput *points = outputs.find<PointsOutput>(it->first);
+    if (!points || it->second->pub.getNumSubscribers() == 0)
+      continue;
+    sensor_msgs::PointCloud2Ptr cloud = it->second->pool.acquire();
+    cloud->header.stamp = stamp;
+    // PointsOutput has the layout of the cloud fields, x y z intensity as float
+    cloud->width = points->count;
+    cloud->row_step = cloud->width * cloud->point_step;
+    cloud->data.resize(cloud->row_step);
+    memcpy(cloud->data.data(), points->xyzi.data(), cloud->data.size());
+    it->second->pub.publish(cloud);
+  }
+
+  for (std::map<std::string, Changes>::iterator it = changes_.begin(); it != changes_.end(); ++it)
+  {
+    const std::vector<ChangedRegion> *regions = outputs.find<std::vector<ChangedRegion> >(it->first);
+    if (!regions)
+      continue;
+    // Like the change detection of the node, one empty message after the last change disappeared
+    if (!regions->empty() || it->second.had_changes)
+    {
+      it->second.msg.header.stamp = stamp;
+      CoLaAConversion::fillScanChanges(it->second.msg, data, *regions);
+      it->second.pub.publish(it->second.msg);
+    }
+    it->second.had_changes = !regions->empty();
+  }
+}
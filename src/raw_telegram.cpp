@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lms1xx/raw_telegram.h"
+
+#include "lms1xx/colaa_conversion.h"
+
+TelegramPublisher::TelegramPublisher(ros::NodeHandle &nh, const std::string &topic, const std::string &frame_id,
+                                     size_t pool_size)
+  : pub_(nh.advertise<lms1xx::RawTelegram>(topic, 1)), multicast_(NULL), pool_(pool_size)
+{
+  lms1xx::RawTelegram prototype;
+  prototype.header.frame_id = frame_id;
+  pool_.setPrototype(prototype);
+}
+
+bool TelegramPublisher::publishNext(CoLaA &laser)
+{
+  lms1xx::RawTelegramPtr telegram = pool_.acquire();
+  if (!laser.getTelegram(telegram->data))
+    return false;
+  telegram->header.stamp = ros::Time::now();
+  if (multicast_)
+    multicast_->sendTelegram(telegram->data.data(), telegram->data.size(), telegram->header.stamp.toNSec());
+  pub_.publish(telegram);
+  return true;
+}
+
+bool TelegramDecoder::decode(const lms1xx::RawTelegram &telegram)
+{
+  header_ = telegram.header;
+  buffer_.assign(telegram.data.begin(), telegram.data.end());
+  buffer_.push_back(0);
+  if (!parser_.parseTelegram(buffer_.data(), &data_) || data_.echoCount() == 0)
+    return false;
+  decoded_.reset(data_);
+  return true;
+}
+
+const CoLaAStatistics &TelegramDecoder::getStatistics() const
+{
+  return parser_.getStatistics();
+}
+
+template <class Scan>
+void TelegramDecoder::fillHeaderAndTiming(Scan &scan) const
+{
+  scan.header.stamp = header_.stamp;
+  scan.header.frame_id = header_.frame_id;
+  // Frequencies are in 1/100 Hz, the step size in 1/10000 deg
+  double frequency = data_.header.frequencies.scan_frequency / 100.0;
+  if (frequency > 0)
+  {
+    scan.scan_time = 1.0 / frequency;
+    scan.time_increment = data_.ch16bit[0].header.step_size / 10000.0 / 360.0 / frequency;
+  }
+}
+
+void TelegramDecoder::fillLaserScan(sensor_msgs::LaserScan &scan, size_t echo)
+{
+  size_t beams = data_.ch16bit[echo].data.size();
+  scan.ranges.resize(beams);
+  scan.intensities.resize(beams);
+  fillHeaderAndTiming(scan);
+  CoLaAConversion::fillLaserScan(scan, decoded_, echo);
+}
+
+void TelegramDecoder::fillMultiEchoLaserScan(sensor_msgs::MultiEchoLaserScan &scan)
+{
+  size_t beams = data_.ch16bit[0].data.size();
+  // The remission channel of the LMS1xx is not an echo but the intensities of the first one
+  scan.ranges.resize(decoded_.echoCount());
+  scan.intensities.resize(decoded_.echoCount());
+  for (size_t i = 0; i < scan.ranges.size(); ++i)
+  {
+    scan.ranges[i].echoes.resize(beams);
+    scan.intensities[i].echoes.resize(beams);
+  }
+  fillHeaderAndTiming(scan);
+  CoLaAConversion::fillMultiEchoLaserScan(scan, decoded_);
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lms1xx/scan_bundle.h"
+
+#include <algorithm>
+#include <utility>
+
+/**
+ * @brief Bundles in use at the same time whose unused scans are kept, like the default pool capacity
+ */
+static const size_t SPARE_BUNDLES = 4;
+
+ScanBundler::ScanBundler(size_t size) : size_(std::max<size_t>(size, 1)), count_(0)
+{
+}
+
+void ScanBundler::setPrototype(const sensor_msgs::LaserScan &scan)
+{
+  prototype_ = scan;
+  lms1xx::ScanBundle bundle;
+  bundle.header.frame_id = scan.header.frame_id;
+  bundle.scans.assign(size_, scan);
+  pool_.setPrototype(bundle);
+  // Spare scans of the old shape are of no use
+  spare_.clear();
+  spare_.reserve(size_ * SPARE_BUNDLES);
+  clear();
+}
+
+sensor_msgs::LaserScan &ScanBundler::next()
+{
+  if (!current_)
+    current_ = pool_.acquire();
+  // A partial bundle handed out earlier may come back with fewer scans
+  if (current_->scans.size() <= count_)
+  {
+    if (spare_.empty())
+    {
+      current_->scans.push_back(prototype_);
+    }
+    else
+    {
+      current_->scans.push_back(std::move(spare_.back()));
+      spare_.pop_back();
+    }
+  }
+  return current_->scans[count_++];
+}
+
+lms1xx::ScanBundlePtr ScanBundler::take()
+{
+  lms1xx::ScanBundlePtr bundle;
+  bundle.swap(current_);
+  if (bundle)
+  {
+    for (size_t i = count_; i < bundle->scans.size() && spare_.size() < spare_.capacity(); ++i)
+      spare_.push_back(std::move(bundle->scans[i]));
+    bundle->scans.resize(count_);
+    bundle->header.stamp = count_ > 0 ? bundle->scans[0].header.stamp : ros::Time();
+  }
+  count_ = 0;
+  return bundle;
+}
+
+void ScanBundler::clear()
+{
+  current_.reset();
+  count_ = 0;
+}
+
+sensor_msgs::LaserScanConstPtr ScanBundling::unbundle(const lms1xx::ScanBundleConstPtr &bundle, size_t index)
+{
+  return sensor_msgs::LaserScanConstPtr(bundle, &bundle->scans[index]);
+}
+
+ros::Subscriber ScanBundling::subscribe(ros::NodeHandle &nh, const std::string &topic, uint32_t queue_size,
+                                        const boost::function<void(const sensor_msgs::LaserScanConstPtr &)> &callback)
+{
+  boost::function<void(const lms1xx::ScanBundleConstPtr &)> unbundler =
+      [callback](const lms1xx::ScanBundleConstPtr &bundle)
+  {
+    for (size_t i = 0; i < bundle->scans.size(); ++i)
+      callback(unbundle(bundle, i));
+  };
+  return nh.subscribe<lms1xx::ScanBundle>(topic, queue_size, unbundler);
+}
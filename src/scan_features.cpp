@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lms1xx/scan_features.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+FeatureExtractor::FeatureExtractor(const FeatureConfig &config) : config_(config)
+{
+  if (config_.window == 0)
+    config_.window = 1;
+  if (config_.sectors == 0)
+    config_.sectors = 1;
+}
+
+void FeatureExtractor::computeCurvature(const float *x, const float *y, const float *ranges, float z_factor,
+                                        size_t count, size_t window, float *curvature)
+{
+  if (count < 2 * window + 1)
+  {
+    std::fill(curvature, curvature + count, -1.0f);
+    return;
+  }
+  std::fill(curvature, curvature + window, -1.0f);
+  std::fill(curvature + count - window, curvature + count, -1.0f);
+
+  const float center = 2.0f * window;
+  size_t i = window;
+  size_t end = count - window;
+#ifdef __SSE2__
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 none = _mm_set1_ps(-1.0f);
+  const __m128 v_center = _mm_set1_ps(center);
+  const __m128 v_z = _mm_set1_ps(z_factor);
+  for (; i + 4 <= end; i += 4)
+  {
+    __m128 r = _mm_loadu_ps(ranges + i);
+    __m128 sx = _mm_mul_ps(_mm_loadu_ps(x + i), v_center);
+    __m128 sy = _mm_mul_ps(_mm_loadu_ps(y + i), v_center);
+    __m128 sr = _mm_mul_ps(r, v_center);
+    __m128 valid = _mm_cmpgt_ps(r, zero);
+    // Same order of additions as the scalar path, so both give identical results
+    sx = _mm_sub_ps(zero, sx);
+    sy = _mm_sub_ps(zero, sy);
+    sr = _mm_sub_ps(zero, sr);
+    for (size_t j = i - window; j <= i + window; ++j)
+    {
+      if (j == i)
+        continue;
+      __m128 rj = _mm_loadu_ps(ranges + j);
+      sx = _mm_add_ps(sx, _mm_loadu_ps(x + j));
+      sy = _mm_add_ps(sy, _mm_loadu_ps(y + j));
+      sr = _mm_add_ps(sr, rj);
+      valid = _mm_and_ps(valid, _mm_cmpgt_ps(rj, zero));
+    }
+    __m128 sz = _mm_mul_ps(sr, v_z);
+    __m128 c = _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, sx), _mm_mul_ps(sy, sy)), _mm_mul_ps(sz, sz));
+    _mm_storeu_ps(curvature + i, _mm_or_ps(_mm_and_ps(valid, c), _mm_andnot_ps(valid, none)));
+  }
+#endif
+  for (; i < end; ++i)
+  {
+    float sx = 0.0f - x[i] * center;
+    float sy = 0.0f - y[i] * center;
+    float sr = 0.0f - ranges[i] * center;
+    bool valid = ranges[i] > 0;
+    for (size_t j = i - window; j <= i + window; ++j)
+    {
+      if (j == i)
+        continue;
+      sx += x[j];
+      sy += y[j];
+      sr += ranges[j];
+      valid = valid && ranges[j] > 0;
+    }
+    float sz = sr * z_factor;
+    curvature[i] = valid ? sx * sx + sy * sy + sz * sz : -1.0f;
+  }
+}
+
+void FeatureExtractor::extract(DecodedScan &decoded, size_t echo)
+{
+  edges_.clear();
+  planes_.clear();
+  if (echo >= decoded.echoCount())
+  {
+    curvature_.clear();
+    labels_.clear();
+    return;
+  }
+
+  const std::vector<float> &ranges = decoded.ranges(echo);
+  const BeamDirections &directions = decoded.directions(echo);
+  size_t count = ranges.size();
+  x_.resize(count);
+  y_.resize(count);
+  for (size_t i = 0; i < count; ++i)
+  {
+    x_[i] = ranges[i] * directions.x[i];
+    y_[i] = ranges[i] * directions.y[i];
+  }
+  curvature_.resize(count);
+  computeCurvature(x_.data(), y_.data(), ranges.data(), directions.z, count, config_.window, curvature_.data());
+
+  labels_.assign(count, BeamFeature::None);
+  blocked_.assign(count, 0);
+  if (count < 2u * config_.window + 1)
+    return;
+  excludeUnreliable(ranges);
+
+  size_t first = config_.window;
+  size_t span = count - 2 * config_.window;
+  for (size_t s = 0; s < config_.sectors; ++s)
+    selectSector(ranges, first + span * s / config_.sectors, first + span * (s + 1) / config_.sectors);
+}
+
+void FeatureExtractor::excludeUnreliable(const std::vector<float> &ranges)
+{
+  size_t count = ranges.size();
+  size_t window = config_.window;
+  for (size_t i = 0; i + 1 < count; ++i)
+  {
+    float a = ranges[i];
+    float b = ranges[i + 1];
+    if (a <= 0 || b <= 0)
+      continue;
+    // The far side of an occlusion boundary is cut off by the near one, its last points are no edges
+    if (a - b > config_.occlusion_ratio * b)
+    {
+      for (size_t l = 0; l <= window && l <= i; ++l)
+        blocked_[i - l] = 1;
+    }
+    else if (b - a > config_.occlusion_ratio * a)
+    {
+      for (size_t l = 1; l <= window + 1 && i + l < count; ++l)
+        blocked_[i + l] = 1;
+    }
+  }
+
+  for (size_t i = 1; i + 1 < count; ++i)
+  {
+    float r = ranges[i];
+    float limit = config_.parallel_ratio * r;
+    if (r > 0 && std::fabs(r - ranges[i - 1]) > limit && std::fabs(ranges[i + 1] - r) > limit)
+      blocked_[i] = 1;
+  }
+}
+
+void FeatureExtractor::suppressNeighbours(const std::vector<float> &ranges, size_t beam)
+{
+  blocked_[beam] = 1;
+  for (size_t l = 1; l <= config_.window && beam + l < ranges.size(); ++l)
+  {
+    size_t j = beam + l;
+    if (std::fabs(ranges[j] - ranges[j - 1]) > config_.occlusion_ratio * ranges[j - 1])
+      break;
+    blocked_[j] = 1;
+  }
+  for (size_t l = 1; l <= config_.window && l <= beam; ++l)
+  {
+    size_t j = beam - l;
+    if (std::fabs(ranges[j] - ranges[j + 1]) > config_.occlusion_ratio * ranges[j + 1])
+      break;
+    blocked_[j] = 1;
+  }
+}
+
+void FeatureExtractor::selectSector(const std::vector<float> &ranges, size_t first, size_t last)
+{
+  order_.clear();
+  for (size_t i = first; i < last; ++i)
+  {
+    if (curvature_[i] >= 0)
+      order_.push_back(i);
+  }
+  const std::vector<float> &curvature = curvature_;
+  std::sort(order_.begin(), order_.end(), [&curvature](uint32_t a, uint32_t b)
+  {
+    return curvature[a] < curvature[b] || (curvature[a] == curvature[b] && a < b);
+  });
+
+  size_t selected = 0;
+  for (size_t k = order_.size(); k > 0 && selected < config_.edges_per_sector; --k)
+  {
+    uint32_t i = order_[k - 1];
+    if (curvature_[i] <= config_.edge_threshold)
+      break;
+    if (blocked_[i])
+      continue;
+    labels_[i] = BeamFeature::Edge;
+    edges_.push_back(i);
+    suppressNeighbours(ranges, i);
+    ++selected;
+  }
+
+  selected = 0;
+  for (size_t k = 0; k < order_.size() && selected < config_.planes_per_sector; ++k)
+  {
+    uint32_t i = order_[k];
+    if (curvature_[i] >= config_.plane_threshold)
+      break;
+    if (blocked_[i])
+      continue;
+    labels_[i] = BeamFeature::Plane;
+    planes_.push_back(i);
+    suppressNeighbours(ranges, i);
+    ++selected;
+  }
+}
@@ -0,0 +1,344 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lms1xx/scan_matcher.h"
+
+#include "lms1xx/colaa_log.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Points closer than this to a keyframe hit still score, in cells
+static const int KERNEL_RADIUS = 2;
+// Matches with fewer valid beams are rejected
+static const size_t MIN_POINTS = 10;
+
+static double normalizeAngle(double angle)
+{
+  return atan2(sin(angle), cos(angle));
+}
+
+static Pose2D compose(const Pose2D &a, const Pose2D &b)
+{
+  Pose2D pose;
+  pose.x = a.x + cos(a.theta) * b.x - sin(a.theta) * b.y;
+  pose.y = a.y + sin(a.theta) * b.x + cos(a.theta) * b.y;
+  pose.theta = normalizeAngle(a.theta + b.theta);
+  return pose;
+}
+
+ScanMatcher::ScanMatcher(const ScanMatcherConfig &config)
+  : config_(config), table_start_angle_(0), table_step_(0), point_count_(0), nodes_(0)
+{
+  config_.levels = std::max(1, std::min(config_.levels, 12));
+
+  // The finest grid covers the whole sensor range plus the search window
+  cells_ = static_cast<int>(std::ceil(2.0 * (config_.max_range + config_.linear_window) / config_.resolution)) + 1;
+  origin_ = -0.5 * cells_ * config_.resolution;
+  grids_.resize(config_.levels);
+  for (size_t i = 0; i < grids_.size(); ++i)
+  {
+    grids_[i].size = cells_;
+    grids_[i].cells.resize(static_cast<size_t>(cells_) * cells_);
+  }
+
+  // The angular step is smallest at maximum range, which bounds the number of rotations
+  double step = acos(1.0 - config_.resolution * config_.resolution / (2.0 * config_.max_range * config_.max_range));
+  size_t max_rotations = 2 * static_cast<size_t>(std::ceil(config_.angular_window / step)) + 1;
+  rotated_.resize(max_rotations);
+  for (size_t i = 0; i < rotated_.size(); ++i)
+    rotated_[i].resize(2 * config_.max_points);
+  rotations_.resize(max_rotations);
+  points_.reserve(2 * config_.max_points);
+
+  int window = static_cast<int>(std::ceil(config_.linear_window / config_.resolution));
+  int top_step = 1 << (config_.levels - 1);
+  size_t top_count = static_cast<size_t>(2 * window / top_step + 1);
+  candidate_pool_.resize(config_.levels);
+  candidate_pool_.back().reserve(max_rotations * top_count * top_count);
+  for (size_t i = 0; i + 1 < candidate_pool_.size(); ++i)
+    candidate_pool_[i].reserve(4);
+
+  reset();
+}
+
+void ScanMatcher::reset()
+{
+  has_keyframe_ = false;
+  keyframe_pose_.x = keyframe_pose_.y = keyframe_pose_.theta = 0;
+  relative_ = pose_ = keyframe_pose_;
+  score_ = 0;
+}
+
+const Pose2D &ScanMatcher::pose() const
+{
+  return pose_;
+}
+
+double ScanMatcher::score() const
+{
+  return score_;
+}
+
+size_t ScanMatcher::nodes() const
+{
+  return nodes_;
+}
+
+bool ScanMatcher::addScan(const ScanData &data, size_t echo)
+{
+  extractPoints(data, echo);
+  if (points_.size() / 2 < MIN_POINTS)
+  {
+    logDebug("Scan matcher: only %zu valid beams", points_.size() / 2);
+    return false;
+  }
+
+  if (!has_keyframe_)
+  {
+    setKeyframe(points_);
+    score_ = 1.0;
+    return true;
+  }
+
+  Pose2D result;
+  score_ = match(points_, relative_, result);
+  if (score_ < config_.min_score)
+  {
+    // Start over from this scan at the last known pose instead of being stuck with a stale keyframe
+    logDebug("Scan matcher: score %f below threshold, taking a new keyframe", score_);
+    keyframe_pose_ = pose_;
+    relative_.x = relative_.y = relative_.theta = 0;
+    setKeyframe(points_);
+    return false;
+  }
+
+  relative_ = result;
+  pose_ = compose(keyframe_pose_, relative_);
+  if (std::hypot(relative_.x, relative_.y) > config_.keyframe_distance ||
+      std::fabs(relative_.theta) > config_.keyframe_angle)
+  {
+    keyframe_pose_ = pose_;
+    relative_.x = relative_.y = relative_.theta = 0;
+    setKeyframe(points_);
+  }
+  return true;
+}
+
+void ScanMatcher::extractPoints(const ScanData &data, size_t echo)
+{
+  points_.clear();
+  if (echo >= data.echoCount())
+    return;
+  const ChannelData<uint16_t> &ranges = data.ch16bit[echo];
+  size_t count = ranges.data.size();
+
+  if (cos_table_.size() != count || table_start_angle_ != ranges.header.start_angle ||
+      table_step_ != ranges.header.step_size)
+  {
+    double start_angle = ranges.header.start_angle * M_PI / 180.0 / 10000.0 - M_PI / 2.0;
+    double angle_increment = ranges.header.step_size * M_PI / 180.0 / 10000.0;
+    cos_table_.resize(count);
+    sin_table_.resize(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+      cos_table_[i] = cos(start_angle + i * angle_increment);
+      sin_table_[i] = sin(start_angle + i * angle_increment);
+    }
+    table_start_angle_ = ranges.header.start_angle;
+    table_step_ = ranges.header.step_size;
+  }
+
+  size_t stride = std::max<size_t>(1, (count + config_.max_points - 1) / config_.max_points);
+  float scale = 0.001 * ranges.header.scale_factor;
+  const BeamMask *valid = echo < data.valid.size() ? &data.valid[echo] : NULL;
+  for (size_t i = 0; i < count; i += stride)
+  {
+    if (valid && !valid->test(i))
+      continue;
+    float dist = ranges.data[i] * scale;
+    if (dist < config_.min_range || dist > config_.max_range)
+      continue;
+    points_.push_back(dist * cos_table_[i]);
+    points_.push_back(dist * sin_table_[i]);
+  }
+}
+
+void ScanMatcher::setKeyframe(const std::vector<float> &points)
+{
+  has_keyframe_ = true;
+
+  Grid &base = grids_[0];
+  std::fill(base.cells.begin(), base.cells.end(), 0);
+  uint8_t kernel[2 * KERNEL_RADIUS + 1][2 * KERNEL_RADIUS + 1];
+  for (int dy = -KERNEL_RADIUS; dy <= KERNEL_RADIUS; ++dy)
+    for (int dx = -KERNEL_RADIUS; dx <= KERNEL_RADIUS; ++dx)
+      kernel[dy + KERNEL_RADIUS][dx + KERNEL_RADIUS] = static_cast<uint8_t>(255.0 * exp(-0.5 * (dx * dx + dy * dy)));
+
+  for (size_t i = 0; i + 1 < points.size(); i += 2)
+  {
+    int cx = static_cast<int>(std::floor((points[i] - origin_) / config_.resolution));
+    int cy = static_cast<int>(std::floor((points[i + 1] - origin_) / config_.resolution));
+    if (cx < KERNEL_RADIUS || cy < KERNEL_RADIUS || cx >= cells_ - KERNEL_RADIUS || cy >= cells_ - KERNEL_RADIUS)
+      continue;
+    for (int dy = -KERNEL_RADIUS; dy <= KERNEL_RADIUS; ++dy)
+    {
+      uint8_t *row = &base.cells[(cy + dy) * cells_ + cx];
+      for (int dx = -KERNEL_RADIUS; dx <= KERNEL_RADIUS; ++dx)
+        row[dx] = std::max(row[dx], kernel[dy + KERNEL_RADIUS][dx + KERNEL_RADIUS]);
+    }
+  }
+
+  // Level h holds the maximum of the 2^h x 2^h window starting at each cell,
+  // built from two overlapping windows of the previous level per axis
+  for (size_t level = 1; level < grids_.size(); ++level)
+  {
+    const Grid &prev = grids_[level - 1];
+    Grid &grid = grids_[level];
+    int half = 1 << (level - 1);
+    for (int y = 0; y < cells_; ++y)
+    {
+      for (int x = 0; x < cells_; ++x)
+      {
+        grid.cells[y * cells_ + x] = std::max(std::max(prev.at(x, y), prev.at(x + half, y)),
+                                              std::max(prev.at(x, y + half), prev.at(x + half, y + half)));
+      }
+    }
+  }
+}
+
+uint32_t ScanMatcher::scoreCandidate(const Candidate &c, int level) const
+{
+  const Grid &grid = grids_[level];
+  const std::vector<int32_t> &cells = rotated_[c.rotation];
+  uint32_t score = 0;
+  for (size_t i = 0; i < 2 * point_count_; i += 2)
+    score += grid.at(cells[i] + c.x, cells[i + 1] + c.y);
+  return score;
+}
+
+double ScanMatcher::match(const std::vector<float> &points, const Pose2D &guess, Pose2D &result)
+{
+  result = guess;
+  nodes_ = 0;
+  point_count_ = std::min(points.size() / 2, config_.max_points);
+  if (point_count_ == 0 || !has_keyframe_)
+    return 0;
+
+  // Rotations are spaced so the farthest point moves by at most one cell
+  float max_range = 0;
+  for (size_t i = 0; i < 2 * point_count_; i += 2)
+    max_range = std::max(max_range, std::hypot(points[i], points[i + 1]));
+  max_range = std::max(max_range, static_cast<float>(config_.resolution));
+  double angular_step = acos(std::max(-1.0, 1.0 - config_.resolution * config_.resolution /
+                                                    (2.0 * max_range * max_range)));
+  int rotation_count = std::min(static_cast<int>(std::ceil(config_.angular_window / angular_step)),
+                                static_cast<int>(rotations_.size() / 2));
+
+  for (int r = 0; r < 2 * rotation_count + 1; ++r)
+  {
+    double theta = guess.theta + (r - rotation_count) * angular_step;
+    rotations_[r] = theta;
+    double c = cos(theta);
+    double s = sin(theta);
+    std::vector<int32_t> &cells = rotated_[r];
+    for (size_t i = 0; i < 2 * point_count_; i += 2)
+    {
+      double x = c * points[i] - s * points[i + 1] + guess.x;
+      double y = s * points[i] + c * points[i + 1] + guess.y;
+      cells[i] = static_cast<int32_t>(std::floor((x - origin_) / config_.resolution));
+      cells[i + 1] = static_cast<int32_t>(std::floor((y - origin_) / config_.resolution));
+    }
+  }
+
+  int window = static_cast<int>(std::ceil(config_.linear_window / config_.resolution));
+  int top_level = config_.levels - 1;
+  int top_step = 1 << top_level;
+  std::vector<Candidate> &top = candidate_pool_[top_level];
+  top.clear();
+  for (int r = 0; r < 2 * rotation_count + 1; ++r)
+  {
+    for (int y = -window; y <= window; y += top_step)
+    {
+      for (int x = -window; x <= window; x += top_step)
+      {
+        Candidate c = { r, x, y, 0 };
+        c.score = scoreCandidate(c, top_level);
+        top.push_back(c);
+      }
+    }
+  }
+  nodes_ += top.size();
+  std::sort(top.begin(), top.end());
+
+  Candidate best = branch(top, top_level, 0);
+  if (best.score == 0)
+    return 0;
+
+  result.x = guess.x + best.x * config_.resolution;
+  result.y = guess.y + best.y * config_.resolution;
+  result.theta = normalizeAngle(rotations_[best.rotation]);
+  return best.score / (255.0 * point_count_);
+}
+
+ScanMatcher::Candidate ScanMatcher::branch(std::vector<Candidate> &candidates, int level, uint32_t min_score)
+{
+  Candidate best = { 0, 0, 0, 0 };
+  if (level == 0)
+  {
+    if (!candidates.empty() && candidates.front().score > min_score)
+      best = candidates.front();
+    return best;
+  }
+
+  int window = static_cast<int>(std::ceil(config_.linear_window / config_.resolution));
+  int half = 1 << (level - 1);
+  std::vector<Candidate> &children = candidate_pool_[level - 1];
+  for (size_t i = 0; i < candidates.size(); ++i)
+  {
+    const Candidate &candidate = candidates[i];
+    // Candidates are sorted, all remaining ones are bounded by this score
+    if (candidate.score <= min_score)
+      break;
+    // Out of budget: only the greedy descent of the best candidate is finished
+    if (i > 0 && nodes_ >= config_.max_nodes)
+      break;
+
+    children.clear();
+    for (int dy = 0; dy <= half; dy += half)
+    {
+      for (int dx = 0; dx <= half; dx += half)
+      {
+        Candidate child = { candidate.rotation, candidate.x + dx, candidate.y + dy, 0 };
+        if (child.x > window || child.y > window)
+          continue;
+        child.score = scoreCandidate(child, level - 1);
+        children.push_back(child);
+      }
+    }
+    nodes_ += children.size();
+    std::sort(children.begin(), children.end());
+
+    Candidate found = branch(children, level - 1, min_score);
+    if (found.score > min_score)
+    {
+      min_score = found.score;
+      best = found;
+    }
+  }
+  return best;
+}
@@ -0,0 +1,594 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lms1xx/scan_multicast.h"
+
+#include <arpa/inet.h>
+#include "lms1xx/colaa_log.h"
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <random>
+
+namespace
+{
+template <typename T>
+void put(std::vector<uint8_t> &out, T value)
+{
+  size_t size = out.size();
+  out.resize(size + sizeof(T));
+  memcpy(&out[size], &value, sizeof(T));
+}
+
+template <typename T>
+void put(uint8_t *&out, T value)
+{
+  memcpy(out, &value, sizeof(T));
+  out += sizeof(T);
+}
+
+/**
+ * @brief Bounds checked reading of serialized data
+ */
+struct Reader
+{
+  const uint8_t *position;
+  const uint8_t *end;
+
+  template <typename T>
+  bool get(T &value)
+  {
+    if (static_cast<size_t>(end - position) < sizeof(T))
+      return false;
+    memcpy(&value, position, sizeof(T));
+    position += sizeof(T);
+    return true;
+  }
+
+  bool get(void *data, size_t size)
+  {
+    if (static_cast<size_t>(end - position) < size)
+      return false;
+    memcpy(data, position, size);
+    position += size;
+    return true;
+  }
+};
+
+void putChannelHeader(std::vector<uint8_t> &out, const ChannelDataHeader &header, size_t count)
+{
+  uint8_t length = static_cast<uint8_t>(std::min<size_t>(header.contents.size(), 255));
+  put(out, length);
+  out.insert(out.end(), header.contents.begin(), header.contents.begin() + length);
+  put(out, header.scale_factor);
+  put(out, header.scale_factor_offset);
+  put(out, header.start_angle);
+  put(out, header.step_size);
+  put(out, static_cast<uint16_t>(count));
+}
+
+bool getChannelHeader(Reader &in, ChannelDataHeader &header)
+{
+  uint8_t length;
+  if (!in.get(length))
+    return false;
+  char contents[255];
+  if (!in.get(contents, length))
+    return false;
+  header.contents.assign(contents, length);
+  return in.get(header.scale_factor) && in.get(header.scale_factor_offset) && in.get(header.start_angle) &&
+         in.get(header.step_size) && in.get(header.data_count);
+}
+
+template <typename T>
+void putChannels(std::vector<uint8_t> &out, const std::vector<ChannelData<T> > &channels)
+{
+  put(out, static_cast<uint8_t>(channels.size()));
+  for (size_t c = 0; c < channels.size(); ++c)
+  {
+    putChannelHeader(out, channels[c].header, channels[c].data.size());
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(channels[c].data.data());
+    out.insert(out.end(), data, data + channels[c].data.size() * sizeof(T));
+  }
+}
+
+template <typename T>
+bool getChannels(Reader &in, std::vector<ChannelData<T> > &channels)
+{
+  uint8_t count;
+  if (!in.get(count))
+    return false;
+  channels.resize(count);
+  for (size_t c = 0; c < count; ++c)
+  {
+    if (!getChannelHeader(in, channels[c].header))
+      return false;
+    channels[c].data.resize(channels[c].header.data_count);
+    if (!in.get(channels[c].data.data(), channels[c].data.size() * sizeof(T)))
+      return false;
+  }
+  return true;
+}
+
+bool resolve(const std::string &address, struct in_addr &out)
+{
+  if (inet_pton(AF_INET, address.c_str(), &out) != 1)
+  {
+    logError("Multicast: invalid address %s", address.c_str());
+    return false;
+  }
+  return true;
+}
+}
+
+void ScanMulticast::writeHeader(const DatagramHeader &header, uint8_t *out)
+{
+  memcpy(out, MAGIC, sizeof(MAGIC));
+  out += sizeof(MAGIC);
+  put(out, VERSION);
+  put(out, static_cast<uint8_t>(header.type));
+  put(out, header.fragment);
+  put(out, header.fragment_count);
+  put(out, header.sensor_id);
+  put(out, header.sequence);
+  put(out, header.size);
+  put(out, header.offset);
+  put(out, header.stamp_ns);
+}
+
+bool ScanMulticast::parseHeader(const uint8_t *datagram, size_t length, DatagramHeader &header)
+{
+  if (length < HEADER_SIZE || memcmp(datagram, MAGIC, sizeof(MAGIC)) != 0)
+    return false;
+  Reader in = { datagram + sizeof(MAGIC), datagram + length };
+  uint8_t version = 0, type = 0;
+  in.get(version);
+  in.get(type);
+  in.get(header.fragment);
+  in.get(header.fragment_count);
+  in.get(header.sensor_id);
+  in.get(header.sequence);
+  in.get(header.size);
+  in.get(header.offset);
+  in.get(header.stamp_ns);
+  header.type = static_cast<Type>(type);
+  return version == VERSION && header.fragment < header.fragment_count &&
+         header.size <= static_cast<uint64_t>(header.fragment_count) * (MAX_DATAGRAM_SIZE - HEADER_SIZE) &&
+         header.offset <= header.size && length - HEADER_SIZE <= header.size - header.offset;
+}
+
+void ScanMulticast::serializeScan(const ScanData &data, std::vector<uint8_t> &out)
+{
+  out.clear();
+  const ScanDataHeader &header = data.header;
+  put(out, header.version_number);
+  put(out, header.device.device_number);
+  put(out, header.device.serial_number);
+  put(out, header.device.device_status_1);
+  put(out, header.device.device_status_2);
+  put(out, header.status_info.telegram_counter);
+  put(out, header.status_info.scan_counter);
+  put(out, header.status_info.time_since_startup);
+  put(out, header.status_info.time_of_transmission);
+  put(out, header.status_info.status_digitalin_1);
+  put(out, header.status_info.status_digitalin_2);
+  put(out, header.status_info.status_digitalout_1);
+  put(out, header.status_info.status_digitalout_2);
+  put(out, header.status_info.layer_angle);
+  put(out, header.frequencies.scan_frequency);
+  put(out, header.frequencies.measurement_frequency);
+  putChannels(out, data.ch16bit);
+  putChannels(out, data.ch8bit);
+  put(out, static_cast<uint8_t>(data.valid.size()));
+  for (size_t e = 0; e < data.valid.size(); ++e)
+  {
+    put(out, static_cast<uint16_t>(data.valid[e].bits.size()));
+    const uint8_t *bits = reinterpret_cast<const uint8_t *>(data.valid[e].bits.data());
+    out.insert(out.end(), bits, bits + data.valid[e].bits.size() * sizeof(uint64_t));
+  }
+}
+
+bool ScanMulticast::deserializeScan(const uint8_t *data, size_t size, ScanData &out)
+{
+  Reader in = { data, data + size };
+  ScanDataHeader &header = out.header;
+  bool ok = in.get(header.version_number) && in.get(header.device.device_number) &&
+            in.get(header.device.serial_number) && in.get(header.device.device_status_1) &&
+            in.get(header.device.device_status_2) && in.get(header.status_info.telegram_counter) &&
+            in.get(header.status_info.scan_counter) && in.get(header.status_info.time_since_startup) &&
+            in.get(header.status_info.time_of_transmission) && in.get(header.status_info.status_digitalin_1) &&
+            in.get(header.status_info.status_digitalin_2) && in.get(header.status_info.status_digitalout_1) &&
+            in.get(header.status_info.status_digitalout_2) && in.get(header.status_info.layer_angle) &&
+            in.get(header.frequencies.scan_frequency) && in.get(header.frequencies.measurement_frequency) &&
+            getChannels(in, out.ch16bit) && getChannels(in, out.ch8bit);
+  uint8_t masks = 0;
+  if (!ok || !in.get(masks))
+    return false;
+  out.valid.resize(masks);
+  for (size_t e = 0; e < masks; ++e)
+  {
+    uint16_t words;
+    if (!in.get(words))
+      return false;
+    out.valid[e].bits.resize(words);
+    if (!in.get(out.valid[e].bits.data(), words * sizeof(uint64_t)))
+      return false;
+  }
+  return true;
+}
+
+uint32_t ScanMulticast::sessionId()
+{
+  std::random_device random;
+  uint64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+  return random() ^ static_cast<uint32_t>(now) ^ static_cast<uint32_t>(now >> 32) ^
+         (static_cast<uint32_t>(getpid()) << 16);
+}
+
+MulticastSender::MulticastSender()
+  : socket_fd_(-1), datagram_size_(ScanMulticast::DEFAULT_DATAGRAM_SIZE), sensor_id_(ScanMulticast::sessionId()),
+    sequence_(0)
+{
+}
+
+MulticastSender::~MulticastSender()
+{
+  close();
+}
+
+bool MulticastSender::open(const std::string &group, uint16_t port, const std::string &interface, int ttl)
+{
+  close();
+  struct sockaddr_in destination;
+  memset(&destination, 0, sizeof(destination));
+  destination.sin_family = AF_INET;
+  destination.sin_port = htons(port);
+  if (!resolve(group, destination.sin_addr))
+    return false;
+  struct in_addr local;
+  local.s_addr = htonl(INADDR_ANY);
+  if (!interface.empty() && !resolve(interface, local))
+    return false;
+
+  socket_fd_ = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (socket_fd_ < 0)
+  {
+    logError("Multicast: unable to create socket: %s", strerror(errno));
+    return false;
+  }
+  unsigned char hops = static_cast<unsigned char>(std::max(0, std::min(255, ttl)));
+  unsigned char loop = 1;
+  setsockopt(socket_fd_, IPPROTO_IP, IP_MULTICAST_TTL, &hops, sizeof(hops));
+  setsockopt(socket_fd_, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+  if (!interface.empty() && setsockopt(socket_fd_, IPPROTO_IP, IP_MULTICAST_IF, &local, sizeof(local)) < 0)
+  {
+    logError("Multicast: unable to send on interface %s: %s", interface.c_str(), strerror(errno));
+    close();
+    return false;
+  }
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&destination);
+  destination_.assign(bytes, bytes + sizeof(destination));
+  return true;
+}
+
+void MulticastSender::close()
+{
+  if (socket_fd_ >= 0)
+    ::close(socket_fd_);
+  socket_fd_ = -1;
+}
+
+void MulticastSender::setDatagramSize(size_t size)
+{
+  datagram_size_ = std::max(size, ScanMulticast::HEADER_SIZE + 1);
+}
+
+bool MulticastSender::sendScan(const ScanData &data, int64_t stamp_ns)
+{
+  ScanMulticast::serializeScan(data, payload_);
+  return send(ScanMulticast::Scan, payload_.data(), payload_.size(), stamp_ns);
+}
+
+bool MulticastSender::sendTelegram(const uint8_t *telegram, size_t size, int64_t stamp_ns)
+{
+  return send(ScanMulticast::Telegram, telegram, size, stamp_ns);
+}
+
+bool MulticastSender::send(ScanMulticast::Type type, const uint8_t *data, size_t size, int64_t stamp_ns)
+{
+  if (socket_fd_ < 0)
+    return false;
+  size_t fragment_size = datagram_size_ - ScanMulticast::HEADER_SIZE;
+  size_t fragments = std::max<size_t>(1, (size + fragment_size - 1) / fragment_size);
+  if (fragments > 65535)
+  {
+    logError("Multicast: message of %zu bytes needs too many fragments", size);
+    return false;
+  }
+
+  ScanMulticast::DatagramHeader header;
+  header.type = type;
+  header.fragment_count = static_cast<uint16_t>(fragments);
+  header.sensor_id = sensor_id_;
+  header.sequence = sequence_++;
+  header.size = static_cast<uint32_t>(size);
+  header.stamp_ns = stamp_ns;
+  uint8_t header_bytes[ScanMulticast::HEADER_SIZE];
+  struct iovec parts[2];
+  parts[0].iov_base = header_bytes;
+  parts[0].iov_len = sizeof(header_bytes);
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_name = &destination_[0];
+  message.msg_namelen = destination_.size();
+  message.msg_iov = parts;
+  message.msg_iovlen = 2;
+  for (size_t f = 0; f < fragments; ++f)
+  {
+    header.fragment = static_cast<uint16_t>(f);
+    header.offset = static_cast<uint32_t>(f * fragment_size);
+    ScanMulticast::writeHeader(header, header_bytes);
+    parts[1].iov_base = const_cast<uint8_t *>(data) + header.offset;
+    parts[1].iov_len = std::min(fragment_size, size - header.offset);
+    // Never block acquisition, receivers account for what is dropped here
+    if (sendmsg(socket_fd_, &message, MSG_DONTWAIT) < 0)
+    {
+      logDebug("Multicast: dropped message %u: %s", header.sequence, strerror(errno));
+      return false;
+    }
+  }
+  return true;
+}
+
+MulticastReassembler::MulticastReassembler(size_t slots)
+  : slots_(std::max<size_t>(slots, 1)), max_message_size_(ScanMulticast::DEFAULT_MAX_MESSAGE_SIZE)
+{
+  for (size_t i = 0; i < slots_.size(); ++i)
+    slots_[i].used = false;
+}
+
+bool MulticastReassembler::add(const uint8_t *datagram, size_t length, MulticastMessage &out)
+{
+  ScanMulticast::DatagramHeader header;
+  if (!ScanMulticast::parseHeader(datagram, length, header) || header.size > max_message_size_)
+  {
+    ++statistics_.malformed;
+    return false;
+  }
+  ++statistics_.datagrams;
+
+  std::map<uint32_t, Sender>::iterator sender = senders_.find(header.sensor_id);
+  if (sender != senders_.end() && !newer(header.sequence, sender->second.last_sequence))
+  {
+    // A late fragment of a message already returned or given up, unless the sender started over
+    if (header.stamp_ns <= sender->second.last_stamp_ns &&
+        sender->second.last_sequence - header.sequence <= RESTART_GAP)
+      return false;
+    ++statistics_.restarts;
+    dropOlder(header.sensor_id, 0, true);
+    senders_.erase(sender);
+  }
+
+  Slot *slot = NULL;
+  for (size_t i = 0; i < slots_.size() && !slot; ++i)
+  {
+    if (slots_[i].used && slots_[i].header.sensor_id == header.sensor_id &&
+        slots_[i].header.sequence == header.sequence)
+      slot = &slots_[i];
+  }
+  if (!slot)
+  {
+    for (size_t i = 0; i < slots_.size(); ++i)
+    {
+      if (!slots_[i].used)
+      {
+        slot = &slots_[i];
+        break;
+      }
+      if (!slot || slots_[i].created < slot->created)
+        slot = &slots_[i];
+    }
+    if (slot->used)
+      ++statistics_.incomplete;
+    slot->used = true;
+    slot->created = statistics_.datagrams;
+    slot->header = header;
+    slot->fragment_size = 0;
+    slot->received.assign(header.fragment_count, 0);
+    slot->missing = header.fragment_count;
+    slot->message.data.resize(header.size);
+  }
+  size_t payload = length - ScanMulticast::HEADER_SIZE;
+  if (slot->header.size != header.size || slot->header.fragment_count != header.fragment_count ||
+      !placeFragment(*slot, header, payload))
+  {
+    ++statistics_.malformed;
+    return false;
+  }
+
+  if (!slot->received[header.fragment])
+  {
+    memcpy(slot->message.data.data() + header.offset, datagram + ScanMulticast::HEADER_SIZE, payload);
+    slot->received[header.fragment] = 1;
+    --slot->missing;
+  }
+  if (slot->missing > 0)
+    return false;
+
+  slot->used = false;
+  sender = senders_.find(header.sensor_id);
+  if (sender == senders_.end())
+  {
+    if (senders_.size() >= MAX_SENDERS)
+    {
+      std::map<uint32_t, Sender>::iterator silent = senders_.begin();
+      for (std::map<uint32_t, Sender>::iterator it = senders_.begin(); it != senders_.end(); ++it)
+      {
+        if (it->second.last_message < silent->second.last_message)
+          silent = it;
+      }
+      senders_.erase(silent);
+    }
+    sender = senders_.insert(std::make_pair(header.sensor_id, Sender())).first;
+  }
+  else
+  {
+    statistics_.lost += header.sequence - sender->second.last_sequence - 1;
+  }
+  ++statistics_.messages;
+  sender->second.last_sequence = header.sequence;
+  sender->second.last_stamp_ns = header.stamp_ns;
+  sender->second.last_message = statistics_.messages;
+  out.type = header.type;
+  out.sensor_id = header.sensor_id;
+  out.sequence = header.sequence;
+  out.stamp_ns = header.stamp_ns;
+  out.data.swap(slot->message.data);
+  dropOlder(header.sensor_id, header.sequence);
+  return true;
+}
+
+bool MulticastReassembler::placeFragment(Slot &slot, const ScanMulticast::DatagramHeader &header, size_t payload)
+{
+  // All fragments but the last carry the same number of bytes, fragment f starts at f times that
+  bool last = header.fragment + 1 == header.fragment_count;
+  if (last && header.offset + payload != header.size)
+    return false;
+  uint32_t fragment_size = 0;
+  if (!last)
+  {
+    fragment_size = static_cast<uint32_t>(payload);
+  }
+  else if (header.fragment > 0)
+  {
+    if (header.offset % header.fragment != 0)
+      return false;
+    fragment_size = header.offset / header.fragment;
+  }
+  else
+  {
+    return header.offset == 0;
+  }
+  if (fragment_size == 0 || (slot.fragment_size != 0 && fragment_size != slot.fragment_size) ||
+      static_cast<uint64_t>(header.fragment) * fragment_size != header.offset)
+    return false;
+  slot.fragment_size = fragment_size;
+  return true;
+}
+
+void MulticastReassembler::dropOlder(uint32_t sensor_id, uint32_t sequence, bool restarted)
+{
+  for (size_t i = 0; i < slots_.size(); ++i)
+  {
+    if (slots_[i].used && slots_[i].header.sensor_id == sensor_id &&
+        (restarted || newer(sequence, slots_[i].header.sequence)))
+    {
+      slots_[i].used = false;
+      ++statistics_.incomplete;
+    }
+  }
+}
+
+MulticastReceiver::MulticastReceiver() : socket_fd_(-1), datagram_(65536)
+{
+}
+
+MulticastReceiver::~MulticastReceiver()
+{
+  close();
+}
+
+bool MulticastReceiver::open(const std::string &group, uint16_t port, const std::string &interface,
+                             int receive_buffer)
+{
+  close();
+  struct ip_mreq membership;
+  if (!resolve(group, membership.imr_multiaddr))
+    return false;
+  membership.imr_interface.s_addr = htonl(INADDR_ANY);
+  if (!interface.empty() && !resolve(interface, membership.imr_interface))
+    return false;
+
+  socket_fd_ = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (socket_fd_ < 0)
+  {
+    logError("Multicast: unable to create socket: %s", strerror(errno));
+    return false;
+  }
+  int reuse = 1;
+  setsockopt(socket_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  if (receive_buffer > 0)
+    setsockopt(socket_fd_, SOL_SOCKET, SO_RCVBUF, &receive_buffer, sizeof(receive_buffer));
+
+  struct sockaddr_in local;
+  memset(&local, 0, sizeof(local));
+  local.sin_family = AF_INET;
+  local.sin_port = htons(port);
+  local.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(socket_fd_, reinterpret_cast<struct sockaddr *>(&local), sizeof(local)) < 0)
+  {
+    logError("Multicast: unable to bind port %u: %s", port, strerror(errno));
+    close();
+    return false;
+  }
+  bool multicast = IN_MULTICAST(ntohl(membership.imr_multiaddr.s_addr));
+  if (multicast && setsockopt(socket_fd_, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) < 0)
+  {
+    logError("Multicast: unable to join %s: %s", group.c_str(), strerror(errno));
+    close();
+    return false;
+  }
+  return true;
+}
+
+void MulticastReceiver::close()
+{
+  if (socket_fd_ >= 0)
+    ::close(socket_fd_);
+  socket_fd_ = -1;
+}
+
+uint16_t MulticastReceiver::port() const
+{
+  struct sockaddr_in local;
+  socklen_t length = sizeof(local);
+  if (socket_fd_ < 0 || getsockname(socket_fd_, reinterpret_cast<struct sockaddr *>(&local), &length) < 0)
+    return 0;
+  return ntohs(local.sin_port);
+}
+
+bool MulticastReceiver::receive(MulticastMessage &message, int timeout_ms)
+{
+  if (socket_fd_ < 0)
+    return false;
+  struct pollfd fd = { socket_fd_, POLLIN, 0 };
+  while (poll(&fd, 1, timeout_ms) > 0)
+  {
+    ssize_t length = recv(socket_fd_, datagram_.data(), datagram_.size(), 0);
+    if (length < 0)
+      return false;
+    if (reassembler_.add(datagram_.data(), static_cast<size_t>(length), message))
+      return true;
+  }
+  return false;
+}
@@ -0,0 +1,436 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lms1xx/scan_pipeline.h"
+
+#include "lms1xx/colaa_log.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <set>
+
+#include "lms1xx/background_model.h"
+#include "lms1xx/colaa_points.h"
+#include "lms1xx/scan_features.h"
+#include "lms1xx/sector_index.h"
+
+std::string StageParams::getString(const std::string &key, const std::string &fallback) const
+{
+  std::map<std::string, std::string>::const_iterator it = values_.find(key);
+  return it == values_.end() ? fallback : it->second;
+}
+
+double StageParams::getDouble(const std::string &key, double fallback) const
+{
+  std::map<std::string, std::string>::const_iterator it = values_.find(key);
+  if (it == values_.end() || it->second.empty())
+    return fallback;
+  char *end;
+  double value = strtod(it->second.c_str(), &end);
+  return *end == '\0' ? value : fallback;
+}
+
+int StageParams::getInt(const std::string &key, int fallback) const
+{
+  std::map<std::string, std::string>::const_iterator it = values_.find(key);
+  if (it == values_.end() || it->second.empty())
+    return fallback;
+  char *end;
+  long value = strtol(it->second.c_str(), &end, 10);
+  return *end == '\0' ? static_cast<int>(value) : fallback;
+}
+
+bool StageParams::getBool(const std::string &key, bool fallback) const
+{
+  std::map<std::string, std::string>::const_iterator it = values_.find(key);
+  if (it == values_.end())
+    return fallback;
+  if (it->second == "true" || it->second == "1")
+    return true;
+  if (it->second == "false" || it->second == "0")
+    return false;
+  return fallback;
+}
+
+namespace
+{
+/**
+ * @brief Echo to use from the "echo" parameter
+ */
+bool echoParam(const std::string &name, const StageParams &params, size_t &echo)
+{
+  int value = params.getInt("echo", 0);
+  if (value < 0)
+  {
+    logError("Stage %s: invalid echo %d", name.c_str(), value);
+    return false;
+  }
+  echo = value;
+  return true;
+}
+
+/**
+ * @brief Whether the scan has the configured echo, a 16 bit remission channel does not count
+ *
+ * Warns once per stage, the echoes of a scanner don't change while it streams.
+ */
+bool hasEcho(const std::string &name, const ScanFrame &frame, size_t echo, bool &warned)
+{
+  if (echo < frame.decoded.echoCount())
+    return true;
+  if (!warned)
+  {
+    logWarn("Stage %s: echo %zu not in scan with %zu echoes, skipping it", name.c_str(), echo,
+            frame.decoded.echoCount());
+    warned = true;
+  }
+  return false;
+}
+
+class PointsStage : public ScanStage
+{
+public:
+  bool configure(const std::string &name, const StageParams &params, PipelineOutputs &outputs)
+  {
+    name_ = name;
+    points_ = &outputs.get<PointsOutput>(params.getString("output", name));
+    return echoParam(name, params, echo_);
+  }
+
+  void process(const ScanFrame &frame, PipelineOutputs &)
+  {
+    points_->count = 0;
+    if (!hasEcho(name_, frame, echo_, warned_))
+      return;
+    points_->xyzi.resize(4 * frame.data.ch16bit[echo_].data.size());
+    points_->count = CoLaAPoints::fillPoints(frame.decoded, echo_, points_->xyzi.data());
+  }
+
+private:
+  std::string name_;
+  PointsOutput *points_;
+  size_t echo_;
+  bool warned_ = false;
+};
+
+class ReturnsStage : public ScanStage
+{
+public:
+  bool configure(const std::string &name, const StageParams &params, PipelineOutputs &outputs)
+  {
+    points_ = &outputs.get<PointsOutput>(params.getString("output", name));
+    return true;
+  }
+
+  void process(const ScanFrame &frame, PipelineOutputs &)
+  {
+    points_->xyzi.resize(4 * frame.decoded.sparseEchoes().returns);
+    points_->count = CoLaAPoints::fillReturns(frame.decoded, points_->xyzi.data());
+  }
+
+private:
+  PointsOutput *points_;
+};
+
+class SectorIndexStage : public ScanStage
+{
+public:
+  bool configure(const std::string &name, const StageParams &params, PipelineOutputs &outputs)
+  {
+    name_ = name;
+    index_ = &outputs.get<SectorIndex>(params.getString("output", name));
+    return echoParam(name, params, echo_);
+  }
+
+  void process(const ScanFrame &frame, PipelineOutputs &)
+  {
+    // Clears the index if the echo is missing
+    hasEcho(name_, frame, echo_, warned_);
+    index_->build(frame.data, echo_);
+  }
+
+private:
+  std::string name_;
+  SectorIndex *index_;
+  size_t echo_;
+  bool warned_ = false;
+};
+
+class ChangesStage : public ScanStage
+{
+public:
+  bool configure(const std::string &name, const StageParams &params, PipelineOutputs &outputs)
+  {
+    regions_ = &outputs.get<std::vector<ChangedRegion> >(params.getString("output", name));
+    BackgroundModelConfig config;
+    int learn_scans = params.getInt("learn_scans", config.learn_scans);
+    config.learn_scans = learn_scans < 1 ? 1 : learn_scans;
+    config.sigma = params.getDouble("sigma", config.sigma);
+    config.min_delta = params.getDouble("min_delta", config.min_delta);
+    model_.reset(new BackgroundModel(config));
+    return true;
+  }
+
+  void process(const ScanFrame &frame, PipelineOutputs &)
+  {
+    *regions_ = model_->update(frame.data);
+  }
+
+private:
+  std::vector<ChangedRegion> *regions_;
+  std::unique_ptr<BackgroundModel> model_;
+};
+
+class FeaturesStage : public ScanStage
+{
+public:
+  bool configure(const std::string &name, const StageParams &params, PipelineOutputs &outputs)
+  {
+    edges_ = &outputs.get<PointsOutput>(params.getString("edges_output", name + "/edges"));
+    planes_ = &outputs.get<PointsOutput>(params.getString("planes_output", name + "/planes"));
+    FeatureConfig config;
+    int window = params.getInt("window", config.window);
+    if (window < 1 || window > 64)
+    {
+      logError("Stage %s: invalid window %d", name.c_str(), window);
+      return false;
+    }
+    config.window = window;
+    config.sectors = std::max(params.getInt("sectors", config.sectors), 1);
+    config.edges_per_sector = std::max(params.getInt("edges_per_sector", config.edges_per_sector), 0);
+    config.planes_per_sector = std::max(params.getInt("planes_per_sector", config.planes_per_sector), 0);
+    config.edge_threshold = params.getDouble("edge_threshold", config.edge_threshold);
+    config.plane_threshold = params.getDouble("plane_threshold", config.plane_threshold);
+    config.occlusion_ratio = params.getDouble("occlusion_ratio", config.occlusion_ratio);
+    config.parallel_ratio = params.getDouble("parallel_ratio", config.parallel_ratio);
+    extractor_ = FeatureExtractor(config);
+    name_ = name;
+    return echoParam(name, params, echo_);
+  }
+
+  void process(const ScanFrame &frame, PipelineOutputs &)
+  {
+    // Clears the features if the echo is missing
+    hasEcho(name_, frame, echo_, warned_);
+    extractor_.extract(frame.decoded, echo_);
+    fill(frame, extractor_.edges(), *edges_);
+    fill(frame, extractor_.planes(), *planes_);
+  }
+
+private:
+  void fill(const ScanFrame &frame, const std::vector<uint32_t> &beams, PointsOutput &points)
+  {
+    points.count = beams.size();
+    points.xyzi.resize(4 * beams.size());
+    if (beams.empty())
+      return;
+    const std::vector<float> &ranges = frame.decoded.ranges(echo_);
+    const BeamDirections &directions = frame.decoded.directions(echo_);
+    const std::vector<uint8_t> *intensities =
+        echo_ < frame.data.ch8bit.size() ? &frame.data.ch8bit[echo_].data : NULL;
+    float *out = points.xyzi.data();
+    for (size_t k = 0; k < beams.size(); ++k, out += 4)
+    {
+      uint32_t i = beams[k];
+      out[0] = ranges[i] * directions.x[i];
+      out[1] = ranges[i] * directions.y[i];
+      out[2] = ranges[i] * directions.z;
+      out[3] = intensities && i < intensities->size() ? (*intensities)[i] : 0;
+    }
+  }
+
+  std::string name_;
+  FeatureExtractor extractor_;
+  PointsOutput *edges_;
+  PointsOutput *planes_;
+  size_t echo_;
+  bool warned_ = false;
+};
+
+template <class Stage>
+std::unique_ptr<ScanStage> createStage()
+{
+  return std::unique_ptr<ScanStage>(new Stage());
+}
+
+int64_t now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Weight of a new run time in the moving average
+ */
+const double AVERAGE_WEIGHT = 0.1;
+/**
+ * @brief Factor applied to the expected time of a stage whenever it is skipped
+ */
+const double SKIP_DECAY = 0.9;
+}
+
+std::map<std::string, ScanStageRegistry::Factory> &ScanStageRegistry::factories()
+{
+  // The built-in stages are registered here rather than by static registration objects, which
+  // the linker may leave out of a static library
+  static std::map<std::string, Factory> registered = {
+    { "points", createStage<PointsStage> },
+    { "returns", createStage<ReturnsStage> },
+    { "sector_index", createStage<SectorIndexStage> },
+    { "changes", createStage<ChangesStage> },
+    { "features", createStage<FeaturesStage> },
+  };
+  return registered;
+}
+
+bool ScanStageRegistry::add(const std::string &type, const Factory &factory)
+{
+  if (!factories().insert(std::make_pair(type, factory)).second)
+  {
+    logWarn("Stage type %s registered twice, keeping the first", type.c_str());
+    return false;
+  }
+  return true;
+}
+
+std::unique_ptr<ScanStage> ScanStageRegistry::create(const std::string &type)
+{
+  std::map<std::string, Factory>::const_iterator it = factories().find(type);
+  if (it == factories().end())
+    return std::unique_ptr<ScanStage>();
+  return it->second();
+}
+
+std::vector<std::string> ScanStageRegistry::types()
+{
+  std::vector<std::string> result;
+  for (std::map<std::string, Factory>::const_iterator it = factories().begin(); it != factories().end(); ++it)
+    result.push_back(it->first);
+  return result;
+}
+
+ScanPipeline::ScanPipeline()
+  : sequence_(0), scan_frequency_(0), deadline_(0.5)
+{
+}
+
+bool ScanPipeline::configure(const std::vector<StageConfig> &stages)
+{
+  clear();
+  std::set<std::string> names;
+  for (size_t i = 0; i < stages.size(); ++i)
+  {
+    Stage stage;
+    stage.name = stages[i].name.empty() ? stages[i].type : stages[i].name;
+    if (!names.insert(stage.name).second)
+    {
+      logError("Pipeline: stage name %s used twice", stage.name.c_str());
+      clear();
+      return false;
+    }
+    stage.budget = stages[i].budget;
+    stage.optional = stages[i].optional;
+    stage.stage = ScanStageRegistry::create(stages[i].type);
+    if (!stage.stage)
+    {
+      logError("Pipeline: unknown stage type %s", stages[i].type.c_str());
+      clear();
+      return false;
+    }
+    outputs_.stage_ = i;
+    bool configured = stage.stage->configure(stage.name, stages[i].params, outputs_);
+    outputs_.stage_ = PipelineOutputs::NO_STAGE;
+    if (!configured)
+    {
+      logError("Pipeline: invalid parameters for stage %s", stage.name.c_str());
+      clear();
+      return false;
+    }
+    logDebug("Pipeline: stage %zu is %s (%s)%s", i, stage.name.c_str(), stages[i].type.c_str(),
+             stage.optional ? ", optional" : "");
+    stages_.push_back(std::move(stage));
+  }
+  outputs_.skipped_.assign(stages_.size(), 0);
+  return true;
+}
+
+void ScanPipeline::clear()
+{
+  stages_.clear();
+  outputs_.clear();
+  sequence_ = 0;
+  statistics_ = PipelineStatistics();
+}
+
+void ScanPipeline::process(DecodedScan &decoded, int64_t stamp_ns)
+{
+  ScanFrame frame = { decoded.data(), decoded, stamp_ns, sequence_++ };
+  uint32_t frequency = scan_frequency_ != 0 ? scan_frequency_ : frame.data.header.frequencies.scan_frequency;
+  // Without a known scan period every stage runs and nothing counts as late
+  double period_ns = frequency != 0 ? 1e11 / frequency : 0;
+  int64_t start = now();
+  int64_t deadline = start + static_cast<int64_t>(deadline_ * period_ns);
+  bool degraded = false;
+
+  int64_t begin = start;
+  for (size_t i = 0; i < stages_.size(); ++i)
+  {
+    Stage &stage = stages_[i];
+    StageStatistics &statistics = stage.statistics;
+    if (stage.optional && period_ns > 0 && begin + statistics.average_ns > deadline)
+    {
+      outputs_.skipped_[i] = 1;
+      ++statistics.skipped;
+      statistics.average_ns *= SKIP_DECAY;
+      degraded = true;
+      continue;
+    }
+
+    outputs_.skipped_[i] = 0;
+    outputs_.stage_ = i;
+    stage.stage->process(frame, outputs_);
+    int64_t end = now();
+
+    statistics.last_ns = end - begin;
+    statistics.max_ns = std::max(statistics.max_ns, statistics.last_ns);
+    statistics.average_ns = statistics.runs == 0 ? statistics.last_ns :
+        statistics.average_ns + AVERAGE_WEIGHT * (statistics.last_ns - statistics.average_ns);
+    ++statistics.runs;
+    if (stage.budget > 0 && period_ns > 0 && statistics.last_ns > stage.budget * period_ns)
+    {
+      ++statistics.budget_misses;
+      logDebug("Pipeline: stage %s took %.3f ms, budget %.3f ms", stage.name.c_str(), statistics.last_ns * 1e-6,
+               stage.budget * period_ns * 1e-6);
+    }
+    begin = end;
+  }
+  outputs_.stage_ = PipelineOutputs::NO_STAGE;
+
+  ++statistics_.scans;
+  statistics_.last_ns = begin - start;
+  statistics_.max_ns = std::max(statistics_.max_ns, statistics_.last_ns);
+  if (period_ns > 0 && begin > deadline)
+    ++statistics_.deadline_misses;
+  if (degraded)
+    ++statistics_.degraded;
+}
+
+void ScanPipeline::process(const ScanData &data, int64_t stamp_ns)
+{
+  decoded_.reset(data);
+  process(decoded_, stamp_ns);
+}
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lms1xx/scan_reactor.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include "lms1xx/colaa_log.h"
+#include <algorithm>
+#include <chrono>
+
+static int64_t nowNs()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ScanReactor::ScanReactor(Executor executor) : executor_(executor), stopped_(false)
+{
+  if (pipe(wake_fds_) != 0)
+  {
+    logError("Unable to create wake up pipe");
+    wake_fds_[0] = -1;
+    wake_fds_[1] = -1;
+  }
+  else
+  {
+    fcntl(wake_fds_[0], F_SETFL, O_NONBLOCK);
+    fcntl(wake_fds_[1], F_SETFL, O_NONBLOCK);
+  }
+}
+
+ScanReactor::~ScanReactor()
+{
+  if (wake_fds_[0] >= 0)
+  {
+    close(wake_fds_[0]);
+    close(wake_fds_[1]);
+  }
+}
+
+void ScanReactor::add(CoLaA &sensor, ScanCallback on_scan, ErrorCallback on_error, int timeout_ms)
+{
+  std::shared_ptr<Entry> entry(new Entry());
+  entry->sensor = &sensor;
+  entry->on_scan = on_scan;
+  entry->on_error = on_error;
+  entry->timeout_ns = static_cast<int64_t>(timeout_ms) * 1000000;
+  entry->last_activity_ns = nowNs();
+  entries_.push_back(entry);
+}
+
+void ScanReactor::remove(CoLaA &sensor)
+{
+  for (size_t i = 0; i < entries_.size(); ++i)
+  {
+    if (entries_[i]->sensor == &sensor)
+    {
+      entries_.erase(entries_.begin() + i);
+      return;
+    }
+  }
+}
+
+size_t ScanReactor::runOnce(int max_wait_ms)
+{
+  // Callbacks may add or remove sensors, so work on a snapshot
+  std::vector<std::shared_ptr<Entry> > entries = entries_;
+  std::vector<struct pollfd> fds(entries.size() + 1);
+  int64_t now = nowNs();
+  int64_t next_deadline = now + static_cast<int64_t>(max_wait_ms) * 1000000;
+  for (size_t i = 0; i < entries.size(); ++i)
+  {
+    fds[i].fd = entries[i]->sensor->getSocket();
+    fds[i].events = POLLIN;
+    fds[i].revents = 0;
+    if (entries[i]->on_error)
+      next_deadline = std::min(next_deadline, entries[i]->last_activity_ns + entries[i]->timeout_ns);
+  }
+  fds.back().fd = wake_fds_[0];
+  fds.back().events = POLLIN;
+  fds.back().revents = 0;
+
+  int wait_ms = next_deadline > now ? static_cast<int>((next_deadline - now + 999999) / 1000000) : 0;
+  if (poll(fds.data(), fds.size(), wait_ms) < 0)
+    return 0;
+
+  if (fds.back().revents & POLLIN)
+  {
+    char buf[16];
+    while (read(wake_fds_[0], buf, sizeof(buf)) > 0)
+    {
+    }
+  }
+
+  size_t scans = 0;
+  now = nowNs();
+  for (size_t i = 0; i < entries.size(); ++i)
+  {
+    Entry &entry = *entries[i];
+    if (fds[i].fd >= 0 && (fds[i].revents & (POLLIN | POLLERR | POLLHUP)))
+      scans += drain(entry, now);
+    else if (entry.on_error && now - entry.last_activity_ns >= entry.timeout_ns)
+    {
+      entry.last_activity_ns = now;
+      entry.on_error(*entry.sensor);
+    }
+  }
+  return scans;
+}
+
+size_t ScanReactor::drain(Entry &entry, int64_t now)
+{
+  size_t scans = 0;
+  while (true)
+  {
+    CoLaAReadResult::Result result;
+    if (executor_)
+    {
+      std::shared_ptr<ScanData> scan(new ScanData());
+      result = entry.sensor->tryGetScanData(scan.get());
+      if (result == CoLaAReadResult::Scan)
+      {
+        ScanCallback callback = entry.on_scan;
+        executor_([callback, scan]() { callback(*scan); });
+      }
+    }
+    else
+    {
+      result = entry.sensor->tryGetScanData(&entry.scan);
+      if (result == CoLaAReadResult::Scan)
+        entry.on_scan(entry.scan);
+    }
+
+    if (result == CoLaAReadResult::Scan)
+    {
+      ++scans;
+      entry.last_activity_ns = now;
+      continue;
+    }
+    if (result == CoLaAReadResult::Disconnected && entry.on_error)
+    {
+      entry.last_activity_ns = now;
+      entry.on_error(*entry.sensor);
+    }
+    return scans;
+  }
+}
+
+void ScanReactor::run()
+{
+  stopped_ = false;
+  while (!stopped_)
+    runOnce(100);
+}
+
+void ScanReactor::stop()
+{
+  stopped_ = true;
+  char c = 0;
+  if (write(wake_fds_[1], &c, 1) != 1)
+    logDebug("Wake up pipe full");
+}
@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lms1xx/scan_tracker.h"
+
+#include "lms1xx/colaa_log.h"
+#include <algorithm>
+#include <cmath>
+
+ScanTracker::ScanTracker(const ScanTrackerConfig &config)
+  : config_(config), segments_(config.max_segments), segment_count_(0), tracks_(config.max_tracks),
+    table_start_angle_(0), table_step_(0), breakpoint_factor_(0)
+{
+  reset();
+}
+
+void ScanTracker::reset()
+{
+  for (size_t i = 0; i < tracks_.size(); ++i)
+    tracks_[i].active = false;
+  segment_count_ = 0;
+  next_id_ = 0;
+  last_stamp_ = 0;
+  has_stamp_ = false;
+}
+
+const std::vector<Track> &ScanTracker::tracks() const
+{
+  return tracks_;
+}
+
+bool ScanTracker::isConfirmed(const Track &track) const
+{
+  return track.active && track.hits >= config_.min_hits;
+}
+
+size_t ScanTracker::segmentCount() const
+{
+  return segment_count_;
+}
+
+size_t ScanTracker::update(const ScanData &data, double stamp, size_t echo)
+{
+  float dt = has_stamp_ ? static_cast<float>(stamp - last_stamp_) : 0.0f;
+  last_stamp_ = stamp;
+  has_stamp_ = true;
+
+  segment(data, echo);
+  associate(dt);
+
+  size_t confirmed = 0;
+  for (size_t i = 0; i < tracks_.size(); ++i)
+  {
+    if (isConfirmed(tracks_[i]))
+      ++confirmed;
+  }
+  return confirmed;
+}
+
+void ScanTracker::closeSegment(Segment &current)
+{
+  if (current.count < config_.min_points)
+    return;
+  float dx = current.last_x - current.first_x;
+  float dy = current.last_y - current.first_y;
+  if (dx * dx + dy * dy > config_.max_width * config_.max_width)
+    return;
+  if (segment_count_ == segments_.size())
+  {
+    logDebug("Scan tracker: segment table full");
+    return;
+  }
+  segments_[segment_count_++] = current;
+}
+
+void ScanTracker::segment(const ScanData &data, size_t echo)
+{
+  segment_count_ = 0;
+  if (echo >= data.echoCount())
+    return;
+  const ChannelData<uint16_t> &ranges = data.ch16bit[echo];
+  size_t count = ranges.data.size();
+
+  if (cos_table_.size() != count || table_start_angle_ != ranges.header.start_angle ||
+      table_step_ != ranges.header.step_size)
+  {
+    double start_angle = ranges.header.start_angle * M_PI / 180.0 / 10000.0 - M_PI / 2.0;
+    double angle_increment = ranges.header.step_size * M_PI / 180.0 / 10000.0;
+    cos_table_.resize(count);
+    sin_table_.resize(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+      cos_table_[i] = cos(start_angle + i * angle_increment);
+      sin_table_[i] = sin(start_angle + i * angle_increment);
+    }
+    table_start_angle_ = ranges.header.start_angle;
+    table_step_ = ranges.header.step_size;
+    breakpoint_factor_ = sin(angle_increment) / sin(std::max(config_.breakpoint_angle - angle_increment, 1e-3));
+  }
+
+  float scale = 0.001 * ranges.header.scale_factor;
+  const BeamMask *valid = echo < data.valid.size() ? &data.valid[echo] : NULL;
+  Segment current = Segment();
+  for (size_t i = 0; i < count; ++i)
+  {
+    float dist = ranges.data[i] * scale;
+    if ((valid && !valid->test(i)) || dist < config_.min_range || dist > config_.max_range)
+    {
+      closeSegment(current);
+      current.count = 0;
+      continue;
+    }
+    float x = dist * cos_table_[i];
+    float y = dist * sin_table_[i];
+    float dx = x - current.last_x;
+    float dy = y - current.last_y;
+    float max_gap = config_.segment_distance + dist * breakpoint_factor_;
+    if (current.count > 0 && dx * dx + dy * dy > max_gap * max_gap)
+    {
+      closeSegment(current);
+      current.count = 0;
+    }
+    if (current.count == 0)
+    {
+      current.sum_x = current.sum_y = 0;
+      current.first_x = x;
+      current.first_y = y;
+      current.taken = false;
+    }
+    current.sum_x += x;
+    current.sum_y += y;
+    current.last_x = x;
+    current.last_y = y;
+    ++current.count;
+  }
+  closeSegment(current);
+}
+
+void ScanTracker::associate(float dt)
+{
+  float gate = config_.gate * config_.gate;
+  for (size_t t = 0; t < tracks_.size(); ++t)
+  {
+    Track &track = tracks_[t];
+    if (!track.active)
+      continue;
+
+    float px = track.x + track.vx * dt;
+    float py = track.y + track.vy * dt;
+    size_t nearest = segment_count_;
+    float nearest_dist = gate;
+    for (size_t s = 0; s < segment_count_; ++s)
+    {
+      if (segments_[s].taken)
+        continue;
+      float dx = segments_[s].sum_x / segments_[s].count - px;
+      float dy = segments_[s].sum_y / segments_[s].count - py;
+      float d = dx * dx + dy * dy;
+      if (d < nearest_dist)
+      {
+        nearest_dist = d;
+        nearest = s;
+      }
+    }
+
+    if (nearest == segment_count_)
+    {
+      track.x = px;
+      track.y = py;
+      if (++track.missed > config_.max_missed)
+        track.active = false;
+      continue;
+    }
+
+    Segment &segment = segments_[nearest];
+    segment.taken = true;
+    float rx = segment.sum_x / segment.count - px;
+    float ry = segment.sum_y / segment.count - py;
+    track.x = px + config_.alpha * rx;
+    track.y = py + config_.alpha * ry;
+    if (dt > 0)
+    {
+      track.vx += config_.beta * rx / dt;
+      track.vy += config_.beta * ry / dt;
+    }
+    track.width = std::hypot(segment.last_x - segment.first_x, segment.last_y - segment.first_y);
+    ++track.hits;
+    track.missed = 0;
+  }
+
+  // Unassociated segments start new tracks in free slots
+  size_t slot = 0;
+  for (size_t s = 0; s < segment_count_; ++s)
+  {
+    const Segment &segment = segments_[s];
+    if (segment.taken)
+      continue;
+    while (slot < tracks_.size() && tracks_[slot].active)
+      ++slot;
+    if (slot == tracks_.size())
+    {
+      logDebug("Scan tracker: track table full");
+      return;
+    }
+    Track &track = tracks_[slot];
+    track.id = next_id_++;
+    track.x = segment.sum_x / segment.count;
+    track.y = segment.sum_y / segment.count;
+    track.vx = track.vy = 0;
+    track.width = std::hypot(segment.last_x - segment.first_x, segment.last_y - segment.first_y);
+    track.hits = 1;
+    track.missed = 0;
+    track.active = true;
+  }
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lms1xx/scan_bundle.h>
+#include <ros/ros.h>
+
+/**
+ * Republishes the scans of "scan_bundle" one by one on "scan" for consumers that do not
+ * understand bundles. Run it on the consuming host so bundling still saves the network traffic.
+ */
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "scan_unbundler");
+  ros::NodeHandle nh;
+  ros::NodeHandle n("~");
+  int queue_size;
+  n.param<int>("queue_size", queue_size, 4);
+
+  ros::Publisher scan_pub = nh.advertise<sensor_msgs::LaserScan>("scan", queue_size);
+  ros::Subscriber bundle_sub = ScanBundling::subscribe(nh, "scan_bundle", 1,
+                                                       [&scan_pub](const sensor_msgs::LaserScanConstPtr &scan)
+  {
+    scan_pub.publish(scan);
+  });
+
+  ros::spin();
+  return 0;
+}
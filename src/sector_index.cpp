@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lms1xx/sector_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/**
+ * @brief Key of beams without a valid return
+ */
+static const uint32_t NO_BEAM = 0xffffffff;
+
+static inline size_t floorLog2(size_t n)
+{
+  return 63 - __builtin_clzll(n);
+}
+
+SectorIndex::SectorIndex()
+  : blocks_(0), unit_(0), angle_min_(0), angle_increment_(0), telegram_counter_(0)
+{
+}
+
+void SectorIndex::build(const ScanData &data, size_t echo)
+{
+  if (echo >= data.echoCount())
+  {
+    keys_.clear();
+    blocks_ = 0;
+    return;
+  }
+  const ChannelData<uint16_t> &channel = data.ch16bit[echo];
+  size_t count = channel.data.size();
+  unit_ = 0.001f * channel.header.scale_factor;
+  angle_min_ = channel.header.start_angle * M_PI / 180.0 / 10000.0 - M_PI / 2.0;
+  angle_increment_ = channel.header.step_size * M_PI / 180.0 / 10000.0;
+  telegram_counter_ = data.header.status_info.telegram_counter;
+
+  keys_.resize(count);
+  const uint16_t *ranges = channel.data.data();
+  for (size_t i = 0; i < count; ++i)
+    keys_[i] = ranges[i] ? static_cast<uint32_t>(ranges[i]) << 16 | static_cast<uint32_t>(i) : NO_BEAM;
+  if (echo < data.valid.size())
+    data.valid[echo].forEachInvalid(count, [this](size_t i) { keys_[i] = NO_BEAM; });
+
+  prefix_.resize(count);
+  suffix_.resize(count);
+  blocks_ = (count + BLOCK - 1) / BLOCK;
+  size_t levels = blocks_ > 0 ? floorLog2(blocks_) + 1 : 0;
+  table_.resize(levels * blocks_);
+  for (size_t b = 0; b < blocks_; ++b)
+  {
+    size_t begin = b * BLOCK;
+    size_t end = std::min(count, begin + BLOCK);
+    uint32_t m = NO_BEAM;
+    for (size_t i = begin; i < end; ++i)
+      prefix_[i] = m = std::min(m, keys_[i]);
+    table_[b] = m;
+    m = NO_BEAM;
+    for (size_t i = end; i-- > begin;)
+      suffix_[i] = m = std::min(m, keys_[i]);
+  }
+  for (size_t k = 1; k < levels; ++k)
+  {
+    const uint32_t *previous = &table_[(k - 1) * blocks_];
+    uint32_t *level = &table_[k * blocks_];
+    size_t half = size_t(1) << (k - 1);
+    for (size_t b = 0; b + 2 * half <= blocks_; ++b)
+      level[b] = std::min(previous[b], previous[b + half]);
+  }
+}
+
+SectorMin SectorIndex::query(size_t first, size_t last) const
+{
+  if (first > last)
+    std::swap(first, last);
+  if (first >= keys_.size())
+    return decode(NO_BEAM);
+  last = std::min(last, keys_.size() - 1);
+
+  size_t first_block = first / BLOCK;
+  size_t last_block = last / BLOCK;
+  uint32_t m = NO_BEAM;
+  if (first_block == last_block)
+  {
+    for (size_t i = first; i <= last; ++i)
+      m = std::min(m, keys_[i]);
+    return decode(m);
+  }
+
+  m = std::min(suffix_[first], prefix_[last]);
+  if (last_block > first_block + 1)
+  {
+    size_t l = first_block + 1;
+    size_t r = last_block - 1;
+    size_t k = floorLog2(r - l + 1);
+    const uint32_t *level = &table_[k * blocks_];
+    m = std::min(m, std::min(level[l], level[r + 1 - (size_t(1) << k)]));
+  }
+  return decode(m);
+}
+
+SectorMin SectorIndex::queryAngles(double angle_min, double angle_max) const
+{
+  if (angle_min > angle_max)
+    std::swap(angle_min, angle_max);
+  if (keys_.empty() || angle_increment_ <= 0)
+    return decode(NO_BEAM);
+  // Beams exactly on the sector border belong to it despite rounding
+  double first = std::ceil((angle_min - angle_min_) / angle_increment_ - 1e-6);
+  double last = std::floor((angle_max - angle_min_) / angle_increment_ + 1e-6);
+  if (last < 0 || first >= static_cast<double>(keys_.size()) || first > last)
+    return decode(NO_BEAM);
+  return query(static_cast<size_t>(std::max(first, 0.0)),
+               static_cast<size_t>(std::min(last, static_cast<double>(keys_.size() - 1))));
+}
+
+SectorMin SectorIndex::decode(uint32_t key) const
+{
+  SectorMin result;
+  if (key == NO_BEAM)
+  {
+    result.range = std::numeric_limits<float>::infinity();
+    result.angle = 0;
+    result.beam = -1;
+    return result;
+  }
+  result.beam = static_cast<int32_t>(key & 0xffff);
+  result.range = (key >> 16) * unit_;
+  result.angle = static_cast<float>(angle_min_ + result.beam * angle_increment_);
+  return result;
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lms1xx/sector_service.h"
+
+SectorService::SectorService(ros::NodeHandle &nh, const std::string &name, size_t echo)
+  : echo_(echo), spinner_(1, &queue_), latest_(NULL)
+{
+  for (int i = 0; i < 3; ++i)
+    buffers_.push_back(std::unique_ptr<Indexed>(new Indexed()));
+  ros::AdvertiseServiceOptions options = ros::AdvertiseServiceOptions::create<lms1xx::SectorQuery>(
+        name, boost::bind(&SectorService::query, this, _1, _2), ros::VoidConstPtr(), &queue_);
+  server_ = nh.advertiseService(options);
+  spinner_.start();
+}
+
+SectorService::~SectorService()
+{
+  spinner_.stop();
+  server_.shutdown();
+}
+
+void SectorService::update(const ScanData &data, const ros::Time &stamp)
+{
+  // A buffer neither the latest nor being queried, no query can start on it until it is the latest
+  Indexed *next = NULL;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < buffers_.size() && !next; ++i)
+    {
+      if (buffers_[i].get() != latest_ && buffers_[i]->readers == 0)
+        next = buffers_[i].get();
+    }
+  }
+  if (!next)
+  {
+    buffers_.push_back(std::unique_ptr<Indexed>(new Indexed()));
+    next = buffers_.back().get();
+  }
+
+  next->index.build(data, echo_);
+  next->stamp = stamp;
+  std::lock_guard<std::mutex> lock(mutex_);
+  latest_ = next;
+}
+
+bool SectorService::query(lms1xx::SectorQuery::Request &request, lms1xx::SectorQuery::Response &response)
+{
+  Indexed *latest;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    latest = latest_;
+    if (!latest)
+      return false;
+    ++latest->readers;
+  }
+
+  SectorMin result = latest->index.queryAngles(request.angle_min, request.angle_max);
+  response.range = result.range;
+  response.angle = result.angle;
+  response.beam = result.beam;
+  response.stamp = latest->stamp;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  --latest->readers;
+  return true;
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <lms1xx/fleet_provisioner.h>
+
+void usage()
+{
+  std::cout << "sick_provision [--dry-run] [--jobs N] <fleet config>" << std::endl;
+  std::cout << "Configures all scanners listed in the fleet config concurrently." << std::endl << std::endl;
+  std::cout << "    --dry-run  Only report what would be changed" << std::endl;
+  std::cout << "    --jobs N   Configure at most N scanners at the same time (default 32)" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  bool dry_run = false;
+  size_t jobs = 32;
+  std::string path;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (strcmp(argv[i], "--dry-run") == 0)
+      dry_run = true;
+    else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc)
+      jobs = std::max(1, atoi(argv[++i]));
+    else if (argv[i][0] != '-' && path.empty())
+      path = argv[i];
+    else
+    {
+      usage();
+      return strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0 ? 0 : 1;
+    }
+  }
+  if (path.empty())
+  {
+    usage();
+    return 1;
+  }
+
+  std::vector<DeviceConfig> devices;
+  std::string error;
+  if (!FleetProvisioner::loadConfig(path, devices, error))
+  {
+    std::cerr << error << std::endl;
+    return 1;
+  }
+
+  static const char *RESULTS[] = { "unchanged", "applied", "connect failed", "verify failed", "would change", "timed out" };
+  std::vector<ProvisionReport> reports = FleetProvisioner::provisionFleet(devices, dry_run, jobs);
+  int failures = 0;
+  for (size_t i = 0; i < reports.size(); ++i)
+  {
+    const ProvisionReport &report = reports[i];
+    std::cout << std::left << std::setw(20) << report.name << " " << std::setw(20) << devices[i].host << " "
+              << std::setw(15) << RESULTS[report.result] << std::right << std::fixed << std::setprecision(2)
+              << std::setw(6) << report.seconds << " s" << std::endl;
+    for (size_t k = 0; k < report.changes.size(); ++k)
+      std::cout << "    " << report.changes[k] << std::endl;
+    if (report.result == ProvisionResult::ConnectFailed || report.result == ProvisionResult::VerifyFailed ||
+        report.result == ProvisionResult::Timeout)
+      ++failures;
+  }
+  return failures == 0 ? 0 : 2;
+}
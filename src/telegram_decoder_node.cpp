@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <inttypes.h>
+#include <lms1xx/raw_telegram.h>
+#include <ros/ros.h>
+
+/**
+ * @brief Topic index of an MRS1000 layer, layer 1 is the lowest
+ */
+static size_t getLayerIndex(uint16_t layer)
+{
+  switch (layer) {
+  case CoLaALayers::Layer1:
+    return 0;
+  case CoLaALayers::Layer2:
+    return 1;
+  case CoLaALayers::Layer3:
+    return 2;
+  case CoLaALayers::Layer4:
+    return 3;
+  }
+  return 1;
+}
+
+/**
+ * Converts the telegrams a sensor node publishes in raw passthrough mode into scans, so the parsing
+ * and conversion run on this host instead of the one connected to the sensor.
+ */
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "telegram_decoder");
+  ros::NodeHandle nh;
+  ros::NodeHandle n("~");
+  int queue_size;
+  double max_range;
+  bool layers;
+  n.param<int>("queue_size", queue_size, 4);
+  n.param<double>("range", max_range, 80);
+  n.param<bool>("layers", layers, false);
+
+  // Without layers all scans go to "scan", MRS1000 layers to their own topics like on the sensor node
+  std::vector<ros::Publisher> scan_pubs;
+  std::vector<ros::Publisher> multi_pubs;
+  if (layers)
+  {
+    for (int i = 1; i <= 4; ++i)
+    {
+      std::string layer = "scan_layer_" + std::to_string(i);
+      scan_pubs.push_back(nh.advertise<sensor_msgs::LaserScan>(layer, 1));
+      multi_pubs.push_back(nh.advertise<sensor_msgs::MultiEchoLaserScan>(layer + "_multi", 1));
+    }
+  }
+  else
+  {
+    scan_pubs.push_back(nh.advertise<sensor_msgs::LaserScan>("scan", 1));
+    multi_pubs.push_back(nh.advertise<sensor_msgs::MultiEchoLaserScan>("multi_echo", 1));
+  }
+
+  sensor_msgs::LaserScan scan_msg;
+  scan_msg.range_min = 0.01;
+  scan_msg.range_max = max_range;
+  sensor_msgs::MultiEchoLaserScan multi_scan_msg;
+  multi_scan_msg.range_min = 0.01;
+  multi_scan_msg.range_max = max_range;
+  MessagePool<sensor_msgs::LaserScan> scan_pool(8);
+  MessagePool<sensor_msgs::MultiEchoLaserScan> multi_scan_pool(8);
+  scan_pool.setPrototype(scan_msg);
+  multi_scan_pool.setPrototype(multi_scan_msg);
+
+  TelegramDecoder decoder;
+  // Beams closer than min_range or weaker than min_rssi are decoded like beams without echo,
+  // min_rssi is compared with the 8 bit channels or, in LMS1xx telegrams, the 16 bit remission
+  double min_range;
+  int min_rssi;
+  n.param<double>("min_range", min_range, 0.0);
+  n.param<int>("min_rssi", min_rssi, 0);
+  BeamLimits beam_limits;
+  beam_limits.min_range = min_range;
+  beam_limits.min_rssi = static_cast<uint8_t>(min_rssi < 0 ? 0 : min_rssi > 255 ? 255 : min_rssi);
+  beam_limits.min_remission = static_cast<uint16_t>(min_rssi < 0 ? 0 : min_rssi > 65535 ? 65535 : min_rssi);
+  decoder.setBeamLimits(beam_limits);
+  uint64_t gaps = 0;
+  ros::Subscriber telegram_sub = nh.subscribe<lms1xx::RawTelegram>("telegrams", queue_size,
+                                                                   [&](const lms1xx::RawTelegramConstPtr &telegram)
+  {
+    if (!decoder.decode(*telegram))
+    {
+      ROS_WARN_THROTTLE(1, "Unable to parse telegram of %zu bytes", telegram->data.size());
+      return;
+    }
+    uint64_t total_gaps = decoder.getStatistics().telegram_gaps.load();
+    if (total_gaps != gaps)
+    {
+      ROS_WARN_THROTTLE(1, "%" PRIu64 " telegrams lost", total_gaps - gaps);
+      gaps = total_gaps;
+    }
+
+    size_t index = layers ? getLayerIndex(decoder.data().header.status_info.layer_angle) : 0;
+    sensor_msgs::LaserScanPtr scan = scan_pool.acquire();
+    decoder.fillLaserScan(*scan);
+    scan_pubs[index].publish(scan);
+    if (decoder.decoded().echoCount() > 1)
+    {
+      sensor_msgs::MultiEchoLaserScanPtr multi_scan = multi_scan_pool.acquire();
+      decoder.fillMultiEchoLaserScan(*multi_scan);
+      multi_pubs[index].publish(multi_scan);
+    }
+  });
+
+  ros::spin();
+  return 0;
+}
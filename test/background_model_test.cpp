@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lms1xx/background_model.h>
+#include <gtest/gtest.h>
+#include <cstdlib>
+
+/**
+ * @brief Two echoes of a 541 beam scan, a wall at 4 m with +-10 mm noise, beams 500 and up without echo
+ */
+static ScanData noisyScan()
+{
+  ScanData data;
+  for (int e = 0; e < 2; ++e)
+  {
+    ChannelData<uint16_t> ranges;
+    ranges.header.scale_factor = 1;
+    for (size_t i = 0; i < 541; ++i)
+      ranges.data.push_back(i < 500 ? 4000 + rand() % 21 - 10 : 0);
+    data.ch16bit.push_back(ranges);
+  }
+  return data;
+}
+
+class BackgroundModelTest : public ::testing::Test
+{
+protected:
+  virtual void SetUp()
+  {
+    srand(1);
+    for (uint32_t i = 0; i < BackgroundModelConfig().learn_scans; ++i)
+    {
+      ASSERT_TRUE(model_.learning());
+      EXPECT_TRUE(model_.update(noisyScan()).empty());
+    }
+    ASSERT_FALSE(model_.learning());
+  }
+
+  BackgroundModel model_;
+};
+
+TEST_F(BackgroundModelTest, unchanged_scans_are_quiet)
+{
+  for (int i = 0; i < 200; ++i)
+    EXPECT_TRUE(model_.update(noisyScan()).empty());
+  EXPECT_NEAR(model_.mean(0)[10], 4000, 5);
+  EXPECT_NEAR(model_.mean(1)[520], 65535, 1);
+}
+
+TEST_F(BackgroundModelTest, object_is_reported_as_region)
+{
+  ScanData data = noisyScan();
+  for (size_t i = 100; i <= 120; ++i)
+    data.ch16bit[1].data[i] = 1500;
+  // Single changed beam is noise, beam without echo in front of the wall is a change
+  data.ch16bit[0].data[300] = 1500;
+  data.ch16bit[0].data[400] = 0;
+  data.ch16bit[0].data[401] = 0;
+
+  std::vector<ChangedRegion> regions = model_.update(data);
+  ASSERT_EQ(regions.size(), 2u);
+  EXPECT_EQ(regions[0].echo, 0);
+  EXPECT_EQ(regions[0].first_beam, 400);
+  EXPECT_EQ(regions[0].last_beam, 401);
+  EXPECT_EQ(regions[1].echo, 1);
+  EXPECT_EQ(regions[1].first_beam, 100);
+  EXPECT_EQ(regions[1].last_beam, 120);
+
+  // The object does not become background quickly
+  for (int i = 0; i < 50; ++i)
+    model_.update(data);
+  EXPECT_EQ(model_.update(data).size(), 2u);
+  EXPECT_TRUE(model_.update(noisyScan()).empty());
+}
+
+TEST_F(BackgroundModelTest, merges_small_gaps)
+{
+  ScanData data = noisyScan();
+  data.ch16bit[0].data[200] = 1500;
+  data.ch16bit[0].data[202] = 1500;
+  data.ch16bit[0].data[205] = 1500;
+  data.ch16bit[0].data[206] = 1500;
+  std::vector<ChangedRegion> regions = model_.update(data);
+  ASSERT_EQ(regions.size(), 2u);
+  EXPECT_EQ(regions[0].first_beam, 200);
+  EXPECT_EQ(regions[0].last_beam, 202);
+  EXPECT_EQ(regions[1].first_beam, 205);
+  EXPECT_EQ(regions[1].last_beam, 206);
+}
+
+TEST(BackgroundModel, vector_and_scalar_paths_agree)
+{
+  srand(7);
+  const size_t count = 37;
+  std::vector<uint16_t> ranges(count);
+  std::vector<float> mean(count), variance(count), expected_mean(count), expected_variance(count);
+  for (size_t i = 0; i < count; ++i)
+  {
+    ranges[i] = i % 9 == 0 ? 0 : rand() % 65536;
+    mean[i] = expected_mean[i] = rand() % 65536;
+    variance[i] = expected_variance[i] = rand() % 10000;
+  }
+  std::vector<uint8_t> changed(count);
+  BackgroundModel::updateBeams(ranges.data(), mean.data(), variance.data(), changed.data(), count,
+                               0.01f, 0.001f, 4.0f, 50.0f);
+  for (size_t i = 0; i < count; ++i)
+  {
+    float x = ranges[i] ? ranges[i] : 65535.0f;
+    float d = x - expected_mean[i];
+    bool is_changed = d * d > 16.0f * expected_variance[i] + 2500.0f;
+    float a = is_changed ? 0.001f : 0.01f;
+    EXPECT_EQ(changed[i], is_changed) << i;
+    EXPECT_FLOAT_EQ(mean[i], expected_mean[i] + a * d) << i;
+    EXPECT_FLOAT_EQ(variance[i], (1.0f - a) * (expected_variance[i] + a * d * d)) << i;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
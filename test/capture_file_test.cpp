@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lms1xx/capture_file.h>
+#include <lms1xx/colaa.h>
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+TEST(CaptureFileTest, raw_telegram_file)
+{
+  std::vector<std::vector<char> > telegrams = CaptureFile::loadTelegrams("test/mrs1000.txt");
+  ASSERT_EQ(telegrams.size(), 1u);
+  EXPECT_EQ(telegrams[0].front(), '\x02');
+  EXPECT_EQ(telegrams[0].back(), '\0');
+
+  CoLaA parser;
+  ScanData data;
+  EXPECT_EQ(parser.getSerialNumber(), 0u);
+  EXPECT_TRUE(parser.parseTelegram(telegrams[0].data(), &data));
+  EXPECT_EQ(data.ch16bit[0].data.size(), 1101u);
+  // The parser's tracepoints are keyed on the serial number like the conversion ones
+  EXPECT_NE(data.header.device.serial_number, 0u);
+  EXPECT_EQ(parser.getSerialNumber(), data.header.device.serial_number);
+}
+
+TEST(CaptureFileTest, write_and_reframe)
+{
+  const char *path = "capture_file_test.cap";
+  CaptureFile::Writer writer;
+  ASSERT_TRUE(writer.open(path));
+  // Telegrams split across records and two telegrams in one record
+  ASSERT_TRUE(writer.write(1, "\x02sSN a", 6));
+  ASSERT_TRUE(writer.write(2, " b\x03\x02sSN c\x03", 11));
+  ASSERT_TRUE(writer.write(3, "junk\x02sSN d\x03", 11));
+  writer.close();
+
+  CaptureFile::Reader reader;
+  ASSERT_TRUE(reader.open(path));
+  CaptureFile::Record record;
+  ASSERT_TRUE(reader.next(record));
+  EXPECT_EQ(record.stamp_ns, 1);
+  EXPECT_EQ(std::string(record.data.begin(), record.data.end()), "\x02sSN a");
+
+  std::vector<std::vector<char> > telegrams = CaptureFile::loadTelegrams(path);
+  ASSERT_EQ(telegrams.size(), 3u);
+  EXPECT_STREQ(telegrams[0].data(), "\x02sSN a b");
+  EXPECT_STREQ(telegrams[1].data(), "\x02sSN c");
+  EXPECT_STREQ(telegrams[2].data(), "\x02sSN d");
+  remove(path);
+}
+
+TEST(CaptureFileTest, rejects_corrupt_lengths)
+{
+  const char *path = "capture_file_corrupt.cap";
+  {
+    std::ofstream file(path, std::ios::binary);
+    file.write(CaptureFile::MAGIC, sizeof(CaptureFile::MAGIC));
+    int64_t stamp = 1;
+    uint32_t length = 0xfffffff0u;
+    file.write(reinterpret_cast<const char *>(&stamp), sizeof(stamp));
+    file.write(reinterpret_cast<const char *>(&length), sizeof(length));
+    file.write("\x02sSN a\x03", 7);
+  }
+  CaptureFile::Reader reader;
+  ASSERT_TRUE(reader.open(path));
+  CaptureFile::Record record;
+  EXPECT_FALSE(reader.next(record));
+  EXPECT_TRUE(CaptureFile::loadTelegrams(path).empty());
+  remove(path);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Replays a corpus of capture files through the hot loops of the driver
+ * (tokenizing, channel parsing, conversion) and reports the time per telegram.
+ * Also serves as the training run of the profile guided build, see scripts/pgo_build.
+ *
+ * Usage: colaa_benchmark [-n iterations] capture_file...
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <lms1xx/capture_file.h>
+#include <lms1xx/colaa.h>
+#include <lms1xx/colaa_conversion.h>
+#include <lms1xx/parse_helpers.h>
+
+typedef std::vector<std::vector<char> > Corpus;
+
+static int64_t nowNs()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Runs fn once per telegram for the given number of passes, returns the median ns per telegram
+ */
+template <typename F>
+static double measure(const Corpus &corpus, int iterations, F fn)
+{
+  const int rounds = 5;
+  std::vector<double> results;
+  std::vector<char> scratch;
+  for (int r = 0; r < rounds; ++r)
+  {
+    int64_t start = nowNs();
+    for (int i = 0; i < iterations; ++i)
+    {
+      for (size_t t = 0; t < corpus.size(); ++t)
+      {
+        // Parsing is destructive, always work on a copy
+        scratch = corpus[t];
+        fn(scratch.data(), scratch.size());
+      }
+    }
+    results.push_back(static_cast<double>(nowNs() - start) / (iterations * corpus.size()));
+  }
+  std::sort(results.begin(), results.end());
+  return results[rounds / 2];
+}
+
+int main(int argc, char **argv)
+{
+  int iterations = 200;
+  Corpus corpus;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+    {
+      iterations = atoi(argv[++i]);
+      continue;
+    }
+    Corpus telegrams = CaptureFile::loadTelegrams(argv[i]);
+    corpus.insert(corpus.end(), telegrams.begin(), telegrams.end());
+  }
+  if (corpus.empty() || iterations <= 0)
+  {
+    fprintf(stderr, "Usage: %s [-n iterations] capture_file...\n", argv[0]);
+    return 1;
+  }
+
+  size_t bytes = 0;
+  for (size_t t = 0; t < corpus.size(); ++t)
+    bytes += corpus[t].size();
+
+  CoLaA parser;
+  double copy_ns = measure(corpus, iterations, [](char *, size_t) {});
+
+  double tokenize_ns = measure(corpus, iterations, [](char *buf, size_t len)
+  {
+    size_t tokens = std::count(buf, buf + len, ' ') + 1;
+    for (size_t i = 0; i < tokens; ++i)
+      nextToken(&buf);
+  });
+
+  double parse_ns = measure(corpus, iterations, [&parser](char *buf, size_t)
+  {
+    ScanData data;
+    parser.parseTelegram(buf, &data);
+  });
+
+  sensor_msgs::LaserScan scan;
+  sensor_msgs::PointCloud2 cloud;
+  sensor_msgs::PointCloud2Modifier modifier(cloud);
+  modifier.setPointCloud2Fields(4,
+    "x", 1, sensor_msgs::PointField::FLOAT32,
+    "y", 1, sensor_msgs::PointField::FLOAT32,
+    "z", 1, sensor_msgs::PointField::FLOAT32,
+    "intensity", 1, sensor_msgs::PointField::FLOAT32);
+  std::vector<ScanData> parsed(corpus.size());
+  for (size_t t = 0; t < corpus.size(); ++t)
+  {
+    std::vector<char> copy = corpus[t];
+    parser.parseTelegram(copy.data(), &parsed[t]);
+  }
+  size_t index = 0;
+  DecodedScan decoded;
+  double convert_ns = measure(corpus, iterations, [&](char *, size_t)
+  {
+    const ScanData &data = parsed[index++ % parsed.size()];
+    if (data.ch16bit.empty() || data.ch8bit.empty())
+      return;
+    scan.ranges.resize(data.ch16bit[0].data.size());
+    scan.intensities.resize(data.ch16bit[0].data.size());
+    decoded.reset(data);
+    CoLaAConversion::fillLaserScan(scan, decoded);
+    cloud.height = 1;
+    modifier.resize(data.ch16bit[0].data.size());
+    sensor_msgs::PointCloud2Iterator<float> iter_x(cloud, "x");
+    sensor_msgs::PointCloud2Iterator<float> iter_y(cloud, "y");
+    sensor_msgs::PointCloud2Iterator<float> iter_z(cloud, "z");
+    sensor_msgs::PointCloud2Iterator<float> iter_int(cloud, "intensity");
+    CoLaAConversion::fillPointCloud2(iter_x, iter_y, iter_z, iter_int, decoded);
+  });
+
+  printf("telegrams %zu, %.1f bytes/telegram, %d iterations\n", corpus.size(),
+         static_cast<double>(bytes) / corpus.size(), iterations);
+  printf("%-10s %12s\n", "stage", "ns/telegram");
+  printf("%-10s %12.0f\n", "tokenize", tokenize_ns - copy_ns);
+  printf("%-10s %12.0f\n", "parse", parse_ns - copy_ns);
+  printf("%-10s %12.0f\n", "convert", convert_ns - copy_ns);
+  printf("%-10s %12.0f\n", "total", parse_ns + convert_ns - 2 * copy_ns);
+  return 0;
+}
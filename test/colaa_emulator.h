@@ -0,0 +1,442 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COLAA_EMULATOR_H
+#define COLAA_EMULATOR_H
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Minimal CoLa A sensor emulator for tests
+ *
+ * Listens on an ephemeral port on the loopback interface, answers the
+ * configuration commands issued by CoLaA and, once continuous output is
+ * requested, streams scan telegrams built from a recorded template at a
+ * configurable rate. Each streamed telegram carries an increasing telegram
+ * counter and its send time is recorded so tests can measure latency.
+ */
+class CoLaAEmulator
+{
+public:
+  /**
+   * @param telegram_file Recorded scan telegram used as template (STX/ETX framed)
+   * @param rate_hz Telegrams per second while streaming
+   */
+  CoLaAEmulator(const std::string &telegram_file, double rate_hz)
+    : rate_hz_(rate_hz), listen_fd_(-1), client_fd_(-1), port_(0), running_(false),
+      streaming_(false), telegram_counter_(0), telegrams_sent_(0), connections_(0),
+      scan_frequency_(5000), angular_resolution_(2500), start_angle_(-450000), stop_angle_(2250000)
+  {
+    std::ifstream reader(telegram_file.c_str(), std::ios::binary);
+    std::stringstream ss;
+    ss << reader.rdbuf();
+    splitTemplate(ss.str());
+    for (size_t i = 0; i < 65536; ++i)
+      send_time_ns_[i] = 0;
+  }
+
+  ~CoLaAEmulator()
+  {
+    stop();
+  }
+
+  /**
+   * @brief Bind the listening socket and start serving in a background thread
+   * @return false if the socket could not be set up
+   */
+  bool start()
+  {
+    listen_fd_ = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listen_fd_ < 0)
+      return false;
+    int one = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = 0;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listen_fd_, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(listen_fd_, 4) != 0)
+      return false;
+    socklen_t len = sizeof(addr);
+    getsockname(listen_fd_, (struct sockaddr *) &addr, &len);
+    port_ = ntohs(addr.sin_port);
+    running_ = true;
+    thread_ = std::thread(&CoLaAEmulator::run, this);
+    return true;
+  }
+
+  void stop()
+  {
+    if (running_)
+    {
+      running_ = false;
+      thread_.join();
+    }
+    closeClient();
+    if (listen_fd_ >= 0)
+    {
+      close(listen_fd_);
+      listen_fd_ = -1;
+    }
+  }
+
+  /**
+   * @brief Drop the current client connection as a sensor reboot would
+   */
+  void dropClient()
+  {
+    drop_requested_ = true;
+  }
+
+  int port() const
+  {
+    return port_;
+  }
+
+  uint64_t telegramsSent() const
+  {
+    return telegrams_sent_;
+  }
+
+  uint64_t connections() const
+  {
+    return connections_;
+  }
+
+  /**
+   * @brief Monotonic send time of the telegram with the given counter in ns
+   */
+  int64_t sendTime(uint16_t telegram_counter) const
+  {
+    return send_time_ns_[telegram_counter];
+  }
+
+  /**
+   * @brief Current scan configuration as stored by the emulated device
+   */
+  void scanConfig(uint32_t &frequency, uint32_t &resolution, int32_t &start, int32_t &stop)
+  {
+    std::lock_guard<std::mutex> lock(config_mutex_);
+    frequency = scan_frequency_;
+    resolution = angular_resolution_;
+    start = start_angle_;
+    stop = stop_angle_;
+  }
+
+  void setScanConfig(uint32_t frequency, uint32_t resolution, int32_t start, int32_t stop)
+  {
+    std::lock_guard<std::mutex> lock(config_mutex_);
+    scan_frequency_ = frequency;
+    angular_resolution_ = resolution;
+    start_angle_ = start;
+    stop_angle_ = stop;
+  }
+
+  /**
+   * @brief Number of mEEwriteall commands received
+   */
+  uint64_t eepromWrites() const
+  {
+    return eeprom_writes_;
+  }
+
+  /**
+   * @brief Arguments of the last write or method call with the given name, empty if never received
+   */
+  std::string lastArguments(const std::string &name)
+  {
+    std::lock_guard<std::mutex> lock(config_mutex_);
+    return arguments_[name];
+  }
+
+  /**
+   * @brief Delay every reply, emulating a slow device or network
+   */
+  void setReplyDelay(int delay_ms)
+  {
+    reply_delay_ms_ = delay_ms;
+  }
+
+  /**
+   * @brief Accept connections and commands but never reply, like a hung device
+   */
+  void setSilent(bool silent)
+  {
+    silent_ = silent;
+  }
+
+  /**
+   * @brief Cut the next streamed telegram short after the given number of bytes, keeping its framing
+   */
+  void truncateNext(size_t bytes)
+  {
+    truncate_next_ = bytes;
+  }
+
+  static int64_t nowNs()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+private:
+  void splitTemplate(const std::string &telegram)
+  {
+    // Token 7 is the telegram counter, token 8 the scan counter
+    size_t pos = 0;
+    for (int token = 0; token < 7 && pos != std::string::npos; ++token)
+      pos = telegram.find(' ', pos + 1);
+    size_t end = telegram.find(' ', telegram.find(' ', pos + 1) + 1);
+    if (pos == std::string::npos || end == std::string::npos)
+      return;
+    prefix_ = telegram.substr(0, pos + 1);
+    suffix_ = telegram.substr(end);
+  }
+
+  void closeClient()
+  {
+    if (client_fd_ >= 0)
+    {
+      close(client_fd_);
+      client_fd_ = -1;
+    }
+    streaming_ = false;
+    pending_.clear();
+  }
+
+  void run()
+  {
+    std::chrono::steady_clock::time_point next_scan = std::chrono::steady_clock::now();
+    const std::chrono::nanoseconds period(static_cast<int64_t>(1e9 / rate_hz_));
+    while (running_)
+    {
+      if (drop_requested_)
+      {
+        drop_requested_ = false;
+        closeClient();
+      }
+
+      struct pollfd pfd;
+      pfd.fd = client_fd_ >= 0 ? client_fd_ : listen_fd_;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      int timeout_ms = 1;
+      if (poll(&pfd, 1, timeout_ms) > 0)
+      {
+        if (client_fd_ < 0)
+        {
+          client_fd_ = accept(listen_fd_, NULL, NULL);
+          ++connections_;
+        }
+        else if (!receive())
+        {
+          closeClient();
+        }
+      }
+
+      if (streaming_ && std::chrono::steady_clock::now() >= next_scan)
+      {
+        sendTelegram();
+        next_scan += period;
+        if (next_scan < std::chrono::steady_clock::now())
+          next_scan = std::chrono::steady_clock::now() + period;
+      }
+      else if (!streaming_)
+      {
+        next_scan = std::chrono::steady_clock::now();
+      }
+    }
+  }
+
+  bool receive()
+  {
+    char buf[1024];
+    ssize_t len = read(client_fd_, buf, sizeof(buf));
+    if (len <= 0)
+      return false;
+    pending_.append(buf, len);
+    size_t stx;
+    size_t etx;
+    while ((stx = pending_.find('\x02')) != std::string::npos &&
+           (etx = pending_.find('\x03', stx)) != std::string::npos)
+    {
+      std::string command = pending_.substr(stx + 1, etx - stx - 1);
+      pending_.erase(0, etx + 1);
+      handleCommand(command);
+    }
+    return true;
+  }
+
+  void handleCommand(const std::string &command)
+  {
+    std::istringstream ss(command);
+    std::string type;
+    std::string name;
+    ss >> type >> name;
+    std::string reply_type = type.substr(0, 2) + "A";
+    if (type == "sMN")
+      reply_type = "sAN";
+    std::ostringstream reply;
+    reply << reply_type << " " << name;
+    if (type != "sRN")
+    {
+      std::lock_guard<std::mutex> lock(config_mutex_);
+      size_t args = type.size() + name.size() + 2;
+      arguments_[name] = command.size() > args ? command.substr(args) : "";
+    }
+    if (silent_)
+      return;
+    if (reply_delay_ms_ > 0)
+      std::this_thread::sleep_for(std::chrono::milliseconds(reply_delay_ms_));
+
+    if (name == "LMPscancfg")
+    {
+      std::lock_guard<std::mutex> lock(config_mutex_);
+      reply << std::uppercase << std::hex << " " << scan_frequency_ << " 1 " << angular_resolution_
+            << " " << static_cast<uint32_t>(start_angle_) << " " << static_cast<uint32_t>(stop_angle_);
+    }
+    else if (name == "mLMPsetscancfg")
+    {
+      std::lock_guard<std::mutex> lock(config_mutex_);
+      std::string sectors;
+      ss >> std::hex >> scan_frequency_ >> sectors >> angular_resolution_;
+      uint32_t start;
+      uint32_t stop;
+      ss >> start >> stop;
+      start_angle_ = static_cast<int32_t>(start);
+      stop_angle_ = static_cast<int32_t>(stop);
+      reply << " 0";
+    }
+    else if (name == "LMDscandatacfg")
+    {
+      std::lock_guard<std::mutex> lock(config_mutex_);
+      if (type == "sWN")
+        scan_data_config_ = arguments_[name];
+      else
+        reply << " " << scan_data_config_;
+    }
+    else if (name == "LMPoutputRange")
+    {
+      std::lock_guard<std::mutex> lock(config_mutex_);
+      reply << std::uppercase << std::hex << " 1 " << angular_resolution_ << " "
+            << static_cast<uint32_t>(start_angle_) << " " << static_cast<uint32_t>(stop_angle_);
+    }
+    else if (name == "STlms")
+    {
+      reply << " 7 0";
+    }
+    else if (name == "SCdevicestate")
+    {
+      reply << " 1";
+    }
+    else if (name == "LMDscandata" && type == "sEN")
+    {
+      int start = 0;
+      ss >> start;
+      reply.str("");
+      reply << "sEA LMDscandata " << start;
+      streaming_ = start != 0;
+    }
+    else if (name == "SetAccessMode" || name == "mEEwriteall" || name == "Run")
+    {
+      if (name == "mEEwriteall")
+        ++eeprom_writes_;
+      reply << " 1";
+    }
+    else if (type == "sMN")
+    {
+      reply << " 0";
+    }
+
+    std::string framed = "\x02" + reply.str() + "\x03";
+    writeAll(framed);
+  }
+
+  void sendTelegram()
+  {
+    uint16_t counter = telegram_counter_++;
+    std::ostringstream ss;
+    ss << prefix_ << std::uppercase << std::hex << counter << " " << counter << suffix_;
+    std::string telegram = ss.str();
+    size_t truncate = truncate_next_.exchange(0);
+    if (truncate > 0 && truncate < telegram.size())
+      telegram = telegram.substr(0, truncate) + "\x03";
+    send_time_ns_[counter] = nowNs();
+    if (writeAll(telegram))
+      ++telegrams_sent_;
+  }
+
+  bool writeAll(const std::string &data)
+  {
+    size_t written = 0;
+    while (written < data.size())
+    {
+      ssize_t ret = send(client_fd_, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+      if (ret <= 0)
+        return false;
+      written += ret;
+    }
+    return true;
+  }
+
+  std::string prefix_;
+  std::string suffix_;
+  std::string pending_;
+  double rate_hz_;
+  int listen_fd_;
+  int client_fd_;
+  int port_;
+  std::atomic<bool> running_;
+  std::atomic<bool> drop_requested_{false};
+  std::atomic<bool> streaming_;
+  uint16_t telegram_counter_;
+  std::atomic<uint64_t> telegrams_sent_;
+  std::atomic<uint64_t> connections_;
+  std::atomic<uint64_t> eeprom_writes_{0};
+  std::atomic<int> reply_delay_ms_{0};
+  std::atomic<size_t> truncate_next_{0};
+  std::atomic<bool> silent_{false};
+  std::atomic<int64_t> send_time_ns_[65536];
+  std::thread thread_;
+
+  std::mutex config_mutex_;
+  uint32_t scan_frequency_;
+  uint32_t angular_resolution_;
+  int32_t start_angle_;
+  int32_t stop_angle_;
+  std::map<std::string, std::string> arguments_;
+  std::string scan_data_config_ = "01 00 1 0 0 00 00 0 0 0 0 +1";
+};
+
+#endif // COLAA_EMULATOR_H
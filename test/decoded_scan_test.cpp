@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lms1xx/capture_file.h>
+#include <lms1xx/colaa.h>
+#include <lms1xx/colaa_points.h>
+#include <lms1xx/decoded_scan.h>
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+class DecodedScanTest : public ::testing::Test
+{
+protected:
+  virtual void SetUp()
+  {
+    std::vector<std::vector<char> > telegrams = CaptureFile::loadTelegrams("test/mrs1000.txt");
+    ASSERT_EQ(telegrams.size(), 1u);
+    CoLaA parser;
+    ASSERT_TRUE(parser.parseTelegram(telegrams[0].data(), &data_));
+  }
+
+  ScanData data_;
+};
+
+TEST_F(DecodedScanTest, ranges_in_metres)
+{
+  DecodedScan decoded;
+  decoded.reset(data_);
+  ASSERT_EQ(decoded.echoCount(), data_.ch16bit.size());
+  for (size_t e = 0; e < decoded.echoCount(); ++e)
+  {
+    const std::vector<float> &ranges = decoded.ranges(e);
+    ASSERT_EQ(ranges.size(), data_.ch16bit[e].data.size());
+    for (size_t i = 0; i < ranges.size(); i += 50)
+      EXPECT_FLOAT_EQ(ranges[i], data_.ch16bit[e].data[i] * 0.001 * data_.ch16bit[e].header.scale_factor);
+    // Decoded once per scan
+    EXPECT_EQ(&decoded.ranges(e), &ranges);
+  }
+}
+
+TEST_F(DecodedScanTest, directions_cached_per_geometry)
+{
+  DecodedScan decoded;
+  decoded.reset(data_);
+  const BeamDirections &directions = decoded.directions(0);
+  const float *x = directions.x.data();
+  double angle = decoded.angleMin(0) + 100 * decoded.angleIncrement(0);
+  double layer = CoLaALayers::getLayerAngle(static_cast<CoLaALayers::Layers>(data_.header.status_info.layer_angle));
+  EXPECT_NEAR(directions.x[100], cos(angle) * cos(layer), 1e-6);
+  EXPECT_NEAR(directions.y[100], sin(angle) * cos(layer), 1e-6);
+  EXPECT_NEAR(directions.z, sin(layer), 1e-6);
+
+  // The next scan with the same geometry reuses the table
+  ScanData next = data_;
+  decoded.reset(next);
+  EXPECT_EQ(decoded.directions(0).x.data(), x);
+
+  // Another layer gets its own table
+  next.header.status_info.layer_angle = CoLaALayers::Layer2;
+  decoded.reset(next);
+  EXPECT_NE(decoded.directions(0).x.data(), x);
+  EXPECT_FLOAT_EQ(decoded.directions(0).z, 0);
+}
+
+TEST_F(DecodedScanTest, points_match_decoded_scan)
+{
+  DecodedScan decoded;
+  decoded.reset(data_);
+  std::vector<float> shared(4 * 1101);
+  std::vector<float> single(4 * 1101);
+  ASSERT_EQ(CoLaAPoints::fillPoints(decoded, 1, shared.data()), 1101u);
+  ASSERT_EQ(CoLaAPoints::fillPoints(data_, 1, single.data()), 1101u);
+  EXPECT_EQ(shared, single);
+}
+
+TEST_F(DecodedScanTest, sparse_echoes_keep_only_returns)
+{
+  // Three echoes, the second one only hits on every 10th beam, the third never
+  ScanData data = data_;
+  data.ch16bit.resize(1);
+  data.ch8bit.resize(1);
+  data.ch16bit.push_back(data.ch16bit[0]);
+  data.ch16bit.push_back(data.ch16bit[0]);
+  data.ch8bit.push_back(data.ch8bit[0]);
+  data.ch8bit.push_back(data.ch8bit[0]);
+  // Edited by hand, the masks of the parser no longer apply
+  data.valid.clear();
+  size_t beams = data.ch16bit[0].data.size();
+  data.ch16bit[0].data[0] = 0;
+  data.ch16bit[0].data[10] = 5000;
+  size_t first_returns = 0;
+  for (size_t i = 0; i < beams; ++i)
+  {
+    data.ch16bit[1].data[i] = i % 10 == 0 ? data.ch16bit[0].data[i] + 1000 : 0;
+    data.ch8bit[1].data[i] = 7;
+    data.ch16bit[2].data[i] = 0;
+    if (data.ch16bit[0].data[i] != 0)
+      ++first_returns;
+  }
+
+  DecodedScan decoded;
+  decoded.reset(data);
+  const SparseEchoes &sparse = decoded.sparseEchoes();
+  ASSERT_EQ(sparse.counts.size(), beams);
+  size_t second_returns = (beams + 9) / 10;
+  EXPECT_EQ(sparse.returns, first_returns + second_returns);
+  // Beam 0 lost its first echo, its second one moves up
+  EXPECT_EQ(sparse.counts[0], 1);
+  EXPECT_FLOAT_EQ(sparse.first_ranges[0], decoded.ranges(1)[0]);
+  EXPECT_EQ(sparse.first_intensities[0], 7);
+
+  std::vector<float> points(4 * beams * 3);
+  ASSERT_EQ(CoLaAPoints::fillReturns(decoded, points.data()), sparse.returns);
+  std::vector<float> dense(4 * beams);
+  CoLaAPoints::fillPoints(decoded, 0, dense.data());
+  // Beam 10 has two returns, the first echo comes first
+  size_t point = 0;
+  for (size_t i = 0; i < 10; ++i)
+    point += sparse.counts[i];
+  ASSERT_EQ(sparse.counts[10], 2);
+  EXPECT_EQ(points[4 * point], dense[40]);
+  EXPECT_EQ(points[4 * point + 3], dense[43]);
+  EXPECT_FLOAT_EQ(points[4 * (point + 1) + 3], 7);
+  for (size_t p = 0; p < sparse.returns; ++p)
+    EXPECT_NE(points[4 * p] * points[4 * p] + points[4 * p + 1] * points[4 * p + 1], 0) << p;
+}
+
+TEST(BeamMaskTest, vector_and_scalar_paths_agree)
+{
+  srand(42);
+  std::vector<uint16_t> ranges(1101);
+  std::vector<uint8_t> rssi(ranges.size());
+  for (size_t i = 0; i < ranges.size(); ++i)
+  {
+    ranges[i] = rand() % 4 == 0 ? 0 : rand() % 65536;
+    rssi[i] = rand() % 256;
+  }
+  // Boundaries and values with the sign bit set
+  ranges[0] = 1000;
+  ranges[1] = 50000;
+  ranges[2] = 50001;
+  rssi[3] = 100;
+
+  for (size_t count = 0; count < 40; ++count)
+  {
+    size_t offset = 1101 - count;
+    for (int with_rssi = 0; with_rssi < 2; ++with_rssi)
+    {
+      std::vector<uint64_t> bits(1, 0);
+      BeamMask::computeBits(&ranges[offset], with_rssi ? &rssi[offset] : NULL, count, 1000, 50000, 100, bits.data());
+      for (size_t i = 0; i < count; ++i)
+      {
+        uint16_t r = ranges[offset + i];
+        bool expected = r >= 1000 && r <= 50000 && (!with_rssi || rssi[offset + i] >= 100);
+        EXPECT_EQ((bits[0] >> i) & 1, expected) << count << " " << i;
+      }
+      EXPECT_EQ(bits[0] >> count >> 1, 0u);
+    }
+  }
+
+  BeamMask mask;
+  mask.bits.assign((ranges.size() + 63) / 64, 0);
+  BeamMask::computeBits(ranges.data(), rssi.data(), ranges.size(), 1000, 50000, 100, mask.bits.data());
+  size_t expected = 0;
+  std::vector<size_t> invalid;
+  for (size_t i = 0; i < ranges.size(); ++i)
+  {
+    bool valid = ranges[i] >= 1000 && ranges[i] <= 50000 && rssi[i] >= 100;
+    EXPECT_EQ(mask.test(i), valid);
+    expected += valid;
+    if (!valid)
+      invalid.push_back(i);
+  }
+  EXPECT_EQ(mask.count(), expected);
+  std::vector<size_t> visited;
+  mask.forEachInvalid(ranges.size(), [&visited](size_t i) { visited.push_back(i); });
+  EXPECT_EQ(visited, invalid);
+}
+
+TEST_F(DecodedScanTest, invalid_beams_decode_to_zero)
+{
+  std::vector<std::vector<char> > telegrams = CaptureFile::loadTelegrams("test/mrs1000.txt");
+  BeamLimits limits;
+  limits.min_range = 2.0;
+  limits.max_range = 10.0;
+  limits.min_rssi = 20;
+  CoLaA parser;
+  parser.setBeamLimits(limits);
+  ScanData data;
+  ASSERT_TRUE(parser.parseTelegram(telegrams[0].data(), &data));
+  ASSERT_EQ(data.valid.size(), data.ch16bit.size());
+
+  DecodedScan decoded;
+  decoded.reset(data);
+  const ChannelData<uint16_t> &channel = data.ch16bit[0];
+  const std::vector<float> &ranges = decoded.ranges(0);
+  bool rssi = !data.ch8bit.empty() && data.ch8bit[0].data.size() == channel.data.size();
+  size_t valid = 0;
+  for (size_t i = 0; i < ranges.size(); ++i)
+  {
+    float range = channel.data[i] * 0.001f * channel.header.scale_factor;
+    bool expected = range >= 2.0f && range <= 10.0f && (!rssi || data.ch8bit[0].data[i] >= 20);
+    EXPECT_EQ(data.valid[0].test(i), expected) << i;
+    EXPECT_FLOAT_EQ(ranges[i], expected ? range : 0) << i;
+    valid += expected;
+  }
+  EXPECT_EQ(data.valid[0].count(), valid);
+  EXPECT_GT(valid, 0u);
+  EXPECT_LT(valid, ranges.size());
+
+  // Without limits only beams without echo are invalid, parsing consumed the first copy
+  std::vector<char> telegram = CaptureFile::loadTelegrams("test/mrs1000.txt")[0];
+  ASSERT_TRUE(CoLaA().parseTelegram(telegram.data(), &data));
+  for (size_t i = 0; i < data.ch16bit[0].data.size(); ++i)
+    EXPECT_EQ(data.valid[0].test(i), data.ch16bit[0].data[i] != 0);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
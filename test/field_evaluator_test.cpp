@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lms1xx/field_evaluator.h>
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdlib>
+
+/**
+ * @brief 270 deg scan with 0.5 deg resolution and all beams at the same range
+ */
+static ScanData constantScan(uint16_t range_mm)
+{
+  ScanData data;
+  ChannelData<uint16_t> ranges;
+  ranges.header.scale_factor = 1;
+  ranges.header.start_angle = -450000;
+  ranges.header.step_size = 5000;
+  ranges.header.data_count = 541;
+  ranges.data.assign(ranges.header.data_count, range_mm);
+  data.ch16bit.push_back(ranges);
+  return data;
+}
+
+/**
+ * @brief Rectangle from x0 to x1 and -half_width to half_width
+ */
+static FieldPolygon rectangle(const std::string &name, float x0, float x1, float half_width)
+{
+  FieldPolygon field;
+  field.name = name;
+  float points[] = { x0, -half_width, x1, -half_width, x1, half_width, x0, half_width };
+  field.points.assign(points, points + 8);
+  return field;
+}
+
+/**
+ * @brief Index of the beam pointing in direction angle (rad, 0 is straight ahead)
+ */
+static size_t beam(double angle)
+{
+  return static_cast<size_t>((angle * 180.0 / M_PI + 135.0) * 2.0 + 0.5);
+}
+
+TEST(FieldEvaluator, protective_and_warning_field)
+{
+  std::vector<FieldPolygon> fields;
+  fields.push_back(rectangle("protective", -0.2, 1.0, 0.4));
+  fields.push_back(rectangle("warning", -0.2, 2.0, 0.6));
+  FieldEvaluator evaluator;
+  evaluator.addFieldSet(fields);
+
+  // Free space
+  ScanData data = constantScan(5000);
+  std::vector<FieldResult> results = evaluator.evaluate(data);
+  ASSERT_EQ(results.size(), 2u);
+  EXPECT_FALSE(results[0].violated);
+  EXPECT_FALSE(results[1].violated);
+  EXPECT_EQ(results[0].first_beam, -1);
+
+  // Obstacle straight ahead at 1.5 m
+  data.ch16bit[0].data[beam(0)] = 1500;
+  results = evaluator.evaluate(data);
+  EXPECT_FALSE(results[0].violated);
+  EXPECT_TRUE(results[1].violated);
+  EXPECT_EQ(results[1].beams, 1u);
+  EXPECT_EQ(results[1].first_beam, static_cast<int32_t>(beam(0)));
+
+  // Obstacle at 0.5 m, 30 deg to the left, inside both fields
+  data.ch16bit[0].data[beam(M_PI / 6)] = 500;
+  results = evaluator.evaluate(data);
+  EXPECT_TRUE(results[0].violated);
+  EXPECT_EQ(results[0].beams, 1u);
+  EXPECT_EQ(results[1].beams, 2u);
+
+  // Beams without echo never violate a field
+  data = constantScan(0);
+  results = evaluator.evaluate(data);
+  EXPECT_FALSE(results[0].violated);
+}
+
+TEST(FieldEvaluator, field_not_containing_the_sensor)
+{
+  std::vector<FieldPolygon> fields(1, rectangle("ahead", 1.0, 2.0, 0.5));
+  FieldEvaluator evaluator;
+  evaluator.addFieldSet(fields);
+
+  ScanData data = constantScan(5000);
+  data.ch16bit[0].data[beam(0)] = 500;
+  EXPECT_FALSE(evaluator.evaluate(data)[0].violated);
+  data.ch16bit[0].data[beam(0)] = 1500;
+  EXPECT_TRUE(evaluator.evaluate(data)[0].violated);
+}
+
+TEST(FieldEvaluator, switching_sets)
+{
+  FieldEvaluator evaluator;
+  evaluator.addFieldSet(std::vector<FieldPolygon>(1, rectangle("slow", -0.2, 0.5, 0.4)));
+  evaluator.addFieldSet(std::vector<FieldPolygon>(1, rectangle("fast", -0.2, 2.0, 0.4)));
+
+  ScanData data = constantScan(5000);
+  data.ch16bit[0].data[beam(0)] = 1000;
+  EXPECT_FALSE(evaluator.evaluate(data)[0].violated);
+  ASSERT_TRUE(evaluator.selectFieldSet(1));
+  EXPECT_EQ(evaluator.fields()[0].name, "fast");
+  EXPECT_TRUE(evaluator.evaluate(data)[0].violated);
+  EXPECT_FALSE(evaluator.selectFieldSet(2));
+}
+
+TEST(FieldEvaluator, min_beams)
+{
+  FieldEvaluator evaluator(3);
+  evaluator.addFieldSet(std::vector<FieldPolygon>(1, rectangle("protective", -0.2, 1.0, 0.4)));
+  ScanData data = constantScan(5000);
+  data.ch16bit[0].data[beam(0)] = 500;
+  data.ch16bit[0].data[beam(0) + 1] = 500;
+  EXPECT_FALSE(evaluator.evaluate(data)[0].violated);
+  data.ch16bit[0].data[beam(0) + 2] = 500;
+  EXPECT_TRUE(evaluator.evaluate(data)[0].violated);
+}
+
+TEST(FieldEvaluator, vector_and_scalar_paths_agree)
+{
+  srand(42);
+  std::vector<uint16_t> ranges(1101), lower(1101), upper(1101);
+  for (size_t i = 0; i < ranges.size(); ++i)
+  {
+    ranges[i] = rand() % 65536;
+    lower[i] = rand() % 65536;
+    upper[i] = rand() % 65536;
+  }
+  // Boundaries and values with the sign bit set
+  ranges[0] = lower[0] = 40000;
+  upper[0] = 40001;
+  ranges[1] = upper[1] = 40000;
+
+  for (size_t count = 0; count < 40; ++count)
+  {
+    size_t offset = 1101 - count;
+    uint16_t expected_beams = 0;
+    int32_t expected_first = -1;
+    for (size_t i = 0; i < count; ++i)
+    {
+      if (ranges[offset + i] >= lower[offset + i] && ranges[offset + i] < upper[offset + i])
+      {
+        if (expected_first < 0)
+          expected_first = i;
+        ++expected_beams;
+      }
+    }
+    int32_t first;
+    EXPECT_EQ(FieldEvaluator::countInside(&ranges[offset], &lower[offset], &upper[offset], count, first),
+              expected_beams);
+    EXPECT_EQ(first, expected_first);
+  }
+
+  int32_t first;
+  uint16_t beams = FieldEvaluator::countInside(ranges.data(), lower.data(), upper.data(), ranges.size(), first);
+  uint16_t expected = 0;
+  for (size_t i = 0; i < ranges.size(); ++i)
+    expected += ranges[i] >= lower[i] && ranges[i] < upper[i];
+  EXPECT_EQ(beams, expected);
+  EXPECT_EQ(first, 0);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
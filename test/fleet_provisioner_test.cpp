@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lms1xx/fleet_provisioner.h>
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <unistd.h>
+
+#include "colaa_emulator.h"
+
+class FleetProvisionerTest : public ::testing::Test
+{
+protected:
+  virtual void SetUp()
+  {
+    char directory[] = "/tmp/fleet_provisioner_testXXXXXX";
+    ASSERT_TRUE(mkdtemp(directory) != NULL);
+    directory_ = directory;
+    for (size_t i = 0; i < 4; ++i)
+    {
+      emulators_.push_back(std::unique_ptr<CoLaAEmulator>(new CoLaAEmulator("test/mrs1000.txt", 50)));
+      ASSERT_TRUE(emulators_.back()->start());
+    }
+  }
+
+  virtual void TearDown()
+  {
+    if (directory_.empty())
+      return;
+    remove(path().c_str());
+    rmdir(directory_.c_str());
+  }
+
+  std::string path() const
+  {
+    return directory_ + "/fleet.conf";
+  }
+
+  /**
+   * @brief Write a fleet config for all emulators with the given common settings
+   */
+  std::string writeConfig(const std::string &settings)
+  {
+    std::ofstream file(path().c_str());
+    file << "# Common settings\n" << settings << "\n";
+    for (size_t i = 0; i < emulators_.size(); ++i)
+      file << "[scanner" << i << "]\nhost = 127.0.0.1\nport = " << emulators_[i]->port() << "\n";
+    return path();
+  }
+
+  std::string directory_;
+  std::vector<std::unique_ptr<CoLaAEmulator> > emulators_;
+};
+
+TEST_F(FleetProvisionerTest, load_config)
+{
+  std::vector<DeviceConfig> devices;
+  std::string error;
+  ASSERT_TRUE(FleetProvisioner::loadConfig(writeConfig("type = lms5xx\nscan_frequency = 25\n"
+                                                       "start_angle = -5\nstop_angle = 185\necho_filter = last\n"
+                                                       "reply_timeout = 2.5"),
+                                           devices, error)) << error;
+  ASSERT_EQ(devices.size(), 4u);
+  EXPECT_EQ(devices[1].name, "scanner1");
+  EXPECT_EQ(devices[1].port, emulators_[1]->port());
+  EXPECT_EQ(devices[1].type, CoLaADeviceType::LMS5xx);
+  EXPECT_EQ(devices[1].scan_config_fields,
+            ScanConfigField::Frequency | ScanConfigField::StartAngle | ScanConfigField::StopAngle);
+  EXPECT_EQ(devices[1].scan_config.scan_frequency, 2500u);
+  EXPECT_EQ(devices[1].scan_config.start_angle, -50000);
+  EXPECT_EQ(devices[1].echo_filter, CoLaAEchoFilter::LastEcho);
+  EXPECT_EQ(devices[1].scan_data_fields, 0u);
+  EXPECT_EQ(devices[1].particle_filter, -1);
+  EXPECT_DOUBLE_EQ(devices[1].reply_timeout, 2.5);
+
+  EXPECT_FALSE(FleetProvisioner::loadConfig(writeConfig("scan_frequency = fast"), devices, error));
+  EXPECT_NE(error.find("scan_frequency"), std::string::npos);
+  EXPECT_FALSE(FleetProvisioner::loadConfig("does_not_exist.conf", devices, error));
+}
+
+TEST_F(FleetProvisionerTest, applies_concurrently_and_is_idempotent)
+{
+  for (size_t i = 0; i < emulators_.size(); ++i)
+    emulators_[i]->setReplyDelay(50);
+
+  std::vector<DeviceConfig> devices;
+  std::string error;
+  ASSERT_TRUE(FleetProvisioner::loadConfig(writeConfig("scan_frequency = 25\nangular_resolution = 0.5"),
+                                           devices, error)) << error;
+
+  std::vector<ProvisionReport> reports = FleetProvisioner::provisionFleet(devices, true, 8);
+  for (size_t i = 0; i < reports.size(); ++i)
+  {
+    EXPECT_EQ(reports[i].result, ProvisionResult::DryRun);
+    EXPECT_EQ(emulators_[i]->eepromWrites(), 0u);
+  }
+
+  int64_t start = CoLaAEmulator::nowNs();
+  reports = FleetProvisioner::provisionFleet(devices, false, 8);
+  double seconds = (CoLaAEmulator::nowNs() - start) * 1e-9;
+  double slowest = 0;
+  double sum = 0;
+  for (size_t i = 0; i < reports.size(); ++i)
+  {
+    EXPECT_EQ(reports[i].result, ProvisionResult::Applied) << reports[i].name;
+    EXPECT_EQ(emulators_[i]->eepromWrites(), 1u);
+    uint32_t frequency, resolution;
+    int32_t start_angle, stop_angle;
+    emulators_[i]->scanConfig(frequency, resolution, start_angle, stop_angle);
+    EXPECT_EQ(frequency, 2500u);
+    EXPECT_EQ(resolution, 5000u);
+    slowest = std::max(slowest, reports[i].seconds);
+    sum += reports[i].seconds;
+  }
+  // Roughly the time of the slowest device, not the sum
+  EXPECT_LT(seconds, slowest + 0.5 * (sum - slowest));
+
+  reports = FleetProvisioner::provisionFleet(devices, false, 8);
+  for (size_t i = 0; i < reports.size(); ++i)
+  {
+    EXPECT_EQ(reports[i].result, ProvisionResult::Unchanged);
+    EXPECT_EQ(emulators_[i]->eepromWrites(), 1u);
+  }
+}
+
+TEST_F(FleetProvisionerTest, keeps_unset_scan_config_fields)
+{
+  // An LMS5xx with a resolution and range the LMS1xx does not have
+  emulators_[0]->setScanConfig(5000, 1667, -50000, 1850000);
+  std::vector<DeviceConfig> devices;
+  std::string error;
+  ASSERT_TRUE(FleetProvisioner::loadConfig(writeConfig("type = lms5xx\nscan_frequency = 25"), devices, error))
+      << error;
+  devices.resize(1);
+  ProvisionReport report = FleetProvisioner::provisionDevice(devices[0], false);
+  EXPECT_EQ(report.result, ProvisionResult::Applied);
+
+  uint32_t frequency, resolution;
+  int32_t start_angle, stop_angle;
+  emulators_[0]->scanConfig(frequency, resolution, start_angle, stop_angle);
+  EXPECT_EQ(frequency, 2500u);
+  EXPECT_EQ(resolution, 1667u);
+  EXPECT_EQ(start_angle, -50000);
+  EXPECT_EQ(stop_angle, 1850000);
+}
+
+TEST_F(FleetProvisionerTest, writes_filters_and_data_config)
+{
+  std::vector<DeviceConfig> devices;
+  std::string error;
+  ASSERT_TRUE(FleetProvisioner::loadConfig(writeConfig("type = lms5xx\necho_filter = first\n"
+                                                       "particle_filter = on\nmean_filter = 4\noutput_interval = 2"),
+                                           devices, error)) << error;
+  devices.resize(1);
+  ProvisionReport report = FleetProvisioner::provisionDevice(devices[0], false);
+  EXPECT_EQ(report.result, ProvisionResult::Applied);
+  EXPECT_EQ(report.changes.size(), 4u);
+  EXPECT_EQ(emulators_[0]->lastArguments("FREchoFilter"), "0");
+  EXPECT_EQ(emulators_[0]->lastArguments("LFPparticle"), "1 500");
+  EXPECT_EQ(emulators_[0]->lastArguments("LFPmeanfilter"), "1 4 0");
+  // Only the output interval was given, the device's other scan data settings are kept
+  EXPECT_EQ(emulators_[0]->lastArguments("LMDscandatacfg"), "01 00 1 0 0 00 00 0 0 0 0 +2");
+  EXPECT_EQ(emulators_[0]->eepromWrites(), 1u);
+
+  // The scan data configuration is read back, an unchanged one is not a change
+  devices[0].echo_filter = -1;
+  devices[0].particle_filter = -1;
+  devices[0].mean_filter = -1;
+  report = FleetProvisioner::provisionDevice(devices[0], false);
+  EXPECT_EQ(report.result, ProvisionResult::Unchanged);
+  EXPECT_TRUE(report.changes.empty());
+  EXPECT_EQ(emulators_[0]->eepromWrites(), 1u);
+}
+
+TEST_F(FleetProvisionerTest, reports_unreachable_devices)
+{
+  DeviceConfig device;
+  device.name = "gone";
+  device.host = "127.0.0.1";
+  device.port = emulators_[0]->port();
+  emulators_[0]->stop();
+  std::vector<ProvisionReport> reports = FleetProvisioner::provisionFleet(std::vector<DeviceConfig>(1, device),
+                                                                          false, 4);
+  ASSERT_EQ(reports.size(), 1u);
+  EXPECT_EQ(reports[0].result, ProvisionResult::ConnectFailed);
+}
+
+TEST_F(FleetProvisionerTest, gives_up_on_silent_devices)
+{
+  DeviceConfig device;
+  device.name = "silent";
+  device.host = "127.0.0.1";
+  device.port = emulators_[0]->port();
+  device.reply_timeout = 1;
+  device.mean_filter = 4;
+  emulators_[0]->setSilent(true);
+  ProvisionReport report = FleetProvisioner::provisionDevice(device, false);
+  EXPECT_EQ(report.result, ProvisionResult::Timeout);
+  EXPECT_LT(report.seconds, 3.0);
+  EXPECT_EQ(emulators_[0]->eepromWrites(), 0u);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
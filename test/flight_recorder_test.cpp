@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lms1xx/capture_file.h>
+#include <lms1xx/colaa.h>
+#include <lms1xx/flight_recorder.h>
+#include <gtest/gtest.h>
+
+#include <dirent.h>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "colaa_emulator.h"
+
+static std::string readCapture(const std::string &path, std::vector<int64_t> *stamps = NULL)
+{
+  CaptureFile::Reader reader;
+  EXPECT_TRUE(reader.open(path));
+  std::string stream;
+  CaptureFile::Record record;
+  while (reader.next(record))
+  {
+    stream.append(record.data.begin(), record.data.end());
+    if (stamps)
+      stamps->push_back(record.stamp_ns);
+  }
+  return stream;
+}
+
+TEST(FlightRecorderTest, keeps_newest_bytes)
+{
+  FlightRecorderConfig config;
+  config.capacity = 16;
+  config.max_chunks = 3;
+  FlightRecorder recorder(config);
+  recorder.record("abcdef", 6, 1);
+  recorder.record("ghijkl", 6, 2);
+  recorder.record("mnopqr", 6, 3);
+  EXPECT_EQ(recorder.size(), 16u);
+  // Overwrites the oldest chunk, the ring wraps in the middle of this one
+  recorder.record("stuvwx", 6, 4);
+
+  std::vector<int64_t> stamps;
+  ASSERT_TRUE(recorder.dump("flight_recorder_test.cap"));
+  EXPECT_EQ(readCapture("flight_recorder_test.cap", &stamps), "ijklmnopqrstuvwx");
+  ASSERT_EQ(stamps.size(), 4u);
+  EXPECT_EQ(stamps.front(), 2);
+  EXPECT_EQ(stamps.back(), 4);
+
+  // A single read larger than the ring keeps its tail
+  recorder.record("0123456789abcdefXYZ", 19, 5);
+  ASSERT_TRUE(recorder.dump("flight_recorder_test.cap"));
+  EXPECT_EQ(readCapture("flight_recorder_test.cap"), "3456789abcdefXYZ");
+  remove("flight_recorder_test.cap");
+}
+
+TEST(FlightRecorderTest, dumps_only_window)
+{
+  FlightRecorderConfig config;
+  config.window = 1.0;
+  FlightRecorder recorder(config);
+  recorder.record("old", 3, 0);
+  recorder.record("new", 3, 1500000000);
+  recorder.record("est", 3, 2000000000);
+  ASSERT_TRUE(recorder.dump("flight_recorder_test.cap"));
+  EXPECT_EQ(readCapture("flight_recorder_test.cap"), "newest");
+  remove("flight_recorder_test.cap");
+}
+
+TEST(FlightRecorderTest, dumps_on_timeout)
+{
+  char directory[] = "/tmp/flight_recorder_testXXXXXX";
+  ASSERT_TRUE(mkdtemp(directory) != NULL);
+  FlightRecorderConfig config;
+  config.directory = directory;
+  FlightRecorder recorder(config);
+
+  CoLaAEmulator emulator("test/mrs1000.txt", 200);
+  ASSERT_TRUE(emulator.start());
+  CoLaA laser;
+  laser.setFlightRecorder(&recorder);
+  laser.connect("127.0.0.1", emulator.port());
+  ASSERT_TRUE(laser.isConnected());
+  laser.scanContinuous(true);
+  size_t scans = 0;
+  for (int i = 0; i < 10; ++i)
+  {
+    ScanData data;
+    if (laser.getScanData(&data))
+      ++scans;
+  }
+  ASSERT_GT(scans, 0u);
+
+  // The stream stops, the next read times out
+  laser.scanContinuous(false);
+  ScanData data;
+  while (laser.getScanData(&data))
+  {
+  }
+
+  std::vector<std::string> dumps;
+  DIR *dir = opendir(directory);
+  ASSERT_TRUE(dir != NULL);
+  while (struct dirent *entry = readdir(dir))
+  {
+    std::string name = entry->d_name;
+    if (name.find("flight_") == 0)
+      dumps.push_back(std::string(directory) + "/" + name);
+  }
+  closedir(dir);
+  ASSERT_EQ(dumps.size(), 1u);
+  EXPECT_NE(dumps[0].find("_timeout.cap"), std::string::npos) << dumps[0];
+
+  // The dump replays like any capture
+  std::vector<std::vector<char> > telegrams = CaptureFile::loadTelegrams(dumps[0]);
+  size_t parsed = 0;
+  for (size_t i = 0; i < telegrams.size(); ++i)
+  {
+    if (laser.parseTelegram(telegrams[i].data(), &data))
+      ++parsed;
+  }
+  EXPECT_GE(parsed, scans);
+
+  // Further faults right after a dump are not dumped again
+  EXPECT_EQ(recorder.trigger(FlightRecorderTrigger::Manual), "");
+  remove(dumps[0].c_str());
+  rmdir(directory);
+}
+
+TEST(FlightRecorderTest, dumps_on_truncated_telegram)
+{
+  char directory[] = "/tmp/flight_recorder_testXXXXXX";
+  ASSERT_TRUE(mkdtemp(directory) != NULL);
+  FlightRecorderConfig config;
+  config.directory = directory;
+  FlightRecorder recorder(config);
+
+  CoLaAEmulator emulator("test/mrs1000.txt", 200);
+  ASSERT_TRUE(emulator.start());
+  CoLaA laser;
+  laser.setFlightRecorder(&recorder);
+  laser.connect("127.0.0.1", emulator.port());
+  ASSERT_TRUE(laser.isConnected());
+  laser.scanContinuous(true);
+  ScanData data;
+  ASSERT_TRUE(laser.getScanData(&data));
+
+  // Framed correctly, but the 16 bit channel ends early
+  emulator.truncateNext(300);
+  size_t scans = 0;
+  for (int i = 0; i < 10; ++i)
+  {
+    if (laser.getScanData(&data))
+      ++scans;
+  }
+  laser.scanContinuous(false);
+  EXPECT_GT(scans, 0u);
+  EXPECT_EQ(laser.getStatistics().parse_failures.load(), 1u);
+
+  std::vector<std::string> dumps;
+  DIR *dir = opendir(directory);
+  ASSERT_TRUE(dir != NULL);
+  while (struct dirent *entry = readdir(dir))
+  {
+    std::string name = entry->d_name;
+    if (name.find("flight_") == 0)
+      dumps.push_back(std::string(directory) + "/" + name);
+  }
+  closedir(dir);
+  ASSERT_EQ(dumps.size(), 1u);
+  EXPECT_NE(dumps[0].find("_parse_failure.cap"), std::string::npos) << dumps[0];
+  remove(dumps[0].c_str());
+  rmdir(directory);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lms1xx/message_pool.h>
+#include <gtest/gtest.h>
+#include <thread>
+
+struct FakeScan
+{
+  std::vector<float> ranges;
+};
+
+TEST(MessagePool, reuses_released_messages)
+{
+  MessagePool<FakeScan> pool(2);
+  FakeScan prototype;
+  prototype.ranges.resize(811);
+  pool.setPrototype(prototype);
+
+  const float *data = NULL;
+  {
+    boost::shared_ptr<FakeScan> scan = pool.acquire();
+    ASSERT_EQ(scan->ranges.size(), 811u);
+    data = scan->ranges.data();
+    // A subscriber keeping a reference
+    boost::shared_ptr<const FakeScan> held = scan;
+    scan.reset();
+    EXPECT_EQ(pool.available(), 0u);
+  }
+  EXPECT_EQ(pool.available(), 1u);
+
+  // Steady state publishing does not allocate, neither the message nor its arrays
+  for (int i = 0; i < 100; ++i)
+  {
+    boost::shared_ptr<FakeScan> scan = pool.acquire();
+    EXPECT_EQ(scan->ranges.data(), data);
+  }
+  EXPECT_EQ(pool.allocations(), 1u);
+}
+
+TEST(MessagePool, capacity_and_geometry_change)
+{
+  MessagePool<FakeScan> pool(2);
+  FakeScan prototype;
+  prototype.ranges.resize(10);
+  pool.setPrototype(prototype);
+
+  std::vector<boost::shared_ptr<FakeScan> > held;
+  for (int i = 0; i < 4; ++i)
+    held.push_back(pool.acquire());
+  EXPECT_EQ(pool.allocations(), 4u);
+  held.clear();
+  // Messages beyond the capacity are freed
+  EXPECT_EQ(pool.available(), 2u);
+
+  prototype.ranges.resize(20);
+  pool.setPrototype(prototype);
+  EXPECT_EQ(pool.acquire()->ranges.size(), 20u);
+  EXPECT_EQ(pool.allocations(), 4u);
+}
+
+TEST(MessagePool, messages_outlive_pool)
+{
+  boost::shared_ptr<FakeScan> scan;
+  {
+    MessagePool<FakeScan> pool;
+    scan = pool.acquire();
+  }
+  scan->ranges.resize(5);
+  std::thread subscriber([&scan]() { scan.reset(); });
+  subscriber.join();
+  EXPECT_FALSE(scan);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
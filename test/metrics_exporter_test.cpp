@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lms1xx/colaa.h>
+#include <lms1xx/metrics_exporter.h>
+#include <gtest/gtest.h>
+
+#include "colaa_emulator.h"
+
+static std::string httpGet(int port)
+{
+  int fd = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  std::string response;
+  if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0)
+  {
+    const char *request = "GET /metrics HTTP/1.0\r\n\r\n";
+    if (write(fd, request, strlen(request)) > 0)
+    {
+      char buf[4096];
+      ssize_t len;
+      while ((len = read(fd, buf, sizeof(buf))) > 0)
+        response.append(buf, len);
+    }
+  }
+  close(fd);
+  return response;
+}
+
+TEST(MetricsExporterTest, exports_sensor_counters)
+{
+  CoLaAEmulator emulator("test/mrs1000.txt", 200);
+  ASSERT_TRUE(emulator.start());
+  CoLaA laser;
+  laser.connect("127.0.0.1", emulator.port());
+  ASSERT_TRUE(laser.isConnected());
+  laser.scanContinuous(true);
+
+  MetricsExporter exporter("127.0.0.1", 0);
+  exporter.addSensor("front", laser);
+  ASSERT_TRUE(exporter.start());
+
+  size_t scans = 0;
+  for (int i = 0; i < 20; ++i)
+  {
+    ScanData data;
+    if (laser.getScanData(&data))
+      ++scans;
+  }
+  ASSERT_GT(scans, 0u);
+
+  std::string response = httpGet(exporter.port());
+  EXPECT_EQ(response.find("HTTP/1.0 200 OK"), 0u);
+  std::ostringstream expected;
+  expected << "lms1xx_telegrams_total{sensor=\"front\"} " << laser.getStatistics().telegrams.load();
+  EXPECT_NE(response.find(expected.str()), std::string::npos) << response;
+  // Command replies framed along the scans are not parse failures
+  EXPECT_NE(response.find("lms1xx_parse_failures_total{sensor=\"front\"} 0\n"), std::string::npos) << response;
+  EXPECT_NE(response.find("lms1xx_non_scan_telegrams_total{sensor=\"front\"} "), std::string::npos);
+  EXPECT_NE(response.find("lms1xx_parse_seconds_bucket{sensor=\"front\",le=\"+Inf\"} "), std::string::npos);
+  EXPECT_NE(response.find("# EOF"), std::string::npos);
+  EXPECT_GT(laser.getStatistics().bytes_received.load(), 0u);
+  exporter.stop();
+}
+
+TEST(MetricsExporterTest, renders_external_statistics)
+{
+  CoLaAStatistics statistics;
+  statistics.telegram_gaps = 3;
+  MetricsExporter exporter;
+  exporter.addStatistics("rear", statistics);
+  EXPECT_NE(exporter.render().find("lms1xx_telegram_gaps_total{sensor=\"rear\"} 3"), std::string::npos);
+}
+
+TEST(MetricsExporterTest, reports_socket_backlog)
+{
+  CoLaAEmulator emulator("test/mrs1000.txt", 500);
+  ASSERT_TRUE(emulator.start());
+  CoLaA laser;
+  laser.setBacklogWarning(2, 0.1);
+  laser.connect("127.0.0.1", emulator.port());
+  ASSERT_TRUE(laser.isConnected());
+  int requested = CoLaA::estimateReceiveBuffer(1101, 3, 500, 0.1);
+  EXPECT_GT(requested, 1101 * 3 * 5 * 50);
+  EXPECT_GT(laser.setReceiveBufferSize(requested), 0);
+  laser.scanContinuous(true);
+
+  // The reader is slower than the sensor, telegrams pile up in the socket
+  ScanData data;
+  for (int i = 0; i < 5; ++i)
+  {
+    ASSERT_TRUE(laser.getScanData(&data));
+    usleep(50000);
+  }
+  ASSERT_TRUE(laser.getScanData(&data));
+  EXPECT_GT(laser.getStatistics().socket_queue_bytes.load(), 0u);
+  EXPECT_GE(laser.getStatistics().scans_behind.load(), 2.0);
+  EXPECT_EQ(laser.getStatistics().backlogs.load(), 1u);
+
+  MetricsExporter exporter;
+  exporter.addSensor("front", laser);
+  EXPECT_NE(exporter.render().find("lms1xx_scans_behind{sensor=\"front\"} "), std::string::npos);
+  EXPECT_NE(exporter.render().find("lms1xx_backlogs_total{sensor=\"front\"} 1"), std::string::npos);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,4 +1,5 @@
 #include <lms1xx/colaa.h>
+#include <lms1xx/colaa_points.h>
 #include <gtest/gtest.h>
 #include <fstream>
 #include <sstream>
@@ -39,6 +40,27 @@ TEST_F(MRS1000ScanDataTest, three_echo_buffer)
   EXPECT_EQ(data.ch8bit[0].data[100], 232);
 }
 
+TEST_F(MRS1000ScanDataTest, points)
+{
+  std::ifstream reader("test/mrs1000.txt", std::ios::binary);
+  std::stringstream ss;
+  ss << reader.rdbuf();
+  std::string buf_str = ss.str();
+  std::vector<char> mem(buf_str.begin(), buf_str.end());
+  mem.back() = 0;
+  ScanData data;
+  ASSERT_TRUE(this->parseScanData(mem.data(), &data));
+  std::vector<float> points(4 * 1101);
+  ASSERT_EQ(CoLaAPoints::fillPoints(data, 1, points.data()), 1101u);
+  ASSERT_EQ(CoLaAPoints::fillPoints(data, 3, points.data()), 0u);
+  CoLaAPoints::fillPoints(data, 1, points.data());
+  // Layer 4 is tilted by 5 degrees
+  float dist = data.ch16bit[1].data[47] * 0.001f;
+  EXPECT_NEAR(points[4 * 47 + 2], dist * sin(5 * M_PI / 180.0), 1e-4);
+  EXPECT_NEAR(std::hypot(points[4 * 47], points[4 * 47 + 1]), dist * cos(5 * M_PI / 180.0), 1e-4);
+  EXPECT_EQ(points[4 * 47 + 3], data.ch8bit[1].data[47]);
+}
+
 TEST_F(MRS1000ScanDataTest, enable_reply_parsing)
 {
   const char *str = "\x02sEA LMDscandata 1\x03";
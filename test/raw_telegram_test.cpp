@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lms1xx/raw_telegram.h>
+#include <gtest/gtest.h>
+
+#include "colaa_emulator.h"
+
+TEST(RawTelegram, passthrough_decodes_like_sensor_node)
+{
+  CoLaAEmulator emulator("test/mrs1000.txt", 100);
+  ASSERT_TRUE(emulator.start());
+  CoLaA laser;
+  laser.connect("127.0.0.1", emulator.port());
+  ASSERT_TRUE(laser.isConnected());
+  laser.scanContinuous(true);
+
+  CoLaA reference;
+  TelegramDecoder decoder;
+  lms1xx::RawTelegram telegram;
+  telegram.header.frame_id = "laser";
+  telegram.header.stamp = ros::Time(42);
+  for (int i = 0; i < 8; ++i)
+  {
+    // Only scan telegrams are passed on, the reply to scanContinuous is skipped
+    ASSERT_TRUE(laser.getTelegram(telegram.data));
+    ASSERT_GT(telegram.data.size(), 16u);
+    EXPECT_EQ(telegram.data[0], 0x02);
+    EXPECT_EQ(std::string(telegram.data.begin() + 1, telegram.data.begin() + 16), "sSN LMDscandata");
+
+    ASSERT_TRUE(decoder.decode(telegram));
+    sensor_msgs::LaserScan scan;
+    decoder.fillLaserScan(scan);
+    EXPECT_EQ(scan.header.frame_id, "laser");
+    EXPECT_EQ(scan.header.stamp, ros::Time(42));
+    EXPECT_GT(scan.scan_time, 0);
+    EXPECT_GT(scan.time_increment, 0);
+
+    std::vector<char> copy(telegram.data.begin(), telegram.data.end());
+    copy.push_back(0);
+    ScanData data;
+    ASSERT_TRUE(reference.parseTelegram(copy.data(), &data));
+    ASSERT_EQ(scan.ranges.size(), data.ch16bit[0].data.size());
+    for (size_t k = 0; k < scan.ranges.size(); ++k)
+      EXPECT_FLOAT_EQ(scan.ranges[k], data.ch16bit[0].data[k] * 0.001 * data.ch16bit[0].header.scale_factor);
+
+    sensor_msgs::MultiEchoLaserScan multi_scan;
+    decoder.fillMultiEchoLaserScan(multi_scan);
+    EXPECT_EQ(multi_scan.ranges.size(), data.echoCount());
+  }
+  EXPECT_EQ(laser.getStatistics().telegrams.load(), 8u);
+  EXPECT_EQ(decoder.getStatistics().telegram_gaps.load(), 0u);
+}
+
+TEST(RawTelegram, lms1xx_remission_is_intensity)
+{
+  // DIST1 and RSSI1 as 16 bit channels, no 8 bit channel
+  std::string data = "\x02sSN LMDscandata 1 1 89A27F 0 0 2A 2B 3E8 3F0 0 0 0 0 0 1388 168 0 2 "
+                     "DIST1 3F800000 00000000 FFF92230 1388 5 1F4 3E8 0 7D0 BB8 "
+                     "RSSI1 3F800000 00000000 FFF92230 1388 5 100 80 0 20 FF 0 0 0 0 0 0";
+  lms1xx::RawTelegram telegram;
+  telegram.data.assign(data.begin(), data.end());
+  TelegramDecoder decoder;
+  BeamLimits limits;
+  limits.min_remission = 0x40;
+  decoder.setBeamLimits(limits);
+  ASSERT_TRUE(decoder.decode(telegram));
+  EXPECT_EQ(decoder.decoded().echoCount(), 1u);
+
+  sensor_msgs::LaserScan scan;
+  decoder.fillLaserScan(scan);
+  // The fourth beam is darker than min_remission
+  const float ranges[] = {0.5f, 1.0f, 0, 0, 3.0f};
+  const float intensities[] = {256, 128, 0, 32, 255};
+  ASSERT_EQ(scan.ranges.size(), 5u);
+  ASSERT_EQ(scan.intensities.size(), 5u);
+  for (size_t k = 0; k < 5; ++k)
+  {
+    EXPECT_FLOAT_EQ(scan.ranges[k], ranges[k]) << k;
+    EXPECT_FLOAT_EQ(scan.intensities[k], intensities[k]) << k;
+  }
+
+  sensor_msgs::MultiEchoLaserScan multi_scan;
+  decoder.fillMultiEchoLaserScan(multi_scan);
+  ASSERT_EQ(multi_scan.ranges.size(), 1u);
+  ASSERT_EQ(multi_scan.intensities.size(), 1u);
+  EXPECT_EQ(multi_scan.intensities[0].echoes, scan.intensities);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
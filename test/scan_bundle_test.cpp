@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lms1xx/scan_bundle.h>
+#include <gtest/gtest.h>
+
+#include <set>
+
+static sensor_msgs::LaserScan prototype()
+{
+  sensor_msgs::LaserScan scan;
+  scan.header.frame_id = "laser";
+  scan.ranges.resize(541);
+  scan.intensities.resize(541);
+  return scan;
+}
+
+TEST(ScanBundle, bundles_and_unbundles_in_order)
+{
+  ScanBundler bundler(3);
+  bundler.setPrototype(prototype());
+  EXPECT_TRUE(bundler.empty());
+  for (int i = 0; i < 3; ++i)
+  {
+    EXPECT_FALSE(bundler.full());
+    sensor_msgs::LaserScan &scan = bundler.next();
+    ASSERT_EQ(scan.ranges.size(), 541u);
+    scan.header.seq = i;
+    scan.header.stamp = ros::Time(100 + i);
+    scan.ranges[0] = i;
+  }
+  EXPECT_TRUE(bundler.full());
+
+  lms1xx::ScanBundleConstPtr bundle = bundler.take();
+  EXPECT_TRUE(bundler.empty());
+  ASSERT_EQ(bundle->scans.size(), 3u);
+  EXPECT_EQ(bundle->header.frame_id, "laser");
+  EXPECT_EQ(bundle->header.stamp, ros::Time(100));
+
+  for (size_t i = 0; i < 3; ++i)
+  {
+    sensor_msgs::LaserScanConstPtr scan = ScanBundling::unbundle(bundle, i);
+    // No copy, the scan shares ownership with the bundle
+    EXPECT_EQ(scan.get(), &bundle->scans[i]);
+    EXPECT_EQ(scan->header.seq, i);
+    EXPECT_EQ(scan->header.frame_id, "laser");
+    EXPECT_EQ(scan->ranges[0], static_cast<float>(i));
+  }
+}
+
+TEST(ScanBundle, partial_bundles_and_reuse)
+{
+  ScanBundler bundler(4);
+  bundler.setPrototype(prototype());
+  const float *ranges = NULL;
+  {
+    bundler.next();
+    lms1xx::ScanBundlePtr partial = bundler.take();
+    ASSERT_EQ(partial->scans.size(), 1u);
+    ranges = partial->scans[0].ranges.data();
+  }
+
+  // The returned bundle is reused and grown back to full size
+  for (int i = 0; i < 4; ++i)
+    EXPECT_EQ(bundler.next().ranges.size(), 541u);
+  lms1xx::ScanBundlePtr bundle = bundler.take();
+  ASSERT_EQ(bundle->scans.size(), 4u);
+  EXPECT_EQ(bundle->scans[0].ranges.data(), ranges);
+
+  bundler.next();
+  bundler.clear();
+  EXPECT_TRUE(bundler.empty());
+  EXPECT_FALSE(bundler.take());
+}
+
+TEST(ScanBundle, partial_bundles_keep_their_scans)
+{
+  ScanBundler bundler(4);
+  bundler.setPrototype(prototype());
+  std::set<const float *> arrays;
+  {
+    for (int i = 0; i < 4; ++i)
+      arrays.insert(bundler.next().ranges.data());
+    bundler.take();
+  }
+  {
+    bundler.next();
+    lms1xx::ScanBundlePtr partial = bundler.take();
+    ASSERT_EQ(partial->scans.size(), 1u);
+  }
+
+  // The scans left out of the partial bundle come back with their arrays
+  std::set<const float *> reused;
+  for (int i = 0; i < 4; ++i)
+    reused.insert(bundler.next().ranges.data());
+  EXPECT_EQ(reused, arrays);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lms1xx/decoded_scan.h>
+#include <lms1xx/scan_features.h>
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdlib>
+
+/**
+ * @brief Single echo scan with 0.25 deg resolution starting at angle_min (ROS convention, degrees)
+ */
+static ScanData makeScan(double angle_min, const std::vector<double> &ranges)
+{
+  ScanData data;
+  ChannelData<uint16_t> channel;
+  channel.header.scale_factor = 1;
+  channel.header.start_angle = static_cast<int32_t>((angle_min + 90.0) * 10000);
+  channel.header.step_size = 2500;
+  channel.header.data_count = ranges.size();
+  for (size_t i = 0; i < ranges.size(); ++i)
+    channel.data.push_back(static_cast<uint16_t>(ranges[i] * 1000 + 0.5));
+  data.ch16bit.push_back(channel);
+  return data;
+}
+
+TEST(FeatureExtractor, curvature_matches_reference)
+{
+  srand(3);
+  const size_t count = 203;
+  const size_t window = 5;
+  std::vector<float> x(count), y(count), ranges(count), curvature(count);
+  for (size_t i = 0; i < count; ++i)
+  {
+    ranges[i] = rand() % 13 == 0 ? 0 : 1 + (rand() % 1000) * 0.01f;
+    x[i] = ranges[i] * std::cos(i * 0.01);
+    y[i] = ranges[i] * std::sin(i * 0.01);
+  }
+  FeatureExtractor::computeCurvature(x.data(), y.data(), ranges.data(), 0.5f, count, window, curvature.data());
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    bool valid = i >= window && i + window < count;
+    double sx = 0, sy = 0, sz = 0;
+    for (size_t j = i - window; valid && j <= i + window; ++j)
+    {
+      valid = ranges[j] > 0;
+      sx += x[j] - x[i];
+      sy += y[j] - y[i];
+      sz += 0.5 * (ranges[j] - ranges[i]);
+    }
+    if (!valid)
+      EXPECT_EQ(curvature[i], -1.0f) << i;
+    else
+      EXPECT_NEAR(curvature[i], sx * sx + sy * sy + sz * sz, 1e-3 * (1 + curvature[i])) << i;
+  }
+}
+
+TEST(FeatureExtractor, corner_is_an_edge_walls_are_planar)
+{
+  // Inside a room corner at (2, 2), beams from 0 to 90 deg
+  std::vector<double> ranges;
+  for (int i = 0; i <= 360; ++i)
+  {
+    double angle = i * 0.25 * M_PI / 180.0;
+    ranges.push_back(std::min(2.0 / std::cos(angle), 2.0 / std::sin(angle)));
+  }
+  ScanData data = makeScan(0, ranges);
+  DecodedScan decoded;
+  decoded.reset(data);
+
+  FeatureConfig config;
+  config.sectors = 1;
+  config.edges_per_sector = 1;
+  config.edge_threshold = 0.01;
+  config.plane_threshold = 0.001;
+  FeatureExtractor extractor(config);
+  extractor.extract(decoded);
+
+  ASSERT_EQ(extractor.edges().size(), 1u);
+  EXPECT_NEAR(extractor.edges()[0], 180, 1);
+  EXPECT_EQ(extractor.labels()[extractor.edges()[0]], BeamFeature::Edge);
+  ASSERT_EQ(extractor.planes().size(), config.planes_per_sector);
+  for (size_t k = 0; k < extractor.planes().size(); ++k)
+  {
+    uint32_t beam = extractor.planes()[k];
+    EXPECT_GT(std::abs(static_cast<int>(beam) - 180), 5);
+    EXPECT_EQ(extractor.labels()[beam], BeamFeature::Plane);
+  }
+  // Selected beams keep their neighbours from being selected
+  for (size_t k = 0; k < extractor.planes().size(); ++k)
+    for (size_t l = k + 1; l < extractor.planes().size(); ++l)
+      EXPECT_GT(std::abs(static_cast<int>(extractor.planes()[k]) - static_cast<int>(extractor.planes()[l])), 5);
+}
+
+TEST(FeatureExtractor, occluded_side_is_not_an_edge)
+{
+  // Wall at 4 m, an object at 2 m in front of beams 60 to 90
+  std::vector<double> ranges(161, 4.0);
+  for (size_t i = 60; i <= 90; ++i)
+    ranges[i] = 2.0;
+  ScanData data = makeScan(-20, ranges);
+  DecodedScan decoded;
+  decoded.reset(data);
+
+  FeatureConfig config;
+  config.sectors = 1;
+  FeatureExtractor extractor(config);
+  extractor.extract(decoded);
+
+  ASSERT_EQ(extractor.edges().size(), 2u);
+  for (size_t k = 0; k < 2; ++k)
+  {
+    uint32_t beam = extractor.edges()[k];
+    // The near side of the boundaries, never the wall behind the object
+    EXPECT_TRUE((beam >= 60 && beam <= 64) || (beam >= 86 && beam <= 90)) << beam;
+  }
+  for (size_t i = 54; i < 60; ++i)
+    EXPECT_NE(extractor.labels()[i], BeamFeature::Edge) << i;
+  for (size_t i = 91; i <= 96; ++i)
+    EXPECT_NE(extractor.labels()[i], BeamFeature::Edge) << i;
+}
+
+TEST(FeatureExtractor, invalid_beams_have_no_curvature)
+{
+  std::vector<double> ranges(100, 3.0);
+  ranges[50] = 0;
+  ScanData data = makeScan(0, ranges);
+  DecodedScan decoded;
+  decoded.reset(data);
+  FeatureExtractor extractor;
+  extractor.extract(decoded);
+  for (size_t i = 45; i <= 55; ++i)
+    EXPECT_EQ(extractor.curvature()[i], -1.0f) << i;
+  EXPECT_GE(extractor.curvature()[44], 0.0f);
+  EXPECT_GE(extractor.curvature()[56], 0.0f);
+  EXPECT_EQ(extractor.labels()[50], BeamFeature::None);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lms1xx/scan_matcher.h>
+#include <gtest/gtest.h>
+#include <cmath>
+
+/**
+ * @brief Ray casts an L-shaped room with a pillar, seen by a 270 deg scanner with 0.5 deg resolution
+ */
+static ScanData simulateScan(double x, double y, double theta)
+{
+  static const double walls[][4] =
+  {
+    { -4, -3, 6, -3 }, { 6, -3, 6, 2 }, { 6, 2, 1, 2 }, { 1, 2, 1, 5 },
+    { 1, 5, -4, 5 }, { -4, 5, -4, -3 },
+    { 2, -1, 2.5, -1 }, { 2.5, -1, 2.5, -0.4 }, { 2.5, -0.4, 2, -0.4 }, { 2, -0.4, 2, -1 }
+  };
+
+  ScanData data;
+  data.header.status_info.layer_angle = 0;
+  ChannelData<uint16_t> ranges;
+  ranges.header.scale_factor = 1;
+  ranges.header.start_angle = -450000;
+  ranges.header.step_size = 5000;
+  ranges.header.data_count = 541;
+  for (size_t i = 0; i < ranges.header.data_count; ++i)
+  {
+    double angle = theta + (ranges.header.start_angle + static_cast<double>(i) * ranges.header.step_size) *
+                   M_PI / 180.0 / 10000.0 - M_PI / 2.0;
+    double dx = cos(angle);
+    double dy = sin(angle);
+    double best = 0;
+    for (size_t w = 0; w < sizeof(walls) / sizeof(walls[0]); ++w)
+    {
+      double ex = walls[w][2] - walls[w][0];
+      double ey = walls[w][3] - walls[w][1];
+      double denom = dx * ey - dy * ex;
+      if (std::fabs(denom) < 1e-9)
+        continue;
+      double t = ((walls[w][0] - x) * ey - (walls[w][1] - y) * ex) / denom;
+      double u = ((walls[w][0] - x) * dy - (walls[w][1] - y) * dx) / denom;
+      if (t > 0 && u >= 0 && u <= 1 && (best == 0 || t < best))
+        best = t;
+    }
+    ranges.data.push_back(static_cast<uint16_t>(best * 1000.0 + 0.5));
+  }
+  data.ch16bit.push_back(ranges);
+  return data;
+}
+
+TEST(ScanMatcher, single_match)
+{
+  ScanMatcher matcher;
+  ASSERT_TRUE(matcher.addScan(simulateScan(0, 0, 0)));
+  ASSERT_TRUE(matcher.addScan(simulateScan(0.12, -0.08, 0.05)));
+  EXPECT_NEAR(matcher.pose().x, 0.12, 0.03);
+  EXPECT_NEAR(matcher.pose().y, -0.08, 0.03);
+  EXPECT_NEAR(matcher.pose().theta, 0.05, 0.01);
+  EXPECT_GT(matcher.score(), 0.5);
+}
+
+TEST(ScanMatcher, trajectory_with_keyframes)
+{
+  ScanMatcher matcher;
+  double x = 0, y = 0, theta = 0;
+  for (int i = 0; i < 100; ++i)
+  {
+    ASSERT_TRUE(matcher.addScan(simulateScan(x, y, theta))) << "scan " << i;
+    x += 0.03;
+    y += 0.01;
+    theta += 0.005;
+  }
+  x -= 0.03;
+  y -= 0.01;
+  theta -= 0.005;
+  EXPECT_NEAR(matcher.pose().x, x, 0.1);
+  EXPECT_NEAR(matcher.pose().y, y, 0.1);
+  EXPECT_NEAR(matcher.pose().theta, theta, 0.03);
+}
+
+TEST(ScanMatcher, bounded_nodes)
+{
+  ScanMatcherConfig config;
+  config.max_nodes = 500;
+  ScanMatcher matcher(config);
+  ASSERT_TRUE(matcher.addScan(simulateScan(0, 0, 0)));
+  matcher.addScan(simulateScan(0.1, 0.05, -0.03));
+  // Only the descent running when the budget ran out may exceed it
+  EXPECT_LE(matcher.nodes(), config.max_nodes + 4u * config.levels);
+}
+
+TEST(ScanMatcher, rejects_unrelated_scan)
+{
+  ScanMatcher matcher;
+  ASSERT_TRUE(matcher.addScan(simulateScan(0, 0, 0)));
+  EXPECT_FALSE(matcher.addScan(simulateScan(3.5, 3.5, 2.0)));
+  EXPECT_DOUBLE_EQ(matcher.pose().x, 0);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
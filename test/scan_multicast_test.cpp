@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lms1xx/capture_file.h>
+#include <lms1xx/colaa.h>
+#include <lms1xx/scan_multicast.h>
+#include <gtest/gtest.h>
+
+#include <cstring>
+
+class ScanMulticastTest : public ::testing::Test
+{
+protected:
+  virtual void SetUp()
+  {
+    std::vector<std::vector<char> > telegrams = CaptureFile::loadTelegrams("test/mrs1000.txt");
+    ASSERT_EQ(telegrams.size(), 1u);
+    telegram_size_ = strlen(telegrams[0].data());
+    CoLaA parser;
+    ASSERT_TRUE(parser.parseTelegram(telegrams[0].data(), &data_));
+  }
+
+  void expectEqual(const ScanData &a, const ScanData &b)
+  {
+    EXPECT_EQ(a.header.device.serial_number, b.header.device.serial_number);
+    EXPECT_EQ(a.header.status_info.telegram_counter, b.header.status_info.telegram_counter);
+    EXPECT_EQ(a.header.status_info.layer_angle, b.header.status_info.layer_angle);
+    EXPECT_EQ(a.header.frequencies.scan_frequency, b.header.frequencies.scan_frequency);
+    ASSERT_EQ(a.ch16bit.size(), b.ch16bit.size());
+    for (size_t c = 0; c < a.ch16bit.size(); ++c)
+    {
+      EXPECT_EQ(a.ch16bit[c].header.contents, b.ch16bit[c].header.contents);
+      EXPECT_EQ(a.ch16bit[c].header.scale_factor, b.ch16bit[c].header.scale_factor);
+      EXPECT_EQ(a.ch16bit[c].header.start_angle, b.ch16bit[c].header.start_angle);
+      EXPECT_EQ(a.ch16bit[c].header.step_size, b.ch16bit[c].header.step_size);
+      EXPECT_EQ(a.ch16bit[c].data, b.ch16bit[c].data);
+    }
+    ASSERT_EQ(a.ch8bit.size(), b.ch8bit.size());
+    for (size_t c = 0; c < a.ch8bit.size(); ++c)
+      EXPECT_EQ(a.ch8bit[c].data, b.ch8bit[c].data);
+    ASSERT_EQ(a.valid.size(), b.valid.size());
+    for (size_t e = 0; e < a.valid.size(); ++e)
+      EXPECT_EQ(a.valid[e].bits, b.valid[e].bits);
+  }
+
+  ScanData data_;
+  size_t telegram_size_;
+};
+
+/**
+ * @brief Datagram carrying bytes [offset, offset + length) of a message
+ */
+static std::vector<uint8_t> datagram(uint32_t sequence, uint16_t fragment, uint16_t fragments,
+                                     const std::vector<uint8_t> &message, size_t offset, size_t length,
+                                     uint32_t sensor_id = 3, int64_t stamp_ns = -1)
+{
+  ScanMulticast::DatagramHeader header;
+  header.type = ScanMulticast::Telegram;
+  header.fragment = fragment;
+  header.fragment_count = fragments;
+  header.sensor_id = sensor_id;
+  header.sequence = sequence;
+  header.size = message.size();
+  header.offset = offset;
+  header.stamp_ns = stamp_ns < 0 ? 1000 + sequence : stamp_ns;
+  std::vector<uint8_t> out(ScanMulticast::HEADER_SIZE);
+  ScanMulticast::writeHeader(header, out.data());
+  out.insert(out.end(), message.begin() + offset, message.begin() + offset + length);
+  return out;
+}
+
+TEST_F(ScanMulticastTest, compact_scan_round_trip)
+{
+  std::vector<uint8_t> bytes;
+  ScanMulticast::serializeScan(data_, bytes);
+  EXPECT_LT(bytes.size(), telegram_size_);
+
+  ScanData copy;
+  ASSERT_TRUE(ScanMulticast::deserializeScan(bytes.data(), bytes.size(), copy));
+  expectEqual(data_, copy);
+  // Truncated data is rejected
+  EXPECT_FALSE(ScanMulticast::deserializeScan(bytes.data(), bytes.size() - 1, copy));
+}
+
+TEST(MulticastReassembler, reorders_fragments_and_counts_losses)
+{
+  std::vector<uint8_t> message(250);
+  for (size_t i = 0; i < message.size(); ++i)
+    message[i] = static_cast<uint8_t>(i);
+
+  MulticastReassembler reassembler;
+  MulticastMessage out;
+  // Fragments in reverse order, one duplicated
+  EXPECT_FALSE(reassembler.add(datagram(0, 2, 3, message, 200, 50).data(), ScanMulticast::HEADER_SIZE + 50, out));
+  EXPECT_FALSE(reassembler.add(datagram(0, 1, 3, message, 100, 100).data(), ScanMulticast::HEADER_SIZE + 100, out));
+  EXPECT_FALSE(reassembler.add(datagram(0, 1, 3, message, 100, 100).data(), ScanMulticast::HEADER_SIZE + 100, out));
+  ASSERT_TRUE(reassembler.add(datagram(0, 0, 3, message, 0, 100).data(), ScanMulticast::HEADER_SIZE + 100, out));
+  EXPECT_EQ(out.data, message);
+  EXPECT_EQ(out.sequence, 0u);
+  EXPECT_EQ(out.sensor_id, 3u);
+  EXPECT_EQ(out.stamp_ns, 1000);
+  EXPECT_EQ(out.type, ScanMulticast::Telegram);
+
+  // Message 1 misses a fragment, message 2 is lost entirely, message 3 completes
+  EXPECT_FALSE(reassembler.add(datagram(1, 0, 3, message, 0, 100).data(), ScanMulticast::HEADER_SIZE + 100, out));
+  EXPECT_FALSE(reassembler.add(datagram(3, 1, 2, message, 100, 150).data(), ScanMulticast::HEADER_SIZE + 150, out));
+  ASSERT_TRUE(reassembler.add(datagram(3, 0, 2, message, 0, 100).data(), ScanMulticast::HEADER_SIZE + 100, out));
+  EXPECT_EQ(out.sequence, 3u);
+  EXPECT_EQ(out.data, message);
+  // A late fragment of message 1 is ignored
+  EXPECT_FALSE(reassembler.add(datagram(1, 1, 3, message, 100, 100).data(), ScanMulticast::HEADER_SIZE + 100, out));
+
+  const MulticastStatistics &statistics = reassembler.statistics();
+  EXPECT_EQ(statistics.messages, 2u);
+  EXPECT_EQ(statistics.lost, 2u);
+  EXPECT_EQ(statistics.incomplete, 1u);
+
+  // Garbage and fragments claiming more than the message are rejected
+  uint8_t garbage[64] = { 0 };
+  EXPECT_FALSE(reassembler.add(garbage, sizeof(garbage), out));
+  std::vector<uint8_t> overflow = datagram(4, 0, 1, message, 0, 250);
+  overflow.push_back(0);
+  EXPECT_FALSE(reassembler.add(overflow.data(), overflow.size(), out));
+  EXPECT_EQ(statistics.malformed, 2u);
+}
+
+TEST(MulticastReassembler, rejects_oversized_and_misplaced_fragments)
+{
+  std::vector<uint8_t> message(250);
+  MulticastReassembler reassembler;
+  reassembler.setMaxMessageSize(200);
+  MulticastMessage out;
+  // More than the maximum message size, nothing is allocated for it
+  EXPECT_FALSE(reassembler.add(datagram(0, 0, 3, message, 0, 100).data(), ScanMulticast::HEADER_SIZE + 100, out));
+
+  // A size no fragment count can carry, even without a limit
+  reassembler.setMaxMessageSize(0xffffffffu);
+  std::vector<uint8_t> huge = datagram(0, 0, 1, message, 0, 100);
+  uint32_t size = 0xfffffff0u;
+  memcpy(&huge[18], &size, sizeof(size));
+  ScanMulticast::DatagramHeader header;
+  EXPECT_FALSE(ScanMulticast::parseHeader(huge.data(), huge.size(), header));
+  EXPECT_FALSE(reassembler.add(huge.data(), huge.size(), out));
+  EXPECT_EQ(reassembler.statistics().malformed, 2u);
+
+  // Fragment 1 at an offset not matching the size of fragment 0
+  reassembler.setMaxMessageSize(ScanMulticast::DEFAULT_MAX_MESSAGE_SIZE);
+  EXPECT_FALSE(reassembler.add(datagram(1, 0, 3, message, 0, 100).data(), ScanMulticast::HEADER_SIZE + 100, out));
+  EXPECT_FALSE(reassembler.add(datagram(1, 1, 3, message, 90, 100).data(), ScanMulticast::HEADER_SIZE + 100, out));
+  EXPECT_EQ(reassembler.statistics().malformed, 3u);
+}
+
+TEST(MulticastReassembler, follows_restarted_and_concurrent_senders)
+{
+  std::vector<uint8_t> message(100);
+  MulticastReassembler reassembler;
+  MulticastMessage out;
+  for (uint32_t sequence = 5000; sequence < 5010; ++sequence)
+    ASSERT_TRUE(reassembler.add(datagram(sequence, 0, 1, message, 0, 100).data(), ScanMulticast::HEADER_SIZE + 100,
+                                out));
+
+  // The same sender restarted, its sequence starts over with newer receive times
+  ASSERT_TRUE(reassembler.add(datagram(0, 0, 1, message, 0, 100, 3, 20000).data(), ScanMulticast::HEADER_SIZE + 100,
+                              out));
+  EXPECT_EQ(out.sequence, 0u);
+  ASSERT_TRUE(reassembler.add(datagram(1, 0, 1, message, 0, 100, 3, 20001).data(), ScanMulticast::HEADER_SIZE + 100,
+                              out));
+  EXPECT_EQ(reassembler.statistics().restarts, 1u);
+  EXPECT_EQ(reassembler.statistics().lost, 0u);
+  // A duplicate is still not returned twice
+  EXPECT_FALSE(reassembler.add(datagram(1, 0, 1, message, 0, 100, 3, 20001).data(), ScanMulticast::HEADER_SIZE + 100,
+                               out));
+
+  // Two senders with the same sequence numbers interleave their fragments
+  std::vector<uint8_t> first(200, 1);
+  std::vector<uint8_t> second(200, 2);
+  EXPECT_FALSE(reassembler.add(datagram(7, 0, 2, first, 0, 100, 10).data(), ScanMulticast::HEADER_SIZE + 100, out));
+  EXPECT_FALSE(reassembler.add(datagram(7, 0, 2, second, 0, 100, 11).data(), ScanMulticast::HEADER_SIZE + 100, out));
+  ASSERT_TRUE(reassembler.add(datagram(7, 1, 2, second, 100, 100, 11).data(), ScanMulticast::HEADER_SIZE + 100, out));
+  EXPECT_EQ(out.sensor_id, 11u);
+  EXPECT_EQ(out.data, second);
+  ASSERT_TRUE(reassembler.add(datagram(7, 1, 2, first, 100, 100, 10).data(), ScanMulticast::HEADER_SIZE + 100, out));
+  EXPECT_EQ(out.sensor_id, 10u);
+  EXPECT_EQ(out.data, first);
+  EXPECT_EQ(reassembler.statistics().lost, 0u);
+}
+
+TEST_F(ScanMulticastTest, fan_out_over_loopback)
+{
+  const std::string group = "239.255.76.1";
+  MulticastReceiver first;
+  ASSERT_TRUE(first.open(group, 0, "127.0.0.1"));
+  uint16_t port = first.port();
+  ASSERT_NE(port, 0);
+  // A second consumer on the same group and port
+  MulticastReceiver second;
+  ASSERT_TRUE(second.open(group, port, "127.0.0.1"));
+
+  MulticastSender sender;
+  ASSERT_TRUE(sender.open(group, port, "127.0.0.1"));
+  sender.setSensorId(7);
+  // Small datagrams to fragment every scan
+  sender.setDatagramSize(512);
+  const int SCANS = 5;
+  for (int i = 0; i < SCANS; ++i)
+  {
+    data_.header.status_info.telegram_counter = i;
+    ASSERT_TRUE(sender.sendScan(data_, i * 1000));
+  }
+  EXPECT_EQ(sender.sequence(), static_cast<uint32_t>(SCANS));
+
+  MulticastReceiver *receivers[] = { &first, &second };
+  for (size_t r = 0; r < 2; ++r)
+  {
+    MulticastMessage message;
+    for (int i = 0; i < SCANS; ++i)
+    {
+      ASSERT_TRUE(receivers[r]->receive(message, 1000)) << r << " " << i;
+      EXPECT_EQ(message.type, ScanMulticast::Scan);
+      EXPECT_EQ(message.sensor_id, 7u);
+      EXPECT_EQ(message.sequence, static_cast<uint32_t>(i));
+      EXPECT_EQ(message.stamp_ns, i * 1000);
+      ScanData scan;
+      ASSERT_TRUE(ScanMulticast::deserializeScan(message.data.data(), message.data.size(), scan));
+      data_.header.status_info.telegram_counter = i;
+      expectEqual(data_, scan);
+    }
+    EXPECT_GT(receivers[r]->statistics().datagrams, static_cast<uint64_t>(SCANS));
+    EXPECT_EQ(receivers[r]->statistics().lost, 0u);
+    EXPECT_FALSE(receivers[r]->receive(message, 10));
+  }
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
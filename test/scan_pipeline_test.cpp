@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lms1xx/capture_file.h>
+#include <lms1xx/colaa.h>
+#include <lms1xx/colaa_points.h>
+#include <lms1xx/scan_pipeline.h>
+#include <lms1xx/sector_index.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+/**
+ * @brief Counts the points of an earlier stage above a height, reading its output by name
+ */
+class CountAboveStage : public ScanStage
+{
+public:
+  bool configure(const std::string &name, const StageParams &params, PipelineOutputs &outputs)
+  {
+    input_ = params.getString("input", "");
+    min_z_ = params.getDouble("min_z", 0);
+    count_ = &outputs.get<size_t>(name);
+    return !input_.empty();
+  }
+
+  void process(const ScanFrame &, PipelineOutputs &outputs)
+  {
+    *count_ = 0;
+    const PointsOutput *points = outputs.find<PointsOutput>(input_);
+    for (size_t i = 0; points && i < points->count; ++i)
+    {
+      if (points->xyzi[4 * i + 2] > min_z_)
+        ++*count_;
+    }
+  }
+
+private:
+  std::string input_;
+  double min_z_;
+  size_t *count_;
+};
+
+LMS1XX_REGISTER_STAGE(CountAboveStage, "count_above");
+
+/**
+ * @brief Takes at least the configured time
+ */
+class SleepStage : public ScanStage
+{
+public:
+  bool configure(const std::string &, const StageParams &params, PipelineOutputs &)
+  {
+    ms_ = params.getInt("ms", 1);
+    return true;
+  }
+
+  void process(const ScanFrame &, PipelineOutputs &)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms_));
+  }
+
+private:
+  int ms_;
+};
+
+LMS1XX_REGISTER_STAGE(SleepStage, "sleep");
+
+class ScanPipelineTest : public ::testing::Test
+{
+protected:
+  virtual void SetUp()
+  {
+    std::vector<std::vector<char> > telegrams = CaptureFile::loadTelegrams("test/mrs1000.txt");
+    ASSERT_EQ(telegrams.size(), 1u);
+    CoLaA parser;
+    ASSERT_TRUE(parser.parseTelegram(telegrams[0].data(), &data_));
+  }
+
+  static StageConfig stage(const std::string &type, const std::string &name = "")
+  {
+    StageConfig config;
+    config.type = type;
+    config.name = name;
+    return config;
+  }
+
+  ScanData data_;
+};
+
+TEST_F(ScanPipelineTest, built_in_and_registered_stages_are_chained)
+{
+  std::vector<StageConfig> stages;
+  stages.push_back(stage("points", "cloud"));
+  stages.push_back(stage("sector_index"));
+  stages.push_back(stage("count_above", "high"));
+  stages.back().params.set("input", "cloud");
+  stages.back().params.set("min_z", "-1000");
+  ScanPipeline pipeline;
+  ASSERT_TRUE(pipeline.configure(stages));
+  ASSERT_EQ(pipeline.size(), 3u);
+  EXPECT_EQ(pipeline.stageName(1), "sector_index");
+
+  DecodedScan decoded;
+  decoded.reset(data_);
+  pipeline.process(decoded, 1000);
+
+  std::vector<float> expected(4 * data_.ch16bit[0].data.size());
+  size_t count = CoLaAPoints::fillPoints(data_, 0, expected.data());
+  const PointsOutput *cloud = pipeline.outputs().find<PointsOutput>("cloud");
+  ASSERT_TRUE(cloud != NULL);
+  ASSERT_EQ(cloud->count, count);
+  for (size_t i = 0; i < 4 * count; ++i)
+    EXPECT_FLOAT_EQ(cloud->xyzi[i], expected[i]);
+
+  const SectorIndex *index = pipeline.outputs().find<SectorIndex>("sector_index");
+  ASSERT_TRUE(index != NULL);
+  EXPECT_EQ(index->size(), data_.ch16bit[0].data.size());
+  const size_t *high = pipeline.outputs().find<size_t>("high");
+  ASSERT_TRUE(high != NULL);
+  EXPECT_EQ(*high, count);
+  // Outputs are typed
+  EXPECT_TRUE(pipeline.outputs().find<SectorIndex>("cloud") == NULL);
+  EXPECT_EQ(pipeline.outputs().names<PointsOutput>(), std::vector<std::string>(1, "cloud"));
+
+  // The next scan is written into the same buffers
+  const float *buffer = cloud->xyzi.data();
+  pipeline.process(data_, 2000);
+  EXPECT_EQ(pipeline.outputs().find<PointsOutput>("cloud"), cloud);
+  EXPECT_EQ(cloud->xyzi.data(), buffer);
+  EXPECT_EQ(cloud->count, count);
+}
+
+TEST_F(ScanPipelineTest, invalid_configurations_leave_the_pipeline_empty)
+{
+  ScanPipeline pipeline;
+  std::vector<StageConfig> stages(1, stage("no_such_stage"));
+  EXPECT_FALSE(pipeline.configure(stages));
+  EXPECT_TRUE(pipeline.empty());
+
+  stages.assign(2, stage("points"));
+  EXPECT_FALSE(pipeline.configure(stages));
+  EXPECT_TRUE(pipeline.empty());
+
+  stages.assign(1, stage("points"));
+  stages[0].params.set("echo", "-1");
+  EXPECT_FALSE(pipeline.configure(stages));
+  EXPECT_TRUE(pipeline.empty());
+
+  // A missing echo yields no points rather than reading past the scan
+  stages[0].params.set("echo", "7");
+  ASSERT_TRUE(pipeline.configure(stages));
+  pipeline.process(data_, 0);
+  EXPECT_EQ(pipeline.outputs().find<PointsOutput>("points")->count, 0u);
+}
+
+TEST_F(ScanPipelineTest, remission_channel_is_not_an_echo)
+{
+  // LMS1xx layout: distances and remission as 16 bit channels, no 8 bit channel
+  data_.ch16bit.resize(1);
+  data_.ch8bit.clear();
+  ChannelData<uint16_t> rssi = data_.ch16bit[0];
+  rssi.header.contents = "RSSI1";
+  rssi.data.assign(rssi.data.size(), 1000);
+  data_.ch16bit.push_back(rssi);
+  EXPECT_EQ(data_.echoCount(), 1u);
+
+  std::vector<StageConfig> stages;
+  stages.push_back(stage("points", "remission"));
+  stages.back().params.set("echo", "1");
+  stages.push_back(stage("returns"));
+  ScanPipeline pipeline;
+  ASSERT_TRUE(pipeline.configure(stages));
+  DecodedScan decoded;
+  decoded.reset(data_);
+  EXPECT_EQ(decoded.echoCount(), 1u);
+  pipeline.process(decoded, 0);
+
+  EXPECT_EQ(pipeline.outputs().find<PointsOutput>("remission")->count, 0u);
+  // Only the distances are returns, every remission value would be one as well
+  const std::vector<float> &ranges = decoded.ranges(0);
+  size_t returns = ranges.size() - std::count(ranges.begin(), ranges.end(), 0.0f);
+  EXPECT_EQ(pipeline.outputs().find<PointsOutput>("returns")->count, returns);
+}
+
+TEST_F(ScanPipelineTest, optional_stages_are_skipped_to_keep_the_deadline)
+{
+  std::vector<StageConfig> stages;
+  stages.push_back(stage("sleep", "slow"));
+  stages.back().params.set("ms", "8");
+  stages.back().budget = 0.2;
+  stages.push_back(stage("points"));
+  stages.back().optional = true;
+  ScanPipeline pipeline;
+  ASSERT_TRUE(pipeline.configure(stages));
+  // 100 Hz, the pipeline may take 5 ms, the slow stage 2 ms
+  pipeline.setScanFrequency(10000);
+  pipeline.setDeadline(0.5);
+
+  pipeline.process(data_, 0);
+  EXPECT_TRUE(pipeline.ran(0));
+  EXPECT_FALSE(pipeline.ran(1));
+  EXPECT_TRUE(pipeline.outputs().find<PointsOutput>("points") == NULL);
+  EXPECT_EQ(pipeline.stageStatistics(0).runs, 1u);
+  EXPECT_EQ(pipeline.stageStatistics(0).budget_misses, 1u);
+  EXPECT_GE(pipeline.stageStatistics(0).last_ns, 8000000);
+  EXPECT_EQ(pipeline.stageStatistics(1).runs, 0u);
+  EXPECT_EQ(pipeline.stageStatistics(1).skipped, 1u);
+  EXPECT_EQ(pipeline.statistics().scans, 1u);
+  EXPECT_EQ(pipeline.statistics().deadline_misses, 1u);
+  EXPECT_EQ(pipeline.statistics().degraded, 1u);
+
+  // With a longer scan period there is time for every stage
+  pipeline.setScanFrequency(1000);
+  pipeline.process(data_, 0);
+  EXPECT_TRUE(pipeline.ran(1));
+  EXPECT_TRUE(pipeline.outputs().find<PointsOutput>("points") != NULL);
+  EXPECT_EQ(pipeline.stageStatistics(0).budget_misses, 1u);
+  EXPECT_EQ(pipeline.stageStatistics(1).runs, 1u);
+  EXPECT_EQ(pipeline.statistics().deadline_misses, 1u);
+  EXPECT_EQ(pipeline.statistics().degraded, 1u);
+}
+
+TEST(StageParams, conversions)
+{
+  StageParams params;
+  params.set("number", "2.5");
+  params.set("count", "3");
+  params.set("flag", "true");
+  params.set("text", "abc");
+  EXPECT_DOUBLE_EQ(params.getDouble("number", 0), 2.5);
+  EXPECT_EQ(params.getInt("count", 0), 3);
+  EXPECT_TRUE(params.getBool("flag", false));
+  EXPECT_EQ(params.getString("text", ""), "abc");
+  // Missing or unconvertible values fall back
+  EXPECT_DOUBLE_EQ(params.getDouble("text", 1.5), 1.5);
+  EXPECT_EQ(params.getInt("number", 4), 4);
+  EXPECT_FALSE(params.getBool("text", false));
+  EXPECT_EQ(params.getString("missing", "x"), "x");
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lms1xx/scan_reactor.h>
+#include <lms1xx/scan_stream.h>
+#include <gtest/gtest.h>
+
+#include "colaa_emulator.h"
+
+class ScanReactorTest : public ::testing::Test
+{
+protected:
+  ScanReactorTest() : front_("test/mrs1000.txt", 200), rear_("test/mrs1000.txt", 200)
+  {
+  }
+
+  virtual void SetUp()
+  {
+    ASSERT_TRUE(front_.start());
+    ASSERT_TRUE(rear_.start());
+    front_laser_.connect("127.0.0.1", front_.port());
+    rear_laser_.connect("127.0.0.1", rear_.port());
+    ASSERT_TRUE(front_laser_.isConnected());
+    ASSERT_TRUE(rear_laser_.isConnected());
+    front_laser_.scanContinuous(true);
+    rear_laser_.scanContinuous(true);
+  }
+
+  /**
+   * @brief Run the reactor until done returns true, at most for two seconds
+   */
+  template <typename F>
+  void runUntil(ScanReactor &reactor, F done)
+  {
+    int64_t end = CoLaAEmulator::nowNs() + 2000000000ll;
+    while (!done() && CoLaAEmulator::nowNs() < end)
+      reactor.runOnce(10);
+  }
+
+  CoLaAEmulator front_;
+  CoLaAEmulator rear_;
+  CoLaA front_laser_;
+  CoLaA rear_laser_;
+};
+
+TEST_F(ScanReactorTest, multiplexes_sensors_on_one_thread)
+{
+  ScanReactor reactor;
+  size_t front_scans = 0;
+  size_t rear_scans = 0;
+  reactor.add(front_laser_, [&](const ScanData &data)
+  {
+    EXPECT_EQ(data.ch16bit[0].data.size(), 1101u);
+    ++front_scans;
+  });
+  reactor.add(rear_laser_, [&](const ScanData &) { ++rear_scans; });
+
+  runUntil(reactor, [&]() { return front_scans >= 10 && rear_scans >= 10; });
+  EXPECT_GE(front_scans, 10u);
+  EXPECT_GE(rear_scans, 10u);
+}
+
+TEST_F(ScanReactorTest, reports_disconnect)
+{
+  ScanReactor reactor;
+  size_t scans = 0;
+  size_t errors = 0;
+  reactor.add(front_laser_, [&](const ScanData &) { ++scans; }, [&](CoLaA &laser)
+  {
+    ++errors;
+    laser.disconnect();
+  });
+
+  runUntil(reactor, [&]() { return scans > 0; });
+  front_.dropClient();
+  runUntil(reactor, [&]() { return errors > 0; });
+  EXPECT_GT(scans, 0u);
+  EXPECT_EQ(errors, 1u);
+  EXPECT_FALSE(front_laser_.isConnected());
+}
+
+TEST_F(ScanReactorTest, executor)
+{
+  std::vector<std::function<void()> > tasks;
+  ScanReactor reactor([&](std::function<void()> task) { tasks.push_back(task); });
+  size_t scans = 0;
+  reactor.add(front_laser_, [&](const ScanData &data)
+  {
+    EXPECT_EQ(data.ch8bit.size(), 3u);
+    ++scans;
+  });
+
+  runUntil(reactor, [&]() { return tasks.size() >= 5; });
+  EXPECT_EQ(scans, 0u);
+  for (size_t i = 0; i < tasks.size(); ++i)
+    tasks[i]();
+  EXPECT_EQ(scans, tasks.size());
+}
+
+#ifdef LMS1XX_ENABLE_COROUTINES
+ScanTask collect(ScanStream &stream, std::vector<uint16_t> &counters, bool &finished)
+{
+  while (std::optional<ScanData> scan = co_await stream.nextScan())
+  {
+    counters.push_back(scan->header.status_info.telegram_counter);
+    if (counters.size() == 5)
+      break;
+  }
+  finished = true;
+}
+
+TEST_F(ScanReactorTest, coroutine)
+{
+  ScanReactor reactor;
+  ScanStream stream(reactor, front_laser_);
+  std::vector<uint16_t> counters;
+  bool finished = false;
+  collect(stream, counters, finished);
+
+  runUntil(reactor, [&]() { return finished; });
+  ASSERT_TRUE(finished);
+  ASSERT_EQ(counters.size(), 5u);
+  for (size_t i = 1; i < counters.size(); ++i)
+    EXPECT_EQ(static_cast<uint16_t>(counters[i - 1] + 1), counters[i]);
+}
+#endif
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lms1xx/scan_tracker.h>
+#include <gtest/gtest.h>
+#include <cmath>
+
+struct Circle
+{
+  double x;
+  double y;
+  double radius;
+};
+
+/**
+ * @brief Ray casts circles in front of a straight wall at x = 8 m, 270 deg with 0.25 deg resolution
+ */
+static ScanData simulateScan(const std::vector<Circle> &circles)
+{
+  ScanData data;
+  ChannelData<uint16_t> ranges;
+  ranges.header.scale_factor = 1;
+  ranges.header.start_angle = -450000;
+  ranges.header.step_size = 2500;
+  ranges.header.data_count = 1081;
+  for (size_t i = 0; i < ranges.header.data_count; ++i)
+  {
+    double angle = (ranges.header.start_angle + static_cast<double>(i) * ranges.header.step_size) *
+                   M_PI / 180.0 / 10000.0 - M_PI / 2.0;
+    double dx = cos(angle);
+    double dy = sin(angle);
+    double best = dx > 0.01 ? 8.0 / dx : 0;
+    for (size_t c = 0; c < circles.size(); ++c)
+    {
+      double b = dx * circles[c].x + dy * circles[c].y;
+      double disc = b * b - (circles[c].x * circles[c].x + circles[c].y * circles[c].y -
+                             circles[c].radius * circles[c].radius);
+      if (disc < 0)
+        continue;
+      double t = b - sqrt(disc);
+      if (t > 0 && (best == 0 || t < best))
+        best = t;
+    }
+    ranges.data.push_back(best > 30 ? 0 : static_cast<uint16_t>(best * 1000.0 + 0.5));
+  }
+  data.ch16bit.push_back(ranges);
+  return data;
+}
+
+static const Track *findConfirmed(const ScanTracker &tracker, size_t n)
+{
+  for (size_t i = 0; i < tracker.tracks().size(); ++i)
+  {
+    if (tracker.isConfirmed(tracker.tracks()[i]) && n-- == 0)
+      return &tracker.tracks()[i];
+  }
+  return NULL;
+}
+
+TEST(ScanTracker, velocity)
+{
+  ScanTracker tracker;
+  for (int i = 0; i < 40; ++i)
+  {
+    std::vector<Circle> circles(1);
+    circles[0] = { 3.0 + i * 0.04, -1.0, 0.2 };
+    tracker.update(simulateScan(circles), i * 0.04);
+  }
+  ASSERT_EQ(tracker.update(simulateScan(std::vector<Circle>(1, { 4.6, -1.0, 0.2 })), 1.6), 1u);
+  const Track *track = findConfirmed(tracker, 0);
+  ASSERT_TRUE(track != NULL);
+  EXPECT_NEAR(track->vx, 1.0, 0.1);
+  EXPECT_NEAR(track->vy, 0.0, 0.1);
+  // The centroid of the visible arc is in front of the centre
+  EXPECT_NEAR(track->x, 4.5, 0.15);
+  EXPECT_NEAR(track->y, -1.0, 0.1);
+}
+
+TEST(ScanTracker, keeps_ids_of_separate_objects)
+{
+  ScanTracker tracker;
+  uint32_t ids[2] = { 0, 0 };
+  for (int i = 0; i < 30; ++i)
+  {
+    std::vector<Circle> circles(2);
+    circles[0] = { 2.0 + i * 0.03, 2.0, 0.25 };
+    circles[1] = { 5.0 - i * 0.03, -2.0, 0.25 };
+    size_t confirmed = tracker.update(simulateScan(circles), i * 0.04);
+    if (i < 2)
+      continue;
+    ASSERT_EQ(confirmed, 2u);
+    for (size_t k = 0; k < 2; ++k)
+    {
+      const Track *track = findConfirmed(tracker, k);
+      size_t object = track->y > 0 ? 0 : 1;
+      if (i == 2)
+        ids[object] = track->id;
+      EXPECT_EQ(track->id, ids[object]);
+    }
+  }
+  EXPECT_NE(ids[0], ids[1]);
+}
+
+TEST(ScanTracker, drops_lost_tracks)
+{
+  ScanTrackerConfig config;
+  config.max_missed = 3;
+  ScanTracker tracker(config);
+  std::vector<Circle> circles(1);
+  circles[0] = { 3.0, 0.5, 0.2 };
+  for (int i = 0; i < 5; ++i)
+    tracker.update(simulateScan(circles), i * 0.04);
+  EXPECT_EQ(tracker.update(simulateScan(std::vector<Circle>()), 0.2), 1u);
+  for (int i = 0; i < 3; ++i)
+    tracker.update(simulateScan(std::vector<Circle>()), 0.24 + i * 0.04);
+  EXPECT_TRUE(findConfirmed(tracker, 0) == NULL);
+  // The wall is wider than max_width and never becomes a segment
+  EXPECT_EQ(tracker.segmentCount(), 0u);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
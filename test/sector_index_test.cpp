@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lms1xx/sector_index.h>
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+/**
+ * @brief 270 deg scan with 0.5 deg resolution, random ranges with gaps and few distinct values for ties
+ */
+static ScanData randomScan(size_t count)
+{
+  ScanData data;
+  ChannelData<uint16_t> ranges;
+  ranges.header.scale_factor = 1;
+  ranges.header.start_angle = -450000;
+  ranges.header.step_size = 5000;
+  ranges.header.data_count = count;
+  ranges.data.resize(count);
+  for (size_t i = 0; i < count; ++i)
+    ranges.data[i] = rand() % 5 == 0 ? 0 : 100 + rand() % 50;
+  data.ch16bit.push_back(ranges);
+  return data;
+}
+
+static SectorMin bruteForce(const ScanData &data, size_t first, size_t last)
+{
+  SectorMin result = { std::numeric_limits<float>::infinity(), 0, -1 };
+  const std::vector<uint16_t> &ranges = data.ch16bit[0].data;
+  for (size_t i = first; i <= last && i < ranges.size(); ++i)
+  {
+    bool valid = ranges[i] != 0 && (data.valid.empty() || data.valid[0].test(i));
+    if (valid && ranges[i] * 0.001f < result.range)
+    {
+      result.range = ranges[i] * 0.001f;
+      result.beam = static_cast<int32_t>(i);
+    }
+  }
+  return result;
+}
+
+TEST(SectorIndex, matches_linear_scan)
+{
+  srand(7);
+  SectorIndex index;
+  size_t sizes[] = { 1, 15, 16, 17, 33, 541 };
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+  {
+    ScanData data = randomScan(sizes[s]);
+    // Rebuilt in place for every scan
+    index.build(data);
+    ASSERT_EQ(index.size(), sizes[s]);
+    for (size_t first = 0; first < sizes[s]; ++first)
+    {
+      for (size_t last = first; last < sizes[s]; ++last)
+      {
+        SectorMin expected = bruteForce(data, first, last);
+        SectorMin result = index.query(first, last);
+        ASSERT_EQ(result.beam, expected.beam) << sizes[s] << " [" << first << ", " << last << "]";
+        ASSERT_EQ(result.range, expected.range);
+      }
+    }
+  }
+}
+
+TEST(SectorIndex, skips_invalid_beams)
+{
+  srand(8);
+  ScanData data = randomScan(541);
+  data.ch16bit[0].data[100] = 1;
+  data.valid.resize(1);
+  data.valid[0].bits.assign((541 + 63) / 64, ~uint64_t(0));
+  // The closest beam is marked invalid, e.g. below min_range
+  data.valid[0].bits[100 / 64] &= ~(uint64_t(1) << (100 % 64));
+
+  SectorIndex index;
+  index.build(data);
+  SectorMin result = index.query(0, 540);
+  EXPECT_NE(result.beam, 100);
+  EXPECT_EQ(result.beam, bruteForce(data, 0, 540).beam);
+
+  // A sector without valid beams
+  for (size_t i = 200; i < 210; ++i)
+    data.ch16bit[0].data[i] = 0;
+  index.build(data);
+  result = index.query(200, 209);
+  EXPECT_EQ(result.beam, -1);
+  EXPECT_TRUE(std::isinf(result.range));
+  EXPECT_EQ(index.query(600, 700).beam, -1);
+}
+
+TEST(SectorIndex, sectors_by_angle)
+{
+  srand(9);
+  ScanData data = randomScan(541);
+  SectorIndex index;
+  index.build(data);
+
+  // -45 to 45 deg are beams 180 to 360, the borders included
+  SectorMin result = index.queryAngles(-M_PI / 4, M_PI / 4);
+  EXPECT_EQ(result.beam, bruteForce(data, 180, 360).beam);
+  EXPECT_NEAR(result.angle, -M_PI / 4 + (result.beam - 180) * M_PI / 360, 1e-5);
+  EXPECT_EQ(index.queryAngles(M_PI / 4, -M_PI / 4).beam, result.beam);
+
+  // Sectors reaching past the scan are clamped, sectors outside or between two beams are empty
+  EXPECT_EQ(index.queryAngles(-M_PI, M_PI).beam, bruteForce(data, 0, 540).beam);
+  EXPECT_EQ(index.queryAngles(2.5, 3.0).beam, -1);
+  EXPECT_EQ(index.queryAngles(0.001, 0.002).beam, -1);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
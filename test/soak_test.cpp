@@ -0,0 +1,306 @@
+/*
+ * Copyright (c) 2017 Fraunhofer Institute for Manufacturing Engineering and Automation (IPA)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Long running soak test of the acquisition pipeline against the emulator.
+ *
+ * The default duration is short enough for CI. For a real soak run set
+ *   LMS1XX_SOAK_SECONDS      total duration (default 20)
+ *   LMS1XX_SOAK_RATE_HZ      telegram rate of the emulator (default 500, i.e. 10x realtime)
+ *   LMS1XX_SOAK_RECONNECT_S  interval between induced reconnects (default 5)
+ *   LMS1XX_SOAK_SAMPLE_S     sampling interval of the resource counters (default 1)
+ */
+
+#include <lms1xx/colaa.h>
+#include <gtest/gtest.h>
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "colaa_emulator.h"
+
+static std::atomic<uint64_t> g_allocations(0);
+static std::atomic<uint64_t> g_deallocations(0);
+
+void *operator new(size_t size)
+{
+  ++g_allocations;
+  void *p = malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept
+{
+  if (p)
+    ++g_deallocations;
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+  operator delete(p);
+}
+
+static double envOr(const char *name, double def)
+{
+  const char *val = getenv(name);
+  return val ? atof(val) : def;
+}
+
+/**
+ * @brief Log2 histogram of latencies in microseconds
+ */
+struct LatencyHistogram
+{
+  static constexpr size_t BUCKETS = 32;
+  uint64_t counts[BUCKETS];
+  uint64_t total;
+
+  LatencyHistogram() : total(0)
+  {
+    std::fill(counts, counts + BUCKETS, 0);
+  }
+
+  void add(int64_t ns)
+  {
+    uint64_t us = ns > 0 ? ns / 1000 : 0;
+    size_t bucket = 0;
+    while (us > 0 && bucket < BUCKETS - 1)
+    {
+      us >>= 1;
+      ++bucket;
+    }
+    ++counts[bucket];
+    ++total;
+  }
+
+  /**
+   * @brief Upper bound of the bucket containing the given quantile in microseconds
+   */
+  uint64_t quantile(double q) const
+  {
+    uint64_t target = static_cast<uint64_t>(q * total);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i)
+    {
+      seen += counts[i];
+      if (seen > target)
+        return 1ull << i;
+    }
+    return 1ull << (BUCKETS - 1);
+  }
+};
+
+struct SoakSample
+{
+  double t;
+  long rss_kb;
+  size_t fds;
+  int64_t live_allocations;
+  uint64_t p99_us;
+};
+
+static long residentKb()
+{
+  long pages = 0;
+  long resident = 0;
+  FILE *f = fopen("/proc/self/statm", "r");
+  if (!f)
+    return 0;
+  if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+    resident = 0;
+  fclose(f);
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static size_t openFds()
+{
+  size_t count = 0;
+  DIR *dir = opendir("/proc/self/fd");
+  if (!dir)
+    return 0;
+  while (readdir(dir))
+    ++count;
+  closedir(dir);
+  return count;
+}
+
+/**
+ * @brief Least squares slope of y over t
+ */
+template <typename F>
+static double slope(const std::vector<SoakSample> &samples, F y)
+{
+  double n = samples.size();
+  double st = 0, sy = 0, stt = 0, sty = 0;
+  for (size_t i = 0; i < samples.size(); ++i)
+  {
+    st += samples[i].t;
+    sy += y(samples[i]);
+    stt += samples[i].t * samples[i].t;
+    sty += samples[i].t * y(samples[i]);
+  }
+  double denom = n * stt - st * st;
+  return denom != 0 ? (n * sty - st * sy) / denom : 0;
+}
+
+/**
+ * @brief Fails if a trend exceeds its hourly limit and is larger than the noise floor
+ */
+static void expectNoDrift(const char *name, double slope_per_s, double span_s, double max_per_hour,
+                          double noise_floor)
+{
+  double growth = slope_per_s * span_s;
+  EXPECT_TRUE(slope_per_s * 3600 < max_per_hour || growth < noise_floor)
+      << name << " grows by " << slope_per_s * 3600 << " per hour (" << growth << " over " << span_s << " s)";
+}
+
+class SoakTest : public ::testing::Test
+{
+protected:
+  virtual void SetUp()
+  {
+    duration_s_ = envOr("LMS1XX_SOAK_SECONDS", 20);
+    rate_hz_ = envOr("LMS1XX_SOAK_RATE_HZ", 500);
+    reconnect_s_ = envOr("LMS1XX_SOAK_RECONNECT_S", 5);
+    sample_s_ = envOr("LMS1XX_SOAK_SAMPLE_S", 1);
+  }
+
+  bool bringUp(CoLaA &laser, CoLaAEmulator &emulator)
+  {
+    laser.connect("127.0.0.1", emulator.port());
+    if (!laser.isConnected())
+      return false;
+    laser.login();
+    laser.getScanConfig();
+    laser.startMeasurement();
+    laser.startDevice();
+    laser.scanContinuous(true);
+    return true;
+  }
+
+  double duration_s_;
+  double rate_hz_;
+  double reconnect_s_;
+  double sample_s_;
+};
+
+TEST_F(SoakTest, no_resource_or_latency_drift)
+{
+  CoLaAEmulator emulator("test/mrs1000.txt", rate_hz_);
+  ASSERT_TRUE(emulator.start());
+  CoLaA laser;
+  ASSERT_TRUE(bringUp(laser, emulator));
+
+  std::vector<SoakSample> samples;
+  LatencyHistogram window;
+  uint64_t scans = 0;
+  uint64_t timeouts = 0;
+  size_t reconnects = 0;
+  const int64_t start = CoLaAEmulator::nowNs();
+  int64_t next_sample = start + static_cast<int64_t>(sample_s_ * 1e9);
+  int64_t next_reconnect = start + static_cast<int64_t>(reconnect_s_ * 1e9);
+  const int64_t end = start + static_cast<int64_t>(duration_s_ * 1e9);
+
+  while (CoLaAEmulator::nowNs() < end)
+  {
+    ScanData data;
+    if (laser.getScanData(&data))
+    {
+      int64_t sent = emulator.sendTime(data.header.status_info.telegram_counter);
+      if (sent > 0)
+        window.add(CoLaAEmulator::nowNs() - sent);
+      ++scans;
+    }
+    else
+    {
+      // Same recovery path as the nodes
+      ++timeouts;
+      laser.disconnect();
+      bringUp(laser, emulator);
+    }
+
+    int64_t now = CoLaAEmulator::nowNs();
+    if (now >= next_reconnect)
+    {
+      // Alternate between a client side reconnect and a sensor side drop
+      if (reconnects++ % 2 == 0)
+      {
+        laser.scanContinuous(false);
+        laser.stopMeasurement();
+        laser.disconnect();
+      }
+      else
+      {
+        emulator.dropClient();
+        usleep(10000);
+        laser.disconnect();
+      }
+      ASSERT_TRUE(bringUp(laser, emulator));
+      next_reconnect = now + static_cast<int64_t>(reconnect_s_ * 1e9);
+    }
+    if (now >= next_sample)
+    {
+      SoakSample s;
+      s.t = (now - start) * 1e-9;
+      s.rss_kb = residentKb();
+      s.fds = openFds();
+      s.live_allocations = static_cast<int64_t>(g_allocations - g_deallocations);
+      s.p99_us = window.quantile(0.99);
+      samples.push_back(s);
+      window = LatencyHistogram();
+      next_sample = now + static_cast<int64_t>(sample_s_ * 1e9);
+    }
+  }
+  laser.disconnect();
+
+  ASSERT_GE(samples.size(), 4u);
+  EXPECT_GT(scans, 0u);
+  RecordProperty("scans", static_cast<int>(scans));
+  RecordProperty("timeouts", static_cast<int>(timeouts));
+  RecordProperty("reconnects", static_cast<int>(reconnects));
+
+  // Ignore the warm up phase (first quarter) for the trend analysis
+  std::vector<SoakSample> steady(samples.begin() + samples.size() / 4, samples.end());
+  double rss_slope = slope(steady, [](const SoakSample &s) { return static_cast<double>(s.rss_kb); });
+  double fd_slope = slope(steady, [](const SoakSample &s) { return static_cast<double>(s.fds); });
+  double alloc_slope = slope(steady, [](const SoakSample &s) { return static_cast<double>(s.live_allocations); });
+  double p99_slope = slope(steady, [](const SoakSample &s) { return static_cast<double>(s.p99_us); });
+
+  // Thresholds are growth per hour so they hold for long runs, short runs are allowed
+  // to wobble up to a noise floor
+  double span = steady.back().t - steady.front().t;
+  expectNoDrift("rss_kb", rss_slope, span, envOr("LMS1XX_SOAK_MAX_RSS_KB_PER_HOUR", 4096), 512);
+  expectNoDrift("fds", fd_slope, span, 1, 0.5);
+  expectNoDrift("live_allocations", alloc_slope, span, envOr("LMS1XX_SOAK_MAX_ALLOCS_PER_HOUR", 1000), 64);
+  expectNoDrift("p99_us", p99_slope, span, envOr("LMS1XX_SOAK_MAX_P99_US_PER_HOUR", 100000), 2000);
+  EXPECT_EQ(steady.front().fds, steady.back().fds);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}